@@ -4,6 +4,27 @@
 // Don't forget to comment again when you finish debugging.
 // #define WAIT_FOR_SERIAL_CONSOLE_ON_BOOT
 
+// Uncomment to print how long each step of booting took to the serial console.
+// #define LOG_BOOT_TIMELINE
+
+// Fast boot shows the first screen as soon as possible: the boot progress text is skipped,
+// hardware waits overlap other work, and the message history, search index, status bar and
+// first battery reading come after the first frame. Comment out to do everything up front.
+#define FAST_BOOT
+
+// Uncomment to record render time, flush time, pixels flushed, invalidated area, main loop
+// period and the time from receiving a message to the frame that shows it. On the serial
+// console, press 'p' to print the statistics as CSV, along with scene transition times,
+// 'r' to reset them and 'o' to toggle an overlay showing them on screen.
+// #define PROFILE_FRAMES
+
+// Uncomment as well to show the profiling overlay from boot.
+// #define PROFILE_FRAMES_OVERLAY
+
+// Uncomment to replay a script of interactions through the scenes once the history has loaded,
+// printing the time, pixel count and hash of every frame to the serial console as CSV.
+// #define BENCHMARK_SCENES
+
 // Keyboard Featherwing pin definitions for the Feather ESP32-S2.
 // You might need to change these if you use a different microcontroller.
 #define SD_CS           5
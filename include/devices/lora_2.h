@@ -41,4 +41,8 @@
 // Choices are: 100, 200, 500, 1000, 2000, 3000
 #if defined(USE_LC709203)
 #define LC_BATTERY_CAPACITY LC709203F_APA_2000MAH
-#endif
\ No newline at end of file
+#endif
+
+// Uncomment to send messages with forward error correction when the LoRa link gets marginal.
+// Receiving FEC-coded messages is always supported.
+// #define USE_LORA_FEC
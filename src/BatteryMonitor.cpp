@@ -3,7 +3,7 @@
 // #define LOGGER Serial
 #include "Logger.h"
 
-bool BatteryMonitor::begin() {
+bool BatteryMonitor::begin(bool waitForReading) {
     if (!monitor.begin()) {
         return false;
     }
@@ -16,17 +16,24 @@ bool BatteryMonitor::begin() {
     monitor.setAlarmVoltage(3.8);        
 #else
     LOGLN("Using MAX17048 battery monitor");
+#endif
+
+    lastUpdate = millis();
+    isInitialized = true;
+
+    if (!waitForReading) {
+        return true;
+    }
 
     // Need to give it a bit of time or else we'll just get zeros on the first read.
-    delay(100);
-#endif
+    delay(settleMS);
 
     percentage = readPercentage();
+    readingTaken = true;
 
-    LOGFMT("Battery: %d%d\n", percentage);
+    LOGFMT("Battery: %d%%\n", percentage);
 
     lastUpdate = millis();
-    isInitialized = true;
 
     return true;
 }
@@ -38,7 +45,7 @@ void BatteryMonitor::update() {
 
     uint32_t now = millis();
 
-    if (now - lastUpdate < updateIntervalMS) {
+    if (now - lastUpdate < (readingTaken ? updateIntervalMS : settleMS)) {
         return;
     }
 
@@ -46,7 +53,9 @@ void BatteryMonitor::update() {
 
     const uint8_t newPercentage = readPercentage();
 
-    if (newPercentage != percentage) {
+    // Always report the first reading.
+    if (newPercentage != percentage || !readingTaken) {
+        readingTaken = true;
         percentage = newPercentage;
 
         if (percentChangedCallback) {
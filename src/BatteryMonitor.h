@@ -12,7 +12,16 @@ class BatteryMonitor {
 public:
     static constexpr uint32_t updateIntervalMS = 3000;
 
-    bool begin();
+    // The MAX17048 reads zero until it has had a moment after power on.
+#if defined(USE_LC709203)
+    static constexpr uint32_t settleMS = 0;
+#else
+    static constexpr uint32_t settleMS = 100;
+#endif
+
+    // If waitForReading is false, begin() returns right away and update() takes the first
+    // reading once the monitor has settled, calling the percent changed callback.
+    bool begin(bool waitForReading = true);
     void update();
 
     void setPercentChangedCallback(void (*cb)(uint8_t)) {
@@ -23,6 +32,11 @@ public:
         return percentage;
     }    
 
+    // False until the first reading has been taken.
+    inline bool hasReading() const {
+        return readingTaken;
+    }
+
 private:
 
     uint8_t readPercentage() {
@@ -45,6 +59,7 @@ private:
     void (*percentChangedCallback)(uint8_t) = nullptr;    
 
     bool isInitialized = false;
+    bool readingTaken = false;
     uint32_t lastUpdate = 0;
     uint8_t percentage = 0;
 };
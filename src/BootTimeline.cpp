@@ -0,0 +1,46 @@
+#include "BootTimeline.h"
+
+void BootTimeline::mark(const char* name) {
+    const uint32_t now = micros();
+
+    if (stepCount == maxSteps) {
+        droppedCount++;
+        return;
+    }
+
+    steps[stepCount].name = name;
+    steps[stepCount].endMicros = now;
+    stepCount++;
+}
+
+uint32_t BootTimeline::elapsedMS(const char* name) const {
+    for (size_t i = 0; i < stepCount; i++) {
+        if (strcmp(steps[i].name, name) == 0) {
+            return steps[i].endMicros / 1000;
+        }
+    }
+
+    return 0;
+}
+
+void BootTimeline::dump(Print& out) const {
+    out.println("Boot timeline:");
+    out.printf("%10s %10s  %s\n", "at ms", "took ms", "step");
+
+    uint32_t previous = 0;
+
+    for (size_t i = 0; i < stepCount; i++) {
+        const Step& step = steps[i];
+        const uint32_t took = step.endMicros - previous;
+        previous = step.endMicros;
+
+        out.printf("%6u.%03u %6u.%03u  %s\n",
+            (unsigned)(step.endMicros / 1000), (unsigned)(step.endMicros % 1000),
+            (unsigned)(took / 1000), (unsigned)(took % 1000),
+            step.name);
+    }
+
+    if (droppedCount > 0) {
+        out.printf("%u more steps not recorded\n", (unsigned)droppedCount);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Records when each step of setup() finishes, to see where boot time goes.
+//
+// Marking a step is just a micros() call, so steps are always recorded; dump() prints them
+// with how long each took. Times are from reset, so the first step includes the bootloader
+// and framework startup.
+class BootTimeline {
+public:
+    static constexpr size_t maxSteps = 24;
+
+    // The step called name just finished. name must outlive the timeline, e.g. a string literal.
+    // Steps past maxSteps are counted but not recorded.
+    void mark(const char* name);
+
+    // Milliseconds from reset to the end of the step called name, or 0 if it wasn't recorded.
+    uint32_t elapsedMS(const char* name) const;
+
+    // Print each step, when it finished and how long it took.
+    void dump(Print& out) const;
+
+private:
+    struct Step {
+        const char* name;
+        uint32_t endMicros;
+    };
+
+    Step steps[maxSteps];
+    size_t stepCount = 0;
+    size_t droppedCount = 0;
+};
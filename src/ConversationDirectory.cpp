@@ -0,0 +1,195 @@
+#include "ConversationDirectory.h"
+#include "Crc32.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+static_assert(ConversationDirectory::maxConversations <= 100, "Slot numbers must fit the file names");
+
+void ConversationDirectory::filesForSlot(uint8_t slot, Files& files) {
+    snprintf(files.journal, maxFilenameLength, "c%02u.jnl", slot);
+    snprintf(files.journalIndex, maxFilenameLength, "c%02u.idx", slot);
+    snprintf(files.compaction, maxFilenameLength, "c%02u.tmp", slot);
+    snprintf(files.compactionIndex, maxFilenameLength, "c%02u.itm", slot);
+    snprintf(files.searchIndex, maxFilenameLength, "c%02u.six", slot);
+}
+
+int ConversationDirectory::find(const MacAddress& peer) const {
+    for (size_t i = 0; i < count; i++) {
+        if (memcmp(entries[i].peer, peer.rawAddress, MacAddress::addressLength) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool ConversationDirectory::load() {
+    count = 0;
+    openCounter = 0;
+    created = false;
+
+    // A save was interrupted after the old directory was removed; the copy is complete.
+    if (!storage.exists(filename) && storage.exists(tempFilename)) {
+        LOGLN("Recovering conversation directory");
+        storage.rename(tempFilename, filename);
+    }
+
+    if (!storage.exists(filename)) {
+        created = true;
+        return true;
+    }
+
+    StorageFile* file = storage.open(filename, Storage::Mode::read);
+
+    if (file == nullptr) {
+        LOGFMT("Failed to open %s\n", filename);
+        return false;
+    }
+
+    FileHeader header;
+    bool valid = file->read(&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == magic && header.version == currentVersion && header.count <= maxConversations;
+
+    if (valid) {
+        const size_t length = header.count * sizeof(Entry);
+        valid = file->read(entries, length) == int(length) && Crc32::compute(entries, length) == header.crc;
+    }
+
+    storage.close(file);
+
+    if (!valid) {
+        // The conversations' files are still there, but there's no telling whose they are.
+        LOGFMT("Unreadable %s, starting over\n", filename);
+        created = true;
+        return true;
+    }
+
+    count = header.count;
+
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].lastOpened > openCounter) {
+            openCounter = entries[i].lastOpened;
+        }
+    }
+
+    LOGFMT("Conversation directory loaded: %u conversations\n", count);
+
+    return true;
+}
+
+bool ConversationDirectory::save() {
+    if (storage.exists(tempFilename)) {
+        storage.remove(tempFilename);
+    }
+
+    StorageFile* file = storage.open(tempFilename, Storage::Mode::truncate);
+
+    if (file == nullptr) {
+        LOGFMT("Failed to create %s\n", tempFilename);
+        return false;
+    }
+
+    const size_t length = count * sizeof(Entry);
+
+    FileHeader header;
+    header.magic = magic;
+    header.version = currentVersion;
+    header.count = count;
+    header.crc = Crc32::compute(entries, length);
+
+    const bool written = file->write(&header, sizeof(header)) == sizeof(header) &&
+                         file->write(entries, length) == length &&
+                         file->sync();
+
+    storage.close(file);
+
+    if (!written) {
+        LOGFMT("Failed to write %s\n", tempFilename);
+        storage.remove(tempFilename);
+        return false;
+    }
+
+    // If we're interrupted between these two, load() picks up the copy.
+    if ((storage.exists(filename) && !storage.remove(filename)) || !storage.rename(tempFilename, filename)) {
+        LOGFMT("Failed to replace %s\n", filename);
+        return false;
+    }
+
+    created = false;
+    return true;
+}
+
+void ConversationDirectory::evict(size_t i) {
+    Files files;
+    filesForSlot(entries[i].slot, files);
+
+    LOGFMT("Conversation directory full, deleting conversation in slot %u\n", entries[i].slot);
+
+    storage.remove(files.journal);
+    storage.remove(files.journalIndex);
+    storage.remove(files.compaction);
+    storage.remove(files.compactionIndex);
+    storage.remove(files.searchIndex);
+
+    entries[i] = entries[count - 1];
+    count--;
+}
+
+bool ConversationDirectory::open(const MacAddress& peer, Files& files) {
+    int i = find(peer);
+
+    if (i < 0) {
+        if (count == maxConversations) {
+            size_t oldest = 0;
+
+            for (size_t k = 1; k < count; k++) {
+                if (entries[k].lastOpened < entries[oldest].lastOpened) {
+                    oldest = k;
+                }
+            }
+
+            evict(oldest);
+        }
+
+        // Lowest free slot.
+        uint8_t slot = 0;
+
+        for (bool used = true; used; ) {
+            used = false;
+
+            for (size_t k = 0; k < count && !used; k++) {
+                if (entries[k].slot == slot) {
+                    used = true;
+                    slot++;
+                }
+            }
+        }
+
+        i = count++;
+        memcpy(entries[i].peer, peer.rawAddress, MacAddress::addressLength);
+        entries[i].slot = slot;
+        entries[i].messageCount = 0;
+
+        // Whatever is in the slot belongs to someone else.
+        filesForSlot(slot, files);
+        storage.remove(files.journal);
+        storage.remove(files.journalIndex);
+        storage.remove(files.compaction);
+        storage.remove(files.compactionIndex);
+        storage.remove(files.searchIndex);
+    }
+
+    entries[i].lastOpened = ++openCounter;
+    filesForSlot(entries[i].slot, files);
+
+    return save();
+}
+
+void ConversationDirectory::setMessageCount(const MacAddress& peer, uint32_t messageCount) {
+    const int i = find(peer);
+
+    if (i >= 0) {
+        entries[i].messageCount = messageCount;
+    }
+}
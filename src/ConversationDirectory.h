@@ -0,0 +1,112 @@
+#pragma once
+
+#include <Arduino.h>
+#include "MacAddress.h"
+#include "Storage/Storage.h"
+
+// The conversations kept on the card, one per peer.
+//
+// Each conversation's history lives in its own set of files (journal, message index, search
+// index), so loading, saving and searching scale with that conversation rather than with all
+// traffic. Only the open conversation is loaded; the others stay on the card until opened.
+//
+// The directory maps peer addresses to slots, and each slot's files are named after it
+// (c00.jnl, c00.idx, ...), which keeps them within 8.3 names.
+//
+// The directory is small and rarely changes, so it's rewritten whole: to a temporary file,
+// which then replaces the directory. If that's interrupted, load() picks up the copy.
+//
+// Directory file format:
+// FileHeader
+// Entry, repeated FileHeader::count times
+class ConversationDirectory {
+public:
+    static constexpr uint32_t magic = 0x52494443; // "CDIR"
+    static constexpr uint8_t currentVersion = 1;
+
+    static constexpr size_t maxConversations = 16;
+
+    // 8.3 name plus null terminator.
+    static constexpr size_t maxFilenameLength = 13;
+
+    struct FileHeader {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t count;
+
+        // CRC-32 of the entries.
+        uint32_t crc;
+    } __attribute__((packed));
+
+    struct Entry {
+        uint8_t peer[MacAddress::addressLength];
+        uint8_t slot;
+
+        // As of the last time the conversation was closed, so it can be listed without loading it.
+        uint32_t messageCount;
+
+        // Higher is more recent.
+        uint32_t lastOpened;
+    } __attribute__((packed));
+
+    // Names of a conversation's files.
+    struct Files {
+        char journal[maxFilenameLength];
+        char journalIndex[maxFilenameLength];
+        char compaction[maxFilenameLength];
+        char compactionIndex[maxFilenameLength];
+        char searchIndex[maxFilenameLength];
+    };
+
+public:
+    ConversationDirectory(Storage& s, const char* directoryFilename, const char* tempDirectoryFilename) :
+        storage(s),
+        filename(directoryFilename),
+        tempFilename(tempDirectoryFilename)
+    {}
+
+    // Read the directory. Starts an empty one if there isn't one yet.
+    bool load();
+
+    // True if load() found no directory, e.g. on the first start after updating from
+    // firmware that kept a single history.
+    inline bool isNew() const {
+        return created;
+    }
+
+    // Find the conversation with peer, adding it if needed, and fill in the names of its files.
+    // When the directory is full, the least recently opened conversation is deleted to make room.
+    bool open(const MacAddress& peer, Files& files);
+
+    // Remember a conversation's size. Saved with the directory the next time it changes.
+    void setMessageCount(const MacAddress& peer, uint32_t count);
+
+    bool save();
+
+    inline size_t size() const {
+        return count;
+    }
+
+    inline const Entry& entry(size_t i) const {
+        return entries[i];
+    }
+
+    static void filesForSlot(uint8_t slot, Files& files);
+
+private:
+    int find(const MacAddress& peer) const;
+
+    // Delete a conversation's files and its entry.
+    void evict(size_t i);
+
+private:
+    Storage& storage;
+    const char* filename;
+    const char* tempFilename;
+
+    Entry entries[maxConversations];
+    size_t count = 0;
+
+    uint32_t openCounter = 0;
+    bool created = false;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Standard CRC-32 (IEEE 802.3, reflected, same as zlib).
+// Uses a 16 entry table, a nibble at a time, which is a good trade between flash and speed.
+namespace Crc32 {
+    static constexpr uint32_t initial = 0;
+
+    // Continue a CRC over more data. Start with Crc32::initial.
+    inline uint32_t update(uint32_t crc, const void* data, size_t length) {
+        static const uint32_t table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+            0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+            0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+        };
+
+        const uint8_t* bytes = (const uint8_t*)data;
+        crc = ~crc;
+
+        for (size_t i = 0; i < length; i++) {
+            crc = table[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+            crc = table[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+        }
+
+        return ~crc;
+    }
+
+    inline uint32_t compute(const void* data, size_t length) {
+        return update(initial, data, length);
+    }
+}
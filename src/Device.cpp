@@ -1,4 +1,8 @@
 #include "Device.h"
+#include "Payload.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
 
 const lv_point_t Device::barButtonIndicatorPositions[barButtonCount] = { 
     {6, 236}, 
@@ -11,3 +15,19 @@ void Device::setPixelColor(const Color::RGB& c) {
     pixel.fill(c.packed());
     pixel.show();    
 }
+
+bool Device::sendMessage(uint32_t id, const char* text) {
+    const size_t length = strlen(text);
+
+    uint8_t payload[Message::maxLength];
+    const uint8_t payloadLength = legacyPeer ? Payload::encodeLegacyText(payload, text, length) :
+                                               Payload::encodeMessage(payload, id, text, length);
+
+    if (!messenger->txWait(payload, payloadLength)) {
+        LOGFMT("Failed to send message %u\n", id);
+        return false;
+    }
+
+    (void)messageHistory.setStatus(id, Message::Status::sent);
+    return true;
+}
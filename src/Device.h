@@ -11,6 +11,7 @@
 #include "SceneManager.h"
 #include "Settings.h"
 #include "MessageHistory.h"
+#include "SearchIndex.h"
 #include "Color.h"
 
 // More friendly names
@@ -39,6 +40,7 @@ public:
            Settings& _settings,
            Messenger* _messenger,
            MessageHistory& _messageHistory,
+           SearchIndex& _searchIndex,
            Display& _display,
            BBQ10Keyboard& _keyboard,
            Touchpad& _touchpad,
@@ -49,6 +51,7 @@ public:
         settings(_settings),
         messenger(_messenger),
         messageHistory(_messageHistory),
+        searchIndex(_searchIndex),
         display(_display),
         keyboard(_keyboard),
         touchpad(_touchpad),
@@ -65,6 +68,7 @@ public:
     Settings& settings;
     Messenger* messenger;
     MessageHistory& messageHistory;    
+    SearchIndex& searchIndex;
 
     Display& display;
     BBQ10Keyboard& keyboard;
@@ -79,6 +83,14 @@ public:
     // Don't forget to remove it when you're done.
     lv_group_t* lvglKeyboardGroup = nullptr;
 
+    // While the history is still loading after boot, the newest messages read so far, oldest first.
+    // nullptr once it has loaded.
+    const MessageArena* historyPreview = nullptr;
+
+    // The paired device runs firmware from before typed payloads, going by the last payload it
+    // sent. It gets bare text, and no history sync.
+    bool legacyPeer = false;
+
 // Callback assignment for common device tasks provided by main program.
 public:
     // Provide an implementation to flush input, if possible.
@@ -106,6 +118,16 @@ public:
         saveMessageHistoryCallback = cb;
     }    
 
+    // Provide implementation for switching to the conversation with another peer
+    void setOpenConversationCallback(bool (*cb)(const MacAddress&)) {
+        openConversationCallback = cb;
+    }
+
+    // Provide implementation for finishing the history load right away
+    void setFinishLoadingHistoryCallback(void (*cb)()) {
+        finishLoadingHistoryCallback = cb;
+    }
+
     // Provide implementation for new message indicator
     void setShowNewIndicatorCallback(void (*cb)(bool)) {
         showNewIndicatorCallback = cb;
@@ -115,6 +137,10 @@ public:
 public:
     void setPixelColor(const Color::RGB& c);
 
+    // Send one of our messages that's already in the history, and mark it sent if the radio
+    // confirms it. A resend uses the same id, so a peer that only lost the ack drops the copy.
+    bool sendMessage(uint32_t id, const char* text);
+
     inline void setPixelBlack() {
         setPixelColor(Color::RGB(0));
     }
@@ -160,6 +186,24 @@ public:
         return saveMessageHistoryCallback();
     }
 
+    // Make the conversation with peer the current one, loading its history in place of the
+    // current conversation's. Does nothing if it's already the current one.
+    bool openConversation(const MacAddress& peer) {
+        if (openConversationCallback == nullptr) {
+            return false;
+        }
+
+        return openConversationCallback(peer);
+    }
+
+    // If the history is still loading after boot, load the rest now.
+    // Call before changing the history, or leaving a scene that shows historyPreview.
+    void finishLoadingHistory() {
+        if (finishLoadingHistoryCallback) {
+            finishLoadingHistoryCallback();
+        }
+    }
+
     // Displays or hides the new message indicator
     void showNewIndicator(bool show) {
         if (showNewIndicatorCallback) {
@@ -186,6 +230,8 @@ private:
 private:
     bool (*saveSettingsCallback)() = nullptr;
     bool (*saveMessageHistoryCallback)() = nullptr;
+    bool (*openConversationCallback)(const MacAddress&) = nullptr;
+    void (*finishLoadingHistoryCallback)() = nullptr;
     void (*flushInputCallback)() = nullptr;
     void (*connectBarButtonCallback)(lv_obj_t* btn, BarButton bb) = nullptr;
     void (*disconnectBarButtonCallback)(BarButton bb) = nullptr;
@@ -0,0 +1,169 @@
+#include "ErasureCode.h"
+
+namespace {
+    uint8_t gfExp[512];
+    uint8_t gfLog[256];
+    bool tablesInitialized = false;
+
+    void initTables() {
+        if (tablesInitialized) {
+            return;
+        }
+
+        // Primitive polynomial x^8 + x^4 + x^3 + x^2 + 1
+        uint16_t x = 1;
+
+        for (int i = 0; i < 255; i++) {
+            gfExp[i] = x;
+            gfLog[x] = i;
+
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11D;
+            }
+        }
+
+        // Duplicate the table so mul() doesn't need a modulo.
+        for (int i = 255; i < 512; i++) {
+            gfExp[i] = gfExp[i - 255];
+        }
+
+        tablesInitialized = true;
+    }
+
+    inline uint8_t mul(uint8_t a, uint8_t b) {
+        if (a == 0 || b == 0) {
+            return 0;
+        }
+
+        return gfExp[gfLog[a] + gfLog[b]];
+    }
+
+    inline uint8_t inv(uint8_t a) {
+        return gfExp[255 - gfLog[a]];
+    }
+
+    // Generator matrix coefficient for fragment `index`, data fragment `column`.
+    inline uint8_t coefficient(uint8_t dataCount, uint8_t index, uint8_t column) {
+        if (index < dataCount) {
+            return (index == column) ? 1 : 0;
+        }
+
+        // Cauchy matrix: 1 / (x_r + y_c), with x_r = index and y_c = column.
+        // Since index >= dataCount > column, x_r + y_c (xor) is never zero.
+        return inv(index ^ column);
+    }
+
+    // out += c * in
+    void mulAdd(uint8_t* out, const uint8_t* in, uint8_t c, uint8_t size) {
+        if (c == 0) {
+            return;
+        }
+
+        const uint8_t logC = gfLog[c];
+
+        for (uint8_t i = 0; i < size; i++) {
+            if (in[i] != 0) {
+                out[i] ^= gfExp[gfLog[in[i]] + logC];
+            }
+        }
+    }
+}
+
+void ErasureCode::encode(const uint8_t* data, uint8_t dataCount, uint8_t fragmentSize, uint8_t index, uint8_t* out) {
+    initTables();
+
+    if (index < dataCount) {
+        memcpy(out, &data[index * fragmentSize], fragmentSize);
+        return;
+    }
+
+    memset(out, 0, fragmentSize);
+
+    for (uint8_t column = 0; column < dataCount; column++) {
+        mulAdd(out, &data[column * fragmentSize], coefficient(dataCount, index, column), fragmentSize);
+    }
+}
+
+bool ErasureCode::decode(const uint8_t* fragments, const uint8_t* indices, uint8_t dataCount, uint8_t fragmentSize, uint8_t* out) {
+    initTables();
+
+    if (dataCount == 0 || dataCount > maxDataFragments) {
+        return false;
+    }
+
+    // Build the generator rows for the fragments we have, next to an identity matrix,
+    // and reduce the left side to identity (Gauss-Jordan). The right side is then the inverse.
+    uint8_t matrix[maxDataFragments][maxDataFragments];
+    uint8_t inverse[maxDataFragments][maxDataFragments];
+
+    for (uint8_t row = 0; row < dataCount; row++) {
+        if (indices[row] >= maxFragmentIndex) {
+            return false;
+        }
+
+        for (uint8_t column = 0; column < dataCount; column++) {
+            matrix[row][column] = coefficient(dataCount, indices[row], column);
+            inverse[row][column] = (row == column) ? 1 : 0;
+        }
+    }
+
+    for (uint8_t column = 0; column < dataCount; column++) {
+        // Find a pivot
+        uint8_t pivot = column;
+        while (pivot < dataCount && matrix[pivot][column] == 0) {
+            pivot++;
+        }
+
+        // Singular; the same fragment was passed twice.
+        if (pivot == dataCount) {
+            return false;
+        }
+
+        if (pivot != column) {
+            for (uint8_t i = 0; i < dataCount; i++) {
+                uint8_t t = matrix[pivot][i];
+                matrix[pivot][i] = matrix[column][i];
+                matrix[column][i] = t;
+
+                t = inverse[pivot][i];
+                inverse[pivot][i] = inverse[column][i];
+                inverse[column][i] = t;
+            }
+        }
+
+        // Normalize the pivot row
+        const uint8_t scale = inv(matrix[column][column]);
+
+        for (uint8_t i = 0; i < dataCount; i++) {
+            matrix[column][i] = mul(matrix[column][i], scale);
+            inverse[column][i] = mul(inverse[column][i], scale);
+        }
+
+        // Eliminate the column from every other row
+        for (uint8_t row = 0; row < dataCount; row++) {
+            const uint8_t factor = matrix[row][column];
+
+            if (row == column || factor == 0) {
+                continue;
+            }
+
+            for (uint8_t i = 0; i < dataCount; i++) {
+                matrix[row][i] ^= mul(factor, matrix[column][i]);
+                inverse[row][i] ^= mul(factor, inverse[column][i]);
+            }
+        }
+    }
+
+    // data = inverse * fragments
+    for (uint8_t row = 0; row < dataCount; row++) {
+        uint8_t* dst = &out[row * fragmentSize];
+        memset(dst, 0, fragmentSize);
+
+        for (uint8_t i = 0; i < dataCount; i++) {
+            mulAdd(dst, &fragments[i * fragmentSize], inverse[row][i], fragmentSize);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Systematic Reed-Solomon erasure code over GF(2^8), using a Cauchy generator matrix.
+//
+// A message is split into `dataCount` equally sized data fragments (indices 0 to dataCount-1).
+// Any number of parity fragments (indices dataCount and up) can be generated from them, and the
+// original data can be recovered from *any* dataCount distinct fragments.
+namespace ErasureCode {
+    // Upper bound on data fragments per block; keeps the decode matrix small.
+    static constexpr uint8_t maxDataFragments = 8;
+
+    // Fragment indices must stay below this so every Cauchy row is distinct.
+    static constexpr uint16_t maxFragmentIndex = 256 - maxDataFragments;
+
+    // Generate the fragment with the given index (>= dataCount) into `out`.
+    // `data` holds dataCount fragments of fragmentSize bytes each, back to back.
+    void encode(const uint8_t* data, uint8_t dataCount, uint8_t fragmentSize, uint8_t index, uint8_t* out);
+
+    // Recover the data fragments from exactly dataCount distinct fragments.
+    // `fragments` holds the received fragments back to back, `indices` their fragment indices.
+    // The recovered data fragments are written to `out` (dataCount * fragmentSize bytes).
+    // Returns false if the indices are invalid or repeated.
+    bool decode(const uint8_t* fragments, const uint8_t* indices, uint8_t dataCount, uint8_t fragmentSize, uint8_t* out);
+}
@@ -42,6 +42,8 @@ bool EspNowMessenger::begin(const MacAddress& _otherAddress, const uint8_t (&pmk
     }
 
     // Set up peer
+    peers.setChannel(1);
+
     if (!setPeer(_otherAddress, lmk)) {
         return false;
     }
@@ -50,15 +52,18 @@ bool EspNowMessenger::begin(const MacAddress& _otherAddress, const uint8_t (&pmk
     esp_now_register_recv_cb(dataReceived);    
     esp_now_register_send_cb(dataSent);
 
-    // Randomize; if we always start at 1, then if you turn off a device and turn
-    // it back on, there's an increased chance the new messages will be seen as
-    // duplicate sends.
-    nextPacketIdentifier = random(10000, 20000);
-    
     return true;
 }
 
 void EspNowMessenger::updateRx() {
+    finishPing();
+    processReceivedPacket();
+
+    // Send whatever is waiting in the transmit queue.
+    serviceTxQueue();
+}
+
+void EspNowMessenger::processReceivedPacket() {
     if (receivedByteCount == 0) {
         return;
     }
@@ -74,6 +79,14 @@ void EspNowMessenger::updateRx() {
     PacketHeader hdr;
     memcpy(&hdr, rxBuffer, sizeof(PacketHeader));
 
+    // The peer may have been removed since the packet arrived.
+    EspNowPeerTable::Peer* peer = peers.find(rxAddress);
+
+    // Any traffic from a peer tells us it's alive.
+    if (peer != nullptr) {
+        peer->link.recordReceive(millis());
+    }
+
     if (hdr.packetType == PacketType::ping) {
         if (pingCallback) {
             pingCallback();
@@ -109,17 +122,57 @@ void EspNowMessenger::updateRx() {
         return;        
     }
 
-    // Prepare the ack header and copy to our send buffer.
+    // Queue the ack; it's the highest traffic class, so the next pass over the queue sends it
+    // ahead of anything else waiting.
     PacketHeader ackHeader;
     ackHeader.packetType = PacketType::ack;
     ackHeader.packetIdentifier = hdr.packetIdentifier;
     ackHeader.payloadSize = 0;
     ackHeader.checksum = 0;
-    memcpy(txBuffer, &ackHeader, sizeof(ackHeader));
 
+    if (enqueue(TrafficClass::ack, (const uint8_t*)&ackHeader, sizeof(ackHeader), rxAddress.rawAddress, MacAddress::addressLength) == 0) {
+        LOGLN("Ack dropped, ack queue full");
+    }
+
+    if (peer == nullptr) {
+        LOGLN("Received packet from a peer that is no longer registered, ignoring");
+    }
+    else if (peer->isPacketIdentifierRecognized(hdr.packetIdentifier)) {
+        LOGFMT("Received packet with recognized ID, ignoring");
+    }
+    else if (payloadReceivedCallback) {
+        payloadReceivedCallback(&rxBuffer[sizeof(PacketHeader)], hdr.payloadSize);
+        peer->rememberPacketIdentifier(hdr.packetIdentifier);
+    }
+
+    receivedByteCount = 0;
+}
+
+bool EspNowMessenger::transmit(const TrafficQueue::Entry& entry) {
+    switch (entry.trafficClass) {
+        case TrafficClass::ack:
+            return sendAck(entry);
+
+        case TrafficClass::presence:
+            return sendPing();
+
+        case TrafficClass::message:
+        case TrafficClass::sync:
+            return sendMessage(entry.frame, entry.length);
+    }
+
+    return false;
+}
+
+bool EspNowMessenger::sendAck(const TrafficQueue::Entry& entry) {
+    waitForPing();
+
+    // Send straight from the queue entry so an in-flight message in txBuffer isn't clobbered.
     sendStatus = SendStatus::sending;
     sendPacketType = PacketType::ack;
-    esp_err_t result = esp_now_send(rxAddress.rawAddress, txBuffer, sizeof(PacketHeader));
+    esp_err_t result = esp_now_send(entry.destination, entry.frame, entry.length);
+
+    bool success = false;
 
     if (result != ESP_OK) {
         LOGFMT("ESP-NOW send failed sending Ack, error code: %02X\n", result);
@@ -129,7 +182,9 @@ void EspNowMessenger::updateRx() {
             yield();
         }
 
-        if (sendStatus == SendStatus::success) {
+        success = (sendStatus == SendStatus::success);
+
+        if (success) {
             LOGLN("Ack send succeeded");
         }
         else {
@@ -138,40 +193,29 @@ void EspNowMessenger::updateRx() {
     }
 
     sendStatus = SendStatus::none;
-
-    if (isPacketIdentifierRecognized(hdr.packetIdentifier)) {
-        LOGFMT("Received packet with recognized ID, ignoring");
-    }
-    else if (payloadReceivedCallback) {
-        payloadReceivedCallback(&rxBuffer[sizeof(PacketHeader)], hdr.payloadSize);
-
-        PacketIdentifierMemo memo;
-        memo.packetIdentifier = hdr.packetIdentifier;
-        memo.timestamp = millis();
-        packetIdentifierMemos.push(memo);        
-    }
-
-    receivedByteCount = 0;
+    return success;
 }
 
-bool EspNowMessenger::txWait(const uint8_t* payload, uint8_t len) {
+bool EspNowMessenger::sendMessage(const uint8_t* payload, uint8_t len) {
     if (len > Message::maxLength) {
         // Message length is too long.
         return false;
     }
 
-    // Get the next packet identifier.
-    nextPacketIdentifier++;
-    if (nextPacketIdentifier == 0) {
-        nextPacketIdentifier = 1;
+    EspNowPeerTable::Peer* peer = peers.find(otherAddress);
+
+    if (peer == nullptr) {
+        LOGLN("Paired device is not registered as a peer.");
+        return false;
     }
 
-    uint16_t packetIdentifier = nextPacketIdentifier;
+    // Get the next packet identifier for this peer.
+    uint16_t packetIdentifier = peer->takePacketIdentifier();
 
     // Prepare the header and copy to our send buffer.
     PacketHeader header;
     header.packetType = PacketType::message;
-    header.packetIdentifier = nextPacketIdentifier;
+    header.packetIdentifier = packetIdentifier;
     header.payloadSize = len;
     header.checksum = esp_rom_crc16_le(0xFFFF, payload, len);
     memcpy(txBuffer, &header, sizeof(header));
@@ -179,12 +223,15 @@ bool EspNowMessenger::txWait(const uint8_t* payload, uint8_t len) {
     // Copy payload to the buffer.
     memcpy(&txBuffer[sizeof(header)], payload, len);
 
+    waitForPing();
+
     uint8_t retryCount = 0;
     while (retryCount <= maxSendRetries) {
         sendStatus = SendStatus::sending;
         sendPacketType = PacketType::message;
 
         LOGFMT("Send attempt %d, packet ID: %d\n", retryCount + 1, packetIdentifier);
+        peer->link.recordSent(millis());
 
         esp_err_t result = esp_now_send(otherAddress.rawAddress, txBuffer, sizeof(PacketHeader) + len);
 
@@ -203,6 +250,7 @@ bool EspNowMessenger::txWait(const uint8_t* payload, uint8_t len) {
         // was not detected and we know we can't send a message to it right now.
         if (sendStatus == SendStatus::failure) {
             LOGFMT("ESP-NOW send failed: paired device not detected.");    
+            peer->link.recordDelivery(millis(), false);
             sendStatus = SendStatus::none;
             return false;
         }
@@ -228,6 +276,7 @@ bool EspNowMessenger::txWait(const uint8_t* payload, uint8_t len) {
 
                 if (ackHeader.packetType == PacketType::ack && ackHeader.packetIdentifier == packetIdentifier) {
                     LOGLN("Ack received!");
+                    peer->link.recordDelivery(millis(), true);
                     // This was the ack we're looking for! We're done.
                     receivedByteCount = 0;
                     return true;
@@ -242,6 +291,7 @@ bool EspNowMessenger::txWait(const uint8_t* payload, uint8_t len) {
         }
 
         LOGLN("Wait for ack timed out");
+        peer->link.recordDelivery(millis(), false);
         retryCount++;
         timeoutStart = millis();
     }
@@ -259,8 +309,8 @@ void EspNowMessenger::dataReceived(const uint8_t* mac, const uint8_t* incomingDa
         return;
     }
 
-    // This message is not from our paired device, ignore it.
-    if (memcmp(mac, pInstance->otherAddress.rawAddress, 6) != 0) {
+    // This message is not from a registered peer, ignore it.
+    if (!pInstance->peers.contains(mac)) {
         LOGLN("Message received from unknown device. Ignoring.");
         return;
     }
@@ -296,50 +346,87 @@ void EspNowMessenger::dataSent(const uint8_t *mac, esp_now_send_status_t status)
 
         case PacketType::ping:
             LOGFMT("Ping packet send result: %s\n", (status == ESP_NOW_SEND_SUCCESS) ? "success" : "failure");
-            pInstance->sendStatus = (status == ESP_NOW_SEND_SUCCESS) ? SendStatus::success : SendStatus::failure;        
+            pInstance->pingStatus = (status == ESP_NOW_SEND_SUCCESS) ? SendStatus::success : SendStatus::failure;        
             break;
     }
 }
 
-bool EspNowMessenger::isPacketIdentifierRecognized(uint16_t id) {
-    uint32_t now = millis();
+void EspNowMessenger::ping() {
+    PacketHeader pingHeader;
+    pingHeader.packetType = PacketType::ping;
 
-    for (int i = 0; i < maxPacketIdentifierMemos; i++) {
-        uint32_t age = now - packetIdentifierMemos[i].timestamp;
-        if (age < memoLifetime && id == packetIdentifierMemos[i].packetIdentifier) {
-            return true;
-        }
+    // Pings are sent from the transmit queue, behind acks and user messages.
+    if (enqueue(TrafficClass::presence, (const uint8_t*)&pingHeader, sizeof(pingHeader)) == 0) {
+        LOGLN("Ping dropped, presence queue full");
     }
-
-    return false;
 }
 
-void EspNowMessenger::ping() {
+bool EspNowMessenger::sendPing() {
+    // The last one hasn't been reported yet; this one would only tell us the same.
+    if (pingStatus == SendStatus::sending) {
+        LOGLN("Ping still in flight, skipping");
+        return false;
+    }
+
     PacketHeader pingHeader;
     pingHeader.packetType = PacketType::ping;
 
     LOGLN("Sending Ping");
-    sendStatus = SendStatus::sending;
+    pingStatus = SendStatus::sending;
     sendPacketType = PacketType::ping;
     esp_err_t result = esp_now_send(otherAddress.rawAddress, (uint8_t*)&pingHeader, sizeof(PacketHeader));
 
     if (result != ESP_OK) {
         LOGLN("Failed to send ping");
+        pingStatus = SendStatus::none;
+        return false;
+    }
+
+    // We don't wait for the result; finishPing() records it.
+    return true;
+}
+
+void EspNowMessenger::finishPing() {
+    const SendStatus status = pingStatus;
+
+    if (status != SendStatus::success && status != SendStatus::failure) {
+        return;
+    }
+
+    const bool success = (status == SendStatus::success);
+
+    if (success) {
+        LOGLN("Ping succeeded");
     }
     else {
-        while(sendStatus == SendStatus::sending) {
-            yield();
-        }
+        LOGLN("Ping failed");
+    }
 
-        if (sendStatus == SendStatus::success) {
-            LOGLN("Ping succeeded");
-        }
-        else {
-            LOGLN("Ping failed");
-        }
+    // Pings are unicast, so a successful send means the peer's radio acknowledged it.
+    EspNowPeerTable::Peer* peer = peers.find(otherAddress);
+
+    if (peer != nullptr) {
+        peer->link.recordSent(millis());
+        peer->link.recordDelivery(millis(), success);
     }
 
-    // We don't wait for an Ack for pings.
+    pingStatus = SendStatus::none;
+}
+
+void EspNowMessenger::waitForPing() {
+    // A unicast send is reported within a few retries at the MAC layer.
+    while (pingStatus == SendStatus::sending) {
+        yield();
+    }
+
+    finishPing();
+}
+
+const LinkStats& EspNowMessenger::linkStats() const {
+    static const LinkStats noLink;
+
+    const EspNowPeerTable::Peer* peer = peers.find(otherAddress.rawAddress);
+    return (peer != nullptr) ? peer->link : noLink;
 }
 
 bool EspNowMessenger::setPMK(const uint8_t (&pmk)[16]) {
@@ -359,42 +446,37 @@ bool EspNowMessenger::setPMK(const uint8_t (&pmk)[16]) {
 }
 
 bool EspNowMessenger::setPeer(const MacAddress& mac, const uint8_t (&lmk)[16]) {
-    deleteAllPeers();
+    // Swap out only the previously paired peer; a key change on the same peer is an in-place update.
+    if (mac != otherAddress && peers.find(otherAddress) != nullptr) {
+        LOGLN("Removing previously paired peer");
+        peers.remove(otherAddress);
+    }
 
     otherAddress = mac;
 
-    LOGFMT("new Peer address: %02X:%02X:%02X:%02X:%02X:%02X\n", 
-        mac.rawAddress[0], 
-        mac.rawAddress[1], 
-        mac.rawAddress[2], 
-        mac.rawAddress[3], 
-        mac.rawAddress[4], 
-        mac.rawAddress[5]);
-        
-    esp_now_peer_info_t peerInfo;        
-    memcpy(peerInfo.peer_addr, mac.rawAddress, ESP_NOW_ETH_ALEN);
-    peerInfo.channel = 1;
-    peerInfo.encrypt = true;
-    peerInfo.ifidx = WIFI_IF_STA;
-    memcpy(peerInfo.lmk, lmk, ESP_NOW_KEY_LEN);
-
-    esp_err_t addPeerResult = esp_now_add_peer(&peerInfo);
-    if (addPeerResult == ESP_OK) {
-        if (esp_now_is_peer_exist(peerInfo.peer_addr)) {
-            LOGLN("Add peer success");
-        } else {
-            LOGLN("Add peer failed - not found after adding");
-            return false;
-        }
+    if (!peers.add(mac, lmk)) {
+        return false;
     }
-    else {
-        LOGFMT("Failed to add peer, error code: %02X\n", addPeerResult);
+
+    if (esp_now_is_peer_exist(mac.rawAddress)) {
+        LOGLN("Add peer success");
+    } else {
+        LOGLN("Add peer failed - not found after adding");
         return false;
     }
 
     return true;
 }
 
+bool EspNowMessenger::removePeer(const MacAddress& mac) {
+    if (mac == otherAddress) {
+        LOGLN("Cannot remove the paired peer");
+        return false;
+    }
+
+    return peers.remove(mac);
+}
+
 bool EspNowMessenger::settingsChanged(const Settings& settings, uint8_t changeFlags) {
     bool setPMKSuccess = true;
     bool setPeerSuccess = true;
@@ -410,10 +492,13 @@ bool EspNowMessenger::settingsChanged(const Settings& settings, uint8_t changeFl
             setPMKSuccess = false;
         }
 
-        // Note that if the primary key changes we need to update the peer, 
+        // Note that if the primary key changes we need to update the peers, 
         // because the local key is derived from the primary key.
-        updatePeer = true;
-        LOGLN("peer needs update (primary key changed)");
+        LOGLN("peers need update (primary key changed)");
+
+        if (!peers.refreshAll()) {
+            setPeerSuccess = false;
+        }
     }
 
     if (changeFlags & Settings::CHANGE_LOCAL_KEY) {
@@ -432,48 +517,10 @@ bool EspNowMessenger::settingsChanged(const Settings& settings, uint8_t changeFl
         Settings::lmk_t lmk;
         settings.lmk(lmk);
 
-        setPeerSuccess = setPeer(settings.otherMacAddress(), lmk);
+        if (!setPeer(settings.otherMacAddress(), lmk)) {
+            setPeerSuccess = false;
+        }
     }
 
     return (setPMKSuccess && setPeerSuccess);
 }
-
-void EspNowMessenger::deleteAllPeers() {
-    esp_now_peer_num_t totalPeers;
-    if (!esp_now_get_peer_num(&totalPeers) == ESP_OK) {
-        LOGLN("Failed to get peer count");
-        return;
-    }
-    
-    if (totalPeers.total_num == 0) {
-        LOGLN("No peers to delete");
-        return;
-    }
-
-    LOGFMT("Deleting %d peers...\n", totalPeers.total_num);
-    
-    // Array to hold MAC addresses of peers
-    esp_now_peer_info_t peerInfo[totalPeers.total_num];
-
-    // Retrieve all peers
-    if (esp_now_fetch_peer(totalPeers.total_num, peerInfo) != ESP_OK) {
-        LOGLN("Failed to fetch peer information.");
-        return;
-    }
-
-    // Loop through and delete each peer
-    char macStr[32];
-
-    for (int i = 0; i < totalPeers.total_num; i++) {
-        snprintf(macStr, sizeof(macStr), "%02X:%02X:%02X:%02X:%02X:%02X",
-                peerInfo[i].peer_addr[0], peerInfo[i].peer_addr[1], peerInfo[i].peer_addr[2],
-                peerInfo[i].peer_addr[3], peerInfo[i].peer_addr[4], peerInfo[i].peer_addr[5]);
-
-        LOGFMT("Deleting peer: %s\n", macStr);
-
-        // Delete the peer
-        if (esp_now_del_peer(peerInfo[i].peer_addr) != ESP_OK) {
-            LOGFMT("Failed to delete peer: %s\n", macStr);
-        }
-    }
-}
\ No newline at end of file
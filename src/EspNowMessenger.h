@@ -4,7 +4,7 @@
 #include <esp_now.h>
 #include "MacAddress.h"
 #include "Messenger.h"
-#include <CircularBuffer.hpp>
+#include "EspNowPeerTable.h"
 
 class EspNowMessenger: public Messenger {
 public:
@@ -14,9 +14,9 @@ public:
     bool begin(const MacAddress& _otherAddress, const uint8_t (&pmk)[16], const uint8_t (&lmk)[16]);
 
     virtual void updateRx() override;
-    virtual bool txWait(const uint8_t* payload, uint8_t len) override;
     virtual void ping() override;
     virtual bool settingsChanged(const Settings& settings, uint8_t changeFlags) override;    
+    virtual const LinkStats& linkStats() const override;
 
     // Called when a payload is received.
     void setPayloadReceivedCallback(void (*cb)(const uint8_t* payload, uint32_t len)) {
@@ -28,23 +28,45 @@ public:
         pingCallback = cb;
     } 
 
+    // Register an additional peer, or update the local key of an existing one.
+    bool addPeer(const MacAddress& mac, const uint8_t (&lmk)[16]) {
+        return peers.add(mac, lmk);
+    }
+
+    // Unregister a peer. The paired device can't be removed this way; change it in settings instead.
+    bool removePeer(const MacAddress& mac);
+
+protected:
+    virtual bool transmit(const TrafficQueue::Entry& entry) override;
+
 private:
+    // Handle the packet in rxBuffer, if any.
+    void processReceivedPacket();
+
+    // Transmit helpers for each traffic class. Acks and messages block until sent;
+    // pings only hand the packet to the driver.
+    bool sendAck(const TrafficQueue::Entry& entry);
+    bool sendMessage(const uint8_t* payload, uint8_t len);
+    bool sendPing();
+
+    // Record the result of the last ping once the driver has reported it.
+    void finishPing();
+
+    // The driver reports sends in order, and dataSent() can't tell them apart, so a
+    // ping's result has to be in before another packet is sent.
+    void waitForPing();
+
     // Callbacks from ESP-NOW
     static void dataReceived(const uint8_t* mac, const uint8_t* incomingData, int len);
     static void dataSent(const uint8_t *mac, esp_now_send_status_t status);
 
-    // Have we seen a packet with this ID recently?
-    bool isPacketIdentifierRecognized(uint16_t identifier);
-
     // Set primary encryption key. (used by settingsChanged())
     bool setPMK(const uint8_t (&pmk)[16]);
 
-    // Set the peer (used by settingsChanged())
+    // Set the paired peer (used by settingsChanged())
     // We need both a mac and an LMK to set the peer.
-    bool setPeer(const MacAddress& mac, const uint8_t (&lmk)[16]);    
-
-    // Delete all known peers.
-    void deleteAllPeers();
+    // Only the previously paired peer is replaced; other registered peers are left alone.
+    bool setPeer(const MacAddress& mac, const uint8_t (&lmk)[16]);
 
 private:
     enum class SendStatus: uint8_t {
@@ -68,17 +90,15 @@ private:
         uint16_t checksum = 0; 
     } __attribute__((packed));
 
-    struct PacketIdentifierMemo {
-        uint16_t packetIdentifier;
-        uint32_t timestamp;
-    } __attribute__((packed));;
-
     static constexpr uint32_t maxSendRetries = 3;
     static constexpr uint32_t sendTimeout = 500;
 
     // The mac address of the paired device.
     MacAddress otherAddress;
 
+    // All registered peers, including the paired device.
+    EspNowPeerTable peers;
+
     // When a packet has been received, this will be set to non-zero,
     // signalling that the packet is ready to be processed.
     volatile uint8_t receivedByteCount = 0;  
@@ -96,17 +116,12 @@ private:
     volatile SendStatus sendStatus = SendStatus::none;
     PacketType sendPacketType = PacketType::message;
 
+    // Status of the last ping, which is sent without waiting for it.
+    volatile SendStatus pingStatus = SendStatus::none;
+
     // Send and receive buffers.
     // Message::maxLength is 239, and the max ESP-NOW packet size is 250,
     // so we can easily inject our packet headers into the messages.
     uint8_t txBuffer[Message::maxLength + sizeof(PacketHeader)] = {0};
     uint8_t rxBuffer[Message::maxLength + sizeof(PacketHeader)] = {0};
-
-    // Increment this for each message packet sent.
-    uint16_t nextPacketIdentifier = 0;
-
-    // Avoid processing the same packet multiple times in less-than-ideal conditions.
-    static constexpr size_t maxPacketIdentifierMemos = 16;
-    static constexpr uint32_t memoLifetime = 30 * 1000;
-    CircularBuffer<PacketIdentifierMemo, maxPacketIdentifierMemos> packetIdentifierMemos;
 };
@@ -0,0 +1,233 @@
+#include "EspNowPeerTable.h"
+#include <WiFi.h>
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+uint16_t EspNowPeerTable::Peer::takePacketIdentifier() {
+    nextPacketIdentifier++;
+    if (nextPacketIdentifier == 0) {
+        nextPacketIdentifier = 1;
+    }
+
+    return nextPacketIdentifier;
+}
+
+bool EspNowPeerTable::Peer::isPacketIdentifierRecognized(uint16_t id) const {
+    uint32_t now = millis();
+
+    for (size_t i = 0; i < packetIdentifierMemos.size(); i++) {
+        uint32_t age = now - packetIdentifierMemos[i].timestamp;
+        if (age < memoLifetime && id == packetIdentifierMemos[i].packetIdentifier) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void EspNowPeerTable::Peer::rememberPacketIdentifier(uint16_t id) {
+    PacketIdentifierMemo memo;
+    memo.packetIdentifier = id;
+    memo.timestamp = millis();
+    packetIdentifierMemos.push(memo);
+}
+
+EspNowPeerTable::EspNowPeerTable() {
+    memset(slots, emptySlot, sizeof(slots));
+}
+
+size_t EspNowPeerTable::hash(const uint8_t* mac) {
+    // FNV-1a over the 6 address bytes.
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < MacAddress::addressLength; i++) {
+        h ^= mac[i];
+        h *= 16777619u;
+    }
+
+    return h & (hashSize - 1);
+}
+
+int EspNowPeerTable::findSlot(const uint8_t* mac) const {
+    size_t slot = hash(mac);
+
+    for (size_t probe = 0; probe < hashSize; probe++) {
+        int8_t index = slots[slot];
+
+        if (index == emptySlot) {
+            return -1;
+        }
+
+        if (memcmp(peers[index].address.rawAddress, mac, MacAddress::addressLength) == 0) {
+            return slot;
+        }
+
+        slot = (slot + 1) & (hashSize - 1);
+    }
+
+    return -1;
+}
+
+EspNowPeerTable::Peer* EspNowPeerTable::find(const uint8_t* mac) {
+    int slot = findSlot(mac);
+    return (slot < 0) ? nullptr : &peers[slots[slot]];
+}
+
+const EspNowPeerTable::Peer* EspNowPeerTable::find(const uint8_t* mac) const {
+    int slot = findSlot(mac);
+    return (slot < 0) ? nullptr : &peers[slots[slot]];
+}
+
+bool EspNowPeerTable::contains(const uint8_t* mac) const {
+    portENTER_CRITICAL(&lock);
+    const bool found = findSlot(mac) >= 0;
+    portEXIT_CRITICAL(&lock);
+
+    return found;
+}
+
+bool EspNowPeerTable::applyToDriver(const Peer& peer, bool modify) {
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, peer.address.rawAddress, ESP_NOW_ETH_ALEN);
+    peerInfo.channel = channel;
+    peerInfo.encrypt = true;
+    peerInfo.ifidx = WIFI_IF_STA;
+    memcpy(peerInfo.lmk, peer.lmk, ESP_NOW_KEY_LEN);
+
+    esp_err_t result = modify ? esp_now_mod_peer(&peerInfo) : esp_now_add_peer(&peerInfo);
+
+    if (result != ESP_OK) {
+        LOGFMT("Failed to %s peer, error code: %02X\n", modify ? "modify" : "add", result);
+        return false;
+    }
+
+    return true;
+}
+
+bool EspNowPeerTable::add(const MacAddress& mac, const uint8_t (&lmk)[lmkSize]) {
+    LOGFMT("Adding peer: %02X:%02X:%02X:%02X:%02X:%02X\n",
+        mac.rawAddress[0],
+        mac.rawAddress[1],
+        mac.rawAddress[2],
+        mac.rawAddress[3],
+        mac.rawAddress[4],
+        mac.rawAddress[5]);
+
+    // Known peer; just update the local key.
+    Peer* existing = find(mac);
+    if (existing != nullptr) {
+        memcpy(existing->lmk, lmk, lmkSize);
+        return applyToDriver(*existing, true);
+    }
+
+    if (count >= maxPeers) {
+        LOGLN("Peer table full");
+        return false;
+    }
+
+    // Find a free peer entry.
+    int index = 0;
+    while (peerUsed[index]) {
+        index++;
+    }
+
+    Peer& peer = peers[index];
+    peer.address = mac;
+    memcpy(peer.lmk, lmk, lmkSize);
+    peer.packetIdentifierMemos.clear();
+    peer.link = LinkStats();
+
+    // Randomize; if we always start at 1, then if you turn off a device and turn
+    // it back on, there's an increased chance the new messages will be seen as
+    // duplicate sends.
+    peer.nextPacketIdentifier = random(10000, 20000);
+
+    if (!applyToDriver(peer, false)) {
+        return false;
+    }
+
+    // Publish the peer to the hash map last, so the receive callback never sees a half-initialized entry.
+    portENTER_CRITICAL(&lock);
+
+    size_t slot = hash(mac.rawAddress);
+    while (slots[slot] != emptySlot) {
+        slot = (slot + 1) & (hashSize - 1);
+    }
+
+    peerUsed[index] = true;
+    slots[slot] = index;
+    count++;
+
+    portEXIT_CRITICAL(&lock);
+
+    return true;
+}
+
+bool EspNowPeerTable::remove(const MacAddress& mac) {
+    int slot = findSlot(mac.rawAddress);
+
+    if (slot < 0) {
+        return false;
+    }
+
+    // The driver still has it, so keep it; the callback would otherwise drop its packets.
+    if (esp_now_del_peer(mac.rawAddress) != ESP_OK) {
+        LOGLN("Failed to delete peer from driver");
+        return false;
+    }
+
+    // The shift below moves other peers' slots; a lookup in the middle of it could miss them.
+    portENTER_CRITICAL(&lock);
+
+    peerUsed[slots[slot]] = false;
+    slots[slot] = emptySlot;
+    count--;
+
+    // Backward-shift deletion: re-seat any entries in the probe run after the
+    // removed slot so lookups don't stop early at the new hole.
+    size_t hole = slot;
+    size_t next = (hole + 1) & (hashSize - 1);
+
+    while (slots[next] != emptySlot) {
+        size_t home = hash(peers[slots[next]].address.rawAddress);
+
+        // Distance from the entry's home slot to where it sits now, and to the hole.
+        size_t distanceToNext = (next - home) & (hashSize - 1);
+        size_t distanceToHole = (hole - home) & (hashSize - 1);
+
+        if (distanceToHole < distanceToNext) {
+            slots[hole] = slots[next];
+            slots[next] = emptySlot;
+            hole = next;
+        }
+
+        next = (next + 1) & (hashSize - 1);
+    }
+
+    portEXIT_CRITICAL(&lock);
+
+    return true;
+}
+
+bool EspNowPeerTable::refresh(const MacAddress& mac) {
+    Peer* peer = find(mac);
+
+    if (peer == nullptr) {
+        return false;
+    }
+
+    return applyToDriver(*peer, true);
+}
+
+bool EspNowPeerTable::refreshAll() {
+    bool success = true;
+
+    for (size_t i = 0; i < maxPeers; i++) {
+        if (peerUsed[i] && !applyToDriver(peers[i], true)) {
+            success = false;
+        }
+    }
+
+    return success;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include <CircularBuffer.hpp>
+#include "MacAddress.h"
+#include "LinkStats.h"
+
+// Registry of the ESP-NOW peers known to the driver.
+// Peers are added, updated and removed one at a time, so changing the settings for one peer
+// doesn't tear down every other peer. Each peer keeps its own local key and packet sequence state.
+//
+// Inbound MAC addresses are resolved with a small open-addressed hash map, which keeps the
+// lookup in the ESP-NOW receive callback cheap regardless of how many peers are registered.
+// The receive callback runs in the WiFi task, so it checks peers with contains(), and add()
+// and remove() change the hash map inside the same critical section. Everything else is
+// only called from loop().
+class EspNowPeerTable {
+public:
+    // Every peer is added encrypted, so the driver's encrypted peer limit is the table's,
+    // not the larger ESP_NOW_MAX_TOTAL_PEER_NUM.
+    static constexpr size_t maxPeers = ESP_NOW_MAX_ENCRYPT_PEER_NUM;
+
+    static constexpr size_t lmkSize = ESP_NOW_KEY_LEN;
+
+    // Avoid processing the same packet multiple times in less-than-ideal conditions.
+    static constexpr size_t maxPacketIdentifierMemos = 16;
+    static constexpr uint32_t memoLifetime = 30 * 1000;
+
+    struct PacketIdentifierMemo {
+        uint16_t packetIdentifier;
+        uint32_t timestamp;
+    } __attribute__((packed));
+
+    struct Peer {
+        MacAddress address;
+        uint8_t lmk[lmkSize] = {0};
+
+        // Increment this for each message packet sent to this peer.
+        uint16_t nextPacketIdentifier = 0;
+
+        // Recently received packet identifiers from this peer.
+        CircularBuffer<PacketIdentifierMemo, maxPacketIdentifierMemos> packetIdentifierMemos;
+
+        // Liveness and link quality.
+        LinkStats link;
+
+        // Returns the identifier to use for the next message packet sent to this peer.
+        uint16_t takePacketIdentifier();
+
+        // Have we seen a packet with this ID recently?
+        bool isPacketIdentifierRecognized(uint16_t identifier) const;
+
+        // Remember a processed packet ID.
+        void rememberPacketIdentifier(uint16_t identifier);
+    };
+
+public:
+    EspNowPeerTable();
+
+    // Channel used when registering peers with the driver.
+    void setChannel(uint8_t c) {
+        channel = c;
+    }
+
+    // Register a peer with the driver. If the peer already exists, its local key is updated instead.
+    bool add(const MacAddress& mac, const uint8_t (&lmk)[lmkSize]);
+
+    // Unregister a single peer.
+    bool remove(const MacAddress& mac);
+
+    // Re-apply a peer's local key to the driver.
+    bool refresh(const MacAddress& mac);
+
+    // Re-apply every peer's local key to the driver (e.g. after the primary key changed).
+    bool refreshAll();
+
+    // Look up a registered peer. Returns nullptr if the peer is unknown.
+    Peer* find(const uint8_t* mac);
+    const Peer* find(const uint8_t* mac) const;
+
+    Peer* find(const MacAddress& mac) {
+        return find(mac.rawAddress);
+    }
+
+    // Is this peer registered? Safe to call from the ESP-NOW callbacks.
+    bool contains(const uint8_t* mac) const;
+
+    inline size_t size() const {
+        return count;
+    }
+
+private:
+    // Power of two, at least twice the peer limit so probe sequences stay short.
+    static constexpr size_t hashSize = 64;
+    static constexpr int8_t emptySlot = -1;
+
+    static_assert(maxPeers <= 127, "Peer indices must fit in the hash slots");
+    static_assert(hashSize >= maxPeers * 2, "Hash map is too small for the peer limit");
+
+    static size_t hash(const uint8_t* mac);
+
+    // Returns the hash slot holding this mac, or -1.
+    int findSlot(const uint8_t* mac) const;
+
+    bool applyToDriver(const Peer& peer, bool modify);
+
+private:
+    Peer peers[maxPeers];
+    bool peerUsed[maxPeers] = {false};
+    int8_t slots[hashSize];
+    size_t count = 0;
+    uint8_t channel = 1;
+
+    // Guards slots, peerUsed and count against the receive callback.
+    mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
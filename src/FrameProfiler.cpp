@@ -0,0 +1,161 @@
+#include "FrameProfiler.h"
+#include "GlobalTheme.h"
+
+void FrameProfiler::begin(lv_display_t* display) {
+    lv_display_add_event_cb(display, displayEvent, LV_EVENT_REFR_START, this);
+    lv_display_add_event_cb(display, displayEvent, LV_EVENT_REFR_READY, this);
+    lv_display_add_event_cb(display, displayEvent, LV_EVENT_INVALIDATE_AREA, this);
+}
+
+void FrameProfiler::displayEvent(lv_event_t* e) {
+    FrameProfiler* profiler = (FrameProfiler*)lv_event_get_user_data(e);
+
+    switch (lv_event_get_code(e)) {
+        case LV_EVENT_REFR_START:
+            profiler->refreshStart = micros();
+            profiler->frameFlushMicros = 0;
+            profiler->framePixels = 0;
+            break;
+
+        case LV_EVENT_REFR_READY:
+            profiler->frameFinished();
+            break;
+
+        case LV_EVENT_INVALIDATE_AREA: {
+            const lv_area_t* area = (const lv_area_t*)lv_event_get_param(e);
+
+            if (area != nullptr) {
+                profiler->pendingInvalidated += lv_area_get_size(area);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void FrameProfiler::flushFinished(const lv_area_t* area) {
+    frameFlushMicros += micros() - flushStart;
+    framePixels += lv_area_get_size(area);
+}
+
+void FrameProfiler::frameFinished() {
+    // The refresh timer runs whether or not anything changed.
+    if (framePixels == 0) {
+        return;
+    }
+
+    histograms[uint8_t(Metric::render)].add(micros() - refreshStart);
+    histograms[uint8_t(Metric::flush)].add(frameFlushMicros);
+    histograms[uint8_t(Metric::pixelsFlushed)].add(framePixels);
+    histograms[uint8_t(Metric::invalidatedArea)].add(pendingInvalidated);
+
+    if (messagePending) {
+        histograms[uint8_t(Metric::messageLatency)].add(micros() - messageReceived);
+        messagePending = false;
+    }
+
+    pendingInvalidated = 0;
+}
+
+void FrameProfiler::loopTick() {
+    const uint32_t now = micros();
+
+    if (looped) {
+        histograms[uint8_t(Metric::loopPeriod)].add(now - lastLoop);
+    }
+
+    lastLoop = now;
+    looped = true;
+}
+
+void FrameProfiler::showOverlay(bool show) {
+    if (show == isOverlayShown()) {
+        return;
+    }
+
+    if (!show) {
+        lv_obj_delete(overlay);
+        overlay = nullptr;
+        return;
+    }
+
+    overlay = lv_label_create(lv_layer_top());
+    lv_obj_add_style(overlay, &globalTheme.statusBarText, 0);
+    lv_obj_set_style_bg_color(overlay, lv_color_black(), 0);
+    lv_obj_set_style_bg_opa(overlay, LV_OPA_COVER, 0);
+    lv_obj_align(overlay, LV_ALIGN_TOP_MID, 0, 20);
+    lv_label_set_text(overlay, "");
+
+    lastOverlayUpdate = millis() - overlayIntervalMS;
+}
+
+void FrameProfiler::update() {
+    if (overlay == nullptr || millis() - lastOverlayUpdate < overlayIntervalMS) {
+        return;
+    }
+
+    lastOverlayUpdate = millis();
+
+    const Histogram& render = histogram(Metric::render);
+    const Histogram& flush = histogram(Metric::flush);
+    const Histogram& pixels = histogram(Metric::pixelsFlushed);
+    const Histogram& loopPeriod = histogram(Metric::loopPeriod);
+
+    // Typical and 90th percentile, in ms.
+    lv_label_set_text_fmt(overlay, "render %u/%u flush %u/%u px %u loop %u/%u",
+        (unsigned)(render.percentile(50) / 1000), (unsigned)(render.percentile(90) / 1000),
+        (unsigned)(flush.percentile(50) / 1000), (unsigned)(flush.percentile(90) / 1000),
+        (unsigned)pixels.mean(),
+        (unsigned)(loopPeriod.percentile(50) / 1000), (unsigned)(loopPeriod.percentile(90) / 1000));
+}
+
+const char* FrameProfiler::metricName(Metric metric) {
+    switch (metric) {
+        case Metric::render:            return "render_us";
+        case Metric::flush:             return "flush_us";
+        case Metric::pixelsFlushed:     return "pixels_flushed";
+        case Metric::invalidatedArea:   return "invalidated_px";
+        case Metric::loopPeriod:        return "loop_period_us";
+        case Metric::messageLatency:    return "message_latency_us";
+    }
+
+    return "unknown";
+}
+
+void FrameProfiler::printCsv(Print& out) const {
+    out.print("metric,count,min,mean,p50,p90,p99,max");
+
+    for (size_t b = 0; b < Histogram::bucketCount; b++) {
+        out.printf(",ge_%u", (unsigned)Histogram::bucketLow(b));
+    }
+
+    out.println();
+
+    for (size_t m = 0; m < metricCount; m++) {
+        const Histogram& h = histograms[m];
+
+        out.printf("%s,%u,%u,%u,%u,%u,%u,%u",
+            metricName(Metric(m)),
+            (unsigned)h.count, (unsigned)h.minimum, (unsigned)h.mean(),
+            (unsigned)h.percentile(50), (unsigned)h.percentile(90), (unsigned)h.percentile(99),
+            (unsigned)h.maximum);
+
+        for (size_t b = 0; b < Histogram::bucketCount; b++) {
+            out.printf(",%u", (unsigned)h.buckets[b]);
+        }
+
+        out.println();
+    }
+}
+
+void FrameProfiler::reset() {
+    for (size_t m = 0; m < metricCount; m++) {
+        histograms[m].reset();
+    }
+
+    pendingInvalidated = 0;
+    looped = false;
+    messagePending = false;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <Arduino.h>
+#include <lvgl.h>
+#include "Histogram.h"
+
+// Per-frame rendering statistics, to find jank.
+//
+// Only built into the firmware when PROFILE_FRAMES is defined in config.h. Each frame LVGL
+// draws records how long it took from the start of the refresh to the last flush, how much
+// of that was spent sending pixels to the display, how many pixels were sent, and how much
+// of the screen was invalidated to cause it. The main loop period is recorded every loop, and
+// the time from receiving a message to the end of the frame that shows it.
+//
+// Statistics go into fixed-size histograms (see Histogram), so profiling can stay on for as
+// long as needed. They can be shown in a small overlay on the top layer, and printed as CSV.
+class FrameProfiler {
+public:
+    enum class Metric: uint8_t {
+        // Microseconds from the start of a refresh to the end of its last flush, flushes included.
+        render = 0,
+
+        // Microseconds spent in the flush callback during a frame.
+        flush,
+
+        // Pixels sent to the display in a frame.
+        pixelsFlushed,
+
+        // Pixels invalidated since the previous frame. Overlapping areas are counted twice.
+        invalidatedArea,
+
+        // Microseconds between main loop iterations.
+        loopPeriod,
+
+        // Microseconds from receiving a message to the end of the next frame that drew anything.
+        messageLatency,
+    };
+
+    static constexpr size_t metricCount = 6;
+
+    // Overlay text is refreshed this often; it invalidates a little of the screen itself.
+    static constexpr uint32_t overlayIntervalMS = 1000;
+
+    // Start recording frames drawn on display.
+    void begin(lv_display_t* display);
+
+    // Call from the flush callback, around sending the pixels.
+    inline void flushStarted() {
+        flushStart = micros();
+    }
+
+    void flushFinished(const lv_area_t* area);
+
+    // Call once per main loop iteration.
+    void loopTick();
+
+    // Call once a message received at receivedMicros has been added to the history and the
+    // scene told about it. Recorded when the next frame finishes.
+    inline void messageAdded(uint32_t receivedMicros) {
+        messageReceived = receivedMicros;
+        messagePending = true;
+    }
+
+    // Show or hide the overlay on the top layer.
+    void showOverlay(bool show);
+
+    inline bool isOverlayShown() const {
+        return overlay != nullptr;
+    }
+
+    // Call often, for example in loop(). Refreshes the overlay.
+    void update();
+
+    const Histogram& histogram(Metric metric) const {
+        return histograms[uint8_t(metric)];
+    }
+
+    // One row per metric: name, count, min, mean, p50, p90, p99, max, then the bucket counts.
+    void printCsv(Print& out) const;
+
+    void reset();
+
+private:
+    static void displayEvent(lv_event_t* e);
+
+    // A refresh finished; record it if it drew anything.
+    void frameFinished();
+
+    static const char* metricName(Metric metric);
+
+private:
+    Histogram histograms[metricCount];
+
+    // Current frame.
+    uint32_t refreshStart = 0;
+    uint32_t frameFlushMicros = 0;
+    uint32_t framePixels = 0;
+    uint32_t pendingInvalidated = 0;
+    uint32_t flushStart = 0;
+
+    uint32_t lastLoop = 0;
+    bool looped = false;
+
+    uint32_t messageReceived = 0;
+    bool messagePending = false;
+
+    lv_obj_t* overlay = nullptr;
+    uint32_t lastOverlayUpdate = 0;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Fixed-size histogram with power-of-two buckets, for timing and size statistics that can
+// range over several orders of magnitude. Bucket 0 counts 0 and 1; bucket i counts values
+// from 2^i to 2^(i+1) - 1. The last bucket also counts anything larger.
+struct Histogram {
+    static constexpr size_t bucketCount = 24;
+
+    void add(uint32_t value) {
+        buckets[bucketFor(value)]++;
+
+        if (count == 0 || value < minimum) {
+            minimum = value;
+        }
+
+        if (value > maximum) {
+            maximum = value;
+        }
+
+        count++;
+        total += value;
+    }
+
+    void reset() {
+        *this = Histogram();
+    }
+
+    static size_t bucketFor(uint32_t value) {
+        size_t bucket = 0;
+
+        while (value > 1 && bucket < bucketCount - 1) {
+            value >>= 1;
+            bucket++;
+        }
+
+        return bucket;
+    }
+
+    // Smallest value counted in a bucket.
+    static inline uint32_t bucketLow(size_t bucket) {
+        return (bucket == 0) ? 0 : (1UL << bucket);
+    }
+
+    inline uint32_t mean() const {
+        return (count == 0) ? 0 : total / count;
+    }
+
+    // Upper bound of the bucket holding the given percentile (0-100) of the samples.
+    uint32_t percentile(uint8_t percent) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        const uint32_t rank = (count * percent + 99) / 100;
+        uint32_t seen = 0;
+
+        for (size_t i = 0; i < bucketCount; i++) {
+            seen += buckets[i];
+
+            if (seen >= rank && seen > 0) {
+                return (i == bucketCount - 1) ? maximum : min(maximum, bucketLow(i + 1) - 1);
+            }
+        }
+
+        return maximum;
+    }
+
+    uint32_t buckets[bucketCount] = {0};
+    uint32_t count = 0;
+    uint32_t minimum = 0;
+    uint32_t maximum = 0;
+    uint64_t total = 0;
+};
@@ -0,0 +1,999 @@
+#include "HistoryJournal.h"
+#include "Crc32.h"
+#include "SchemaMigration.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+namespace {
+    // Version 1 layouts.
+    struct MessagePayloadHeaderV1 {
+        Message::Sender sender;
+        uint16_t sequence;
+    } __attribute__((packed));
+
+    struct SequenceStatePayloadV1 {
+        uint16_t nextSequence;
+        uint16_t receivedHighWater;
+    } __attribute__((packed));
+
+    // Version 2 added message ids, timestamps and delivery status.
+    bool migrateRecordToVersion2(uint8_t& type, uint8_t* data, uint16_t& length, uint16_t capacity) {
+        switch (HistoryJournal::RecordType(type)) {
+            case HistoryJournal::RecordType::message: {
+                MessagePayloadHeaderV1 old;
+
+                if (length < sizeof(old)) {
+                    return false;
+                }
+
+                memcpy(&old, data, sizeof(old));
+
+                // Messages were only stored once sent. The id high bits and timestamp are 0 (unknown),
+                // a single byte each.
+                const Message::Status status = (old.sender == Message::Sender::me) ? Message::Status::sent : Message::Status::acked;
+                HistoryJournal::MessagePayloadHeader header = {old.sender, old.sequence, Message::withStatus(0, status)};
+
+                const size_t prefixLength = sizeof(header) + 2;
+                const size_t textLength = length - sizeof(old);
+
+                if (prefixLength + textLength > capacity) {
+                    return false;
+                }
+
+                memmove(data + prefixLength, data + sizeof(old), textLength);
+                memcpy(data, &header, sizeof(header));
+                data[sizeof(header)] = 0;
+                data[sizeof(header) + 1] = 0;
+                length = prefixLength + textLength;
+                return true;
+            }
+
+            case HistoryJournal::RecordType::sequenceState: {
+                SequenceStatePayloadV1 old;
+
+                if (length != sizeof(old)) {
+                    return false;
+                }
+
+                memcpy(&old, data, sizeof(old));
+
+                HistoryJournal::SequenceStatePayload state = {old.nextSequence, old.receivedHighWater, 0};
+                memcpy(data, &state, sizeof(state));
+                length = sizeof(state);
+                return true;
+            }
+
+            default:
+                return true;
+        }
+    }
+}
+
+// Journal upgrades, one per version change. See SchemaMigration.
+static const SchemaMigration::Step journalMigrationSteps[] = {
+    {1, migrateRecordToVersion2},
+    {0, nullptr}
+};
+
+static const SchemaMigration journalMigration(journalMigrationSteps, HistoryJournal::currentVersion);
+
+struct HistoryJournal::ReadBuffer {
+    uint8_t bytes[loadBufferSize];
+
+    // Journal offset of bytes[0], and the unread bytes in the buffer.
+    uint32_t offset = 0;
+    size_t start = 0;
+    size_t end = 0;
+
+    // The file must be positioned at offset.
+    explicit ReadBuffer(uint32_t at) : offset(at) {}
+
+    // Journal offset of the next unread byte.
+    inline uint32_t position() const {
+        return offset + start;
+    }
+
+    // Buffer at least length bytes, unless the journal ends first. Returns the bytes available.
+    size_t fill(StorageFile* f, size_t length) {
+        if (end - start >= length) {
+            return end - start;
+        }
+
+        memmove(bytes, bytes + start, end - start);
+        offset += start;
+        end -= start;
+        start = 0;
+
+        const int read = f->read(bytes + end, sizeof(bytes) - end);
+        if (read > 0) {
+            end += read;
+        }
+
+        return end - start;
+    }
+};
+
+bool HistoryJournal::exists() {
+    return storage.exists(filename) || storage.exists(tempFilename);
+}
+
+bool HistoryJournal::openJournal() {
+    if (fileOpen) {
+        storage.close(file);
+        storage.close(indexFile);
+        fileOpen = false;
+    }
+
+    file = storage.open(filename, Storage::Mode::readWrite);
+    if (file == nullptr) {
+        LOGFMT("Failed to open %s\n", filename);
+        return false;
+    }
+
+    indexFile = storage.open(indexFilename, Storage::Mode::readWrite);
+    if (indexFile == nullptr) {
+        LOGFMT("Failed to open %s\n", indexFilename);
+        storage.close(file);
+        return false;
+    }
+
+    fileOpen = true;
+
+    // New (or torn before the header was complete); start it over.
+    if (file->size() < sizeof(FileHeader)) {
+        FileHeader header = {magic, currentVersion};
+
+        if (!file->truncate(0) || file->write(&header, sizeof(header)) != sizeof(header) || !file->sync() ||
+            !indexFile->truncate(0) || !indexFile->sync()) 
+        {
+            LOGFMT("Failed to write %s header\n", filename);
+            storage.close(file);
+            storage.close(indexFile);
+            fileOpen = false;
+            return false;
+        }
+
+        recordCount = 0;
+        messageCount = 0;
+    }
+
+    return true;
+}
+
+bool HistoryJournal::writeRecord(StorageFile* f, RecordType type, const void* payload, uint16_t length) {
+    if (length > maxPayloadLength) {
+        return false;
+    }
+
+    uint8_t record[maxRecordLength];
+
+    RecordHeader header;
+    header.length = length;
+    header.type = type;
+    header.crc = Crc32::update(Crc32::compute(&header.type, sizeof(header.type)), payload, length);
+
+    memcpy(record, &header, sizeof(header));
+    if (length > 0) {
+        memcpy(record + sizeof(header), payload, length);
+    }
+
+    const size_t recordLength = sizeof(header) + length;
+    return f->write(record, recordLength) == recordLength;
+}
+
+bool HistoryJournal::writeMessageRecord(StorageFile* f, const MessageView& msg, size_t position, uint32_t previousTimestamp) {
+    uint8_t payload[maxPayloadLength];
+
+    MessagePayloadHeader header = {msg.sender, msg.sequence, msg.flags};
+    memcpy(payload, &header, sizeof(header));
+    size_t length = sizeof(header);
+
+    length += Varint::write(payload + length, msg.id >> 16);
+
+    const uint32_t base = (position % timestampKeyInterval == 0) ? 0 : previousTimestamp;
+    length += Varint::write(payload + length, Varint::zigzag(int32_t(msg.timestamp - base)));
+
+    memcpy(payload + length, msg.text, msg.length);
+    length += msg.length;
+
+    return writeRecord(f, RecordType::message, payload, length);
+}
+
+bool HistoryJournal::decodeMessage(uint8_t* payload, uint16_t length, size_t position, uint32_t previousTimestamp, MessageView& msg) {
+    MessagePayloadHeader header;
+
+    if (length < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, payload, sizeof(header));
+
+    if (header.sender != Message::Sender::me && header.sender != Message::Sender::them) {
+        return false;
+    }
+
+    const uint8_t* p = payload + sizeof(header);
+    const uint8_t* end = payload + length;
+    uint32_t idHigh = 0;
+    uint32_t timestamp = 0;
+
+    if (!Varint::read(p, end, idHigh) || !Varint::read(p, end, timestamp)) {
+        return false;
+    }
+
+    const uint32_t base = (position % timestampKeyInterval == 0) ? 0 : previousTimestamp;
+
+    msg.sender = header.sender;
+    msg.id = (idHigh << 16) | header.sequence;
+    msg.sequence = header.sequence;
+    msg.flags = header.flags;
+    msg.timestamp = base + uint32_t(Varint::unzigzag(timestamp));
+    msg.length = end - p;
+
+    // Null terminate the text in place.
+    payload[length] = 0;
+    msg.text = (const char*)p;
+
+    return true;
+}
+
+bool HistoryJournal::writeSequenceStateRecord(StorageFile* f, uint32_t nextId, uint32_t receivedHighWater, uint32_t ackedHighWater) {
+    SequenceStatePayload payload = {nextId, receivedHighWater, ackedHighWater};
+    return writeRecord(f, RecordType::sequenceState, &payload, sizeof(payload));
+}
+
+bool HistoryJournal::appendIndexEntry(StorageFile* f, uint32_t offset) {
+    f->seekEnd();
+    return f->write(&offset, sizeof(offset)) == sizeof(offset);
+}
+
+bool HistoryJournal::readRecord(RecordHeader& header, uint8_t* payload) {
+    if (file->read(&header, sizeof(header)) != sizeof(header) || header.length > maxPayloadLength || 
+        file->read(payload, header.length) != header.length) 
+    {
+        return false;
+    }
+
+    const uint32_t crc = Crc32::update(Crc32::compute(&header.type, sizeof(header.type)), payload, header.length);
+    return crc == header.crc;
+}
+
+bool HistoryJournal::readRecord(ReadBuffer& buffer, RecordHeader& header, uint8_t* payload) {
+    if (buffer.fill(file, sizeof(header)) < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, buffer.bytes + buffer.start, sizeof(header));
+
+    const size_t length = sizeof(header) + header.length;
+    if (header.length > maxPayloadLength || buffer.fill(file, length) < length) {
+        return false;
+    }
+
+    memcpy(payload, buffer.bytes + buffer.start + sizeof(header), header.length);
+    buffer.start += length;
+
+    const uint32_t crc = Crc32::update(Crc32::compute(&header.type, sizeof(header.type)), payload, header.length);
+    return crc == header.crc;
+}
+
+bool HistoryJournal::verifyIndex(uint32_t lastMessageOffset) {
+    bool valid = (indexFile->size() == messageCount * sizeof(uint32_t));
+
+    if (valid && messageCount > 0) {
+        uint32_t offset = 0;
+        indexFile->seek((messageCount - 1) * sizeof(uint32_t));
+        valid = (indexFile->read(&offset, sizeof(offset)) == sizeof(offset)) && offset == lastMessageOffset;
+    }
+
+    if (valid) {
+        return true;
+    }
+
+    LOGLN("Message index doesn't match the journal, rebuilding");
+    return rebuildIndex();
+}
+
+bool HistoryJournal::rebuildIndex() {
+    if (!indexFile->truncate(0)) {
+        return false;
+    }
+
+    uint8_t payload[maxPayloadLength];
+    RecordHeader header;
+    bool success = true;
+
+    file->seek(sizeof(FileHeader));
+
+    while (true) {
+        const uint32_t offset = file->position();
+
+        if (!readRecord(header, payload)) {
+            break;
+        }
+
+        if (header.type == RecordType::clear) {
+            success = indexFile->truncate(0) && success;
+        }
+        else if (header.type == RecordType::message) {
+            success = appendIndexEntry(indexFile, offset) && success;
+        }
+    }
+
+    success = indexFile->sync() && success;
+    file->seekEnd();
+
+    return success;
+}
+
+size_t HistoryJournal::readMessages(size_t first, size_t count, MessageArena& out) {
+    if (!fileOpen || first + count > messageCount) {
+        return 0;
+    }
+
+    return readIndexed(first, count, out, false);
+}
+
+size_t HistoryJournal::readNewest(size_t maxCount, MessageArena& out) {
+    out.clear();
+
+    if (!fileOpen) {
+        return 0;
+    }
+
+    const size_t indexed = indexFile->size() / sizeof(uint32_t);
+    const size_t count = (maxCount < indexed) ? maxCount : indexed;
+
+    return readIndexed(indexed - count, count, out, true);
+}
+
+size_t HistoryJournal::readIndexed(size_t first, size_t count, MessageArena& out, bool evict) {
+    // Timestamps are relative to the previous message, so start at the last full one.
+    const size_t start = first - (first % timestampKeyInterval);
+
+    // All the offsets in one read.
+    uint32_t offsets[MessageHistory::pageSize];
+    uint8_t payload[maxPayloadLength + 1];
+    RecordHeader header;
+    MessageView msg;
+    uint32_t previousTimestamp = 0;
+    bool success = true;
+    size_t done = 0;
+    size_t position = start;
+
+    while (position < first + count && success) {
+        size_t chunk = first + count - position;
+        if (chunk > MessageHistory::pageSize) {
+            chunk = MessageHistory::pageSize;
+        }
+
+        indexFile->seek(position * sizeof(uint32_t));
+        if (indexFile->read(offsets, chunk * sizeof(uint32_t)) != int(chunk * sizeof(uint32_t))) {
+            success = false;
+            break;
+        }
+
+        for (size_t i = 0; i < chunk; i++, position++) {
+            file->seek(offsets[i]);
+
+            if (!readRecord(header, payload) || header.type != RecordType::message || 
+                !decodeMessage(payload, header.length, position, previousTimestamp, msg)) 
+            {
+                success = false;
+                break;
+            }
+
+            previousTimestamp = msg.timestamp;
+
+            if (position < first) {
+                continue;
+            }
+
+            // Stop once the arena is full.
+            if (!out.push(msg.sender, msg.id, msg.flags, msg.timestamp, msg.text, msg.length, evict)) {
+                success = false;
+                break;
+            }
+
+            done++;
+        }
+    }
+
+    // Back to the end for the next append.
+    file->seekEnd();
+    indexFile->seekEnd();
+
+    return done;
+}
+
+void HistoryJournal::noteMessageWritten(Message::Sender sender, uint32_t id) {
+    // Mirror what replay does, so we only write a sequence state record when replay
+    // wouldn't arrive at the same state by itself.
+    if (id == 0) {
+        return;
+    }
+
+    if (sender == Message::Sender::me) {
+        uint32_t next = id + 1;
+        if (Message::sequenceOf(next) == 0) {
+            next++;
+        }
+
+        if (Message::isIdAfter(next, savedNextId)) {
+            savedNextId = next;
+        }
+    }
+    else if (savedReceivedHighWater == 0 || Message::isIdAfter(id, savedReceivedHighWater)) {
+        savedReceivedHighWater = id;
+    }
+}
+
+bool HistoryJournal::load(MessageHistory& history) {
+    if (!beginLoad(history)) {
+        return false;
+    }
+
+    while (!continueLoad(history, UINT32_MAX)) {
+    }
+
+    return true;
+}
+
+bool HistoryJournal::beginLoad(MessageHistory& history) {
+    abortCompaction();
+    loading = false;
+
+    // A compaction was interrupted after the old journal was removed; the copy is complete.
+    // If both exist, the compaction never finished and the copy is incomplete.
+    if (!storage.exists(filename) && storage.exists(tempFilename)) {
+        LOGLN("Recovering compacted message journal");
+        storage.rename(tempFilename, filename);
+    }
+    else if (storage.exists(tempFilename)) {
+        storage.remove(tempFilename);
+    }
+
+    if (storage.exists(tempIndexFilename)) {
+        storage.remove(tempIndexFilename);
+    }
+
+    if (!openJournal()) {
+        return false;
+    }
+
+    file->seek(0);
+
+    FileHeader fileHeader;
+    if (file->read(&fileHeader, sizeof(fileHeader)) != sizeof(fileHeader) || fileHeader.magic != magic) {
+        LOGFMT("Unrecognized %s header\n", filename);
+        close();
+        return false;
+    }
+
+    if (fileHeader.version != currentVersion) {
+        if (!journalMigration.canMigrate(fileHeader.version) || !migrate(fileHeader.version) || !openJournal()) {
+            LOGFMT("Can't read %s version %u\n", filename, fileHeader.version);
+            close();
+            return false;
+        }
+
+        file->seek(sizeof(FileHeader));
+    }
+
+    recordCount = 0;
+    messageCount = 0;
+    savedNextId = history.nextSentId();
+    savedReceivedHighWater = history.receivedHighWaterId();
+    savedAckedHighWater = history.ackedHighWaterId();
+    savedTimestamp = 0;
+
+    loading = true;
+    loadOffset = file->position();
+    loadEnd = file->size();
+    loadLastMessageOffset = 0;
+
+    return true;
+}
+
+bool HistoryJournal::continueLoad(MessageHistory& history, uint32_t budgetMS) {
+    if (!loading) {
+        return true;
+    }
+
+    const uint32_t start = millis();
+
+    // Picks up where the last slice left off; anything it buffered past that is read again.
+    file->seek(loadOffset);
+    ReadBuffer buffer(loadOffset);
+
+    uint8_t payload[maxPayloadLength + 1];
+    bool torn = false;
+
+    while (loadOffset < loadEnd) {
+        RecordHeader header;
+
+        if (!readRecord(buffer, header, payload) || !replayRecord(history, header, payload, loadOffset)) {
+            torn = true;
+            break;
+        }
+
+        recordCount++;
+        loadOffset = buffer.position();
+
+        if (millis() - start >= budgetMS) {
+            return false;
+        }
+    }
+
+    finishLoad(history, torn);
+    return true;
+}
+
+bool HistoryJournal::replayRecord(MessageHistory& history, const RecordHeader& header, uint8_t* payload, uint32_t offset) {
+    switch (header.type) {
+        case RecordType::message: {
+            MessageView msg;
+
+            if (!decodeMessage(payload, header.length, messageCount, savedTimestamp, msg)) {
+                return false;
+            }
+
+            history.restoreMessage(msg.sender, msg.text, msg.length, msg.id, msg.flags, msg.timestamp);
+            noteMessageWritten(msg.sender, msg.id);
+            savedTimestamp = msg.timestamp;
+
+            loadLastMessageOffset = offset;
+            messageCount++;
+
+            if (savedNextId != history.nextSentId()) {
+                history.setIdState(savedNextId, history.receivedHighWaterId(), history.ackedHighWaterId());
+            }
+            return true;
+        }
+
+        case RecordType::sequenceState: {
+            SequenceStatePayload state;
+
+            if (header.length != sizeof(state)) {
+                return false;
+            }
+
+            memcpy(&state, payload, sizeof(state));
+            history.setIdState(state.nextId, state.receivedHighWater, state.ackedHighWater);
+            savedNextId = history.nextSentId();
+            savedReceivedHighWater = history.receivedHighWaterId();
+            savedAckedHighWater = history.ackedHighWaterId();
+            return true;
+        }
+
+        case RecordType::status: {
+            StatusPayload status;
+
+            if (header.length != sizeof(status)) {
+                return false;
+            }
+
+            // Only recent messages change status, so they're still in RAM.
+            memcpy(&status, payload, sizeof(status));
+            (void)history.setStatus(status.id, Message::statusOf(status.flags));
+            return true;
+        }
+
+        case RecordType::clear:
+            history.clear();
+            messageCount = 0;
+            return true;
+
+        default:
+            // Unknown record; treat it like damage.
+            return false;
+    }
+}
+
+void HistoryJournal::finishLoad(MessageHistory& history, bool torn) {
+    loading = false;
+
+    if (torn) {
+        journalStats.truncatedBytes = file->size() - loadOffset;
+        LOGFMT("Message journal damaged after %u records, truncating %u bytes\n", recordCount, journalStats.truncatedBytes);
+
+        if (!file->truncate(loadOffset) || !file->sync()) {
+            LOGLN("Failed to truncate message journal");
+        }
+    }
+
+    if (!verifyIndex(loadLastMessageOffset)) {
+        LOGLN("Failed to rebuild message index");
+    }
+
+    file->seekEnd();
+    indexFile->seekEnd();
+
+    savedAdded = history.totalAdded();
+    savedCleared = history.totalCleared();
+    savedNextId = history.nextSentId();
+    savedReceivedHighWater = history.receivedHighWaterId();
+    savedAckedHighWater = history.ackedHighWaterId();
+    savedStatusChanges = history.totalStatusChanges();
+
+    LOGFMT("Message journal loaded: %u records, %u messages\n", recordCount, history.size());
+}
+
+bool HistoryJournal::migrate(uint8_t version) {
+    LOGFMT("Migrating %s from version %u to %u\n", filename, version, currentVersion);
+
+    StorageFile* out = storage.open(tempFilename, Storage::Mode::truncate);
+    if (out == nullptr) {
+        LOGFMT("Failed to create %s\n", tempFilename);
+        return false;
+    }
+
+    FileHeader fileHeader = {magic, currentVersion};
+    bool success = out->write(&fileHeader, sizeof(fileHeader)) == sizeof(fileHeader);
+
+    uint8_t payload[maxPayloadLength];
+    uint32_t migrated = 0;
+    uint32_t dropped = 0;
+    RecordHeader header;
+
+    // A damaged tail ends the migration just like it ends a load.
+    while (success && readRecord(header, payload)) {
+        uint8_t type = (uint8_t)header.type;
+        uint16_t length = header.length;
+
+        if (!journalMigration.migrateRecord(version, type, payload, length, maxPayloadLength)) {
+            dropped++;
+            continue;
+        }
+
+        success = writeRecord(out, (RecordType)type, payload, length);
+        migrated++;
+    }
+
+    success = success && out->sync();
+    storage.close(out);
+
+    if (!success) {
+        LOGLN("Failed to migrate message journal");
+        storage.remove(tempFilename);
+        return false;
+    }
+
+    storage.close(file);
+    storage.close(indexFile);
+    fileOpen = false;
+
+    // Same order as compaction: if we're interrupted after the old journal is removed,
+    // load() picks up the complete copy. The index is rebuilt on load.
+    if (!storage.remove(filename) || !storage.rename(tempFilename, filename)) {
+        LOGLN("Failed to replace message journal");
+        return false;
+    }
+
+    storage.remove(indexFilename);
+
+    LOGFMT("Message journal migrated: %u records, %u dropped\n", migrated, dropped);
+
+    return true;
+}
+
+bool HistoryJournal::save(const MessageHistory& history) {
+    if (!fileOpen || loading) {
+        LOGLN("Failed to save message history: journal not open");
+        return false;
+    }
+
+    const uint32_t start = micros();
+    const uint32_t positionBefore = file->position();
+    bool success = true;
+    bool wrote = false;
+
+    if (history.totalCleared() != savedCleared) {
+        success = writeRecord(file, RecordType::clear, nullptr, 0) && success;
+        success = indexFile->truncate(0) && success;
+        savedCleared = history.totalCleared();
+        messageCount = 0;
+        recordCount++;
+        wrote = true;
+    }
+
+    // New messages can only be in RAM; anything older is already in the journal.
+    uint32_t added = history.totalAdded() - savedAdded;
+    if (added > history.residentCount()) {
+        LOGFMT("%u messages were never saved\n", added - history.residentCount());
+        added = history.residentCount();
+    }
+
+    for (size_t i = history.size() - added; i < history.size(); i++) {
+        MessageView msg = history.getMessage(i);
+        const uint32_t offset = file->position();
+
+        success = writeMessageRecord(file, msg, messageCount, savedTimestamp) && success;
+        success = appendIndexEntry(indexFile, offset) && success;
+        noteMessageWritten(msg.sender, msg.id);
+        savedTimestamp = msg.timestamp;
+        messageCount++;
+        recordCount++;
+        wrote = true;
+    }
+
+    savedAdded = history.totalAdded();
+
+    // Messages that changed status after they were written. Only the last few changes are kept;
+    // the acked high water mark still covers older ones once the paired device has them.
+    uint32_t changes = history.totalStatusChanges() - savedStatusChanges;
+    if (changes > MessageHistory::maxStatusChanges) {
+        LOGFMT("%u message status changes were never saved\n", changes - MessageHistory::maxStatusChanges);
+        changes = MessageHistory::maxStatusChanges;
+    }
+
+    for (uint32_t c = history.totalStatusChanges() - changes; c != history.totalStatusChanges(); c++) {
+        const uint32_t id = history.statusChangeId(c);
+        const int32_t index = history.indexOf(Message::Sender::me, id, MessageHistory::maxResidentMessages);
+
+        // Skip messages that were just written; their record has the new status.
+        if (index < 0 || size_t(index) >= history.size() - added) {
+            continue;
+        }
+
+        StatusPayload status = {id, history.getMessage(index).flags};
+        success = writeRecord(file, RecordType::status, &status, sizeof(status)) && success;
+        recordCount++;
+        wrote = true;
+    }
+
+    savedStatusChanges = history.totalStatusChanges();
+
+    if (history.nextSentId() != savedNextId || history.receivedHighWaterId() != savedReceivedHighWater ||
+        history.ackedHighWaterId() != savedAckedHighWater) 
+    {
+        savedNextId = history.nextSentId();
+        savedReceivedHighWater = history.receivedHighWaterId();
+        savedAckedHighWater = history.ackedHighWaterId();
+        success = writeSequenceStateRecord(file, savedNextId, savedReceivedHighWater, savedAckedHighWater) && success;
+        recordCount++;
+        wrote = true;
+    }
+
+    if (!wrote) {
+        return true;
+    }
+
+    success = file->sync() && success;
+    success = indexFile->sync() && success;
+
+    const uint32_t elapsed = micros() - start;
+    journalStats.appends++;
+    journalStats.appendedBytes += file->position() - positionBefore;
+    journalStats.lastAppendMicros = elapsed;
+    if (elapsed > journalStats.maxAppendMicros) {
+        journalStats.maxAppendMicros = elapsed;
+    }
+
+    lastAppendTimestamp = millis();
+
+    if (!success) {
+        LOGLN("Failed to append to message journal");
+    }
+
+    LOGFMT("Message journal append: %u bytes, %u us\n", file->position() - positionBefore, elapsed);
+
+    return success;
+}
+
+void HistoryJournal::close() {
+    abortCompaction();
+    loading = false;
+
+    if (fileOpen) {
+        storage.close(file);
+        storage.close(indexFile);
+        fileOpen = false;
+    }
+
+    recordCount = 0;
+    messageCount = 0;
+}
+
+bool HistoryJournal::remove() {
+    close();
+
+    storage.remove(indexFilename);
+    return storage.remove(filename);
+}
+
+bool HistoryJournal::isCompactionDue() const {
+    // A compact journal has one record per message, plus the sequence state. Compaction copies
+    // every message, so wait for slack in proportion, or long histories would be copied over
+    // and over for a handful of records.
+    const uint32_t compactRecords = messageCount + 1;
+    const uint32_t slack = recordCount - compactRecords;
+    return recordCount > compactRecords && slack > compactionSlackRecords && slack > messageCount;
+}
+
+bool HistoryJournal::beginCompaction(const MessageHistory& history) {
+    if (storage.exists(tempFilename)) {
+        storage.remove(tempFilename);
+    }
+
+    compactionFile = storage.open(tempFilename, Storage::Mode::truncate);
+    if (compactionFile == nullptr) {
+        LOGFMT("Failed to create %s\n", tempFilename);
+        return false;
+    }
+
+    compactionIndexFile = storage.open(tempIndexFilename, Storage::Mode::truncate);
+    if (compactionIndexFile == nullptr) {
+        LOGFMT("Failed to create %s\n", tempIndexFilename);
+        storage.close(compactionFile);
+        storage.remove(tempFilename);
+        return false;
+    }
+
+    FileHeader header = {magic, currentVersion};
+
+    compactionNextId = history.nextSentId();
+    compactionReceivedHighWater = history.receivedHighWaterId();
+    compactionAckedHighWater = history.ackedHighWaterId();
+    compactionStatusChanges = history.totalStatusChanges();
+    compactionTimestamp = 0;
+
+    if (compactionFile->write(&header, sizeof(header)) != sizeof(header) ||
+        !writeSequenceStateRecord(compactionFile, compactionNextId, compactionReceivedHighWater, compactionAckedHighWater)) 
+    {
+        LOGLN("Failed to start message journal compaction");
+        storage.close(compactionFile);
+        storage.close(compactionIndexFile);
+        storage.remove(tempFilename);
+        storage.remove(tempIndexFilename);
+        return false;
+    }
+
+    compacting = true;
+    compactionIndex = 0;
+    compactionClearedSnapshot = history.totalCleared();
+    compactionStartTimestamp = millis();
+
+    return true;
+}
+
+bool HistoryJournal::stepCompaction(const MessageHistory& history) {
+    const uint32_t offset = compactionFile->position();
+    const MessageView msg = history.getMessage(compactionIndex);
+
+    if (!writeMessageRecord(compactionFile, msg, compactionIndex, compactionTimestamp) ||
+        !appendIndexEntry(compactionIndexFile, offset)) 
+    {
+        LOGLN("Failed to write compacted message");
+        return false;
+    }
+
+    compactionTimestamp = msg.timestamp;
+
+    compactionIndex++;
+    return true;
+}
+
+bool HistoryJournal::finishCompaction(const MessageHistory& history) {
+    if (!compactionFile->sync() || !compactionIndexFile->sync()) {
+        LOGLN("Failed to sync compacted message journal");
+        return false;
+    }
+
+    storage.close(compactionFile);
+    storage.close(compactionIndexFile);
+    compacting = false;
+
+    if (fileOpen) {
+        storage.close(file);
+        storage.close(indexFile);
+        fileOpen = false;
+    }
+
+    // If we're interrupted between these two, load() picks up the complete copy.
+    if ((storage.exists(filename) && !storage.remove(filename)) || !storage.rename(tempFilename, filename)) {
+        LOGLN("Failed to replace message journal");
+    }
+
+    // If this fails, load() rebuilds the index.
+    if ((storage.exists(indexFilename) && !storage.remove(indexFilename)) || !storage.rename(tempIndexFilename, indexFilename)) {
+        LOGLN("Failed to replace message index");
+    }
+
+    if (!openJournal()) {
+        return false;
+    }
+
+    file->seekEnd();
+    indexFile->seekEnd();
+
+    recordCount = history.size() + 1;
+    messageCount = history.size();
+
+    // The compacted journal matches the snapshot; anything that changed since is appended by the next save().
+    // Messages added during compaction were copied too.
+    savedAdded = history.totalAdded();
+    savedCleared = compactionClearedSnapshot;
+    savedNextId = compactionNextId;
+    savedReceivedHighWater = compactionReceivedHighWater;
+    savedAckedHighWater = compactionAckedHighWater;
+    savedStatusChanges = compactionStatusChanges;
+    savedTimestamp = compactionTimestamp;
+
+    journalStats.compactions++;
+    journalStats.lastCompactionMS = millis() - compactionStartTimestamp;
+
+    LOGFMT("Message journal compacted: %u records, %u ms\n", recordCount, journalStats.lastCompactionMS);
+
+    return true;
+}
+
+void HistoryJournal::abortCompaction() {
+    if (!compacting) {
+        return;
+    }
+
+    storage.close(compactionFile);
+    storage.close(compactionIndexFile);
+    storage.remove(tempFilename);
+    storage.remove(tempIndexFilename);
+    compacting = false;
+}
+
+void HistoryJournal::update(const MessageHistory& history) {
+    if (!fileOpen || loading) {
+        return;
+    }
+
+    if (!compacting) {
+        if (isCompactionDue() && (millis() - lastAppendTimestamp) >= compactionIdleMS) {
+            (void)beginCompaction(history);
+        }
+
+        return;
+    }
+
+    // The history was cleared under us; start over later. New messages are simply copied
+    // along with the rest, so a long compaction can't be starved by a busy conversation.
+    if (history.totalCleared() != compactionClearedSnapshot) {
+        LOGLN("History changed, restarting message journal compaction");
+        abortCompaction();
+        return;
+    }
+
+    // One record per call, so the UI stays responsive.
+    if (compactionIndex < history.size()) {
+        if (!stepCompaction(history)) {
+            abortCompaction();
+        }
+
+        return;
+    }
+
+    if (!finishCompaction(history)) {
+        abortCompaction();
+    }
+}
+
+bool HistoryJournal::rewrite(const MessageHistory& history) {
+    abortCompaction();
+
+    if (!beginCompaction(history)) {
+        return false;
+    }
+
+    while (compactionIndex < history.size()) {
+        if (!stepCompaction(history)) {
+            abortCompaction();
+            return false;
+        }
+    }
+
+    if (!finishCompaction(history)) {
+        abortCompaction();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <Arduino.h>
+#include "MessageHistory.h"
+#include "Storage/Storage.h"
+#include "Varint.h"
+
+// Append-only message history file.
+//
+// Instead of rewriting the whole history on every change, each change is appended as a
+// small self-checking record with a single write. On load the records are replayed; a
+// record cut short by a power loss or reset fails its length or CRC check, and the file is
+// truncated back to the last good record.
+//
+// The journal keeps every message since the history was last cleared, and doubles as the
+// history's archive: an index file holds the offset of each message record, so any message
+// can be read back with two seeks. The index can always be rebuilt from the journal, so it's
+// checked on load and rebuilt if it doesn't match (e.g. after a power loss).
+//
+// Records that no longer matter (cleared messages, outdated sequence state) pile up over time,
+// so once there are enough of them the journal is compacted in the background: the live
+// history is written to a temporary file one record per update(), which then replaces the journal.
+//
+// A journal written by older firmware is migrated to the current version on load, a record at
+// a time, into the compaction file, which then replaces the journal. Record framing (RecordHeader)
+// is the same in every version; only payloads change.
+//
+// Journal file format:
+// FileHeader
+// RecordHeader + payload, repeated
+//
+// Record payloads:
+// message: sender (1 byte), sequence number (2 bytes), flags (1 byte), high 16 bits of the id (varint),
+//          timestamp (zigzag varint), text (remaining bytes, not null terminated)
+// sequenceState: next outgoing id, highest received id, highest acked id (4 bytes each)
+// status: message id (4 bytes), flags (1 byte); one of our messages changed status after it was written
+// clear: empty
+//
+// Message timestamps are stored as the difference from the previous message, which usually
+// fits in a byte or two. Every timestampKeyInterval-th message since the last clear stores the
+// full timestamp instead, so messages can still be read back from the middle of the journal.
+// Overhead per message record is 7 bytes of header, plus 6-8 bytes of message header for
+// typical messages (version 1: 3 bytes, no id high bits, flags or timestamp).
+//
+// Loading replays every record, so it takes longer the longer the history. It can be done a
+// slice at a time (beginLoad(), continueLoad()), e.g. after the first frame, with the newest
+// messages read straight from the index (readNewest()) to show in the meantime.
+//
+// Index file format:
+// Journal offset of each message record since the last clear (4 bytes each), oldest first.
+class HistoryJournal: public MessageArchive {
+public:
+    static constexpr uint32_t magic = 0x4C4E4A48; // "HJNL"
+    static constexpr uint8_t currentVersion = 2;
+
+    // A page of history is read with at most this many records before it.
+    static constexpr size_t timestampKeyInterval = MessageHistory::pageSize;
+
+    // Compact once the journal holds this many more records than the history it describes,
+    // and more of them than messages, so the cost of copying every message is spread out.
+    static constexpr uint32_t compactionSlackRecords = 32;
+
+    // Compaction only starts once appends have been quiet for this long,
+    // so it doesn't compete with a conversation in progress.
+    static constexpr uint32_t compactionIdleMS = 3 * 1000;
+
+    enum class RecordType: uint8_t {
+        message = 1,
+        sequenceState,
+        clear,
+        status,
+    };
+
+    struct FileHeader {
+        uint32_t magic;
+        uint8_t version;
+    } __attribute__((packed));
+
+    struct RecordHeader {
+        // Payload length, not including this header.
+        uint16_t length;
+
+        // CRC-32 of the type byte and the payload.
+        uint32_t crc;
+
+        RecordType type;
+    } __attribute__((packed));
+
+    struct MessagePayloadHeader {
+        Message::Sender sender;
+        uint16_t sequence;
+        uint8_t flags;
+    } __attribute__((packed));
+
+    struct SequenceStatePayload {
+        uint32_t nextId;
+        uint32_t receivedHighWater;
+        uint32_t ackedHighWater;
+    } __attribute__((packed));
+
+    struct StatusPayload {
+        uint32_t id;
+        uint8_t flags;
+    } __attribute__((packed));
+
+    // Header, id high bits and timestamp.
+    static constexpr size_t maxMessagePrefixLength = sizeof(MessagePayloadHeader) + 2 * Varint::maxLength;
+
+    static constexpr size_t maxPayloadLength = maxMessagePrefixLength + Message::maxLength;
+    static constexpr size_t maxRecordLength = sizeof(RecordHeader) + maxPayloadLength;
+
+    // Records are replayed out of reads this large, instead of two small reads per record.
+    static constexpr size_t loadBufferSize = 1024;
+    static_assert(loadBufferSize >= maxRecordLength, "Load buffer must fit the longest record");
+
+    struct Stats {
+        uint32_t appends = 0;
+        uint32_t appendedBytes = 0;
+        uint32_t lastAppendMicros = 0;
+        uint32_t maxAppendMicros = 0;
+        uint32_t compactions = 0;
+        uint32_t lastCompactionMS = 0;
+        uint32_t truncatedBytes = 0;
+    };
+
+public:
+    HistoryJournal(Storage& s, 
+                   const char* journalFilename, 
+                   const char* journalIndexFilename, 
+                   const char* compactionFilename, 
+                   const char* compactionIndexFilename) :
+        storage(s),
+        filename(journalFilename),
+        indexFilename(journalIndexFilename),
+        tempFilename(compactionFilename),
+        tempIndexFilename(compactionIndexFilename)
+    {}
+
+    bool exists();
+
+    // Replay the journal into history. Creates the journal if it doesn't exist.
+    // Returns false if the journal is unreadable.
+    bool load(MessageHistory& history);
+
+    // Start replaying the journal into history, like load(), but leave the records for
+    // continueLoad(). Returns false if the journal is unreadable.
+    bool beginLoad(MessageHistory& history);
+
+    // Replay records for up to budgetMS. Returns true once the load is finished.
+    // Don't change history or save it until then.
+    bool continueLoad(MessageHistory& history, uint32_t budgetMS);
+
+    inline bool isLoading() const {
+        return loading;
+    }
+
+    // Read up to maxCount of the newest messages into out, oldest first, going by the index alone.
+    // Works before the journal is loaded, but the index isn't checked, so use it for display only.
+    // Returns the number of messages read.
+    size_t readNewest(size_t maxCount, MessageArena& out);
+
+    // Append whatever changed in history since the last load() or save().
+    bool save(const MessageHistory& history);
+
+    // Replace the journal with a compact copy of history, all at once.
+    bool rewrite(const MessageHistory& history);
+
+    // Call often, for example in loop(). Runs background compaction.
+    void update(const MessageHistory& history);
+
+    // Close the journal, e.g. before switching to another conversation's files.
+    // Anything not saved is lost; a compaction in progress is abandoned.
+    void close();
+
+    // Delete the journal.
+    bool remove();
+
+    // MessageArchive
+    virtual size_t readMessages(size_t first, size_t maxCount, MessageArena& out) override;
+
+    // Messages added to history since it was last saved.
+    inline uint32_t unsavedMessageCount(const MessageHistory& history) const {
+        return history.totalAdded() - savedAdded;
+    }
+
+    const Stats& stats() const {
+        return journalStats;
+    }
+
+private:
+    // Buffered reader for replaying records; see loadBufferSize.
+    struct ReadBuffer;
+
+    bool openJournal();
+
+    // Check the index against the journal, and rebuild it if it doesn't match.
+    bool verifyIndex(uint32_t lastMessageOffset);
+    bool rebuildIndex();
+
+    bool appendIndexEntry(StorageFile* f, uint32_t offset);
+
+    // Upgrade a journal from an older version. The journal must be open, positioned after its header.
+    bool migrate(uint8_t version);
+
+    // Read and check the record at the current position. Returns false at the end of the journal or on damage.
+    bool readRecord(RecordHeader& header, uint8_t* payload);
+    bool readRecord(ReadBuffer& buffer, RecordHeader& header, uint8_t* payload);
+
+    // Apply one record at offset to history during a load. Returns false if it's malformed.
+    bool replayRecord(MessageHistory& history, const RecordHeader& header, uint8_t* payload, uint32_t offset);
+
+    // Truncate any damage, check the index and get ready to append.
+    void finishLoad(MessageHistory& history, bool torn);
+
+    // Read count messages starting with message number first, dropping the oldest from out if evict is set.
+    size_t readIndexed(size_t first, size_t count, MessageArena& out, bool evict);
+
+    // Write one record with a single write call.
+    static bool writeRecord(StorageFile* f, RecordType type, const void* payload, uint16_t length);
+
+    // position is the message's number since the last clear; previousTimestamp the timestamp of the message before it.
+    bool writeMessageRecord(StorageFile* f, const MessageView& msg, size_t position, uint32_t previousTimestamp);
+    bool writeSequenceStateRecord(StorageFile* f, uint32_t nextId, uint32_t receivedHighWater, uint32_t ackedHighWater);
+
+    // Decode a message record payload into msg. text is null terminated in place, so payload
+    // needs a byte to spare. Returns false if the payload is malformed.
+    static bool decodeMessage(uint8_t* payload, uint16_t length, size_t position, uint32_t previousTimestamp, MessageView& msg);
+
+    // Track the id state that replaying the journal would produce.
+    void noteMessageWritten(Message::Sender sender, uint32_t id);
+
+    // Background compaction steps.
+    bool beginCompaction(const MessageHistory& history);
+    bool stepCompaction(const MessageHistory& history);
+    bool finishCompaction(const MessageHistory& history);
+    void abortCompaction();
+
+    bool isCompactionDue() const;
+
+private:
+    Storage& storage;
+    const char* filename;
+    const char* indexFilename;
+    const char* tempFilename;
+    const char* tempIndexFilename;
+
+    StorageFile* file = nullptr;
+    StorageFile* indexFile = nullptr;
+    bool fileOpen = false;
+
+    // Records currently in the journal.
+    uint32_t recordCount = 0;
+
+    // Messages since the last clear record, i.e. entries in the index.
+    uint32_t messageCount = 0;
+
+    // History state as of the last write, so save() can append just the difference.
+    uint32_t savedAdded = 0;
+    uint32_t savedCleared = 0;
+    uint32_t savedNextId = 1;
+    uint32_t savedReceivedHighWater = 0;
+    uint32_t savedAckedHighWater = 0;
+    uint32_t savedStatusChanges = 0;
+
+    // Timestamp of the newest message in the journal, which the next one is stored relative to.
+    uint32_t savedTimestamp = 0;
+
+    uint32_t lastAppendTimestamp = 0;
+
+    // Load state.
+    bool loading = false;
+    uint32_t loadOffset = 0;
+    uint32_t loadEnd = 0;
+    uint32_t loadLastMessageOffset = 0;
+
+    // Compaction state.
+    bool compacting = false;
+    StorageFile* compactionFile = nullptr;
+    StorageFile* compactionIndexFile = nullptr;
+    size_t compactionIndex = 0;
+    uint32_t compactionClearedSnapshot = 0;
+    uint32_t compactionNextId = 1;
+    uint32_t compactionReceivedHighWater = 0;
+    uint32_t compactionAckedHighWater = 0;
+    uint32_t compactionStatusChanges = 0;
+    uint32_t compactionTimestamp = 0;
+    uint32_t compactionStartTimestamp = 0;
+
+    Stats journalStats;
+};
@@ -0,0 +1,363 @@
+#include "HistorySync.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+void HistorySync::begin(Messenger* m, MessageHistory* h) {
+    messenger = m;
+    history = h;
+}
+
+void HistorySync::reset() {
+    streaming = false;
+    digestSent = false;
+    streamIndex = 0;
+}
+
+uint32_t HistorySync::messageHash(uint16_t sequence, const char* text) {
+    // FNV-1a over the sequence number and the text.
+    uint32_t h = 2166136261u;
+
+    h ^= sequence & 0xFF;
+    h *= 16777619u;
+    h ^= sequence >> 8;
+    h *= 16777619u;
+
+    for (const char* c = text; *c != 0; c++) {
+        h ^= uint8_t(*c);
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+bool HistorySync::isSequenceInRange(uint16_t sequence, uint16_t first, uint16_t last) {
+    return uint16_t(sequence - first) <= uint16_t(last - first);
+}
+
+uint32_t HistorySync::rangeHash(Message::Sender sender, uint16_t first, uint16_t last, bool& complete) const {
+    // Summing the per-message hashes makes the result independent of message order,
+    // so both sides agree even if a synced message was appended out of order.
+    uint32_t sum = 0;
+
+    // Sequence numbers in the window seen so far, and how far back the scan is past it.
+    uint32_t seen = 0;
+    const uint32_t windowSize = uint32_t(uint16_t(last - first)) + 1;
+    const uint32_t full = (windowSize >= 32) ? UINT32_MAX : (1u << windowSize) - 1;
+    size_t pastWindow = 0;
+
+    complete = false;
+
+    for (size_t i = history->size(), scanned = 0; i > 0; i--, scanned++) {
+        if (seen == full) {
+            complete = true;
+            return sum;
+        }
+
+        if (scanned == maxHashScan) {
+            LOGFMT("Hash scan gave up after %u messages\n", scanned);
+            return sum;
+        }
+
+        MessageView msg = history->getMessage(i - 1);
+
+        if (msg.sender != sender || msg.sequence == 0) {
+            continue;
+        }
+
+        if (isSequenceInRange(msg.sequence, first, last)) {
+            const uint32_t bit = 1u << uint16_t(msg.sequence - first);
+
+            if ((seen & bit) == 0) {
+                seen |= bit;
+                sum += messageHash(msg.sequence, msg.text);
+            }
+        }
+        else if (MessageHistory::isSequenceAfter(first, msg.sequence) && ++pastWindow > hashScanLimit) {
+            break;
+        }
+    }
+
+    // Reached the oldest message, or well past the window: whatever is missing is missing.
+    complete = true;
+    return sum;
+}
+
+void HistorySync::sendDigest() {
+    if (messenger == nullptr) {
+        return;
+    }
+
+    Payload::SyncDigest digest;
+    digest.type = Payload::Type::syncDigest;
+    digest.sentHighWater = history->sentHighWater();
+    digest.receivedHighWater = history->receivedHighWaterMark();
+    digest.receivedHash = 0;
+
+    if (digest.receivedHighWater != 0) {
+        bool complete = false;
+        digest.receivedHash = rangeHash(Message::Sender::them, digest.receivedHighWater - hashWindow + 1, digest.receivedHighWater, complete);
+
+        if (!complete) {
+            digest.receivedHash = Payload::unknownHash;
+        }
+    }
+
+    if (messenger->enqueue(TrafficClass::sync, (const uint8_t*)&digest, sizeof(digest)) == 0) {
+        LOGLN("Sync queue full, digest not sent");
+        return;
+    }
+
+    LOGFMT("Sent sync digest: sent %u, received %u\n", digest.sentHighWater, digest.receivedHighWater);
+
+    lastDigestSentTimestamp = millis();
+    digestSent = true;
+}
+
+void HistorySync::payloadReceived(const uint8_t* payload, uint32_t len) {
+    if (messenger == nullptr) {
+        return;
+    }
+
+    switch (Payload::Type(Payload::typeOf(payload, len))) {
+        case Payload::Type::syncDigest:
+            if (len == sizeof(Payload::SyncDigest)) {
+                Payload::SyncDigest digest;
+                memcpy(&digest, payload, sizeof(digest));
+                digestReceived(digest);
+            }
+            break;
+
+        case Payload::Type::syncBatch:
+            batchReceived(payload, len);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void HistorySync::digestReceived(const Payload::SyncDigest& digest) {
+    uint16_t sentHighWater = history->sentHighWater();
+
+    // The peer has seen higher sequence numbers from us than we remember sending, so our
+    // history file was lost. Skip ahead, otherwise the peer would drop our new messages as duplicates.
+    if (digest.receivedHighWater != 0 && 
+        (sentHighWater == 0 || MessageHistory::isSequenceAfter(digest.receivedHighWater, sentHighWater))) 
+    {
+        LOGFMT("Peer has seen sequence %u from us, skipping ahead\n", digest.receivedHighWater);
+        history->skipSentPast(digest.receivedHighWater);
+        sentHighWater = history->sentHighWater();
+    }
+
+    LOGFMT("Received sync digest: peer sent %u, peer received %u, we sent %u\n", 
+        digest.sentHighWater, digest.receivedHighWater, sentHighWater);
+
+    // What is the peer missing from us?
+    if (sentHighWater != 0) {
+        uint16_t first = 1;
+
+        if (digest.receivedHighWater != 0) {
+            const uint16_t windowStart = digest.receivedHighWater - hashWindow + 1;
+
+            bool complete = false;
+            const uint32_t hash = rangeHash(Message::Sender::me, windowStart, digest.receivedHighWater, complete);
+
+            // Matching hashes mean the peer has everything up to its high water mark. 
+            // Otherwise it missed something within the window; resend the whole window
+            // and let the peer skip the ones it already has.
+            if (digest.receivedHash == Payload::unknownHash || !complete) {
+                // One side couldn't hash the window. Resending it wouldn't change that, so it
+                // would go out again on every sync; send only what's past the high water mark.
+                LOGLN("Sync window can't be checked, sending from the peer's high water mark");
+                first = digest.receivedHighWater + 1;
+            }
+            else if (hash == digest.receivedHash) {
+                first = digest.receivedHighWater + 1;
+                history->setAckedThrough(digest.receivedHighWater);
+            }
+            else {
+                first = windowStart;
+            }
+        }
+
+        if (first == 0) {
+            first = 1;
+        }
+
+        if (!MessageHistory::isSequenceAfter(first, sentHighWater)) {
+            if (!streaming) {
+                streamStartTimestamp = millis();
+                streamBytes = 0;
+                streamMessages = 0;
+                streamFrames = 0;
+            }
+
+            streaming = true;
+            streamNext = first;
+            streamLast = sentHighWater;
+            streamIndex = findStreamStart(first);
+
+            LOGFMT("Streaming history %u to %u\n", streamNext, streamLast);
+        }
+    }
+
+    // Are we missing something from the peer? Answer with our digest so the peer starts streaming.
+    const bool missing = digest.sentHighWater != 0 && 
+        (history->receivedHighWaterMark() == 0 || 
+         MessageHistory::isSequenceAfter(digest.sentHighWater, history->receivedHighWaterMark()));
+
+    const bool holdoffExpired = !digestSent || (millis() - lastDigestSentTimestamp) >= digestReplyHoldoffMS;
+
+    if (missing && holdoffExpired) {
+        sendDigest();
+    }
+}
+
+size_t HistorySync::findStreamStart(uint16_t first) const {
+    // Our messages are stored in send order, so walk back from the newest
+    // until we find one the peer already has.
+    for (size_t i = history->size(); i > 0; i--) {
+        MessageView msg = history->getMessage(i - 1);
+
+        if (msg.sender == Message::Sender::me && msg.sequence != 0 && MessageHistory::isSequenceAfter(first, msg.sequence)) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+bool HistorySync::queueNextBatch() {
+    uint8_t frame[Message::maxLength];
+    size_t frameLength = sizeof(Payload::SyncBatchHeader);
+    uint8_t count = 0;
+    bool more = false;
+    size_t examined = 0;
+
+    for (; streamIndex < history->size(); streamIndex++) {
+        // Don't hold up the loop reading through a long stretch of the peer's messages.
+        if (++examined > maxExaminedPerBatch) {
+            more = true;
+            break;
+        }
+
+        MessageView msg = history->getMessage(streamIndex);
+
+        if (msg.sender != Message::Sender::me || msg.sequence == 0 || 
+            !isSequenceInRange(msg.sequence, streamNext, streamLast)) 
+        {
+            continue;
+        }
+
+        const size_t textLength = msg.length;
+        const size_t entryLength = sizeof(Payload::SyncBatchEntry) + textLength;
+
+        // Frame is full; the rest goes in the next one.
+        if (frameLength + entryLength > sizeof(frame)) {
+            more = true;
+            break;
+        }
+
+        Payload::SyncBatchEntry entry = {msg.sequence, uint8_t(textLength)};
+        memcpy(frame + frameLength, &entry, sizeof(entry));
+        memcpy(frame + frameLength + sizeof(entry), msg.text, textLength);
+        frameLength += entryLength;
+        count++;
+    }
+
+    if (count > 0) {
+        Payload::SyncBatchHeader header = {Payload::Type::syncBatch, count};
+        memcpy(frame, &header, sizeof(header));
+
+        if (messenger->enqueue(TrafficClass::sync, frame, frameLength) == 0) {
+            LOGLN("Failed to queue sync batch");
+            return false;
+        }
+
+        streamBytes += frameLength;
+        streamMessages += count;
+        streamFrames++;
+    }
+
+    return more;
+}
+
+void HistorySync::update() {
+    if (!streaming) {
+        return;
+    }
+
+    // Feed the queue one frame at a time, so the stream never hogs the sync class
+    // and a new digest can restart it cheaply.
+    if (messenger->trafficQueue().isFull(TrafficClass::sync)) {
+        return;
+    }
+
+    if (!queueNextBatch()) {
+        streaming = false;
+
+        LOGFMT("History sync stream done: %u messages, %u frames, %u bytes, %u ms\n",
+            streamMessages, streamFrames, streamBytes, millis() - streamStartTimestamp);
+    }
+}
+
+void HistorySync::batchReceived(const uint8_t* payload, uint32_t len) {
+    if (len < sizeof(Payload::SyncBatchHeader)) {
+        return;
+    }
+
+    Payload::SyncBatchHeader header;
+    memcpy(&header, payload, sizeof(header));
+
+    size_t offset = sizeof(header);
+    uint8_t added = 0;
+    uint8_t unreported = 0;
+    char text[Message::bufferSize];
+
+    for (uint8_t i = 0; i < header.count; i++) {
+        if (offset + sizeof(Payload::SyncBatchEntry) > len) {
+            LOGLN("Truncated sync batch");
+            break;
+        }
+
+        Payload::SyncBatchEntry entry;
+        memcpy(&entry, payload + offset, sizeof(entry));
+        offset += sizeof(entry);
+
+        if (offset + entry.length > len || entry.length > Message::maxLength) {
+            LOGLN("Truncated sync batch");
+            break;
+        }
+
+        memcpy(text, payload + offset, entry.length);
+        text[entry.length] = 0;
+        offset += entry.length;
+
+        if (entry.sequence == 0) {
+            continue;
+        }
+
+        const uint32_t id = history->receivedIdForSequence(entry.sequence);
+
+        if (history->contains(Message::Sender::them, id)) {
+            continue;
+        }
+
+        history->addMessage(Message::Sender::them, text, id);
+        added++;
+        unreported++;
+
+        // Only the newest messages are kept in RAM, so have them saved before they scroll out.
+        if (unreported == MessageHistory::minResidentMessages && messagesAddedCallback != nullptr) {
+            messagesAddedCallback(unreported);
+            unreported = 0;
+        }
+    }
+
+    LOGFMT("Received sync batch: %u messages, %u new\n", header.count, added);
+
+    if (unreported > 0 && messagesAddedCallback != nullptr) {
+        messagesAddedCallback(unreported);
+    }
+}
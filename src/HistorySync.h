@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Messenger.h"
+#include "MessageHistory.h"
+#include "Payload.h"
+
+// Brings the message histories of two paired devices back in step after one of them
+// was off or out of range.
+//
+// Each side numbers the messages it sends. When the link comes back, each side sends a
+// small digest: the highest sequence number it sent, the highest it received, and a rolling
+// hash of the recently received messages. The peer compares that against its own sent
+// messages and streams only the ones that are missing, packed into as few frames as
+// possible, in the low priority sync traffic class so user messages and pings aren't delayed.
+class HistorySync {
+public:
+    // Number of sequence numbers covered by the digest hash.
+    static constexpr uint16_t hashWindow = 32;
+
+    // Synced messages are appended out of order, so the hash scan goes on through this many
+    // of the sender's messages older than the window before it trusts that nothing else is in it.
+    static constexpr size_t hashScanLimit = 4 * hashWindow;
+
+    // The hash scan gives up after this many messages, e.g. when the window is behind a long run
+    // of the other side's messages. The digest then says its hash is unknown, and the window is
+    // trusted rather than resent on every sync.
+    static constexpr size_t maxHashScan = 8 * hashScanLimit;
+
+    // Messages looked at per batch, so a long stretch of the peer's messages doesn't stall the loop.
+    static constexpr size_t maxExaminedPerBatch = 4 * MessageHistory::pageSize;
+
+    // Don't answer a digest with our own more often than this, so two devices
+    // don't keep bouncing digests back and forth.
+    static constexpr uint32_t digestReplyHoldoffMS = 5 * 1000;
+
+    void begin(Messenger* m, MessageHistory* h);
+
+    // Forget any sync in progress, e.g. when the history is replaced with another conversation's.
+    void reset();
+
+    // Call often, for example in loop(). Queues the next batch while streaming.
+    void update();
+
+    // Send our digest to the paired device. Call when the link comes back.
+    void sendDigest();
+
+    // Call with sync payloads received from the paired device.
+    void payloadReceived(const uint8_t* payload, uint32_t len);
+
+    // Called with the number of messages added to the history by a sync batch.
+    void setMessagesAddedCallback(void (*cb)(uint8_t)) {
+        messagesAddedCallback = cb;
+    }
+
+    inline bool isStreaming() const {
+        return streaming;
+    }
+
+private:
+    void digestReceived(const Payload::SyncDigest& digest);
+    void batchReceived(const uint8_t* payload, uint32_t len);
+
+    // Order independent hash of the messages from sender with sequence numbers in [first, last].
+    // complete is false if the scan gave up before it could have seen all of them.
+    uint32_t rangeHash(Message::Sender sender, uint16_t first, uint16_t last, bool& complete) const;
+    static uint32_t messageHash(uint16_t sequence, const char* text);
+
+    // True if sequence is within [first, last], accounting for wrap around.
+    static bool isSequenceInRange(uint16_t sequence, uint16_t first, uint16_t last);
+
+    // History index of our first message with a sequence number of at least first.
+    size_t findStreamStart(uint16_t first) const;
+
+    // Pack as many pending messages as fit into one frame and queue it. Returns false when done.
+    bool queueNextBatch();
+
+private:
+    Messenger* messenger = nullptr;
+    MessageHistory* history = nullptr;
+
+    void (*messagesAddedCallback)(uint8_t) = nullptr;
+
+    uint32_t lastDigestSentTimestamp = 0;
+    bool digestSent = false;
+
+    // Outgoing stream state: our sent messages with sequence numbers in [streamNext, streamLast].
+    bool streaming = false;
+    uint16_t streamNext = 0;
+    uint16_t streamLast = 0;
+    size_t streamIndex = 0;
+
+    // Stream measurements, logged when the stream completes.
+    uint32_t streamStartTimestamp = 0;
+    uint32_t streamBytes = 0;
+    uint16_t streamMessages = 0;
+    uint16_t streamFrames = 0;
+};
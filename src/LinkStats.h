@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Running link-quality statistics for a single peer.
+// Averages are exponentially weighted and kept in fixed point (the ESP32-S2 has no FPU).
+struct LinkStats {
+    // Fixed point scale for the averaged values.
+    static constexpr int32_t scale = 256;
+
+    // Each new sample contributes 1/(2^ewmaShift) of the average.
+    static constexpr uint8_t ewmaShift = 3;
+
+    // Record a packet received from the peer.
+    // Pass hasSignal = false if the radio doesn't report RSSI/SNR.
+    void recordReceive(uint32_t now, bool hasSignal = false, int16_t rssi = 0, int8_t snr = 0) {
+        lastHeard = now;
+        heard = true;
+        receivedCount++;
+
+        if (!hasSignal) {
+            return;
+        }
+
+        if (!this->hasSignal) {
+            // Seed the averages with the first sample.
+            rssiAvg = rssi * scale;
+            snrAvg = snr * scale;
+            this->hasSignal = true;
+        }
+        else {
+            rssiAvg += (rssi * scale - rssiAvg) >> ewmaShift;
+            snrAvg += (snr * scale - snrAvg) >> ewmaShift;
+        }
+    }
+
+    // Record the outcome of a single transmission attempt that expects an acknowledgement.
+    // A delivered frame proves the peer is alive, so it also counts as hearing from it.
+    void recordDelivery(uint32_t now, bool delivered) {
+        const int32_t sample = delivered ? scale : 0;
+
+        if (deliveryAttempts == 0) {
+            deliveryAvg = sample;
+        }
+        else {
+            deliveryAvg += (sample - deliveryAvg) >> ewmaShift;
+        }
+
+        deliveryAttempts++;
+
+        if (delivered) {
+            lastHeard = now;
+            heard = true;
+        }
+    }
+
+    // Record that we transmitted something to the peer.
+    void recordSent(uint32_t now) {
+        lastSent = now;
+        sent = true;
+    }
+
+    // Averaged signal strength in dBm, if the radio reports it.
+    inline int16_t rssi() const {
+        return rssiAvg / scale;
+    }
+
+    // Averaged signal to noise ratio in dB, if the radio reports it.
+    inline int8_t snr() const {
+        return snrAvg / scale;
+    }
+
+    // Packet delivery ratio, 0-100%.
+    inline uint8_t deliveryPercent() const {
+        return (deliveryAttempts == 0) ? 100 : (deliveryAvg * 100) / scale;
+    }
+
+    // Time since we last heard from the peer, or UINT32_MAX if we never have.
+    inline uint32_t quietTime(uint32_t now) const {
+        return heard ? (now - lastHeard) : UINT32_MAX;
+    }
+
+    // Time since we last transmitted to the peer, or UINT32_MAX if we never have.
+    inline uint32_t idleTime(uint32_t now) const {
+        return sent ? (now - lastSent) : UINT32_MAX;
+    }
+
+    uint32_t lastHeard = 0;
+    uint32_t lastSent = 0;
+    uint32_t receivedCount = 0;
+    uint32_t deliveryAttempts = 0;
+
+    int32_t rssiAvg = 0;
+    int32_t snrAvg = 0;
+    int32_t deliveryAvg = scale;
+
+    bool heard = false;
+    bool sent = false;
+    bool hasSignal = false;
+};
@@ -9,6 +9,9 @@
 // #define LOGGER Serial
 #include "Logger.h"
 
+bool LoRaMessenger::resetStarted = false;
+uint32_t LoRaMessenger::resetStartTimestamp = 0;
+
 LoRaMessenger::LoRaMessenger(uint8_t _myAddress, uint8_t _otherAddress) :
     resetPin(RFM_RST),
     freq(RFM_FREQ),
@@ -23,16 +26,20 @@ LoRaMessenger::LoRaMessenger(uint8_t _myAddress, uint8_t _otherAddress) :
 bool LoRaMessenger::begin(const uint8_t (&pmk)[16]) {
     assert(pmk != nullptr);
 
-    // Initialize reset pin
-    pinMode(resetPin, OUTPUT);
-    digitalWrite(resetPin, HIGH);
-    delay(10);
+    // Manually reset module, unless startReset() already began to.
+    if (!resetStarted) {
+        startReset();
+    }
+
+    const uint32_t elapsed = millis() - resetStartTimestamp;
+
+    if (elapsed < resetPulseMS) {
+        delay(resetPulseMS - elapsed);
+    }
 
-    // Manually reset module.
-    digitalWrite(resetPin, LOW);
-    delay(10);
     digitalWrite(resetPin, HIGH);
-    delay(10);
+    delay(resetSettleMS);
+    resetStarted = false;
 
     // Init lora device
     if (!device.init()) {
@@ -62,51 +69,163 @@ bool LoRaMessenger::begin(const uint8_t (&pmk)[16]) {
     manager.setRetries(6);
     manager.setTimeout(500);
 
+    nextFecBlockId = random(0, 256);
+
     return true;
 }
 
+void LoRaMessenger::startReset() {
+    pinMode(RFM_RST, OUTPUT);
+    digitalWrite(RFM_RST, LOW);
+
+    resetStarted = true;
+    resetStartTimestamp = millis();
+}
+
 void LoRaMessenger::updateRx() {
+    deliverDeferred();
+    processReceivedFrame();
+    serviceFecAck();
+
+    // Send whatever is waiting in the transmit queue.
+    serviceTxQueue();
+}
+
+void LoRaMessenger::processReceivedFrame() {
     if (!manager.available()) {
         return;
     }
 
     uint8_t len = Message::maxLength;
-    uint8_t from, to;
+    uint8_t from, to, flags;
 
-    if (manager.recvfromAck(rxBuffer, &len, &from, &to, nullptr, nullptr)) {
+    // With nowhere to hold a payload, take the frame without acking it, so the peer resends it later.
+    const bool received = canTakePayload() ?
+        manager.recvfromAck(rxBuffer, &len, &from, &to, nullptr, &flags) :
+        manager.recvfrom(rxBuffer, &len, &from, &to, nullptr, &flags);
+
+    if (received) {
         // We only listen for messages from our paired device.
         if (from != otherAddress) {
             return;
         }
 
+        // Any traffic from the paired device tells us it's alive.
+        link.recordReceive(millis(), true, device.lastRssi(), device.lastSNR());
+
+        // FEC frames are broadcast so they aren't acked individually.
+        if (flags & fecFlag) {
+            receivedFecFrame(rxBuffer, len);
+        }
         // We only use the broadcast address for pings
-        if (broadcastAddress == to) {
+        else if (broadcastAddress == to) {
             if (rxBuffer[0] == pingByte1 && rxBuffer[1] == pingByte2) {
-                pingCallback();
+                if (waitingForFecAck) {
+                    deferredPing = true;
+                }
+                else {
+                    pingCallback();
+                }
             }
         }
         // And we only accept messages meant for our address.
-        else if (manager.thisAddress() == to) {
-            if (payloadReceivedCallback) {
-                payloadReceivedCallback(rxBuffer, len);
-            }
+        else if (manager.thisAddress() == to && canTakePayload()) {
+            deliverPayload(rxBuffer, len);
+        }
+    }
+}
+
+void LoRaMessenger::deliverPayload(const uint8_t* payload, uint8_t len) {
+    if (!waitingForFecAck) {
+        if (payloadReceivedCallback) {
+            payloadReceivedCallback(payload, len);
+        }
+
+        return;
+    }
+
+    DeferredPayload deferred;
+    deferred.length = len;
+    memcpy(deferred.data, payload, len);
+    deferredPayloads.push(deferred);
+}
+
+void LoRaMessenger::deliverDeferred() {
+    if (deferredPing) {
+        deferredPing = false;
+        pingCallback();
+    }
+
+    while (!deferredPayloads.isEmpty()) {
+        const DeferredPayload deferred = deferredPayloads.shift();
+
+        if (payloadReceivedCallback) {
+            payloadReceivedCallback(deferred.data, deferred.length);
         }
     }
 }
 
 void LoRaMessenger::ping() {
+    const uint8_t pingFrame[2] = {pingByte1, pingByte2};
+
+    // Pings are sent from the transmit queue, behind acks and user messages.
+    if (enqueue(TrafficClass::presence, pingFrame, sizeof(pingFrame)) == 0) {
+        LOGLN("Ping dropped, presence queue full");
+    }
+}
+
+bool LoRaMessenger::transmit(const TrafficQueue::Entry& entry) {
+    switch (entry.trafficClass) {
+        case TrafficClass::ack:
+            return sendUnacknowledged(entry.frame, entry.length);
+
+        case TrafficClass::presence:
+            return sendPing(entry.frame, entry.length);
+
+        case TrafficClass::message:
+        case TrafficClass::sync:
+            return sendMessage(entry.frame, entry.length);
+    }
+
+    return false;
+}
+
+bool LoRaMessenger::sendPing(const uint8_t* frame, uint8_t len) {
     LOGLN("Sending Ping");
-    txBuffer[0] = pingByte1;
-    txBuffer[1] = pingByte2;
-    (void)manager.sendtoWait(txBuffer, 2, broadcastAddress);
+    memcpy(txBuffer, frame, len);
+
+    // Broadcasts aren't acknowledged, so this doesn't count towards the delivery ratio.
+    const bool sent = sendReliable(txBuffer, len, broadcastAddress);
+    link.recordSent(millis());
+
+    return sent;
 }
 
-bool LoRaMessenger::txWait(const uint8_t* payload, uint8_t len) {
+bool LoRaMessenger::sendMessage(const uint8_t* payload, uint8_t len) {
     // Annoyingly sendToWait() does accepts a non-const buffer so
     // for now I'd rather just copy the payload into our own buffer
     // and pass that rather than casting the const-ness away.
     memcpy(txBuffer, payload, len);
-    return manager.sendtoWait(txBuffer, len, otherAddress);
+
+    if (shouldUseFec()) {
+        return txWaitFec(payload, len);
+    }
+
+    const uint32_t retransmissionsBefore = manager.retransmissions();
+    const bool delivered = sendReliable(txBuffer, len, otherAddress);
+    const uint32_t now = millis();
+
+    // Every retransmission is a frame that wasn't acknowledged.
+    const uint32_t failedAttempts = manager.retransmissions() - retransmissionsBefore;
+    for (uint32_t i = 0; i < failedAttempts; i++) {
+        link.recordDelivery(now, false);
+    }
+
+    // The final attempt either succeeded or timed out as well.
+    link.recordDelivery(now, delivered);
+    link.recordSent(now);
+
+    return delivered;
 }
 
 bool LoRaMessenger::settingsChanged(const Settings& settings, uint8_t changeFlags) {
@@ -128,4 +247,248 @@ bool LoRaMessenger::settingsChanged(const Settings& settings, uint8_t changeFlag
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+bool LoRaMessenger::sendReliable(uint8_t* buffer, uint8_t len, uint8_t address) {
+    // sendtoWait() uses one new sequence number per call, regardless of retries.
+    reliableSequenceNumber++;
+    return manager.sendtoWait(buffer, len, address);
+}
+
+uint8_t LoRaMessenger::nextUnacknowledgedId() {
+    do {
+        unacknowledgedId++;
+    } while (unacknowledgedId == reliableSequenceNumber || unacknowledgedId == uint8_t(reliableSequenceNumber + 1));
+
+    return unacknowledgedId;
+}
+
+bool LoRaMessenger::sendUnacknowledged(const uint8_t* frame, uint8_t len) {
+    memcpy(txBuffer, frame, len);
+
+    manager.setHeaderId(nextUnacknowledgedId());
+    manager.setHeaderFlags(fecFlag, RH_FLAGS_APPLICATION_SPECIFIC);
+
+    // Broadcast, so the receiving RHReliableDatagram doesn't ack each frame.
+    bool sent = manager.sendto(txBuffer, len, broadcastAddress) && manager.waitPacketSent();
+
+    manager.setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_APPLICATION_SPECIFIC);
+    link.recordSent(millis());
+
+    return sent;
+}
+
+bool LoRaMessenger::shouldUseFec() const {
+#if defined(USE_LORA_FEC)
+    return link.deliveryPercent() < fecDeliveryThreshold;
+#else
+    return false;
+#endif
+}
+
+bool LoRaMessenger::txWaitFec(const uint8_t* payload, uint8_t len) {
+    if (len == 0 || len > Message::maxLength) {
+        return false;
+    }
+
+    // Split into data fragments of roughly the target size.
+    uint8_t dataCount = (len + fecFragmentTargetSize - 1) / fecFragmentTargetSize;
+    if (dataCount > ErasureCode::maxDataFragments) {
+        dataCount = ErasureCode::maxDataFragments;
+    }
+
+    const uint8_t fragmentSize = (len + dataCount - 1) / dataCount;
+
+    memset(fecTxBlock, 0, dataCount * fragmentSize);
+    memcpy(fecTxBlock, payload, len);
+
+    // Size the parity to the measured loss: enough to cover the expected erasures, plus one.
+    uint8_t deliveryPercent = link.deliveryPercent();
+    if (deliveryPercent < 10) {
+        deliveryPercent = 10;
+    }
+
+    const uint8_t parityCount = constrain(dataCount * (100 - deliveryPercent) / deliveryPercent + 1, fecMinParity, fecMaxParity);
+
+    pendingFecBlockId = nextFecBlockId++;
+    fecBlockAcked = false;
+
+    LOGFMT("FEC send: block %d, %d data + %d parity fragments of %d bytes\n", pendingFecBlockId, dataCount, parityCount, fragmentSize);
+
+    uint8_t frame[sizeof(FecHeader) + fecBlockBufferSize / ErasureCode::maxDataFragments];
+
+    FecHeader header;
+    header.type = FecFrameType::fragment;
+    header.blockId = pendingFecBlockId;
+    header.dataCount = dataCount;
+    header.length = len;
+
+    uint16_t nextIndex = 0;
+
+    for (uint8_t round = 0; round < fecMaxRounds; round++) {
+        // First round sends the data fragments plus parity; later rounds send fresh parity only.
+        const uint8_t fragmentCount = (round == 0) ? (dataCount + parityCount) : parityCount;
+
+        const uint16_t roundEnd = min(uint16_t(nextIndex + fragmentCount), ErasureCode::maxFragmentIndex);
+        header.roundLast = roundEnd - 1;
+
+        while (nextIndex < roundEnd) {
+            header.index = nextIndex++;
+            memcpy(frame, &header, sizeof(header));
+            ErasureCode::encode(fecTxBlock, dataCount, fragmentSize, header.index, &frame[sizeof(header)]);
+
+            if (!sendUnacknowledged(frame, sizeof(header) + fragmentSize)) {
+                LOGLN("FEC fragment send failed");
+            }
+        }
+
+        // Wait for the block ack. Other payloads are held until updateRx(), since we're
+        // still inside txWait(); only the acks we owe the peer go out meanwhile.
+        const uint32_t waitStart = millis();
+        waitingForFecAck = true;
+
+        while (!fecBlockAcked && millis() - waitStart < fecAckTimeout) {
+            processReceivedFrame();
+            serviceFecAck();
+            serviceTxQueue();
+            yield();
+        }
+
+        waitingForFecAck = false;
+
+        link.recordDelivery(millis(), fecBlockAcked);
+
+        if (fecBlockAcked) {
+            LOGFMT("FEC block %d acked after %d round(s)\n", pendingFecBlockId, round + 1);
+            return true;
+        }
+    }
+
+    LOGFMT("FEC block %d was not acked\n", pendingFecBlockId);
+    return false;
+}
+
+void LoRaMessenger::receivedFecFrame(const uint8_t* frame, uint8_t len) {
+    if (len < sizeof(FecHeader)) {
+        return;
+    }
+
+    FecHeader header;
+    memcpy(&header, frame, sizeof(header));
+
+    if (header.type == FecFrameType::ack) {
+        if (header.blockId == pendingFecBlockId) {
+            fecBlockAcked = true;
+        }
+
+        return;
+    }
+
+    // Already delivered; the sender must have missed our ack.
+    if (rxFecDelivered && header.blockId == rxFecDeliveredBlockId) {
+        holdFecAck(header, len);
+        return;
+    }
+
+    // No room to hold the payload this block carries. Without our ack the sender sends
+    // another round of parity, which we can take once the held payloads are handed over.
+    if (!canTakePayload()) {
+        return;
+    }
+
+    if (header.dataCount == 0 || header.dataCount > ErasureCode::maxDataFragments || 
+        header.length == 0 || header.length > Message::maxLength) 
+    {
+        LOGLN("Invalid FEC header");
+        return;
+    }
+
+    const uint8_t fragmentSize = (header.length + header.dataCount - 1) / header.dataCount;
+
+    if (len != sizeof(FecHeader) + fragmentSize || fragmentSize * header.dataCount > fecBlockBufferSize) {
+        LOGLN("Invalid FEC fragment size");
+        return;
+    }
+
+    // A new block replaces whatever partial block we had.
+    if (!rxFecActive || header.blockId != rxFecBlockId || 
+        header.dataCount != rxFecDataCount || header.length != rxFecLength) 
+    {
+        rxFecActive = true;
+        rxFecBlockId = header.blockId;
+        rxFecDataCount = header.dataCount;
+        rxFecLength = header.length;
+        rxFecReceivedCount = 0;
+    }
+
+    for (uint8_t i = 0; i < rxFecReceivedCount; i++) {
+        if (rxFecIndices[i] == header.index) {
+            return;
+        }
+    }
+
+    rxFecIndices[rxFecReceivedCount] = header.index;
+    memcpy(&rxFecFragments[rxFecReceivedCount * fragmentSize], &frame[sizeof(FecHeader)], fragmentSize);
+    rxFecReceivedCount++;
+
+    if (rxFecReceivedCount < rxFecDataCount) {
+        return;
+    }
+
+    // We have enough fragments to rebuild the message.
+    uint8_t message[fecBlockBufferSize];
+    rxFecActive = false;
+
+    if (!ErasureCode::decode(rxFecFragments, rxFecIndices, rxFecDataCount, fragmentSize, message)) {
+        LOGLN("FEC decode failed");
+        return;
+    }
+
+    LOGFMT("FEC block %d decoded\n", rxFecBlockId);
+
+    rxFecDelivered = true;
+    rxFecDeliveredBlockId = rxFecBlockId;
+
+    holdFecAck(header, len);
+    deliverPayload(message, rxFecLength);
+}
+
+void LoRaMessenger::holdFecAck(const FecHeader& fragment, uint8_t len) {
+    rxFecHeldAck.type = FecFrameType::ack;
+    rxFecHeldAck.blockId = fragment.blockId;
+
+    // The sender can't hear us until it has sent the rest of the round, back to back.
+    // A later fragment moves the deadline to where it actually is.
+    const uint8_t remaining = (fragment.roundLast > fragment.index) ? fragment.roundLast - fragment.index : 0;
+
+    rxFecAckHeld = true;
+    rxFecAckDueTimestamp = millis() + remaining * (airtimeMS(len) + fecSlotGuardMS);
+
+    serviceFecAck();
+}
+
+void LoRaMessenger::serviceFecAck() {
+    if (!rxFecAckHeld || int32_t(millis() - rxFecAckDueTimestamp) < 0) {
+        return;
+    }
+
+    rxFecAckHeld = false;
+    sendFecAck(rxFecHeldAck);
+}
+
+uint32_t LoRaMessenger::airtimeMS(uint8_t len) {
+    // RadioHead's 4 byte header, and the encrypted part padded to Speck's 8 byte block with a length byte.
+    const uint32_t frameLength = 4 + (len + 1 + 7) / 8 * 8;
+
+    // 1.024 ms symbols. 12.25 symbols of preamble, then 8 symbols plus 5 for every 28 bits
+    // of payload, header and CRC.
+    const uint32_t payloadSymbols = 8 + (8 * frameLength - 4 * 7 + 28 + 16 + 27) / 28 * 5;
+    return (12544 + payloadSymbols * 1024 + 999) / 1000;
+}
+
+void LoRaMessenger::sendFecAck(const FecHeader& ack) {
+    // Acks are the highest traffic class, so this goes out right away.
+    if (enqueue(TrafficClass::ack, (const uint8_t*)&ack, sizeof(ack)) != 0) {
+        serviceTxQueue();
+    }
+}
@@ -5,7 +5,9 @@
 #include <RHEncryptedDriver.h>
 #include <RHReliableDatagram.h>
 #include <Speck.h>
+#include <CircularBuffer.hpp>
 #include "Messenger.h"
+#include "ErasureCode.h"
 
 class LoRaMessenger: public Messenger {
 public:
@@ -13,11 +15,18 @@ public:
 
     bool begin(const uint8_t (&pmk)[16]);
 
+    // Start resetting the radio module. Call early in setup() so the reset pulse overlaps
+    // other work, instead of begin() waiting for it.
+    static void startReset();
+
     virtual void updateRx() override;
-    virtual bool txWait(const uint8_t* payload, uint8_t len) override;
     virtual void ping() override;
     virtual bool settingsChanged(const Settings& settings, uint8_t changeFlags) override;
 
+    virtual const LinkStats& linkStats() const override {
+        return link;
+    }
+
     // Called when a ping is received
     void setPingCallback(void (*cb)()) {
         pingCallback = cb;
@@ -28,7 +37,25 @@ public:
         payloadReceivedCallback = cb;
     }
 
+protected:
+    virtual bool transmit(const TrafficQueue::Entry& entry) override;
+
 private:
+    // Handle a received frame, if any.
+    void processReceivedFrame();
+
+    // Transmit helpers (blocking).
+    bool sendMessage(const uint8_t* payload, uint8_t len);
+    bool sendPing(const uint8_t* frame, uint8_t len);
+
+    // Reset pulse length, and time the module needs after it before it can be set up.
+    static constexpr uint32_t resetPulseMS = 10;
+    static constexpr uint32_t resetSettleMS = 10;
+
+    // Whether and when startReset() pulled the reset pin low.
+    static bool resetStarted;
+    static uint32_t resetStartTimestamp;
+
     // 0xFF broadcasts to everyone instead of a specific sender.
     static constexpr uint8_t broadcastAddress = 0xFF;
 
@@ -40,6 +67,100 @@ private:
         cipher.setKey(pmk, 16);
     }
 
+    //
+    // Forward error correction.
+    //
+    // When USE_LORA_FEC is defined and the link's delivery ratio drops, messages are split into
+    // small data fragments plus Reed-Solomon parity fragments and sent without per-frame acks.
+    // The receiver can rebuild the message from any dataCount of them, then sends a single ack
+    // for the whole block. The radio is half duplex, so the ack is held until the round's last
+    // fragment has gone out, when the sender listens. Receiving FEC blocks is always supported.
+    //
+
+    // RadioHead application-specific header flag that marks FEC frames.
+    static constexpr uint8_t fecFlag = 0x01;
+
+    // Aim for fragments of about this many bytes; short frames survive marginal links better.
+    static constexpr uint8_t fecFragmentTargetSize = 32;
+
+    // Only switch to FEC once the delivery ratio falls below this percentage.
+    static constexpr uint8_t fecDeliveryThreshold = 80;
+
+    // Parity fragment limits per round.
+    static constexpr uint8_t fecMinParity = 1;
+    static constexpr uint8_t fecMaxParity = 8;
+
+    // If the block isn't acked, send another round of fresh parity fragments.
+    static constexpr uint8_t fecMaxRounds = 3;
+    static constexpr uint32_t fecAckTimeout = 600;
+
+    enum class FecFrameType: uint8_t {
+        fragment = 0,
+        ack = 1,
+    };
+
+    struct FecHeader {
+        FecFrameType type = FecFrameType::fragment;
+        uint8_t blockId = 0;
+        uint8_t index = 0;
+        uint8_t dataCount = 0;
+        uint8_t length = 0;
+
+        // Index of the last fragment of this round.
+        uint8_t roundLast = 0;
+    } __attribute__((packed));
+
+    // Time on air of a frame with len bytes of payload, with RH_RF95's default modem config
+    // (SF7, 125 kHz, CR 4/5) and the encrypted driver's padding.
+    static uint32_t airtimeMS(uint8_t len);
+
+    // Per fragment on top of its airtime, for the sender to turn the radio around.
+    static constexpr uint32_t fecSlotGuardMS = 5;
+
+    static constexpr uint8_t fecMaxFragmentSize = (Message::maxLength + ErasureCode::maxDataFragments - 1) / ErasureCode::maxDataFragments;
+    static constexpr size_t fecBlockBufferSize = ErasureCode::maxDataFragments * (fecFragmentTargetSize > fecMaxFragmentSize ? fecFragmentTargetSize : fecMaxFragmentSize);
+
+    bool shouldUseFec() const;
+    bool txWaitFec(const uint8_t* payload, uint8_t len);
+    void receivedFecFrame(const uint8_t* frame, uint8_t len);
+    void sendFecAck(const FecHeader& ack);
+
+    // Ack the block fragment belongs to once the sender is done with its round.
+    void holdFecAck(const FecHeader& fragment, uint8_t len);
+
+    // Send the held ack once it's due.
+    void serviceFecAck();
+
+    // txWaitFec() runs inside txWait(), e.g. from an LVGL event, so while it waits for the
+    // block ack, received payloads and pings are held here and handed over by the next updateRx().
+    static constexpr uint8_t maxDeferredPayloads = 4;
+
+    struct DeferredPayload {
+        uint8_t length = 0;
+        uint8_t data[Message::maxLength];
+    };
+
+    // Pass a payload to the callback, or hold it while waiting for a block ack.
+    void deliverPayload(const uint8_t* payload, uint8_t len);
+
+    // Hand over the payloads and ping held while waiting.
+    void deliverDeferred();
+
+    // False while waiting for a block ack with no room left to hold another payload.
+    inline bool canTakePayload() const {
+        return !waitingForFecAck || !deferredPayloads.isFull();
+    }
+
+    // Send a frame without waiting for a per-frame ack.
+    bool sendUnacknowledged(const uint8_t* frame, uint8_t len);
+
+    // Header ID for unacknowledged frames. RHReliableDatagram drops a frame whose ID matches the
+    // last one seen from the same sender, so never reuse the current or next reliable sequence number.
+    uint8_t nextUnacknowledgedId();
+
+    // Wraps manager.sendtoWait() so we can mirror its sequence numbers.
+    bool sendReliable(uint8_t* buffer, uint8_t len, uint8_t address);
+
 private:
     const uint8_t resetPin;
     const float freq;
@@ -53,6 +174,36 @@ private:
     void (*pingCallback)();
 
     uint8_t otherAddress;
+    LinkStats link;
+
+    // Mirror of RHReliableDatagram's last sequence number, and our own ID counter for unacked frames.
+    uint8_t reliableSequenceNumber = 0;
+    uint8_t unacknowledgedId = 0;
+
+    // FEC transmit state
+    uint8_t nextFecBlockId = 0;
+    uint8_t pendingFecBlockId = 0;
+    bool fecBlockAcked = false;
+    uint8_t fecTxBlock[fecBlockBufferSize] = {0};
+
+    // Received while waiting for a block ack.
+    bool waitingForFecAck = false;
+    CircularBuffer<DeferredPayload, maxDeferredPayloads> deferredPayloads;
+    bool deferredPing = false;
+
+    // FEC receive state
+    bool rxFecActive = false;
+    uint8_t rxFecBlockId = 0;
+    uint8_t rxFecDataCount = 0;
+    uint8_t rxFecLength = 0;
+    uint8_t rxFecReceivedCount = 0;
+    uint8_t rxFecIndices[ErasureCode::maxDataFragments] = {0};
+    uint8_t rxFecFragments[fecBlockBufferSize] = {0};
+    bool rxFecDelivered = false;
+    uint8_t rxFecDeliveredBlockId = 0;
+    bool rxFecAckHeld = false;
+    FecHeader rxFecHeldAck;
+    uint32_t rxFecAckDueTimestamp = 0;
     uint8_t rxBuffer[Message::maxLength] = {0};
     uint8_t txBuffer[Message::maxLength] = {0};
 };
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <Arduino.h>
 
+// Limits, sender and status of messages, and the arithmetic on their ids. The messages
+// themselves are MessageViews into MessageHistory's arena.
 struct Message {
     // Regardless of what the RF95 comments say about RH_RF95_MAX_MESSAGE_LEN, any attempt to send more than 239 bytes fails.
     // ESP-NOW has a max packet size of 250 bytes.
@@ -9,6 +11,11 @@ struct Message {
     // but eventually we could upgrade the message system to allow for variable-length message buffers.
     static constexpr uint32_t maxLength = 239;
 
+    // Text is sent inside a small payload header (see Payload.h), and has to fit
+    // in a sync batch frame alongside its own entry header. That's 5 bytes less than the
+    // maxLength older firmware allowed; texts it sends at full length are still stored whole.
+    static constexpr uint32_t maxTextLength = maxLength - 5;
+
     // Add space for a terminating null character so we can use this with string-related functions.
     static constexpr uint32_t bufferSize = maxLength + 1;
 
@@ -18,31 +25,42 @@ struct Message {
         them
     };
 
-    Message() {
-        text[0] = 0;
-    }
+    // Delivery status of our messages, kept in the low bits of the message flags.
+    // Messages from the paired device are always acked.
+    enum class Status: uint8_t {
+        // Stored, but the radio never confirmed the send.
+        pending = 0,
+
+        // The radio confirmed the send.
+        sent = 1,
+
+        // The paired device's history sync digest shows it has the message.
+        acked = 2,
+    };
 
-    Message(Sender s) : sender(s) { 
-        text[0] = 0;
+    static constexpr uint8_t statusMask = 0x03;
+
+    static inline Status statusOf(uint8_t flags) {
+        return Status(flags & statusMask);
     }
 
-    // Expects a null terminated string. If string length exceeds Message::maxLength it will be truncated
-    void setText(const char* str) {
-        const size_t strBufferSize = min(bufferSize, strlen(str) + 1);
-        strncpy(text, str, bufferSize); 
-        text[strBufferSize - 1] = 0;
+    static inline uint8_t withStatus(uint8_t flags, Status status) {
+        return (flags & ~statusMask) | uint8_t(status);
     }
 
-    // Pass the string and the string length. Will automatically null-terminate.
-    void setText(const char* str, size_t strLen) {
-        const size_t strBufferSize = min(bufferSize, strLen + 1);
-        strncpy(text, str, bufferSize); 
-        text[strBufferSize - 1] = 0;
-    }    
+    // Message ids are 32 bits, and count up on each side. The low 16 bits are the sequence number
+    // sent over the air (see HistorySync), and are never 0. Both wrap, so compare them with serial
+    // number arithmetic.
+    static inline uint16_t sequenceOf(uint32_t id) {
+        return uint16_t(id);
+    }
 
-    // Who sent the message?
-    Sender sender = Sender::me;
+    static inline bool isIdAfter(uint32_t a, uint32_t b) {
+        return int32_t(a - b) > 0;
+    }
 
-    // Message storage.
-    char text[bufferSize];
-} __attribute__((packed));
+    // The id with this sequence number closest to reference.
+    static inline uint32_t idForSequence(uint16_t sequence, uint32_t reference) {
+        return reference + uint32_t(int32_t(int16_t(sequence - uint16_t(reference))));
+    }
+};
@@ -0,0 +1,109 @@
+#include "MessageArena.h"
+
+int32_t MessageArena::allocate(size_t size) const {
+    if (count == 0) {
+        return (size <= poolCapacity) ? 0 : -1;
+    }
+
+    const size_t oldest = recordAt(0).offset;
+    const size_t newest = recordAt(count - 1).offset;
+
+    // Texts run from the oldest to the end of the pool, then continue from the start.
+    const bool wrapped = newest < oldest;
+
+    if (wrapped) {
+        return (end + size <= oldest) ? int32_t(end) : -1;
+    }
+
+    if (end + size <= poolCapacity) {
+        return end;
+    }
+
+    // Wrap around to the start, in front of the oldest text.
+    return (size <= oldest) ? 0 : -1;
+}
+
+bool MessageArena::push(Message::Sender sender, uint32_t id, uint8_t flags, uint32_t timestamp, const char* text, size_t length, bool evict) {
+    if (length > Message::maxLength) {
+        length = Message::maxLength;
+    }
+
+    const size_t size = length + 1;
+
+    if (count == capacity) {
+        if (!evict) {
+            return false;
+        }
+
+        shift();
+    }
+
+    int32_t offset = allocate(size);
+
+    while (offset < 0) {
+        if (!evict || count == 0) {
+            return false;
+        }
+
+        shift();
+        offset = allocate(size);
+    }
+
+    memcpy(pool + offset, text, length);
+    pool[offset + length] = 0;
+    end = offset + size;
+
+    Record& r = records[(head + count) % capacity];
+    r.offset = offset;
+    r.length = length;
+    r.sender = sender;
+    r.flags = flags;
+    r.id = id;
+    r.timestamp = timestamp;
+    count++;
+
+    return true;
+}
+
+void MessageArena::shift() {
+    if (count == 0) {
+        return;
+    }
+
+    head = (head + 1) % capacity;
+    count--;
+
+    if (count == 0) {
+        head = 0;
+        end = 0;
+    }
+}
+
+MessageView MessageArena::operator[](size_t index) const {
+    MessageView view;
+
+    if (index >= count) {
+        return view;
+    }
+
+    const Record& r = recordAt(index);
+    view.sender = r.sender;
+    view.id = r.id;
+    view.sequence = Message::sequenceOf(r.id);
+    view.timestamp = r.timestamp;
+    view.flags = r.flags;
+    view.length = r.length;
+    view.text = pool + r.offset;
+
+    return view;
+}
+
+size_t MessageArena::bytesUsed() const {
+    size_t used = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        used += recordAt(i).length + 1;
+    }
+
+    return used;
+}
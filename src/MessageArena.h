@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Message.h"
+
+// Non-owning view of a message stored in a MessageArena.
+// Valid until the arena it points into is changed.
+struct MessageView {
+    Message::Sender sender = Message::Sender::me;
+
+    // Sender's message id, 0 if unknown. The sequence number is its low 16 bits.
+    uint32_t id = 0;
+    uint16_t sequence = 0;
+
+    // Seconds on the device clock (see MessageHistory::now()), 0 if unknown.
+    uint32_t timestamp = 0;
+
+    uint8_t flags = 0;
+    uint8_t length = 0;
+
+    // Null terminated.
+    const char* text = "";
+};
+
+// Variable-length message storage.
+//
+// A Message reserves room for the longest possible text (243 bytes), while most messages
+// are a few dozen characters. An arena packs message texts back to back in a byte pool, and
+// keeps a small fixed-size record for each message (pool offset, length, sender, flags, id,
+// timestamp). Readers get MessageViews pointing straight into the pool, so nothing is
+// copied after the text is stored.
+//
+// Messages are kept oldest first. When pushing with eviction, the oldest messages are dropped
+// to make room, so the arena behaves like a circular buffer bounded by bytes as well as count.
+//
+// The arena doesn't own its storage; use MessageArenaStorage to declare one.
+class MessageArena {
+public:
+    struct Record {
+        uint16_t offset;
+        uint8_t length;
+        Message::Sender sender;
+        uint8_t flags;
+        uint32_t id;
+        uint32_t timestamp;
+    } __attribute__((packed));
+
+    MessageArena(Record* recordStorage, size_t recordCapacity, char* poolStorage, size_t poolSize) :
+        records(recordStorage),
+        capacity(recordCapacity),
+        pool(poolStorage),
+        poolCapacity(poolSize)
+    {}
+
+    // Store a message. If there isn't room and evict is true, the oldest messages are
+    // dropped until there is; otherwise nothing is stored. Returns false if nothing was stored.
+    bool push(Message::Sender sender, uint32_t id, uint8_t flags, uint32_t timestamp, const char* text, size_t length, bool evict);
+
+    // Drop the oldest message.
+    void shift();
+
+    void setFlags(size_t index, uint8_t flags) {
+        if (index < count) {
+            records[(head + index) % capacity].flags = flags;
+        }
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+        end = 0;
+    }
+
+    inline size_t size() const {
+        return count;
+    }
+
+    inline bool isEmpty() const {
+        return count == 0;
+    }
+
+    // Index 0 is the oldest message.
+    MessageView operator[](size_t index) const;
+
+    // Pool bytes in use, including the null terminators.
+    size_t bytesUsed() const;
+
+    inline size_t bytesCapacity() const {
+        return poolCapacity;
+    }
+
+private:
+    inline const Record& recordAt(size_t index) const {
+        return records[(head + index) % capacity];
+    }
+
+    // Find room for size bytes. Returns the pool offset, or -1 if there isn't room.
+    int32_t allocate(size_t size) const;
+
+private:
+    Record* records;
+    size_t capacity;
+    char* pool;
+    size_t poolCapacity;
+
+    // Oldest record, and number of records.
+    size_t head = 0;
+    size_t count = 0;
+
+    // Pool offset just past the newest text.
+    size_t end = 0;
+};
+
+// A MessageArena with its own storage.
+template<size_t recordCapacity, size_t poolSize>
+class MessageArenaStorage: public MessageArena {
+    // Offsets are 16 bits.
+    static_assert(poolSize <= 65535, "Pool too large");
+    static_assert(poolSize >= Message::bufferSize, "Pool must fit the longest message");
+
+public:
+    MessageArenaStorage() : MessageArena(recordStorage, recordCapacity, poolStorage, poolSize) {}
+
+    // The arena points into this object, so it can't be copied.
+    MessageArenaStorage(const MessageArenaStorage&) = delete;
+    MessageArenaStorage& operator=(const MessageArenaStorage&) = delete;
+
+private:
+    Record recordStorage[recordCapacity];
+    char poolStorage[poolSize];
+};
@@ -0,0 +1,177 @@
+#include "MessageHistory.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+void MessageHistory::invalidatePageCache() {
+    for (size_t i = 0; i < cachedPages; i++) {
+        pages[i].first = SIZE_MAX;
+        pages[i].messages.clear();
+    }
+}
+
+bool MessageHistory::loadPage(Page& page, size_t first) const {
+    // Only the part that's older than the RAM tail has to come from the archive.
+    const size_t archivedCount = messageCount - messages.size();
+    size_t count = pageSize;
+    if (first + count > archivedCount) {
+        count = archivedCount - first;
+    }
+
+    page.messages.clear();
+
+    if (archive->readMessages(first, count, page.messages) == 0) {
+        LOGFMT("Failed to read history page at %u\n", first);
+        page.first = SIZE_MAX;
+        return false;
+    }
+
+    page.first = first;
+    page.lastUsed = pageClock;
+
+    return true;
+}
+
+const MessageHistory::Page* MessageHistory::pageFor(size_t index) const {
+    pageClock++;
+
+    // Cached?
+    for (size_t i = 0; i < cachedPages; i++) {
+        if (pages[i].contains(index)) {
+            pages[i].lastUsed = pageClock;
+            cacheHits++;
+            return &pages[i];
+        }
+    }
+
+    cacheMisses++;
+
+    if (archive == nullptr) {
+        return nullptr;
+    }
+
+    const size_t first = index - (index % pageSize);
+
+    // Refill a partial copy of this page if we have one (the RAM tail moved on since it was read),
+    // otherwise replace the least recently used page.
+    Page* victim = &pages[0];
+    for (size_t i = 1; i < cachedPages; i++) {
+        if (victim->first != first && (pages[i].first == first || pages[i].lastUsed < victim->lastUsed)) {
+            victim = &pages[i];
+        }
+    }
+
+    if (!loadPage(*victim, first)) {
+        return nullptr;
+    }
+
+    // Long messages filled the page before reaching index; start the page at index instead.
+    if (!victim->contains(index) && !loadPage(*victim, index)) {
+        return nullptr;
+    }
+
+    return victim;
+}
+
+void MessageHistory::restoreMessage(Message::Sender sender, const char* text, size_t length, uint32_t id, uint8_t flags, uint32_t timestamp) {
+    messages.push(sender, id, flags, timestamp, text, length, true);
+    addedCount++;
+
+    // Nothing to read evicted messages back from, so only count what's still in RAM.
+    messageCount = (archive == nullptr) ? messages.size() : messageCount + 1;
+
+    if (sender == Message::Sender::them && id != 0 &&
+        (receivedHighWater == 0 || Message::isIdAfter(id, receivedHighWater))) 
+    {
+        receivedHighWater = id;
+    }
+
+    // Never let the clock run behind a message we already have.
+    const uint32_t current = now();
+    if (timestamp > current) {
+        clockOffset += timestamp - current;
+    }
+}
+
+void MessageHistory::setAckedThrough(uint16_t sequence) {
+    const uint32_t sent = sentHighWaterId();
+    if (sequence == 0 || sent == 0) {
+        return;
+    }
+
+    const uint32_t id = Message::idForSequence(sequence, sent);
+
+    if (ackedHighWater == 0 || Message::isIdAfter(id, ackedHighWater)) {
+        ackedHighWater = id;
+    }
+}
+
+void MessageHistory::skipSentPast(uint16_t sequence) {
+    nextId = Message::idForSequence(sequence, sentHighWaterId()) + 1;
+
+    if (Message::sequenceOf(nextId) == 0) {
+        nextId++;
+    }
+}
+
+bool MessageHistory::setStatus(uint32_t id, Message::Status status) {
+    for (size_t i = messages.size(); i > 0; i--) {
+        MessageView msg = messages[i - 1];
+
+        if (msg.sender == Message::Sender::me && msg.id == id) {
+            messages.setFlags(i - 1, Message::withStatus(msg.flags, status));
+            statusChanges[statusChangeCount % maxStatusChanges] = id;
+            statusChangeCount++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+MessageView MessageHistory::withDeliveryStatus(MessageView view) const {
+    if (view.sender == Message::Sender::me && view.id != 0 && ackedHighWater != 0 && 
+        !Message::isIdAfter(view.id, ackedHighWater)) 
+    {
+        view.flags = Message::withStatus(view.flags, Message::Status::acked);
+    }
+
+    return view;
+}
+
+MessageView MessageHistory::getMessage(size_t index) const {
+    if (messageCount == 0) {
+        return MessageView();
+    }
+
+    if (index >= messageCount) {
+        index = messageCount - 1;
+    }
+
+    // Newest messages are in RAM.
+    const size_t residentStart = messageCount - messages.size();
+    if (index >= residentStart) {
+        return withDeliveryStatus(messages[index - residentStart]);
+    }
+
+    const Page* page = pageFor(index);
+    if (page == nullptr) {
+        return MessageView();
+    }
+
+    return withDeliveryStatus(page->messages[index - page->first]);
+}
+
+int32_t MessageHistory::indexOf(Message::Sender sender, uint32_t id, size_t scanLimit) const {
+    const size_t stop = (messageCount > scanLimit) ? messageCount - scanLimit : 0;
+
+    for (size_t i = messageCount; i > stop; i--) {
+        MessageView msg = getMessage(i - 1);
+
+        if (msg.sender == sender && msg.id == id) {
+            return i - 1;
+        }
+    }
+
+    return -1;
+}
@@ -1,53 +1,280 @@
 #pragma once
 
 #include <Arduino.h>
-#include <CircularBuffer.hpp>
 #include "Message.h"
+#include "MessageArena.h"
+
+// Somewhere every message in the history is stored, oldest first (see HistoryJournal).
+class MessageArchive {
+public:
+    virtual ~MessageArchive() = default;
+
+    // Read up to maxCount messages, starting with message number first, and push them
+    // onto out until it's full. Returns the number of messages read; 0 on failure.
+    virtual size_t readMessages(size_t first, size_t maxCount, MessageArena& out) = 0;
+};
 
 class MessageHistory {
 public:
-    // Message history file format:
+    // Message history snapshot file format (messages.hst).
+    // Superseded by the journal (see HistoryJournal); only read to convert files from older firmware.
     // 0x0000: message version (1 byte)
     // 0x0001: message count (1 byte)
+    // 0x0002: next outgoing sequence number (2 bytes)
+    // 0x0004: highest sequence number received from the paired device (2 bytes)
     // ----- message 0
-    // 0x0002: message sender (1 byte)
-    // 0x0003: message string length (1 byte)
-    // 0x0004 to 0x0004 + <message string length>: message string (<message string length> bytes)
+    // 0x0006: message sender (1 byte)
+    // 0x0007: message sequence number (2 bytes)
+    // 0x0009: message string length (1 byte)
+    // 0x000A to 0x000A + <message string length>: message string (<message string length> bytes)
     // ----- message 1 ... <message count-1>
     // etc
     // -----
-    static constexpr uint8_t currentVersion = 1;
-    static constexpr int maxMessages = 10;
+    //
+    // Version 1 files have no sequence numbers; they're loaded with sequence 0.
+    static constexpr uint8_t snapshotVersion = 2;
+
+    // The newest messages are kept in RAM. Older messages are read back from the archive
+    // on demand, a page at a time, through a small LRU cache, so RAM use stays constant
+    // no matter how long the history gets.
+    //
+    // Both are MessageArenas, so short messages take little room:
+    // resident: 2048 byte pool + 32 * 13 byte records = 2.4 KB, holds at least 7 max length messages or
+    //           up to 32 short ones (was 10 * 243 byte Messages = 2.4 KB).
+    // cache:    4 pages * (1024 byte pool + 16 * 13 byte records) = 4.8 KB, holds 16 messages
+    //           per page unless they're long (was 4 pages * 8 Messages = 7.8 KB).
+    // getMessage() returns a view instead of copying a 243 byte Message.
+    static constexpr size_t maxResidentMessages = 32;
+    static constexpr size_t residentPoolSize = 2048;
+    static constexpr size_t pageSize = 16;
+    static constexpr size_t pagePoolSize = 1024;
+    static constexpr size_t cachedPages = 4;
+
+    // Messages are guaranteed to stay in RAM until at least this many newer ones are added.
+    // Up to one message worth of pool can be lost where the texts wrap around.
+    static constexpr size_t minResidentMessages = (residentPoolSize - Message::bufferSize) / Message::bufferSize;
 
 public:
-    void addMessage(Message::Sender sender, const char* text) {
-        Message msg(sender);
-        msg.setText(text);
-        messages.push(msg);
+    // Call with the store holding every message in the history, oldest first.
+    // Without one (no SD card), the history is only the messages in RAM.
+    void setArchive(MessageArchive* a) {
+        archive = a;
+        invalidatePageCache();
+
+        if (archive == nullptr) {
+            messageCount = messages.size();
+        }
+    }
+
+    // Status changes remembered until the next save (see HistoryJournal).
+    static constexpr size_t maxStatusChanges = 4;
+
+    // Add a message, stamped with the current time. id is the sender's message id, 0 if unknown.
+    void addMessage(Message::Sender sender, const char* text, uint32_t id = 0, Message::Status status = Message::Status::sent) {
+        if (sender == Message::Sender::them) {
+            status = Message::Status::acked;
+        }
+
+        restoreMessage(sender, text, strlen(text), id, Message::withStatus(0, status), now());
+    }
+
+    // Add a message read back from storage, with its original flags and timestamp.
+    void restoreMessage(Message::Sender sender, const char* text, size_t length, uint32_t id, uint8_t flags, uint32_t timestamp);
+
+    // Seconds on the device clock. There's no real time clock, so it only runs while the device
+    // is on, and carries on from the newest restored message after a restart.
+    inline uint32_t now() const {
+        return clockOffset + millis() / 1000;
     }
 
     inline bool isEmpty() const{
-        return messages.isEmpty();
+        return messageCount == 0;
     }
 
+    // Total number of messages, including the ones that are only in the archive.
+    // Without an archive, older messages are gone once they leave RAM, so they aren't counted.
     inline size_t size() const {
+        return messageCount;
+    }
+
+    // Number of the newest messages that are held in RAM.
+    inline size_t residentCount() const {
         return messages.size();
     }
 
-    Message getMessage(int index) {
-        size_t count = size();
+    // Returns an empty message if it can't be read from the archive.
+    // The view is valid until the next call to getMessage() or change to the history.
+    MessageView getMessage(size_t index) const;
+
+    // Clears the messages, but not the id counters, so the paired device
+    // can still tell new messages apart from ones it has already seen.
+    void clear() {
+        messages.clear();
+        messageCount = 0;
+        clearCount++;
+        invalidatePageCache();
+    }
+
+    // Clears the messages and the id counters, e.g. before loading another conversation.
+    void reset() {
+        clear();
+        nextId = 1;
+        receivedHighWater = 0;
+        ackedHighWater = 0;
+    }
+
+    // Reserve the id for the next outgoing message.
+    uint32_t takeId() {
+        const uint32_t id = nextId++;
 
-        if (index >= count) {
-            return messages[count - 1];
+        // Sequence number 0 means unknown.
+        if (Message::sequenceOf(nextId) == 0) {
+            nextId++;
         }
 
-        return messages[index];
+        return id;
     }
 
-    void clear() {
-        messages.clear();
+    // Id of the newest message we've sent, or 0 if none.
+    inline uint32_t sentHighWaterId() const {
+        if (nextId == 1) {
+            return 0;
+        }
+
+        const uint32_t id = nextId - 1;
+        return (Message::sequenceOf(id) == 0) ? id - 1 : id;
+    }
+
+    // Highest sequence number we've sent, or 0 if none.
+    inline uint16_t sentHighWater() const {
+        return Message::sequenceOf(sentHighWaterId());
+    }
+
+    // Highest message id received from the paired device, or 0 if none.
+    inline uint32_t receivedHighWaterId() const {
+        return receivedHighWater;
+    }
+
+    // Highest sequence number received from the paired device, or 0 if none.
+    inline uint16_t receivedHighWaterMark() const {
+        return Message::sequenceOf(receivedHighWater);
+    }
+
+    // Id of a message from the paired device that only came with its sequence number.
+    inline uint32_t receivedIdForSequence(uint16_t sequence) const {
+        return (receivedHighWater == 0) ? sequence : Message::idForSequence(sequence, receivedHighWater);
+    }
+
+    // Newest of our messages the paired device is known to have; it has every one up to it.
+    inline uint32_t ackedHighWaterId() const {
+        return ackedHighWater;
+    }
+
+    // The paired device has every one of our messages up to this sequence number.
+    void setAckedThrough(uint16_t sequence);
+
+    // The paired device has seen this sequence number from us, so continue after it.
+    void skipSentPast(uint16_t sequence);
+
+    // Change the delivery status of one of our messages still in RAM.
+    // Returns false if it's not there.
+    bool setStatus(uint32_t id, Message::Status status);
+
+    // Status changes so far, and the id of one of the last maxStatusChanges of them.
+    inline uint32_t totalStatusChanges() const {
+        return statusChangeCount;
+    }
+
+    inline uint32_t statusChangeId(uint32_t change) const {
+        return statusChanges[change % maxStatusChanges];
+    }
+
+    // Index of the message from this sender with this id among the newest scanLimit messages, or -1.
+    int32_t indexOf(Message::Sender sender, uint32_t id, size_t scanLimit = 64) const;
+
+    inline bool contains(Message::Sender sender, uint32_t id, size_t scanLimit = 64) const {
+        return indexOf(sender, id, scanLimit) >= 0;
+    }
+
+    // Sequence numbers wrap, so compare them with serial number arithmetic.
+    static inline bool isSequenceAfter(uint16_t a, uint16_t b) {
+        return int16_t(a - b) > 0;
+    }
+
+    // Used when loading the history.
+    void setIdState(uint32_t next, uint32_t received, uint32_t acked) {
+        nextId = (Message::sequenceOf(next) == 0) ? next + 1 : next;
+        receivedHighWater = received;
+        ackedHighWater = acked;
+    }
+
+    inline uint32_t nextSentId() const {
+        return nextId;
+    }
+
+    // Change counters, so persistence can write only what changed since it last saved.
+    // Both only ever increase.
+    inline uint32_t totalAdded() const {
+        return addedCount;
+    }
+
+    inline uint32_t totalCleared() const {
+        return clearCount;
+    }
+
+    // Page cache statistics.
+    inline uint32_t pageHits() const {
+        return cacheHits;
+    }
+
+    inline uint32_t pageMisses() const {
+        return cacheMisses;
     }
 
 private:
-    CircularBuffer<Message, maxMessages> messages;
-};
\ No newline at end of file
+    struct Page {
+        // Index of the first message in the page, or SIZE_MAX if the page is unused.
+        size_t first = SIZE_MAX;
+        uint32_t lastUsed = 0;
+        MessageArenaStorage<pageSize, pagePoolSize> messages;
+
+        inline bool contains(size_t index) const {
+            return first != SIZE_MAX && index >= first && index < first + messages.size();
+        }
+    };
+
+    void invalidatePageCache();
+
+    // Our messages up to the acked high water mark are acked, whatever their stored status.
+    MessageView withDeliveryStatus(MessageView view) const;
+
+    // Returns the cached page holding index, reading it from the archive if needed.
+    const Page* pageFor(size_t index) const;
+
+    // Fill page with messages from the archive, starting at first. Returns false on failure.
+    bool loadPage(Page& page, size_t first) const;
+
+private:
+    MessageArenaStorage<maxResidentMessages, residentPoolSize> messages;
+    size_t messageCount = 0;
+
+    MessageArchive* archive = nullptr;
+
+    // Cache state changes on reads.
+    mutable Page pages[cachedPages];
+    mutable uint32_t pageClock = 0;
+    mutable uint32_t cacheHits = 0;
+    mutable uint32_t cacheMisses = 0;
+
+    uint32_t nextId = 1;
+    uint32_t receivedHighWater = 0;
+    uint32_t ackedHighWater = 0;
+
+    uint32_t clockOffset = 0;
+
+    uint32_t statusChanges[maxStatusChanges] = {0};
+    uint32_t statusChangeCount = 0;
+
+    uint32_t addedCount = 0;
+    uint32_t clearCount = 0;
+};
@@ -0,0 +1,51 @@
+#include "Messenger.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+bool Messenger::serviceTxQueue() {
+    TrafficQueue::Entry entry;
+
+    // Don't start another transmission in the middle of one, except for acks.
+    const TrafficClass ackOnly = TrafficClass::ack;
+
+    if (!txQueue.dequeue(entry, transmitting ? &ackOnly : nullptr)) {
+        return false;
+    }
+
+    const bool wasTransmitting = transmitting;
+    transmitting = true;
+
+    const bool result = transmit(entry);
+
+    transmitting = wasTransmitting;
+    lastTicket = entry.ticket;
+    lastResult = result;
+
+    return true;
+}
+
+bool Messenger::txWait(const uint8_t* payload, uint8_t len) {
+    if (len > Message::maxLength) {
+        // Message length is too long.
+        return false;
+    }
+
+    const uint16_t ticket = enqueue(TrafficClass::message, payload, len);
+
+    if (ticket == 0) {
+        return false;
+    }
+
+    // Drain the queue until our message has been sent; anything ahead of it
+    // (acks, or lower classes that aged past it) goes out first.
+    while (lastTicket != ticket) {
+        if (!serviceTxQueue()) {
+            // Shouldn't happen; our message is queued.
+            LOGLN("Message vanished from the transmit queue");
+            return false;
+        }
+    }
+
+    return lastResult;
+}
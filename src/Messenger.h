@@ -3,6 +3,8 @@
 #include <Arduino.h>
 #include "Message.h"
 #include "Settings.h"
+#include "LinkStats.h"
+#include "TrafficQueue.h"
 
 // Base class interface for messengers.
 class Messenger {
@@ -11,7 +13,8 @@ public:
     virtual void updateRx() = 0;
 
     // Send payload to paired address and wait (blocking).
-    virtual bool txWait(const uint8_t* payload, uint8_t len) = 0;
+    // The payload is queued as TrafficClass::message, so pending acks go out first.
+    virtual bool txWait(const uint8_t* payload, uint8_t len);
 
     // Send a ping to the paired device (non-blocking).
     virtual void ping() = 0;
@@ -19,4 +22,34 @@ public:
     // Call this when settings have been updated by user to update addresses and encryption keys.
     // Return false if any settings failed to be updated.
     virtual bool settingsChanged(const Settings& settings, uint8_t changeFlags) = 0;
+
+    // Link statistics for the paired device.
+    virtual const LinkStats& linkStats() const = 0;
+
+    // Queue a frame for transmission in the given traffic class.
+    // Returns a ticket identifying the frame, or 0 if the class's queue is full.
+    uint16_t enqueue(TrafficClass c, const uint8_t* frame, uint8_t len, const uint8_t* destination = nullptr, uint8_t destinationLength = 0) {
+        return txQueue.enqueue(c, frame, len, destination, destinationLength);
+    }
+
+    // Transmit the next queued frame, if any. Returns true if a frame was transmitted.
+    // When called while another frame is being transmitted (e.g. from updateRx() while
+    // waiting for an ack), only acks are sent.
+    bool serviceTxQueue();
+
+    const TrafficQueue& trafficQueue() const {
+        return txQueue;
+    }
+
+protected:
+    // Transmit a single queued frame (blocking). Returns true on success.
+    virtual bool transmit(const TrafficQueue::Entry& entry) = 0;
+
+private:
+    TrafficQueue txQueue;
+    bool transmitting = false;
+
+    // Ticket and result of the last transmitted frame, so txWait() can pick up its result.
+    uint16_t lastTicket = 0;
+    bool lastResult = false;
 };
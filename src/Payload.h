@@ -0,0 +1,103 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Message.h"
+
+// Application payloads carried by the messengers.
+// The first byte of every payload identifies its type. Firmware from before typed payloads
+// sends the bare text instead, which never starts with one of these control characters.
+namespace Payload {
+    enum class Type: uint8_t {
+        // A user message from older firmware: TextHeader followed by the message text (not null terminated).
+        // Still accepted; the id is worked out from the sequence number.
+        text = 0x01,
+
+        // History sync digest: SyncDigest.
+        syncDigest = 0x02,
+
+        // History sync batch: SyncBatchHeader followed by SyncBatchEntry + text, repeated.
+        syncBatch = 0x03,
+
+        // A user message: MessageHeader followed by the message text (not null terminated).
+        message = 0x04,
+    };
+
+    struct TextHeader {
+        Type type;
+        uint16_t sequence;
+    } __attribute__((packed));
+
+    struct MessageHeader {
+        Type type;
+
+        // Sender's message id; a resent message keeps its id, so the receiver can drop the copy.
+        uint32_t id;
+    } __attribute__((packed));
+
+    struct SyncDigest {
+        Type type;
+
+        // Highest sequence number the sender has sent, 0 if none.
+        uint16_t sentHighWater;
+
+        // Highest sequence number the sender has received from us, 0 if none.
+        uint16_t receivedHighWater;
+
+        // Rolling hash of the messages the sender has received from us, covering the
+        // HistorySync::hashWindow sequence numbers ending at receivedHighWater.
+        // unknownHash if the sender couldn't find them all in its history to hash.
+        uint32_t receivedHash;
+    } __attribute__((packed));
+
+    static constexpr uint32_t unknownHash = 0;
+
+    struct SyncBatchHeader {
+        Type type;
+        uint8_t count;
+    } __attribute__((packed));
+
+    struct SyncBatchEntry {
+        uint16_t sequence;
+        uint8_t length;
+    } __attribute__((packed));
+
+    static_assert(sizeof(SyncBatchHeader) + sizeof(SyncBatchEntry) + Message::maxTextLength <= Message::maxLength,
+        "A full length message must fit in a single sync batch");
+
+    static_assert(sizeof(MessageHeader) + Message::maxTextLength <= Message::maxLength,
+        "A full length message must fit in a single message payload");
+
+    // Returns the payload type, or 0 if the payload is empty.
+    inline uint8_t typeOf(const uint8_t* payload, uint32_t len) {
+        return (len == 0) ? 0 : payload[0];
+    }
+
+    // True if the payload is bare text from firmware that predates typed payloads.
+    inline bool isLegacyText(const uint8_t* payload, uint32_t len) {
+        return len > 0 && (payload[0] >= 0x20 || payload[0] == '\t' || payload[0] == '\n' || payload[0] == '\r');
+    }
+
+    // Build a message payload for firmware that predates typed payloads: the bare text.
+    inline uint8_t encodeLegacyText(uint8_t* out, const char* text, size_t textLength) {
+        if (textLength > Message::maxTextLength) {
+            textLength = Message::maxTextLength;
+        }
+
+        memcpy(out, text, textLength);
+        return textLength;
+    }
+
+    // Build a message payload. out must hold at least Message::maxLength bytes.
+    // Returns the payload length.
+    inline uint8_t encodeMessage(uint8_t* out, uint32_t id, const char* text, size_t textLength) {
+        if (textLength > Message::maxTextLength) {
+            textLength = Message::maxTextLength;
+        }
+
+        MessageHeader header = {Type::message, id};
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + sizeof(header), text, textLength);
+
+        return sizeof(header) + textLength;
+    }
+}
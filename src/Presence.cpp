@@ -0,0 +1,109 @@
+#include "Presence.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+void Presence::begin(Messenger* m) {
+    messenger = m;
+    startTimestamp = millis();
+
+    // Send the first ping soon after launch.
+    // Randomize to reduce chances that two turned on at the same time
+    // will send their first ping at the exact same time.
+    scheduleNextPing(startTimestamp, random(3000, 6000));
+}
+
+void Presence::scheduleNextPing(uint32_t now, uint32_t delay) {
+    nextPingTimestamp = now + delay;
+}
+
+void Presence::pingReceived() {
+    if (messenger == nullptr) {
+        return;
+    }
+
+    const uint32_t now = millis();
+
+    // If the peer hasn't heard from us in a while, its view of us is stale; answer soon.
+    if (messenger->linkStats().idleTime(now) >= freshIntervalMS) {
+        scheduleNextPing(now, random(minPingReplyDelayMS, maxPingReplyDelayMS));
+        replyPending = true;
+    }
+}
+
+void Presence::update() {
+    if (messenger == nullptr) {
+        return;
+    }
+
+    const uint32_t now = millis();
+    const LinkStats& link = messenger->linkStats();
+
+    // New traffic resets the ping back-off.
+    if (link.heard && link.lastHeard != lastHeard) {
+        lastHeard = link.lastHeard;
+        pingInterval = minPingIntervalMS;
+
+        // No need for a ping until the link goes quiet again.
+        if (!replyPending && int32_t(nextPingTimestamp - (lastHeard + freshIntervalMS)) < 0) {
+            scheduleNextPing(lastHeard, freshIntervalMS);
+        }
+    }
+
+    const uint32_t quiet = link.heard ? link.quietTime(now) : (now - startTimestamp);
+
+    State newState;
+
+    if (quiet >= unreachableTimeoutMS) {
+        newState = State::unreachable;
+    }
+    else if (!link.heard) {
+        newState = State::unknown;
+    }
+    else if (quiet >= freshIntervalMS) {
+        newState = State::stale;
+    }
+    else {
+        newState = State::reachable;
+    }
+
+    if (newState != state) {
+        LOGFMT("Presence: %s -> %s (rssi: %d, snr: %d, pdr: %d%%)\n",
+            stateName(state), stateName(newState), link.rssi(), link.snr(), link.deliveryPercent());
+
+        state = newState;
+
+        if (stateChangedCallback) {
+            stateChangedCallback(state);
+        }
+    }
+
+    if (int32_t(now - nextPingTimestamp) < 0) {
+        return;
+    }
+
+    messenger->ping();
+    replyPending = false;
+
+    // Back off while the peer stays quiet. Jitter keeps two devices from pinging in lockstep.
+    scheduleNextPing(now, pingInterval + random(0, pingInterval / 4));
+    pingInterval = min(pingInterval * 2, maxPingIntervalMS);
+}
+
+const char* Presence::stateName(State s) {
+    switch (s) {
+        case State::unknown:
+            return "unknown";
+
+        case State::reachable:
+            return "reachable";
+
+        case State::stale:
+            return "stale";
+
+        case State::unreachable:
+            return "unreachable";
+    }
+
+    return "";
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Messenger.h"
+
+// Tracks whether the paired device is reachable, and decides when a ping is actually needed.
+// Any traffic from the peer counts as proof of life, so pings only go out when the link has
+// gone quiet. While the peer stays quiet, pings back off exponentially to save airtime and power.
+class Presence {
+public:
+    enum class State: uint8_t {
+        // We haven't heard from the peer since boot.
+        unknown,
+
+        // We heard from the peer recently.
+        reachable,
+
+        // The link has been quiet for a while.
+        stale,
+
+        // We haven't heard from the peer for a long time.
+        unreachable,
+    };
+
+    // No pings are needed while traffic flowed within this window.
+    static constexpr uint32_t freshIntervalMS = 90 * 1000;
+
+    // Quiet for this long and the peer is considered unreachable.
+    static constexpr uint32_t unreachableTimeoutMS = 5 * 60 * 1000;
+
+    // Ping interval while stale. Doubles after each unanswered ping, up to the max.
+    static constexpr uint32_t minPingIntervalMS = 15 * 1000;
+    static constexpr uint32_t maxPingIntervalMS = 4 * 60 * 1000;
+
+    // Delay before answering a ping when we haven't transmitted recently,
+    // so the peer gets to hear from us too.
+    static constexpr uint32_t minPingReplyDelayMS = 500;
+    static constexpr uint32_t maxPingReplyDelayMS = 2000;
+
+    void begin(Messenger* m);
+
+    // Call often, for example in loop(). May send a ping.
+    void update();
+
+    // Call when a ping is received from the peer.
+    void pingReceived();
+
+    void setStateChangedCallback(void (*cb)(State)) {
+        stateChangedCallback = cb;
+    }
+
+    inline State getState() const {
+        return state;
+    }
+
+    static const char* stateName(State s);
+
+private:
+    void scheduleNextPing(uint32_t now, uint32_t delay);
+
+private:
+    Messenger* messenger = nullptr;
+
+    void (*stateChangedCallback)(State) = nullptr;
+
+    State state = State::unknown;
+
+    uint32_t startTimestamp = 0;
+    uint32_t nextPingTimestamp = 0;
+    uint32_t pingInterval = minPingIntervalMS;
+
+    // So we can tell when new traffic arrived since the last update.
+    uint32_t lastHeard = 0;
+
+    // A ping reply is scheduled; don't let new traffic push it back.
+    bool replyPending = false;
+};
@@ -15,22 +15,55 @@ public:
     // However, final layout has not yet been performed.
     virtual void willLoadScreen() {}
 
-    // Screen is loaded and final layout has been performed.
+    // Screen is laid out and about to be shown, either just built or kept in the scene cache.
+    // Take the keyboard group and bar buttons here.
+    virtual void willAppear() {}
+
+    // Screen is loaded and final layout has been performed. Only called the first time.
     virtual void didLoadScreen() {}
 
-    // Screen is about to be unloaded
+    // Another scene is taking over the screen. Give back the keyboard group and bar buttons;
+    // a cached scene may appear again later.
+    virtual void didDisappear() {}
+
+    // Screen is about to be deleted, along with the scene.
     virtual void willUnloadScreen() {}
 
     // Called once every device update loop.
     virtual void update(uint32_t dt) {}
 
-    // Called whenever the device receives a text mesage.
+    // Called whenever the device receives a text mesage, on the current scene only.
     virtual void receivedMessage(const char* message) {}
 
+    // History changes go to cached scenes too, so they're up to date when they appear.
+
+    // Called when messages were added to the end of the history. Indices don't move: older
+    // messages go to the archive but keep theirs, so only the new ones need drawing.
+    virtual void historyAppended(size_t appended) {}
+
+    // Called when the message history changed other than by appending,
+    // e.g. once it has been loaded after the first frame.
+    virtual void historyChanged() {}
+
+    inline bool isShown() const {
+        return shown;
+    }
+
 protected:
     Device& device;
     lv_obj_t* screen = nullptr;
 
+private:
+    // Set by the scene manager.
+    bool shown = false;
+
+    // Scenes of the same type share a key; null if not cached.
+    const void* cacheKey = nullptr;
+
+    // Memory the screen took to build, and when it was last shown.
+    size_t cacheBytes = 0;
+    uint32_t lastShown = 0;
+
     // So the scene manager can set the scene's screen.
     friend SceneManager;
 };
\ No newline at end of file
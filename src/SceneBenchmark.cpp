@@ -0,0 +1,232 @@
+#include "SceneBenchmark.h"
+#include "Crc32.h"
+#include "SceneManager.h"
+#include "Scenes/Conversation/ConversationScene.h"
+#include "Scenes/Compose/ComposeScene.h"
+#include "Scenes/Settings/SettingsScene.h"
+
+namespace {
+    const char* sampleText = "The quick brown fox jumps over the lazy dog. ";
+
+    const SceneBenchmark::Step script[] = {
+        {"open conversation",   SceneBenchmark::Action::openScene,  uint32_t(SceneBenchmark::SceneId::conversation), 1},
+        {"scroll up",           SceneBenchmark::Action::key,        LV_KEY_UP,          100},
+        {"scroll down",         SceneBenchmark::Action::key,        LV_KEY_DOWN,        100},
+        {"open compose",        SceneBenchmark::Action::openScene,  uint32_t(SceneBenchmark::SceneId::compose), 1},
+        // Erases as many characters as it types; a draft over 34 characters long loses the rest.
+        {"type",                SceneBenchmark::Action::type,       0,                  200},
+        {"erase",               SceneBenchmark::Action::key,        LV_KEY_BACKSPACE,   200},
+        {"open settings",       SceneBenchmark::Action::openScene,  uint32_t(SceneBenchmark::SceneId::settings), 1},
+        {"switch tabs",         SceneBenchmark::Action::barButton,  uint32_t(Device::BarButton::one), 8},
+        {"back to conversation",SceneBenchmark::Action::openScene,  uint32_t(SceneBenchmark::SceneId::conversation), 1},
+    };
+
+    const size_t scriptLength = sizeof(script) / sizeof(script[0]);
+}
+
+void SceneBenchmark::begin(Device& d, lv_display_t* display) {
+    device = &d;
+
+    lv_display_add_event_cb(display, displayEvent, LV_EVENT_REFR_START, this);
+    lv_display_add_event_cb(display, displayEvent, LV_EVENT_REFR_READY, this);
+}
+
+void SceneBenchmark::start() {
+    if (device == nullptr || running) {
+        return;
+    }
+
+    started = true;
+    running = true;
+    stepIndex = 0;
+
+    Serial.println("kind,step,frame,render_us,pixels,hash");
+    Serial.println("kind,step,frames,p50_us,p90_us,max_us,pixels,hash");
+
+    beginStep();
+}
+
+void SceneBenchmark::beginStep() {
+    repetition = 0;
+    phase = Phase::ready;
+
+    renderMicros.reset();
+    stepPixels = 0;
+    stepHash = Crc32::initial;
+    frameIndex = 0;
+}
+
+void SceneBenchmark::finishStep() {
+    Serial.printf("step,%s,%u,%u,%u,%u,%u,%08x\n",
+        script[stepIndex].name,
+        (unsigned)renderMicros.count,
+        (unsigned)renderMicros.percentile(50),
+        (unsigned)renderMicros.percentile(90),
+        (unsigned)renderMicros.maximum,
+        (unsigned)stepPixels,
+        (unsigned)stepHash);
+}
+
+void SceneBenchmark::update() {
+    if (!running) {
+        return;
+    }
+
+    const Step& step = script[stepIndex];
+
+    if (phase == Phase::ready) {
+        if (repetition == step.repeat) {
+            phase = Phase::settle;
+            lastDrawn = millis();
+            return;
+        }
+
+        if (step.action == Action::openScene) {
+            openScene(SceneId(step.value));
+            phase = Phase::waitFrame;
+        }
+        else {
+            phase = Phase::press;
+        }
+    }
+    else if (phase == Phase::settle && millis() - lastDrawn >= settleMS) {
+        finishStep();
+        stepIndex++;
+
+        if (stepIndex == scriptLength) {
+            running = false;
+            Serial.println("Scene benchmark finished");
+            return;
+        }
+
+        beginStep();
+    }
+}
+
+void SceneBenchmark::openScene(SceneId scene) {
+    switch (scene) {
+        case SceneId::conversation:
+            device->sceneManager.gotoCachedScene<ConversationScene>(*device);
+            break;
+
+        case SceneId::compose:
+            device->sceneManager.gotoCachedScene<ComposeScene>(*device);
+            break;
+
+        case SceneId::settings:
+            device->sceneManager.gotoCachedScene<SettingsScene>(*device);
+            break;
+    }
+}
+
+uint32_t SceneBenchmark::currentKey() const {
+    const Step& step = script[stepIndex];
+
+    if (step.action == Action::type) {
+        return sampleText[repetition % strlen(sampleText)];
+    }
+
+    return step.value;
+}
+
+void SceneBenchmark::readKeyboard(lv_indev_data_t* data) {
+    const Step& step = script[stepIndex];
+
+    if (!running || (step.action != Action::key && step.action != Action::type)) {
+        return;
+    }
+
+    if (phase == Phase::press) {
+        data->key = currentKey();
+        data->state = LV_INDEV_STATE_PRESSED;
+        phase = Phase::release;
+    }
+    else if (phase == Phase::release) {
+        data->key = currentKey();
+        data->state = LV_INDEV_STATE_RELEASED;
+        phase = Phase::waitFrame;
+    }
+}
+
+void SceneBenchmark::readBarButton(uint8_t index, lv_indev_data_t* data) {
+    const Step& step = script[stepIndex];
+    data->state = LV_INDEV_STATE_RELEASED;
+
+    if (!running || step.action != Action::barButton || step.value != index) {
+        return;
+    }
+
+    if (phase == Phase::press) {
+        data->state = LV_INDEV_STATE_PRESSED;
+        phase = Phase::release;
+    }
+    else if (phase == Phase::release) {
+        phase = Phase::waitFrame;
+    }
+}
+
+void SceneBenchmark::flushed(const lv_area_t* area, const uint8_t* pixels) {
+    if (!running) {
+        return;
+    }
+
+    // Hashing isn't part of drawing the frame, so it's taken out of the render time.
+    const uint32_t start = micros();
+    const uint32_t size = lv_area_get_size(area);
+
+    frameHash = Crc32::update(frameHash, area, sizeof(lv_area_t));
+    frameHash = Crc32::update(frameHash, pixels, size * (LV_COLOR_DEPTH / 8));
+    framePixels += size;
+
+    hashMicros += micros() - start;
+}
+
+void SceneBenchmark::displayEvent(lv_event_t* e) {
+    SceneBenchmark* benchmark = (SceneBenchmark*)lv_event_get_user_data(e);
+
+    if (!benchmark->running) {
+        return;
+    }
+
+    switch (lv_event_get_code(e)) {
+        case LV_EVENT_REFR_START:
+            benchmark->frameStart = micros();
+            benchmark->framePixels = 0;
+            benchmark->frameHash = Crc32::initial;
+            benchmark->hashMicros = 0;
+            break;
+
+        case LV_EVENT_REFR_READY:
+            benchmark->frameFinished();
+            break;
+
+        default:
+            break;
+    }
+}
+
+void SceneBenchmark::frameFinished() {
+    if (framePixels > 0) {
+        const uint32_t render = micros() - frameStart - hashMicros;
+
+        renderMicros.add(render);
+        stepPixels += framePixels;
+        stepHash = Crc32::update(stepHash, &frameHash, sizeof(frameHash));
+        lastDrawn = millis();
+
+        Serial.printf("frame,%s,%u,%u,%u,%08x\n",
+            script[stepIndex].name,
+            (unsigned)frameIndex,
+            (unsigned)render,
+            (unsigned)framePixels,
+            (unsigned)frameHash);
+
+        frameIndex++;
+    }
+
+    // The interaction has been drawn, if it changed anything.
+    if (phase == Phase::waitFrame) {
+        repetition++;
+        phase = Phase::ready;
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Arduino.h>
+#include <lvgl.h>
+#include "Device.h"
+#include "Histogram.h"
+
+// Replays a fixed script of interactions through the real scenes and input devices, and
+// reports how long every frame took to draw, how many pixels it sent, and a hash of them.
+//
+// Only built into the firmware when BENCHMARK_SCENES is defined in config.h. The script opens
+// the conversation and scrolls it, types and erases text in compose, and cycles through the
+// settings tabs. Keys and bar buttons are fed to LVGL through the same read callbacks as the
+// keyboard, so the scenes handle them exactly as they would a person's.
+//
+// Output goes to the serial console as CSV: a "frame" row per frame, then a "step" row per
+// step of the script with the frame statistics and a hash of all its frames. Comparing hashes
+// between builds shows which steps draw something different.
+class SceneBenchmark {
+public:
+    enum class Action: uint8_t {
+        // Go to a scene. value is a SceneId.
+        openScene = 0,
+
+        // Press and release an LVGL key. value is the key.
+        key,
+
+        // Type the next character of the sample text.
+        type,
+
+        // Press and release a bar button. value is the button's index.
+        barButton,
+    };
+
+    enum class SceneId: uint8_t {
+        conversation = 0,
+        compose,
+        settings,
+    };
+
+    struct Step {
+        const char* name;
+        Action action;
+        uint32_t value;
+        uint16_t repeat;
+    };
+
+    // After the last interaction of a step, wait until nothing has been drawn for this long,
+    // so scroll animations and the like are counted in the step that started them.
+    static constexpr uint32_t settleMS = 500;
+
+    // Start recording frames drawn on display.
+    void begin(Device& d, lv_display_t* display);
+
+    // Run the script once. The current scene is replaced.
+    void start();
+
+    inline bool isRunning() const {
+        return running;
+    }
+
+    inline bool hasRun() const {
+        return started;
+    }
+
+    // Call once per main loop iteration, after lv_timer_handler().
+    void update();
+
+    // Call from the keyboard read callback instead of reading the keyboard while running.
+    void readKeyboard(lv_indev_data_t* data);
+
+    // Call from the bar button read callback instead of reading the keyboard while running.
+    void readBarButton(uint8_t index, lv_indev_data_t* data);
+
+    // Call from the flush callback with the pixels sent.
+    void flushed(const lv_area_t* area, const uint8_t* pixels);
+
+private:
+    enum class Phase: uint8_t {
+        // Start the next interaction of the current step.
+        ready = 0,
+
+        // The next read reports the key or button pressed.
+        press,
+
+        // The next read reports it released.
+        release,
+
+        // Waiting for a refresh after the interaction.
+        waitFrame,
+
+        // Waiting for the screen to stop changing before finishing the step.
+        settle,
+    };
+
+    static void displayEvent(lv_event_t* e);
+
+    void frameFinished();
+    void beginStep();
+    void finishStep();
+    void openScene(SceneId scene);
+
+    // Key sent by the current interaction.
+    uint32_t currentKey() const;
+
+private:
+    Device* device = nullptr;
+
+    bool started = false;
+    bool running = false;
+
+    size_t stepIndex = 0;
+    uint16_t repetition = 0;
+    Phase phase = Phase::ready;
+
+    // Current frame.
+    uint32_t frameStart = 0;
+    uint32_t framePixels = 0;
+    uint32_t frameHash = 0;
+    uint32_t hashMicros = 0;
+
+    // Current step.
+    Histogram renderMicros;
+    uint32_t stepPixels = 0;
+    uint32_t stepHash = 0;
+    uint32_t frameIndex = 0;
+    uint32_t lastDrawn = 0;
+};
@@ -1,12 +1,21 @@
-
 #include "SceneManager.h"
 #include "Scene.h"
+#include "lvgl_allocator.h"
 #include <lvgl.h>
 
+// #define LOGGER Serial
+#include "Logger.h"
+
 SceneManager::~SceneManager() {
-    if (currentScene != nullptr) {
+    if (currentScene != nullptr && !isCached(currentScene)) {
         delete currentScene;
-        currentScene = nullptr;
+    }
+
+    currentScene = nullptr;
+
+    for (size_t i = 0; i < maxCachedScenes; i++) {
+        delete cache[i];
+        cache[i] = nullptr;
     }
 }
 
@@ -17,51 +26,243 @@ void SceneManager::update(uint32_t dt) {
 }
 
 void SceneManager::gotoScene(Scene* s) {
-    if (currentScene != nullptr) {
-        currentScene->willUnloadScreen();
-        delete currentScene;
+    if (s != nullptr && s == currentScene) {
+        return;
     }
 
-    // The next scene is now the current scene.
-    currentScene = s;
+    const uint32_t start = micros();
+    const uint32_t allocationsBefore = lvglAllocationStats().allocations;
+    const bool cached = s != nullptr && s->screen != nullptr;
 
     // Gonna need this in a sec
     lv_obj_t* previousScreen = lv_screen_active();
+    bool keepPreviousScreen = false;
 
-    // Create screne and provide default setup.
-    lv_obj_t* screen = lv_obj_create(NULL);
-    lv_obj_set_size(screen, Device::displayWidth, Device::displayHeight);
-    lv_obj_set_pos(screen, 0, 0);
-    lv_obj_set_style_bg_color(screen, lv_color_black(), 0);
-    lv_obj_remove_flag(screen, LV_OBJ_FLAG_SCROLLABLE);
+    if (currentScene != nullptr) {
+        currentScene->didDisappear();
+        currentScene->shown = false;
+
+        if (isCached(currentScene)) {
+            keepPreviousScreen = true;
+        }
+        else {
+            currentScene->willUnloadScreen();
+            delete currentScene;
+        }
+    }
+
+    // The next scene is now the current scene.
+    currentScene = s;
 
     if (currentScene == nullptr) {
         // Load default empty screen
-        lv_screen_load(screen);
+        lv_screen_load(createScreen());
+    }
+    else if (cached) {
+        // Already built and laid out.
+        currentScene->willAppear();
+        currentScene->shown = true;
+        lv_screen_load(currentScene->screen);
     }
     else {
+        const size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+
         // Our scene now can access the screen.
-        currentScene->screen = screen;
+        currentScene->screen = createScreen();
 
-        // Let the current scene set up the screen and then load it.
+        // Let the current scene set up the screen and lay it out.
         currentScene->willLoadScreen();
-        lv_screen_load(screen);
+        lv_obj_update_layout(currentScene->screen);
 
-        // Lay the new screen out
-        lv_obj_update_layout(screen);
+        const size_t freeAfter = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+        currentScene->cacheBytes = (freeBefore > freeAfter) ? freeBefore - freeAfter : 0;
+
+        // Then load it.
+        currentScene->willAppear();
+        currentScene->shown = true;
+        lv_screen_load(currentScene->screen);
 
         // And let the scene know we finished loading and laying out the screen.
         currentScene->didLoadScreen();
-    }    
 
-    // Delete the previous screen
-    if (previousScreen != nullptr) {
-        lv_obj_del(previousScreen);
+        if (currentScene->cacheKey != nullptr) {
+            addToCache(currentScene);
+        }
+    }
+
+    if (currentScene != nullptr) {
+        currentScene->lastShown = ++showCount;
+    }
+
+    // Delete the previous screen, unless its scene is cached.
+    if (previousScreen != nullptr && !keepPreviousScreen) {
+        lv_obj_delete(previousScreen);
     }
+
+    trimCache();
+
+    const uint32_t elapsed = micros() - start;
+    const uint32_t allocations = lvglAllocationStats().allocations - allocationsBefore;
+
+    transitionMicros[cached].add(elapsed);
+    transitionAllocations[cached].add(allocations);
+
+    LOGFMT("Scene transition (%s): %u us, %u LVGL allocations\n",
+        cached ? "cached" : "built", (unsigned)elapsed, (unsigned)allocations);
 }
 
 void SceneManager::receivedMessage(const char* message) {
     if (currentScene != nullptr) {
         currentScene->receivedMessage(message);
     }
-}
\ No newline at end of file
+}
+
+void SceneManager::historyAppended(size_t appended) {
+    if (currentScene != nullptr && !isCached(currentScene)) {
+        currentScene->historyAppended(appended);
+    }
+
+    for (size_t i = 0; i < maxCachedScenes; i++) {
+        if (cache[i] != nullptr) {
+            cache[i]->historyAppended(appended);
+        }
+    }
+}
+
+void SceneManager::historyChanged() {
+    if (currentScene != nullptr && !isCached(currentScene)) {
+        currentScene->historyChanged();
+    }
+
+    for (size_t i = 0; i < maxCachedScenes; i++) {
+        if (cache[i] != nullptr) {
+            cache[i]->historyChanged();
+        }
+    }
+}
+
+void SceneManager::printStats(Print& out) const {
+    const char* kinds[] = {"built", "cached"};
+
+    for (size_t i = 0; i < 2; i++) {
+        const Histogram& times = transitionMicros[i];
+
+        out.printf("scene transitions %s: %u, p50 %u us, p90 %u us, max %u us, %u LVGL allocations each\n",
+            kinds[i],
+            (unsigned)times.count,
+            (unsigned)times.percentile(50),
+            (unsigned)times.percentile(90),
+            (unsigned)times.maximum,
+            (unsigned)transitionAllocations[i].mean());
+    }
+
+    size_t count = 0;
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < maxCachedScenes; i++) {
+        if (cache[i] != nullptr) {
+            count++;
+            bytes += cache[i]->cacheBytes;
+        }
+    }
+
+    out.printf("scene cache: %u scenes, %u bytes, %u evictions\n",
+        (unsigned)count, (unsigned)bytes, (unsigned)evictions);
+}
+
+void SceneManager::setCacheKey(Scene* scene, const void* key) {
+    scene->cacheKey = key;
+}
+
+lv_obj_t* SceneManager::createScreen() {
+    // Create screne and provide default setup.
+    lv_obj_t* screen = lv_obj_create(NULL);
+    lv_obj_set_size(screen, Device::displayWidth, Device::displayHeight);
+    lv_obj_set_pos(screen, 0, 0);
+    lv_obj_set_style_bg_color(screen, lv_color_black(), 0);
+    lv_obj_remove_flag(screen, LV_OBJ_FLAG_SCROLLABLE);
+
+    return screen;
+}
+
+Scene* SceneManager::findCached(const void* key) const {
+    for (size_t i = 0; i < maxCachedScenes; i++) {
+        if (cache[i] != nullptr && cache[i]->cacheKey == key) {
+            return cache[i];
+        }
+    }
+
+    return nullptr;
+}
+
+bool SceneManager::isCached(const Scene* scene) const {
+    for (size_t i = 0; i < maxCachedScenes; i++) {
+        if (cache[i] == scene) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SceneManager::addToCache(Scene* scene) {
+    size_t slot = maxCachedScenes;
+    size_t oldest = maxCachedScenes;
+
+    for (size_t i = 0; i < maxCachedScenes; i++) {
+        if (cache[i] == nullptr) {
+            slot = i;
+            break;
+        }
+
+        if (cache[i] != currentScene && (oldest == maxCachedScenes || cache[i]->lastShown < cache[oldest]->lastShown)) {
+            oldest = i;
+        }
+    }
+
+    // Full; make room.
+    if (slot == maxCachedScenes) {
+        slot = oldest;
+        evict(slot);
+    }
+
+    cache[slot] = scene;
+}
+
+void SceneManager::evict(size_t index) {
+    Scene* scene = cache[index];
+    cache[index] = nullptr;
+    evictions++;
+
+    LOGFMT("Evicting cached scene: %u bytes\n", (unsigned)scene->cacheBytes);
+
+    // Its screen isn't the active one, so it can go right away.
+    scene->willUnloadScreen();
+    lv_obj_delete(scene->screen);
+    delete scene;
+}
+
+void SceneManager::trimCache() {
+    while (true) {
+        size_t bytes = 0;
+        size_t oldest = maxCachedScenes;
+
+        for (size_t i = 0; i < maxCachedScenes; i++) {
+            if (cache[i] == nullptr) {
+                continue;
+            }
+
+            bytes += cache[i]->cacheBytes;
+
+            if (cache[i] != currentScene && (oldest == maxCachedScenes || cache[i]->lastShown < cache[oldest]->lastShown)) {
+                oldest = i;
+            }
+        }
+
+        if (bytes <= cacheBudget || oldest == maxCachedScenes) {
+            return;
+        }
+
+        evict(oldest);
+    }
+}
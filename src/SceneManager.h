@@ -1,11 +1,25 @@
 #pragma once
 
 #include <Arduino.h>
+#include <lvgl.h>
+#include "Histogram.h"
 
+class Device;
 class Scene;
 
+// Shows one scene at a time.
+//
+// Scenes got from cachedScene() keep their screen when another scene takes over, so going
+// back to them loads the screen instead of rebuilding it. The scenes shown least recently are
+// deleted when there are more than maxCachedScenes, or when their screens took more than
+// cacheBudget bytes to build. Other scenes are deleted as soon as they're left.
 class SceneManager {
 public:
+    static constexpr size_t maxCachedScenes = 4;
+
+    // LVGL allocates from PSRAM (see lvgl_allocator.cpp), so there's room for a few screens.
+    static constexpr size_t cacheBudget = 128 * 1024;
+
     ~SceneManager();
 
     // Update the current scene.
@@ -14,9 +28,60 @@ public:
     // Transition to another scene
     void gotoScene(Scene* s);
 
+    // The cached scene of type T, or a new one, cached once it's shown. Pass it to gotoScene().
+    template<class T>
+    T* cachedScene(Device& device) {
+        const void* key = cacheKey<T>();
+        T* scene = static_cast<T*>(findCached(key));
+
+        if (scene == nullptr) {
+            scene = new T(device);
+            setCacheKey(scene, key);
+        }
+
+        return scene;
+    }
+
+    template<class T>
+    void gotoCachedScene(Device& device) {
+        gotoScene(cachedScene<T>(device));
+    }
+
     // Event handling
     void receivedMessage(const char* message);
+    void historyAppended(size_t appended);
+    void historyChanged();
+
+    // Transition times and LVGL allocations, built and cached, and what's in the cache.
+    void printStats(Print& out) const;
+
+private:
+    // One per scene type.
+    template<class T>
+    static const void* cacheKey() {
+        static const char key = 0;
+        return &key;
+    }
+
+    static void setCacheKey(Scene* scene, const void* key);
+    static lv_obj_t* createScreen();
+
+    Scene* findCached(const void* key) const;
+    bool isCached(const Scene* scene) const;
+
+    void addToCache(Scene* scene);
+    void evict(size_t index);
+
+    // Evict until the cache is within its budget. The current scene stays.
+    void trimCache();
 
 private:
     Scene* currentScene = nullptr;
+    Scene* cache[maxCachedScenes] = {nullptr};
+    uint32_t showCount = 0;
+
+    // Indexed by whether the scene was cached.
+    Histogram transitionMicros[2];
+    Histogram transitionAllocations[2];
+    uint32_t evictions = 0;
 };
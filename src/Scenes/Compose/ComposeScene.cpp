@@ -62,11 +62,8 @@ void ComposeScene::willLoadScreen() {
         lv_obj_set_size(textArea, device.displayWidth, 160);
         lv_textarea_set_text(textArea, composeBuffer);
         lv_obj_set_pos(textArea, 0, 50);
-        lv_textarea_set_max_length(textArea, Message::maxLength);
+        lv_textarea_set_max_length(textArea, Message::maxTextLength);
         lv_obj_add_event_cb(textArea, textAreaValueChanged, LV_EVENT_VALUE_CHANGED, this);
-
-        // Subscribe to keyboard input events.
-        lv_group_add_obj(device.lvglKeyboardGroup, textArea);
     } 
 
     // Send button
@@ -111,23 +108,34 @@ void ComposeScene::willLoadScreen() {
     }
 }
 
-void ComposeScene::didLoadScreen() {
+void ComposeScene::willAppear() {
+    // Cleared by sending since the screen was last shown.
+    if (strcmp(lv_textarea_get_text(textArea), composeBuffer) != 0) {
+        lv_textarea_set_text(textArea, composeBuffer);
+    }
+
+    // Subscribe to keyboard input events.
+    lv_group_add_obj(device.lvglKeyboardGroup, textArea);
+
     device.connectBarButton(backButton, Device::BarButton::one);
     device.connectBarButton(sendButton, Device::BarButton::three);
 }
 
-void ComposeScene::willUnloadScreen() {
+void ComposeScene::didDisappear() {
     device.setPixelBlack();
 
     lv_group_remove_obj(textArea);
     device.disconnectBarButton(Device::BarButton::one);
     device.disconnectBarButton(Device::BarButton::three);
+
+    // The conversation shows the new messages.
+    lv_label_set_text(backButtonLabel, "Messages");
 }
 
 void ComposeScene::updateCharacterCountLabel(int32_t currentLength) {
     char buffer[64];
     const int32_t bufferSize = sizeof(buffer);
-    snprintf(buffer, bufferSize, "%d / %d", currentLength, Message::maxLength);
+    snprintf(buffer, bufferSize, "%d / %d", currentLength, Message::maxTextLength);
     buffer[bufferSize-1] = 0;
     lv_label_set_text(characterCountLabel, buffer);
     lv_obj_align_to(characterCountLabel, titleBg, LV_ALIGN_RIGHT_MID, 0, 0);
@@ -146,32 +154,33 @@ void ComposeScene::sendClicked(lv_event_t* e) {
         // Send message
         device.setPixelColor(Color::RGB(0, 0, 255));
 
-        if (device.messenger->txWait((uint8_t*)text, sendLength)) {
-            device.setPixelBlack();
-
-            // Update message history
-            device.messageHistory.addMessage(Message::Sender::me, text);
+        MessageHistory& history = device.messageHistory;
 
-            // Save it
-            (void)device.saveMessageHistory();
+        // Stored before it's sent, so if the send fails it's still in the conversation,
+        // shown as not sent, and resent with the same id once the paired device is reachable.
+        const uint32_t id = history.takeId();
+        history.addMessage(Message::Sender::me, text, id, Message::Status::pending);
+        device.sceneManager.historyAppended(1);
 
-            // Reset compose buffer now that we've sent the message.
-            composeBuffer[0] = 0;                
-
-            // Flush keyboard events in case user spammed send button
-            device.flushInputEvents();
-
-            // Return to conversation scene.
-            device.sceneManager.gotoScene(new ConversationScene(device));
-            return;
+        if (device.sendMessage(id, text)) {
+            device.setPixelBlack();
         }
         else {
             device.setPixelColor(Color::RGB(255, 0, 0));
-
-            // Flush keyboard events in case user spammed send button
-            device.flushInputEvents();
-            LOGLN("Failed to send message");
+            LOGLN("Failed to send message, it will be resent");
         }
+
+        // Save it
+        (void)device.saveMessageHistory();
+
+        // Reset compose buffer now that the message is in the history.
+        composeBuffer[0] = 0;                
+
+        // Flush keyboard events in case user spammed send button
+        device.flushInputEvents();
+
+        // Return to conversation scene.
+        device.sceneManager.gotoCachedScene<ConversationScene>(device);
     }
 }
 
@@ -181,9 +190,9 @@ void ComposeScene::backButtonEvent(lv_event_t* e) {
     // Save any text from the text area into the compose buffer
     const char* text = lv_textarea_get_text(scene->textArea);
     strncpy(composeBuffer, text, Message::bufferSize);
-    composeBuffer[Message::maxLength] = 0;
+    composeBuffer[Message::maxTextLength] = 0;
 
-    scene->device.sceneManager.gotoScene(new ConversationScene(scene->device));
+    scene->device.sceneManager.gotoCachedScene<ConversationScene>(scene->device);
 }
 
 void ComposeScene::textAreaValueChanged(lv_event_t * e) {
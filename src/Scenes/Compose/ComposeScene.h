@@ -10,8 +10,8 @@ public:
     virtual ~ComposeScene() = default;
 
     virtual void willLoadScreen() override;
-    virtual void didLoadScreen() override;
-    virtual void willUnloadScreen() override;
+    virtual void willAppear() override;
+    virtual void didDisappear() override;
     
     virtual void receivedMessage(const char* message) override;
 
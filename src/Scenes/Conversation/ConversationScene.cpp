@@ -6,18 +6,16 @@
 #include "SceneManager.h"
 #include "Scenes/Compose/ComposeScene.h"
 #include "Scenes/Settings/SettingsScene.h"
+#include "Scenes/Search/SearchScene.h"
 
-ConversationScene::ConversationScene(Device& d)
-    : Scene(d)
+ConversationScene::ConversationScene(Device& d, size_t focusIndex)
+    : Scene(d),
+      initialFocus(focusIndex)
 {
-    
+
 }
 
 void ConversationScene::willLoadScreen() {
-    device.showNewIndicator(false);
-
-    const int32_t messageBubbleWidth = 220;
-
     lv_style_init(&historyListStyle);
     lv_style_set_bg_color(&historyListStyle, lv_color_black());
     lv_style_set_border_width(&historyListStyle, 0);
@@ -42,7 +40,7 @@ void ConversationScene::willLoadScreen() {
     lv_style_set_pad_bottom(&theirMessageStyle, 4);    
     lv_style_set_pad_left(&theirMessageStyle, -4);
     lv_style_set_pad_right(&theirMessageStyle, -4);
-    lv_style_set_margin_left(&theirMessageStyle, historyListWidth - messageBubbleWidth - 38);
+    lv_style_set_margin_left(&theirMessageStyle, theirMessageX);
     lv_style_set_text_font(&theirMessageStyle, &lv_font_montserrat_18);
     lv_style_set_text_color(&theirMessageStyle, lv_color_black());
     lv_style_set_radius(&theirMessageStyle, 16);
@@ -50,6 +48,10 @@ void ConversationScene::willLoadScreen() {
     lv_style_set_border_width(&theirMessageStyle, 2);
     lv_style_set_width(&theirMessageStyle, messageBubbleWidth);  
 
+    // Added on top of myMessageStyle.
+    lv_style_init(&pendingMessageStyle);
+    lv_style_set_bg_color(&pendingMessageStyle, lv_color_make(128, 128, 128));
+
     // Title bar
     lv_obj_t* titleBarBg;
     {
@@ -101,6 +103,27 @@ void ConversationScene::willLoadScreen() {
         lv_obj_add_style(indicator, &globalTheme.barButtonIndicatorFour, 0);
     }
 
+    // Search button
+    {
+        // Physical button indicator
+        lv_obj_t* indicator = lv_obj_create(screen);
+        lv_obj_add_style(indicator, &globalTheme.barButtonIndicatorTwo, 0);
+
+        // Button
+        searchButton = lv_button_create(screen);
+        lv_obj_add_style(searchButton, &globalTheme.barButton, LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_obj_add_style(searchButton, &globalTheme.pressedButton, LV_STATE_PRESSED);
+        lv_obj_add_event_cb(searchButton, searchClicked, LV_EVENT_CLICKED, this);
+
+        // Label
+        lv_obj_t* label = lv_label_create(searchButton);
+        lv_obj_align(label, LV_ALIGN_CENTER, 0, 0);
+        lv_label_set_text(label, "Search");
+
+        // Do this after we set the text or else the position will be aligned using empty text.
+        lv_obj_align_to(searchButton, indicator, LV_ALIGN_BOTTOM_MID, 0, 8);
+    }
+
     // Settings button
     {
         // Button
@@ -121,64 +144,113 @@ void ConversationScene::willLoadScreen() {
     }    
 
     // Message list
-    buildMessageList();
+    buildMessageList(initialFocus);
 }
 
-void ConversationScene::didLoadScreen() {
+void ConversationScene::willAppear() {
+    device.showNewIndicator(false);
+    updateStatus();
+
+    lv_group_add_obj(device.lvglKeyboardGroup, historyList);
+
     device.connectBarButton(settingsButton, Device::BarButton::one);
+    device.connectBarButton(searchButton, Device::BarButton::two);
     device.connectBarButton(composeButton, Device::BarButton::four);    
 }
 
-void ConversationScene::willUnloadScreen() {
+void ConversationScene::didDisappear() {
+    closeConfirmationAlert();
     lv_group_remove_obj(historyList);
 
     device.disconnectBarButton(Device::BarButton::one);
+    device.disconnectBarButton(Device::BarButton::two);
     device.disconnectBarButton(Device::BarButton::four);
 }
 
-void ConversationScene::buildMessageList() {
+void ConversationScene::update(uint32_t dt) {
+    updateStatus();
+}
+
+void ConversationScene::buildMessageList(size_t scrollToIndex) {
     if (historyList != nullptr) {
-        lv_obj_del(historyList);
+        // This can be called from an LVGL event, so let LVGL delete the old list
+        // once the event is done with it.
+        lv_group_remove_obj(historyList);
+        lv_obj_add_flag(historyList, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_delete_async(historyList);
     }
 
+    // The labels go with the old list.
+    bubbleHead = 0;
+    bubbleCount = 0;
+    spareCount = 0;
+    labelCount = 0;
+
+    shownStatusChanges = device.messageHistory.totalStatusChanges();
+    shownAckedId = device.messageHistory.ackedHighWaterId();
+
     historyList = lv_list_create(screen);
     lv_obj_add_style(historyList, &historyListStyle, 0);
-    lv_obj_set_size(historyList, historyListWidth, 158);
+    lv_obj_set_size(historyList, historyListWidth, historyListHeight);
     lv_obj_set_pos(historyList, (device.displayWidth - historyListWidth)/2, 52);
-    lv_group_add_obj(device.lvglKeyboardGroup, historyList);
 
-    char buffer[Message::bufferSize + 32];
-    const uint32_t bufferSize = sizeof(buffer);
+    // Otherwise it's added when the screen appears.
+    if (isShown()) {
+        lv_group_add_obj(device.lvglKeyboardGroup, historyList);
+    }
 
-    const int count = device.messageHistory.size();
+    if (device.historyPreview != nullptr) {
+        buildPreviewList(*device.historyPreview);
+        return;
+    }
+
+    // Bubbles are placed by fillViewport(), not by the list's layout. The scrollbar would only
+    // measure the bubbles that exist, so it's hidden.
+    lv_obj_set_layout(historyList, LV_LAYOUT_NONE);
+    lv_obj_set_scrollbar_mode(historyList, LV_SCROLLBAR_MODE_OFF);
+    lv_obj_add_event_cb(historyList, historyListScrolled, LV_EVENT_SCROLL, this);
+
+    const size_t count = device.messageHistory.size();
 
     if (count == 0) {
+        followNewest = true;
         lv_obj_add_flag(deleteHistoryButton, LV_OBJ_FLAG_HIDDEN);
         return;
     }
 
     lv_obj_remove_flag(deleteHistoryButton, LV_OBJ_FLAG_HIDDEN);    
 
-    lv_obj_t* lastItem = nullptr;    
+    // Start from the newest message, or the one to scroll to, and build out from there.
+    followNewest = (scrollToIndex >= count);
+    firstIndex = followNewest ? count - 1 : scrollToIndex;
 
-    for (int i = 0; i < count; i++) {
-        Message message = device.messageHistory.getMessage(i);
+    lv_obj_t* label = takeLabel();
+    Bubble& anchor = bubbleAt(0);
+    anchor.label = label;
+    anchor.top = 0;
+    anchor.height = showMessage(label, firstIndex);
+    lv_obj_set_y(label, anchor.top);
+    bubbleCount = 1;
 
-        if (message.sender == Message::Sender::me) {
-            snprintf(buffer, bufferSize, "%s: %s", MY_NAME, message.text);
-            buffer[bufferSize - 1] = 0;            
+    // The newest message goes at the bottom of the view, the one to scroll to in the middle.
+    const int32_t viewTop = followNewest ? anchor.bottom() - historyListHeight : (anchor.height - historyListHeight) / 2;
+    fillViewport(viewTop, viewTop + historyListHeight);
 
-            lv_obj_t* label = lv_list_add_text(historyList, buffer);
-            lv_obj_add_style(label, &myMessageStyle, 0);
-            lastItem = label;
-        } else {
-            snprintf(buffer, bufferSize, "%s: %s", OTHER_NAME, message.text);
-            buffer[bufferSize - 1] = 0;
+    lv_obj_update_layout(historyList);
+    lv_obj_scroll_to_y(historyList, viewTop, LV_ANIM_OFF);
+}
 
-            lv_obj_t* label = lv_list_add_text(historyList, buffer);
-            lv_obj_add_style(label, &theirMessageStyle, 0);
-            lastItem = label;
-        }
+void ConversationScene::buildPreviewList(const MessageArena& preview) {
+    lv_obj_add_flag(deleteHistoryButton, LV_OBJ_FLAG_HIDDEN);
+
+    // The preview starts with the newest messages and grows backwards as more are read.
+    lv_obj_t* placeholder = lv_list_add_text(historyList, "Loading messages...");
+    lv_obj_add_style(placeholder, &globalTheme.bodyText, 0);
+
+    lv_obj_t* lastItem = nullptr;
+
+    for (size_t i = 0; i < preview.size(); i++) {
+        lastItem = addMessageBubble(preview[i]);
     }
 
     if (lastItem) {
@@ -186,8 +258,239 @@ void ConversationScene::buildMessageList() {
     }
 }
 
+lv_obj_t* ConversationScene::addMessageBubble(const MessageView& message) {
+    char buffer[Message::bufferSize + 32];
+    const uint32_t bufferSize = sizeof(buffer);
+
+    const bool mine = (message.sender == Message::Sender::me);
+
+    snprintf(buffer, bufferSize, "%s: %s", mine ? MY_NAME : OTHER_NAME, message.text);
+    buffer[bufferSize - 1] = 0;
+
+    lv_obj_t* label = lv_list_add_text(historyList, buffer);
+    lv_obj_add_style(label, mine ? &myMessageStyle : &theirMessageStyle, 0);
+    showStatus(label, message);
+
+    return label;
+}
+
+void ConversationScene::fillViewport() {
+    const int32_t viewTop = lv_obj_get_scroll_y(historyList);
+    fillViewport(viewTop, viewTop + historyListHeight);
+}
+
+void ConversationScene::fillViewport(int32_t viewTop, int32_t viewBottom) {
+    // Laying out a new bubble can scroll the list, which calls back in here.
+    if (bubbleCount == 0 || filling) {
+        return;
+    }
+
+    filling = true;
+
+    const int32_t top = viewTop - materializeMargin;
+    const int32_t bottom = viewBottom + materializeMargin;
+    const size_t count = device.messageHistory.size();
+
+    while (true) {
+        // Always keep one bubble to build from.
+        while (bubbleCount > 1 && bubbleAt(0).bottom() < top) {
+            recycleFirst();
+        }
+
+        while (bubbleCount > 1 && bubbleAt(bubbleCount - 1).top > bottom) {
+            recycleLast();
+        }
+
+        if (bubbleAt(bubbleCount - 1).bottom() < bottom && lastIndex() + 1 < count && materializeBelow()) {
+            continue;
+        }
+
+        if (bubbleAt(0).top > top && firstIndex > 0 && materializeAbove()) {
+            continue;
+        }
+
+        break;
+    }
+
+    filling = false;
+}
+
+bool ConversationScene::materializeAbove() {
+    lv_obj_t* label = takeLabel();
+
+    if (label == nullptr) {
+        return false;
+    }
+
+    const int32_t firstTop = bubbleAt(0).top;
+
+    bubbleHead = (bubbleHead + bubblePoolSize - 1) % bubblePoolSize;
+    bubbleCount++;
+    firstIndex--;
+
+    Bubble& bubble = bubbleAt(0);
+    bubble.label = label;
+    bubble.height = showMessage(label, firstIndex);
+    bubble.top = firstTop - lv_obj_get_style_pad_row(historyList, 0) - bubble.height;
+    lv_obj_set_y(label, bubble.top);
+
+    return true;
+}
+
+bool ConversationScene::materializeBelow() {
+    lv_obj_t* label = takeLabel();
+
+    if (label == nullptr) {
+        return false;
+    }
+
+    const int32_t lastBottom = bubbleAt(bubbleCount - 1).bottom();
+
+    Bubble& bubble = bubbleAt(bubbleCount);
+    bubble.label = label;
+    bubble.top = lastBottom + lv_obj_get_style_pad_row(historyList, 0);
+    bubble.height = showMessage(label, lastIndex() + 1);
+    lv_obj_set_y(label, bubble.top);
+
+    bubbleCount++;
+
+    return true;
+}
+
+int32_t ConversationScene::showMessage(lv_obj_t* label, size_t index) {
+    char buffer[Message::bufferSize + 32];
+    const uint32_t bufferSize = sizeof(buffer);
+
+    const MessageView message = device.messageHistory.getMessage(index);
+    const bool mine = (message.sender == Message::Sender::me);
+
+    snprintf(buffer, bufferSize, "%s: %s", mine ? MY_NAME : OTHER_NAME, message.text);
+    buffer[bufferSize - 1] = 0;
+
+    lv_label_set_text(label, buffer);
+    lv_obj_remove_style(label, mine ? &theirMessageStyle : &myMessageStyle, 0);
+    lv_obj_add_style(label, mine ? &myMessageStyle : &theirMessageStyle, 0);
+    lv_obj_set_x(label, mine ? 0 : theirMessageX);
+    lv_obj_remove_flag(label, LV_OBJ_FLAG_HIDDEN);
+    showStatus(label, message);
+
+    // Lays out just this label, so it can be placed against its neighbour.
+    lv_obj_update_layout(label);
+
+    return lv_obj_get_height(label);
+}
+
+void ConversationScene::showStatus(lv_obj_t* label, const MessageView& message) {
+    const bool pending = (message.sender == Message::Sender::me && 
+                          Message::statusOf(message.flags) == Message::Status::pending);
+
+    lv_obj_remove_style(label, &pendingMessageStyle, 0);
+
+    if (pending) {
+        lv_obj_add_style(label, &pendingMessageStyle, 0);
+    }
+}
+
+void ConversationScene::updateStatus() {
+    const MessageHistory& history = device.messageHistory;
+
+    if (history.totalStatusChanges() == shownStatusChanges && history.ackedHighWaterId() == shownAckedId) {
+        return;
+    }
+
+    shownStatusChanges = history.totalStatusChanges();
+    shownAckedId = history.ackedHighWaterId();
+
+    for (size_t i = 0; i < bubbleCount; i++) {
+        showStatus(bubbleAt(i).label, history.getMessage(firstIndex + i));
+    }
+}
+
+lv_obj_t* ConversationScene::takeLabel() {
+    if (spareCount > 0) {
+        return spareLabels[--spareCount];
+    }
+
+    if (labelCount == bubblePoolSize) {
+        return nullptr;
+    }
+
+    labelCount++;
+
+    return lv_list_add_text(historyList, "");
+}
+
+void ConversationScene::recycleFirst() {
+    Bubble& bubble = bubbleAt(0);
+    lv_obj_add_flag(bubble.label, LV_OBJ_FLAG_HIDDEN);
+    spareLabels[spareCount++] = bubble.label;
+    bubble.label = nullptr;
+
+    bubbleHead = (bubbleHead + 1) % bubblePoolSize;
+    bubbleCount--;
+    firstIndex++;
+}
+
+void ConversationScene::recycleLast() {
+    Bubble& bubble = bubbleAt(bubbleCount - 1);
+    lv_obj_add_flag(bubble.label, LV_OBJ_FLAG_HIDDEN);
+    spareLabels[spareCount++] = bubble.label;
+    bubble.label = nullptr;
+
+    bubbleCount--;
+}
+
+void ConversationScene::updateFollowNewest() {
+    if (bubbleCount == 0) {
+        followNewest = true;
+        return;
+    }
+
+    const int32_t viewBottom = lv_obj_get_scroll_y(historyList) + historyListHeight;
+
+    followNewest = (lastIndex() + 1 >= device.messageHistory.size() && bubbleAt(bubbleCount - 1).bottom() <= viewBottom);
+}
+
+void ConversationScene::showNewest() {
+    if (bubbleCount == 0) {
+        buildMessageList();
+        return;
+    }
+
+    if (!followNewest) {
+        // Only materialized if the bottom of the list is near the view.
+        fillViewport();
+        return;
+    }
+
+    // Build down to the newest message as if the view were already at the bottom.
+    const size_t count = device.messageHistory.size();
+
+    while (lastIndex() + 1 < count) {
+        const size_t previousLast = lastIndex();
+        const int32_t bottom = bubbleAt(bubbleCount - 1).bottom();
+
+        fillViewport(bottom - historyListHeight, bottom);
+
+        if (lastIndex() == previousLast) {
+            break;
+        }
+    }
+
+    lv_obj_update_layout(historyList);
+    lv_obj_scroll_to_y(historyList, bubbleAt(bubbleCount - 1).bottom() - historyListHeight, LV_ANIM_OFF);
+}
+
+void ConversationScene::historyListScrolled(lv_event_t* e) {
+    ConversationScene* scene = (ConversationScene*)lv_event_get_user_data(e);
+
+    scene->fillViewport();
+    scene->updateFollowNewest();
+}
+
 void ConversationScene::deleteHistoryClicked(lv_event_t* e) {
     ConversationScene* scene = (ConversationScene*)lv_event_get_user_data(e);
+    scene->device.finishLoadingHistory();
 
     scene->showConfirmationAlert("Delete history?", "You cannot undo this action",
                                  "Cancel", "Delete",
@@ -205,25 +508,54 @@ void ConversationScene::deleteHistoryAlertConfirmClicked(lv_event_t* e) {
 
     scene->device.messageHistory.clear();
     scene->device.saveMessageHistory();
-    scene->buildMessageList();
+
+    // Rebuilds the list, and clears cached search results.
+    scene->device.sceneManager.historyChanged();
 
     scene->closeConfirmationAlert();
 }
 
 void ConversationScene::composeClicked(lv_event_t* e) {
     ConversationScene* scene = (ConversationScene*)lv_event_get_user_data(e);
-    scene->device.sceneManager.gotoScene(new ComposeScene(scene->device));
+    scene->device.finishLoadingHistory();
+    scene->device.sceneManager.gotoCachedScene<ComposeScene>(scene->device);
+}
+
+void ConversationScene::searchClicked(lv_event_t* e) {
+    ConversationScene* scene = (ConversationScene*)lv_event_get_user_data(e);
+    scene->device.finishLoadingHistory();
+    scene->device.sceneManager.gotoCachedScene<SearchScene>(scene->device);
 }
 
 void ConversationScene::settingsClicked(lv_event_t* e) {
     ConversationScene* scene = (ConversationScene*)lv_event_get_user_data(e);
-    scene->device.sceneManager.gotoScene(new SettingsScene(scene->device));
+    scene->device.finishLoadingHistory();
+    scene->device.sceneManager.gotoCachedScene<SettingsScene>(scene->device);
 }
 
-void ConversationScene::receivedMessage(const char* message) {
+void ConversationScene::historyAppended(size_t appended) {
+    // The list is rebuilt when the history finishes loading.
+    if (device.historyPreview != nullptr) {
+        return;
+    }
+
+    // Only the bubbles below the newest change; the rest stay where they are.
+    showNewest();
+}
+
+void ConversationScene::historyChanged() {
     buildMessageList();
 }
 
+void ConversationScene::focusMessage(size_t index) {
+    initialFocus = index;
+
+    // Otherwise the list is built around it when the screen loads.
+    if (historyList != nullptr) {
+        buildMessageList(index);
+    }
+}
+
 void ConversationScene::showConfirmationAlert(const char* title, 
                                               const char* message, 
                                               const char* cancelText, 
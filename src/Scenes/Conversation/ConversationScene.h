@@ -6,21 +6,84 @@
 
 class ConversationScene: public Scene {
 public:
-    ConversationScene(Device& d);
+    // Opens on the newest messages, or on the message at focusIndex.
+    ConversationScene(Device& d, size_t focusIndex = SIZE_MAX);
     virtual ~ConversationScene() = default;
 
     virtual void willLoadScreen() override;
-    virtual void didLoadScreen() override;
-    virtual void willUnloadScreen() override;
+    virtual void willAppear() override;
+    virtual void didDisappear() override;
+    virtual void update(uint32_t dt) override;
     
-    virtual void receivedMessage(const char* message) override;
+    virtual void historyAppended(size_t appended) override;
+    virtual void historyChanged() override;
+
+    // Scroll to the message at index, e.g. a search result.
+    void focusMessage(size_t index);
 
 private:
-    void buildMessageList();
+    // A materialized message: its label, and where it is in the list's content.
+    struct Bubble {
+        lv_obj_t* label = nullptr;
+        int32_t top = 0;
+        int32_t height = 0;
+
+        inline int32_t bottom() const {
+            return top + height;
+        }
+    };
+
+    // Rebuild the list. Scrolls to the message at scrollToIndex, or to the newest message.
+    void buildMessageList(size_t scrollToIndex = SIZE_MAX);
+
+    // Show the messages read so far while the history is loading.
+    void buildPreviewList(const MessageArena& preview);
+
+    lv_obj_t* addMessageBubble(const MessageView& message);
+
+    // Materialize the messages between viewTop and viewBottom (list content coordinates)
+    // plus the margin, recycling the bubbles that are further away.
+    void fillViewport(int32_t viewTop, int32_t viewBottom);
+    void fillViewport();
+
+    // Add the message before the first bubble, or after the last. False if there isn't one,
+    // or no label to show it.
+    bool materializeAbove();
+    bool materializeBelow();
+
+    // Put message index in label, and measure it.
+    int32_t showMessage(lv_obj_t* label, size_t index);
+
+    // Our messages that haven't been sent are shown greyed out. Only changes the colors,
+    // so the bubble keeps its size.
+    void showStatus(lv_obj_t* label, const MessageView& message);
+
+    // Restyle the bubbles if any of our messages changed status since they were shown.
+    void updateStatus();
+
+    lv_obj_t* takeLabel();
+    void recycleFirst();
+    void recycleLast();
+
+    inline Bubble& bubbleAt(size_t i) {
+        return bubbles[(bubbleHead + i) % bubblePoolSize];
+    }
+
+    inline size_t lastIndex() const {
+        return firstIndex + bubbleCount - 1;
+    }
+
+    // Keep following the newest message if the list is scrolled to the bottom.
+    void updateFollowNewest();
+
+    // Scroll the newest message into view, if following it.
+    void showNewest();
 
 private:
+    static void historyListScrolled(lv_event_t* e);
     static void deleteHistoryClicked(lv_event_t* e);
     static void composeClicked(lv_event_t* e);
+    static void searchClicked(lv_event_t* e);
     static void settingsClicked(lv_event_t* e);
 
     static void deleteHistoryAlertCancelClicked(lv_event_t* e);    
@@ -39,13 +102,46 @@ private:
 
 private:
     static constexpr int historyListWidth = Device::displayWidth - 8;
+    static constexpr int historyListHeight = 158;
+    static constexpr int messageBubbleWidth = 220;
+    static constexpr int theirMessageX = historyListWidth - messageBubbleWidth - 38;
+
+    // The history can be thousands of messages long, so only the bubbles in view, or within
+    // materializeMargin of it, exist. Labels scrolled further away are reused for the messages
+    // scrolling into view. The pool has room for a viewport and margins of one-line bubbles.
+    static constexpr int32_t materializeMargin = historyListHeight / 2;
+    static constexpr size_t bubblePoolSize = 16;
+
+    // Materialized messages, firstIndex to lastIndex(), top to bottom, in a ring.
+    Bubble bubbles[bubblePoolSize];
+    size_t bubbleHead = 0;
+    size_t bubbleCount = 0;
+    size_t firstIndex = 0;
+
+    // Labels not showing a message, hidden.
+    lv_obj_t* spareLabels[bubblePoolSize] = {nullptr};
+    size_t spareCount = 0;
+    size_t labelCount = 0;
+    bool filling = false;
+
+    // Keep the newest message in view as new ones arrive.
+    bool followNewest = true;
+
+    // Message to scroll to when the screen loads.
+    size_t initialFocus = SIZE_MAX;
+
+    // Status changes the bubbles show.
+    uint32_t shownStatusChanges = 0;
+    uint32_t shownAckedId = 0;
 
     lv_style_t historyListStyle;
     lv_style_t myMessageStyle;
     lv_style_t theirMessageStyle;
+    lv_style_t pendingMessageStyle;
 
     lv_obj_t* historyList = nullptr;
     lv_obj_t* composeButton = nullptr;
+    lv_obj_t* searchButton = nullptr;
     lv_obj_t* settingsButton = nullptr;
     lv_obj_t* deleteHistoryButton = nullptr;
 
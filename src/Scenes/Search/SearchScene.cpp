@@ -0,0 +1,269 @@
+#include "SearchScene.h"
+#include "GlobalTheme.h"
+#include "Message.h"
+#include "config.h"
+
+#include "SceneManager.h"
+#include "Scenes/Conversation/ConversationScene.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+namespace {
+    // Keep the last query, so it's still there after looking at a result.
+    char queryBuffer[SearchIndex::maxQueryWords * (SearchIndex::maxWordLength + 1)] = {0};
+}
+
+SearchScene::SearchScene(Device& d)
+    : Scene(d)
+{
+
+}
+
+void SearchScene::willLoadScreen() {
+    lv_style_init(&cursorStyle);
+    lv_style_set_border_color(&cursorStyle, lv_color_white());
+
+    lv_style_init(&textAreaStyle);
+    lv_style_set_bg_color(&textAreaStyle, lv_color_black());
+    lv_style_set_text_color(&textAreaStyle, lv_color_white());
+    lv_style_set_border_color(&textAreaStyle, globalTheme.amber);
+    lv_style_set_border_width(&textAreaStyle, 2);
+    lv_style_set_radius(&textAreaStyle, 0);
+    lv_style_set_text_font(&textAreaStyle, &lv_font_montserrat_18);
+
+    lv_style_init(&resultListStyle);
+    lv_style_set_bg_color(&resultListStyle, lv_color_black());
+    lv_style_set_border_width(&resultListStyle, 0);
+    lv_style_set_radius(&resultListStyle, 0);
+
+    // Title bar
+    {
+        titleBg = lv_obj_create(screen);
+        lv_obj_add_style(titleBg, &globalTheme.titleBg, 0);
+        lv_obj_align_to(titleBg, screen, LV_ALIGN_TOP_MID, 0, 20);
+
+        lv_obj_t* titleLabel = lv_label_create(screen);
+        lv_obj_add_style(titleLabel, &globalTheme.titleText, 0);
+        lv_label_set_text(titleLabel, "Search");
+        lv_obj_align_to(titleLabel, titleBg, LV_ALIGN_LEFT_MID, 0, 0);
+
+        statusLabel = lv_label_create(screen);
+        lv_obj_add_style(statusLabel, &globalTheme.titleText, 0);
+        lv_label_set_text(statusLabel, "");
+    }
+
+    // Bar button background
+    {
+        lv_obj_t* bg = lv_obj_create(screen);
+        lv_obj_add_style(bg, &globalTheme.buttonBarBg, 0);
+    }
+
+    // Query
+    {
+        textArea = lv_textarea_create(screen);
+        lv_obj_add_style(textArea, &cursorStyle, LV_PART_CURSOR | LV_STATE_FOCUSED);
+        lv_obj_add_style(textArea, &textAreaStyle, 0);
+        lv_textarea_set_one_line(textArea, true);
+        lv_textarea_set_max_length(textArea, sizeof(queryBuffer) - 1);
+        lv_textarea_set_text(textArea, queryBuffer);
+        lv_obj_set_width(textArea, resultListWidth);
+        lv_obj_set_pos(textArea, (device.displayWidth - resultListWidth)/2, 50);
+
+        // Enter searches too.
+        lv_obj_add_event_cb(textArea, searchClicked, LV_EVENT_READY, this);
+    }
+
+    // Results
+    {
+        resultList = lv_list_create(screen);
+        lv_obj_add_style(resultList, &resultListStyle, 0);
+        lv_obj_set_size(resultList, resultListWidth, 112);
+        lv_obj_set_pos(resultList, (device.displayWidth - resultListWidth)/2, 98);
+    }
+
+    // Search button
+    {
+        // Physical button indicator
+        lv_obj_t* indicator = lv_obj_create(screen);
+        lv_obj_add_style(indicator, &globalTheme.barButtonIndicatorThree, 0);
+
+        // Button
+        searchButton = lv_button_create(screen);
+        lv_obj_add_style(searchButton, &globalTheme.barButton, LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_obj_add_style(searchButton, &globalTheme.pressedButton, LV_STATE_PRESSED);
+        lv_obj_add_event_cb(searchButton, searchClicked, LV_EVENT_CLICKED, this);
+
+        // Label
+        lv_obj_t* label = lv_label_create(searchButton);
+        lv_obj_align(label, LV_ALIGN_CENTER, 0, 0);
+        lv_label_set_text(label, "Search");
+
+        // Do this after we set the text or else the position will be aligned using empty text.
+        lv_obj_align_to(searchButton, indicator, LV_ALIGN_BOTTOM_MID, 0, 8);
+    }
+
+    // Back button
+    {
+        // Button
+        backButton = lv_button_create(screen);
+        lv_obj_add_style(backButton, &globalTheme.barButton, LV_PART_MAIN | LV_STATE_DEFAULT);
+        lv_obj_add_style(backButton, &globalTheme.pressedButton, LV_STATE_PRESSED);
+        lv_obj_align(backButton, LV_ALIGN_BOTTOM_LEFT, 2, -6);
+        lv_obj_add_event_cb(backButton, backButtonEvent, LV_EVENT_CLICKED, this);
+
+        // Label
+        lv_obj_t* label = lv_label_create(backButton);
+        lv_obj_align(label, LV_ALIGN_CENTER, 0, 0);
+        lv_label_set_text(label, "Messages");
+        backButtonLabel = label;
+
+        // Physical button indicator
+        lv_obj_t* indicator = lv_obj_create(screen);
+        lv_obj_add_style(indicator, &globalTheme.barButtonIndicatorOne, 0);
+    }
+}
+
+void SearchScene::willAppear() {
+    // Subscribe to keyboard input events.
+    lv_group_add_obj(device.lvglKeyboardGroup, textArea);
+
+    device.connectBarButton(backButton, Device::BarButton::one);
+    device.connectBarButton(searchButton, Device::BarButton::three);
+}
+
+void SearchScene::didDisappear() {
+    // The results so far stay in the list.
+    if (device.searchIndex.isSearching()) {
+        device.searchIndex.cancelSearch();
+        lv_label_set_text(statusLabel, "Stopped");
+        lv_obj_align_to(statusLabel, titleBg, LV_ALIGN_RIGHT_MID, 0, 0);
+    }
+
+    lv_group_remove_obj(textArea);
+    device.disconnectBarButton(Device::BarButton::one);
+    device.disconnectBarButton(Device::BarButton::three);
+
+    // The conversation shows the new messages.
+    lv_label_set_text(backButtonLabel, "Messages");
+}
+
+void SearchScene::update(uint32_t dt) {
+    if (!device.searchIndex.isSearching()) {
+        return;
+    }
+
+    // A slice at a time, so the screen keeps updating while we search.
+    const bool finished = device.searchIndex.continueSearch(device.messageHistory);
+
+    showNewResults();
+
+    if (finished) {
+        updateStatusLabel();
+    }
+}
+
+void SearchScene::startSearch() {
+    strncpy(queryBuffer, lv_textarea_get_text(textArea), sizeof(queryBuffer));
+    queryBuffer[sizeof(queryBuffer) - 1] = 0;
+
+    lv_obj_clean(resultList);
+    shownResults = 0;
+
+    if (!device.searchIndex.isAvailable()) {
+        lv_label_set_text(statusLabel, "Unavailable");
+    }
+    else if (!device.searchIndex.beginSearch(queryBuffer)) {
+        lv_label_set_text(statusLabel, "Enter a word");
+    }
+    else {
+        lv_label_set_text(statusLabel, "Searching...");
+    }
+
+    lv_obj_align_to(statusLabel, titleBg, LV_ALIGN_RIGHT_MID, 0, 0);
+}
+
+void SearchScene::showNewResults() {
+    char buffer[Message::bufferSize + 32];
+    const uint32_t bufferSize = sizeof(buffer);
+
+    while (shownResults < device.searchIndex.resultCount()) {
+        const size_t index = device.searchIndex.result(shownResults++);
+        MessageView message = device.messageHistory.getMessage(index);
+
+        snprintf(buffer, bufferSize, "%s: %s", 
+            (message.sender == Message::Sender::me) ? MY_NAME : OTHER_NAME, 
+            (message.text != nullptr) ? message.text : "");
+        buffer[bufferSize - 1] = 0;
+
+        lv_obj_t* button = lv_list_add_button(resultList, nullptr, buffer);
+        lv_obj_set_style_bg_color(button, lv_color_black(), 0);
+        lv_obj_set_style_text_color(button, (message.sender == Message::Sender::me) ? globalTheme.amber : globalTheme.green, 0);
+        lv_obj_add_style(button, &globalTheme.pressedButton, LV_STATE_PRESSED);
+        lv_obj_set_user_data(button, (void*)index);
+        lv_obj_add_event_cb(button, resultClicked, LV_EVENT_CLICKED, this);
+
+        // One line per result; the conversation shows the whole message.
+        lv_obj_t* label = lv_obj_get_child(button, 0);
+        lv_label_set_long_mode(label, LV_LABEL_LONG_DOT);
+    }
+}
+
+void SearchScene::updateStatusLabel() {
+    const SearchIndex& index = device.searchIndex;
+    char buffer[48];
+
+    if (index.searchedFrom() > 0) {
+        // Ran out of time or results before reaching the oldest message.
+        snprintf(buffer, sizeof(buffer), "%u in last %u", index.resultCount(), device.messageHistory.size() - index.searchedFrom());
+    }
+    else if (index.resultCount() == 0) {
+        snprintf(buffer, sizeof(buffer), "No matches");
+    }
+    else {
+        snprintf(buffer, sizeof(buffer), "%u found", index.resultCount());
+    }
+
+    lv_label_set_text(statusLabel, buffer);
+    lv_obj_align_to(statusLabel, titleBg, LV_ALIGN_RIGHT_MID, 0, 0);
+
+    LOGFMT("Search: %u results in %u ms\n", index.resultCount(), index.searchElapsedMS());
+}
+
+void SearchScene::searchClicked(lv_event_t* e) {
+    SearchScene* scene = (SearchScene*)lv_event_get_user_data(e);
+    scene->startSearch();
+}
+
+void SearchScene::backButtonEvent(lv_event_t* e) {
+    SearchScene* scene = (SearchScene*)lv_event_get_user_data(e);
+    scene->device.sceneManager.gotoCachedScene<ConversationScene>(scene->device);
+}
+
+void SearchScene::resultClicked(lv_event_t* e) {
+    SearchScene* scene = (SearchScene*)lv_event_get_user_data(e);
+    lv_obj_t* button = (lv_obj_t*)lv_event_get_current_target(e);
+    const size_t index = (size_t)lv_obj_get_user_data(button);
+
+    ConversationScene* conversation = scene->device.sceneManager.cachedScene<ConversationScene>(scene->device);
+    conversation->focusMessage(index);
+    scene->device.sceneManager.gotoScene(conversation);
+}
+
+void SearchScene::receivedMessage(const char* message) {
+    device.showNewIndicator(true);
+
+    if (backButtonLabel) {
+        lv_label_set_text(backButtonLabel, "New Messages");
+    }
+}
+
+void SearchScene::historyChanged() {
+    // The results are indices into the old history.
+    device.searchIndex.cancelSearch();
+
+    lv_obj_clean(resultList);
+    shownResults = 0;
+
+    lv_label_set_text(statusLabel, "");
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <lvgl.h>
+#include "Scene.h"
+
+// Find old messages with the search index. Picking a result opens the conversation at that message.
+class SearchScene: public Scene {
+public:
+    SearchScene(Device& d);
+    virtual ~SearchScene() = default;
+
+    virtual void willLoadScreen() override;
+    virtual void willAppear() override;
+    virtual void didDisappear() override;
+
+    virtual void update(uint32_t dt) override;
+
+    virtual void receivedMessage(const char* message) override;
+    virtual void historyChanged() override;
+
+private:
+    void startSearch();
+
+    // Add results found since the last call to the list.
+    void showNewResults();
+
+    void updateStatusLabel();
+
+    static void searchClicked(lv_event_t* e);
+    static void backButtonEvent(lv_event_t* e);
+    static void resultClicked(lv_event_t* e);
+
+private:
+    static constexpr int resultListWidth = Device::displayWidth - 8;
+
+    lv_style_t cursorStyle;
+    lv_style_t textAreaStyle;
+    lv_style_t resultListStyle;
+
+    lv_obj_t* titleBg = nullptr;
+    lv_obj_t* statusLabel = nullptr;
+    lv_obj_t* textArea = nullptr;
+    lv_obj_t* resultList = nullptr;
+    lv_obj_t* searchButton = nullptr;
+    lv_obj_t* backButton = nullptr;
+    lv_obj_t* backButtonLabel = nullptr;
+
+    // Results already in the list.
+    size_t shownResults = 0;
+};
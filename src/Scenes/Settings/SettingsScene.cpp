@@ -138,47 +138,82 @@ void SettingsScene::willLoadScreen() {
 
     // Build the first tab
     buildGeneralTab();
+}
 
+void SettingsScene::willAppear() {
     // Tab view value changed event doesn't get triggered on the starting tab, 
-    // so add the general controls to the keyboard group manually.
-    lv_group_add_obj(device.lvglKeyboardGroup, displayBrightnessSlider);    
-    lv_group_add_obj(device.lvglKeyboardGroup, keysBrightnessSlider);
-    lv_group_focus_obj(displayBrightnessSlider);
-}
+    // so add its controls to the keyboard group manually.
+    addTabToKeyboardGroup(currentTab);
 
-void SettingsScene::didLoadScreen() {
     device.connectBarButton(nextTabButton, Device::BarButton::one);
     device.connectBarButton(saveButton, Device::BarButton::four);
 }
 
-void SettingsScene::willUnloadScreen() {
+void SettingsScene::didDisappear() {
     device.setPixelBlack();
+    closeConfirmationAlert();
 
-    if (isTabLoaded(Tab::general)) {
-        lv_group_remove_obj(displayBrightnessSlider);
-        lv_group_remove_obj(keysBrightnessSlider);
-    }
+    removeTabFromKeyboardGroup(currentTab);
 
-    if (isTabLoaded(Tab::encryption)) {
-        lv_group_remove_obj(primaryKeyTextArea);
-        lv_group_remove_obj(localKeyTextArea);
-    }
+    device.disconnectBarButton(Device::BarButton::one);
+    device.disconnectBarButton(Device::BarButton::four);
+}
 
-    if (isTabLoaded(Tab::espNow)) {
-        for (int i = 0; i < MacAddress::addressLength; i++) {
-            lv_group_remove_obj(macTextAreas[i]);
-        }
-    }
+void SettingsScene::addTabToKeyboardGroup(Tab t) {
+    switch (t) {
+        case Tab::general:
+            lv_group_add_obj(device.lvglKeyboardGroup, displayBrightnessSlider);                
+            lv_group_add_obj(device.lvglKeyboardGroup, keysBrightnessSlider);
+            lv_group_focus_obj(displayBrightnessSlider);
+            break;
+
+        case Tab::encryption:    
+            lv_group_add_obj(device.lvglKeyboardGroup, primaryKeyTextArea);
+            lv_group_add_obj(device.lvglKeyboardGroup, localKeyTextArea);
+            lv_group_focus_obj(primaryKeyTextArea);
+            break;
+
+        case Tab::espNow:
+            for (int i = 0; i < MacAddress::addressLength; i++) {
+                lv_group_add_obj(device.lvglKeyboardGroup, macTextAreas[i]);
+            }
+            break;
 
 #if defined(USE_LORA)
-    if (isTabLoaded(Tab::lora)) {
-        lv_group_remove_obj(myLoraAddressTextArea);
-        lv_group_remove_obj(otherLoraAddressTextArea);    
-    }
+        case Tab::lora:
+            lv_group_add_obj(device.lvglKeyboardGroup, myLoraAddressTextArea);
+            lv_group_add_obj(device.lvglKeyboardGroup, otherLoraAddressTextArea);
+            lv_group_focus_obj(myLoraAddressTextArea);
+            break;
 #endif
+    }
+}
 
-    device.disconnectBarButton(Device::BarButton::one);
-    device.disconnectBarButton(Device::BarButton::four);
+void SettingsScene::removeTabFromKeyboardGroup(Tab t) {
+    switch (t) {
+        case Tab::general:
+            lv_group_remove_obj(displayBrightnessSlider);
+            lv_group_remove_obj(keysBrightnessSlider);        
+            break;
+
+        case Tab::encryption:    
+            lv_group_remove_obj(primaryKeyTextArea);
+            lv_group_remove_obj(localKeyTextArea);
+            break;            
+
+        case Tab::espNow:
+            for (int i = 0; i < MacAddress::addressLength; i++) {
+                lv_group_remove_obj(macTextAreas[i]);
+            }
+            break;
+
+#if defined(USE_LORA)
+        case Tab::lora:
+            lv_group_remove_obj(myLoraAddressTextArea);
+            lv_group_remove_obj(otherLoraAddressTextArea);
+            break;
+#endif
+    }
 }
 
 void SettingsScene::buildGeneralTab() {
@@ -523,68 +558,30 @@ void SettingsScene::tabViewValueChanged(lv_event_t* e) {
     Tab nextTab = Tab(lv_tabview_get_tab_active(tabView));
 
     // Remove outgoing tab's views from keyboard group
-    switch (scene->currentTab) {
-        case Tab::general:
-            lv_group_remove_obj(scene->displayBrightnessSlider);
-            lv_group_remove_obj(scene->keysBrightnessSlider);        
-            break;
-
-        case Tab::encryption:    
-            lv_group_remove_obj(scene->primaryKeyTextArea);
-            lv_group_remove_obj(scene->localKeyTextArea);
-            break;            
+    scene->removeTabFromKeyboardGroup(scene->currentTab);
 
-        case Tab::espNow:
-            for (int i = 0; i < MacAddress::addressLength; i++) {
-                lv_group_remove_obj(scene->macTextAreas[i]);
-            }
-            break;
-
-#if defined(USE_LORA)
-        case Tab::lora:
-            lv_group_remove_obj(scene->myLoraAddressTextArea);
-            lv_group_remove_obj(scene->otherLoraAddressTextArea);
-            break;
-#endif
-    }
-
-    // Add incoming tab's views to keyboard group
+    // Build the incoming tab if needed, and add its views to keyboard group
     switch (nextTab) {
         case Tab::general:
             scene->buildGeneralTab();
-
-            lv_group_add_obj(scene->device.lvglKeyboardGroup, scene->displayBrightnessSlider);                
-            lv_group_add_obj(scene->device.lvglKeyboardGroup, scene->keysBrightnessSlider);
-            lv_group_focus_obj(scene->displayBrightnessSlider);
             break;
 
         case Tab::encryption:    
             scene->buildEncryptionTab();
-
-            lv_group_add_obj(scene->device.lvglKeyboardGroup, scene->primaryKeyTextArea);
-            lv_group_add_obj(scene->device.lvglKeyboardGroup, scene->localKeyTextArea);
-            lv_group_focus_obj(scene->primaryKeyTextArea);
             break;
 
         case Tab::espNow:
             scene->buildEspNowTab();
-
-            for (int i = 0; i < MacAddress::addressLength; i++) {
-                lv_group_add_obj(scene->device.lvglKeyboardGroup, scene->macTextAreas[i]);
-            }
             break;
 
 #if defined(USE_LORA)
         case Tab::lora:
             scene->buildLoraTab();
-
-            lv_group_add_obj(scene->device.lvglKeyboardGroup, scene->myLoraAddressTextArea);
-            lv_group_add_obj(scene->device.lvglKeyboardGroup, scene->otherLoraAddressTextArea);
-            lv_group_focus_obj(scene->myLoraAddressTextArea);
             break;
 #endif
     }
 
+    scene->addTabToKeyboardGroup(nextTab);
     scene->currentTab = nextTab;
 }
 
@@ -698,6 +695,11 @@ void SettingsScene::syncEntryData() {
         LOGLN("Failed to save settings when synching changes.");
     }
 
+    // Each paired device has its own conversation.
+    if (!device.openConversation(settings.otherMacAddress())) {
+        LOGLN("Failed to open conversation with the paired device.");
+    }
+
     // Sync up the messegner with the settings changes, if necessary.
     if (syncFlags != 0) {
         if (device.messenger->settingsChanged(settings, syncFlags)) {
@@ -827,7 +829,7 @@ void SettingsScene::otherMacTextAreaValueChanged(lv_event_t* e) {
 void SettingsScene::saveClicked(lv_event_t* e) {
     SettingsScene* scene = (SettingsScene*)lv_event_get_user_data(e);
     scene->syncEntryData();
-    scene->device.sceneManager.gotoScene(new ConversationScene(scene->device));        
+    scene->device.sceneManager.gotoCachedScene<ConversationScene>(scene->device);
 }
 
 void SettingsScene::nextTabClicked(lv_event_t* e) {
@@ -13,8 +13,8 @@ public:
     virtual ~SettingsScene() = default;
 
     virtual void willLoadScreen() override;
-    virtual void didLoadScreen() override;
-    virtual void willUnloadScreen() override;
+    virtual void willAppear() override;
+    virtual void didDisappear() override;
     
     virtual void receivedMessage(const char* message) override;
 
@@ -105,6 +105,10 @@ private:
     void buildLoraTab();
 #endif
 
+    // Only the shown tab's views get keyboard input.
+    void addTabToKeyboardGroup(Tab t);
+    void removeTabFromKeyboardGroup(Tab t);
+
 private:
     // Styles
     lv_style_t textAreaStyle;
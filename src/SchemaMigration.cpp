@@ -0,0 +1,41 @@
+#include "SchemaMigration.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+const SchemaMigration::Step* SchemaMigration::find(uint16_t fromVersion) const {
+    for (const Step* step = steps; step->migrateRecord != nullptr; step++) {
+        if (step->fromVersion == fromVersion) {
+            return step;
+        }
+    }
+
+    return nullptr;
+}
+
+bool SchemaMigration::canMigrate(uint16_t version) const {
+    if (version > currentVersion) {
+        return false;
+    }
+
+    for (uint16_t v = version; v < currentVersion; v++) {
+        if (find(v) == nullptr) {
+            LOGFMT("No migration from version %u\n", v);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SchemaMigration::migrateRecord(uint16_t version, uint8_t& type, uint8_t* data, uint16_t& length, uint16_t capacity) const {
+    for (uint16_t v = version; v < currentVersion; v++) {
+        const Step* step = find(v);
+
+        if (step == nullptr || !step->migrateRecord(type, data, length, capacity)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Upgrades data written by older firmware instead of throwing it away.
+//
+// A migration is a list of steps, each upgrading a record from one version to the next.
+// Data of any older version is upgraded by running every step from its version onwards, so
+// a format change only needs a step from the previous version. Records are transformed in
+// place in the caller's buffer, one at a time, so migrating a file of any size needs RAM
+// for one record.
+//
+// To change a format: bump its currentVersion, and add a step from the old version.
+class SchemaMigration {
+public:
+    // Upgrade one record in place from fromVersion to fromVersion + 1. type and length may
+    // change, and the record may grow up to capacity. Return false to drop the record.
+    typedef bool (*MigrateRecordFunction)(uint8_t& type, uint8_t* data, uint16_t& length, uint16_t capacity);
+
+    struct Step {
+        uint16_t fromVersion;
+        MigrateRecordFunction migrateRecord;
+    };
+
+public:
+    // steps ends with an entry whose migrateRecord is nullptr.
+    SchemaMigration(const Step* migrationSteps, uint16_t current) :
+        steps(migrationSteps),
+        currentVersion(current)
+    {}
+
+    // Is there a step for every version from version up to currentVersion?
+    bool canMigrate(uint16_t version) const;
+
+    // Run every step from version onwards. Returns false if a step dropped the record.
+    bool migrateRecord(uint16_t version, uint8_t& type, uint8_t* data, uint16_t& length, uint16_t capacity) const;
+
+private:
+    const Step* find(uint16_t fromVersion) const;
+
+private:
+    const Step* steps;
+    uint16_t currentVersion;
+};
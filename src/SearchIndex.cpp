@@ -0,0 +1,593 @@
+#include "SearchIndex.h"
+#include "Crc32.h"
+#include "Varint.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+static_assert(SearchIndex::maxWordsPerMessage <= SearchIndex::pendingCapacity, "A message's postings must fit in a segment");
+static_assert(SearchIndex::maxSegmentMessages <= 64, "Segment positions must fit the candidate mask");
+static_assert(SearchIndex::maxSegmentLength <= UINT16_MAX, "Segment length must fit its trailer");
+
+namespace {
+    inline bool isWordByte(uint8_t c) {
+        // Anything outside ASCII is part of a UTF-8 sequence; keep it in the word.
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+    }
+
+    uint32_t segmentCrc(const SearchIndex::SegmentHeader& header, const uint8_t* body) {
+        uint32_t crc = Crc32::compute(&header.firstMessage, sizeof(header.firstMessage));
+        crc = Crc32::update(crc, &header.messageCount, sizeof(header.messageCount));
+        crc = Crc32::update(crc, &header.anchor, sizeof(header.anchor));
+        return Crc32::update(crc, body, header.length);
+    }
+}
+
+size_t SearchIndex::nextWord(const char*& p, char (&word)[maxWordLength + 1]) {
+    while (true) {
+        while (*p != 0 && !isWordByte(*p)) {
+            p++;
+        }
+
+        if (*p == 0) {
+            return 0;
+        }
+
+        size_t length = 0;
+
+        while (isWordByte(*p)) {
+            if (length < maxWordLength) {
+                const char c = *p;
+                word[length++] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+            }
+
+            p++;
+        }
+
+        word[length] = 0;
+
+        if (length >= minWordLength) {
+            return length;
+        }
+    }
+}
+
+uint16_t SearchIndex::hashWord(const char* word, size_t length) {
+    // FNV-1a, folded to 16 bits.
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < length; i++) {
+        h ^= uint8_t(word[i]);
+        h *= 16777619u;
+    }
+
+    return uint16_t(h ^ (h >> 16));
+}
+
+uint32_t SearchIndex::hashMessage(const MessageView& msg) {
+    uint32_t h = 2166136261u;
+
+    h = (h ^ uint8_t(msg.sender)) * 16777619u;
+    h = (h ^ uint8_t(msg.sequence)) * 16777619u;
+    h = (h ^ uint8_t(msg.sequence >> 8)) * 16777619u;
+
+    for (const char* p = msg.text; p != nullptr && *p != 0; p++) {
+        h = (h ^ uint8_t(*p)) * 16777619u;
+    }
+
+    return h;
+}
+
+void SearchIndex::closeFile() {
+    storage.close(file);
+    file = nullptr;
+}
+
+bool SearchIndex::writeFileHeader() {
+    FileHeader header = {magic, currentVersion};
+
+    return file->truncate(0) && file->seek(0) &&
+           file->write(&header, sizeof(header)) == sizeof(header) && file->sync();
+}
+
+uint32_t SearchIndex::readSegment(uint32_t offset, SegmentHeader& header) {
+    if (!file->seek(offset) || file->read(&header, sizeof(header)) != sizeof(header) ||
+        header.length > maxBodyLength || header.messageCount == 0 || header.messageCount > maxSegmentMessages)
+    {
+        return 0;
+    }
+
+    // Body, then the trailing segment length.
+    uint8_t* body = segmentBuffer + sizeof(header);
+    const size_t remaining = header.length + sizeof(uint16_t);
+
+    if (file->read(body, remaining) != int(remaining)) {
+        return 0;
+    }
+
+    uint16_t total = 0;
+    memcpy(&total, body + header.length, sizeof(total));
+
+    if (total != sizeof(header) + remaining || segmentCrc(header, body) != header.crc) {
+        return 0;
+    }
+
+    return total;
+}
+
+uint32_t SearchIndex::findEnd(SegmentHeader& last, bool& hasLast) {
+    const uint32_t size = file->size();
+    hasLast = false;
+
+    // Almost always the last segment is intact, so check it first and skip the walk.
+    uint16_t total = 0;
+
+    if (size > sizeof(FileHeader) + sizeof(total) &&
+        file->seek(size - sizeof(total)) && file->read(&total, sizeof(total)) == sizeof(total) &&
+        total <= size - sizeof(FileHeader) && readSegment(size - total, last) == total)
+    {
+        hasLast = true;
+        return size;
+    }
+
+    // The tail is torn; walk forward to the last good segment.
+    uint32_t offset = sizeof(FileHeader);
+    size_t expectedFirst = 0;
+    SegmentHeader header;
+
+    while (true) {
+        const uint32_t length = readSegment(offset, header);
+
+        if (length == 0 || header.firstMessage != expectedFirst) {
+            break;
+        }
+
+        last = header;
+        hasLast = true;
+        offset += length;
+        expectedFirst += header.messageCount;
+    }
+
+    return offset;
+}
+
+bool SearchIndex::load(const MessageHistory& history) {
+    close();
+    lastCleared = history.totalCleared();
+
+    file = storage.open(filename, Storage::Mode::readWrite);
+
+    if (file == nullptr) {
+        LOGFMT("Failed to open %s\n", filename);
+        return false;
+    }
+
+    FileHeader fileHeader;
+
+    if (!file->seek(0) || file->read(&fileHeader, sizeof(fileHeader)) != sizeof(fileHeader) ||
+        fileHeader.magic != magic || fileHeader.version != currentVersion)
+    {
+        return rebuild();
+    }
+
+    SegmentHeader last;
+    bool hasLast = false;
+    const uint32_t end = findEnd(last, hasLast);
+
+    if (end < file->size()) {
+        LOGFMT("Search index damaged, truncating %u bytes\n", file->size() - end);
+
+        if (!file->truncate(end) || !file->sync()) {
+            LOGFMT("Failed to truncate %s\n", filename);
+            closeFile();
+            return false;
+        }
+    }
+
+    if (hasLast) {
+        segmentsEnd = last.firstMessage + last.messageCount;
+
+        // The history was replaced or cleared while the index wasn't looking.
+        if (segmentsEnd > history.size() || hashMessage(history.getMessage(last.firstMessage)) != last.anchor) {
+            LOGLN("Search index doesn't match message history");
+            return rebuild();
+        }
+    }
+
+    LOGFMT("Search index loaded: %u of %u messages\n", segmentsEnd, history.size());
+
+    return true;
+}
+
+void SearchIndex::close() {
+    cancelSearch();
+    closeFile();
+
+    segmentsEnd = 0;
+    pendingCount = 0;
+    pendingMessages = 0;
+}
+
+bool SearchIndex::rebuild() {
+    cancelSearch();
+
+    segmentsEnd = 0;
+    pendingCount = 0;
+    pendingMessages = 0;
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    if (!writeFileHeader()) {
+        LOGFMT("Failed to reset %s\n", filename);
+        closeFile();
+        return false;
+    }
+
+    // update() indexes the history from the start again.
+    LOGLN("Rebuilding search index");
+
+    return true;
+}
+
+void SearchIndex::update(const MessageHistory& history) {
+    if (file == nullptr) {
+        return;
+    }
+
+    // Message numbers start over when the history is cleared.
+    if (history.totalCleared() != lastCleared || history.size() < indexedCount()) {
+        lastCleared = history.totalCleared();
+
+        if (!rebuild()) {
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < catchUpPerUpdate && indexedCount() < history.size() && file != nullptr; i++) {
+        indexMessage(history.getMessage(indexedCount()));
+    }
+}
+
+void SearchIndex::indexMessage(const MessageView& msg) {
+    uint16_t hashes[maxWordsPerMessage];
+    size_t count = 0;
+
+    char word[maxWordLength + 1];
+    const char* p = (msg.text != nullptr) ? msg.text : "";
+    size_t length;
+
+    while (count < maxWordsPerMessage && (length = nextWord(p, word)) > 0) {
+        const uint16_t h = hashWord(word, length);
+
+        bool seen = false;
+        for (size_t i = 0; i < count && !seen; i++) {
+            seen = (hashes[i] == h);
+        }
+
+        if (!seen) {
+            hashes[count++] = h;
+        }
+    }
+
+    if (pendingCount + count > pendingCapacity && !flushPending()) {
+        return;
+    }
+
+    if (pendingMessages == 0) {
+        pendingAnchor = hashMessage(msg);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        pending[pendingCount++] = {hashes[i], uint8_t(pendingMessages)};
+    }
+
+    pendingMessages++;
+
+    if (pendingMessages == maxSegmentMessages) {
+        (void)flushPending();
+    }
+}
+
+bool SearchIndex::flushPending() {
+    if (pendingMessages == 0) {
+        return true;
+    }
+
+    // Group the postings by word. Insertion sort is stable, so positions stay in ascending order.
+    for (size_t i = 1; i < pendingCount; i++) {
+        const Posting posting = pending[i];
+        size_t j = i;
+
+        while (j > 0 && pending[j - 1].wordHash > posting.wordHash) {
+            pending[j] = pending[j - 1];
+            j--;
+        }
+
+        pending[j] = posting;
+    }
+
+    uint8_t* body = segmentBuffer + sizeof(SegmentHeader);
+    size_t length = 0;
+
+    for (size_t i = 0; i < pendingCount; ) {
+        size_t end = i;
+        while (end < pendingCount && pending[end].wordHash == pending[i].wordHash) {
+            end++;
+        }
+
+        memcpy(body + length, &pending[i].wordHash, sizeof(uint16_t));
+        length += sizeof(uint16_t);
+        length += Varint::write(body + length, end - i);
+
+        uint8_t previous = 0;
+        for (size_t k = i; k < end; k++) {
+            length += Varint::write(body + length, pending[k].position - previous);
+            previous = pending[k].position;
+        }
+
+        i = end;
+    }
+
+    SegmentHeader header;
+    header.length = length;
+    header.firstMessage = segmentsEnd;
+    header.messageCount = pendingMessages;
+    header.anchor = pendingAnchor;
+    header.crc = segmentCrc(header, body);
+
+    memcpy(segmentBuffer, &header, sizeof(header));
+
+    const uint16_t total = sizeof(header) + length + sizeof(total);
+    memcpy(body + length, &total, sizeof(total));
+
+    // A torn segment is dropped on load, and its messages indexed again.
+    if (file->append(segmentBuffer, total) != total || !file->sync()) {
+        LOGFMT("Failed to write %s\n", filename);
+        closeFile();
+        return false;
+    }
+
+    segmentsEnd += pendingMessages;
+    pendingCount = 0;
+    pendingMessages = 0;
+
+    return true;
+}
+
+bool SearchIndex::beginSearch(const char* text) {
+    cancelSearch();
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    const char* p = text;
+    size_t length;
+
+    while (queryWordCount < maxQueryWords && (length = nextWord(p, queryWords[queryWordCount])) > 0) {
+        queryHashes[queryWordCount] = hashWord(queryWords[queryWordCount], length);
+        queryWordCount++;
+    }
+
+    if (queryWordCount == 0) {
+        return false;
+    }
+
+    searchState = SearchState::starting;
+    searchStart = millis();
+
+    return true;
+}
+
+void SearchIndex::cancelSearch() {
+    searchState = SearchState::idle;
+    queryWordCount = 0;
+    searchResultCount = 0;
+    searchFrom = 0;
+    searchElapsed = 0;
+}
+
+void SearchIndex::finishSearch() {
+    searchState = SearchState::finished;
+    searchElapsed = millis() - searchStart;
+
+    LOGFMT("Search finished: %u results, searched from %u, %u ms\n", searchResultCount, searchFrom, searchElapsed);
+}
+
+bool SearchIndex::continueSearch(const MessageHistory& history, uint32_t budgetMS) {
+    if (!isSearching()) {
+        return true;
+    }
+
+    const uint32_t sliceStart = millis();
+
+    if (searchState == SearchState::starting) {
+        // Note where everything is now, so messages indexed during the search
+        // are neither missed nor found twice.
+        searchTail = history.size();
+        searchTailStop = indexedCount();
+        searchPendingFirst = segmentsEnd;
+        searchPendingCandidates = matchPending();
+        searchCursor = file->size();
+        searchFrom = history.size();
+        searchState = SearchState::scanningTail;
+    }
+
+    while (true) {
+        const uint32_t now = millis();
+
+        if (now - searchStart >= searchBudgetMS) {
+            break;
+        }
+
+        if (now - sliceStart >= budgetMS) {
+            return false;
+        }
+
+        if (searchState == SearchState::scanningTail) {
+            // Messages that aren't indexed yet (e.g. during a rebuild) are checked directly.
+            if (searchTail == searchTailStop) {
+                searchState = SearchState::scanningPending;
+                continue;
+            }
+
+            searchTail--;
+            searchFrom = searchTail;
+
+            MessageView msg = history.getMessage(searchTail);
+            if (msg.text != nullptr && matchesText(msg.text) && !addResult(searchTail)) {
+                break;
+            }
+        }
+        else if (searchState == SearchState::scanningPending) {
+            searchFrom = searchPendingFirst;
+
+            if (!collectResults(history, searchPendingFirst, searchPendingCandidates)) {
+                break;
+            }
+
+            searchState = SearchState::scanningSegments;
+        }
+        else {
+            if (searchCursor <= sizeof(FileHeader)) {
+                break;
+            }
+
+            uint16_t total = 0;
+            SegmentHeader header;
+
+            if (!file->seek(searchCursor - sizeof(total)) || file->read(&total, sizeof(total)) != sizeof(total) ||
+                total > searchCursor - sizeof(FileHeader) || readSegment(searchCursor - total, header) != total)
+            {
+                LOGLN("Search index damaged");
+                break;
+            }
+
+            searchCursor -= total;
+            searchFrom = header.firstMessage;
+
+            if (!collectResults(history, header.firstMessage, matchBody(segmentBuffer + sizeof(header), header.length))) {
+                break;
+            }
+        }
+    }
+
+    finishSearch();
+    return true;
+}
+
+uint64_t SearchIndex::combineMasks(const uint64_t (&masks)[maxQueryWords]) const {
+    uint64_t candidates = UINT64_MAX;
+
+    for (size_t t = 0; t < queryWordCount; t++) {
+        candidates &= masks[t];
+    }
+
+    return candidates;
+}
+
+uint64_t SearchIndex::matchBody(const uint8_t* body, size_t length) const {
+    uint64_t masks[maxQueryWords] = {0};
+
+    const uint8_t* p = body;
+    const uint8_t* end = body + length;
+
+    while (end - p >= 2) {
+        uint16_t wordHash;
+        memcpy(&wordHash, p, sizeof(wordHash));
+        p += sizeof(wordHash);
+
+        uint32_t count = 0;
+        if (!Varint::read(p, end, count)) {
+            break;
+        }
+
+        // Decode every list, even ones we don't want, to find the next word.
+        uint64_t positions = 0;
+        uint32_t position = 0;
+
+        for (uint32_t k = 0; k < count; k++) {
+            uint32_t delta = 0;
+            if (!Varint::read(p, end, delta)) {
+                return 0;
+            }
+
+            position += delta;
+            if (position < maxSegmentMessages) {
+                positions |= uint64_t(1) << position;
+            }
+        }
+
+        for (size_t t = 0; t < queryWordCount; t++) {
+            if (queryHashes[t] == wordHash) {
+                masks[t] |= positions;
+            }
+        }
+    }
+
+    return combineMasks(masks);
+}
+
+uint64_t SearchIndex::matchPending() const {
+    uint64_t masks[maxQueryWords] = {0};
+
+    for (size_t i = 0; i < pendingCount; i++) {
+        for (size_t t = 0; t < queryWordCount; t++) {
+            if (queryHashes[t] == pending[i].wordHash) {
+                masks[t] |= uint64_t(1) << pending[i].position;
+            }
+        }
+    }
+
+    return combineMasks(masks);
+}
+
+bool SearchIndex::addResult(size_t index) {
+    searchResults[searchResultCount++] = index;
+    return searchResultCount < maxResults;
+}
+
+bool SearchIndex::collectResults(const MessageHistory& history, size_t first, uint64_t candidates) {
+    // Newest first.
+    while (candidates != 0) {
+        const uint8_t position = 63 - __builtin_clzll(candidates);
+        candidates &= ~(uint64_t(1) << position);
+
+        const size_t index = first + position;
+        if (index >= history.size()) {
+            continue;
+        }
+
+        // Rule out hash collisions.
+        MessageView msg = history.getMessage(index);
+        if (msg.text != nullptr && matchesText(msg.text) && !addResult(index)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SearchIndex::matchesText(const char* text) const {
+    const uint8_t all = (1 << queryWordCount) - 1;
+    uint8_t found = 0;
+
+    char word[maxWordLength + 1];
+    const char* p = text;
+
+    while (nextWord(p, word) > 0) {
+        for (size_t t = 0; t < queryWordCount; t++) {
+            if (strcmp(word, queryWords[t]) == 0) {
+                found |= 1 << t;
+            }
+        }
+
+        if (found == all) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <Arduino.h>
+#include "MessageHistory.h"
+#include "Storage/Storage.h"
+
+// Full-text word index over the message history, so old messages can be found
+// without reading the whole journal.
+//
+// Messages are indexed as they're added. Postings (which messages contain which word) are
+// buffered in RAM, then written out as a self-contained segment covering up to 64 consecutive
+// messages. A segment lists the hash of every word in its messages, each followed by the
+// delta-encoded positions of the messages that contain it.
+//
+// Searches walk the segments from newest to oldest, a few at a time, so the UI stays
+// responsive, and stop after a fixed time budget. Word hashes are only 16 bits, so every
+// candidate is checked against the message text before it's reported: hash collisions or a
+// stale index cost a little time, but never give wrong results.
+//
+// The index is derived from the history, so it can always be rebuilt from the journal.
+// Messages missing at the end (e.g. postings still in RAM at power off) are indexed again in
+// the background, and an index that doesn't match the history is thrown away and rebuilt.
+//
+// File format:
+// FileHeader
+// SegmentHeader + body + total segment length (2 bytes), repeated
+//
+// Segment body, for each word in ascending hash order:
+// word hash (2 bytes), posting count (varint), message position deltas (varint each)
+// Positions are relative to the segment's first message; the first delta is from 0.
+class SearchIndex {
+public:
+    static constexpr uint32_t magic = 0x58444953; // "SIDX"
+    static constexpr uint8_t currentVersion = 1;
+
+    // Positions in a segment must fit a 64 bit candidate mask.
+    static constexpr size_t maxSegmentMessages = 64;
+
+    // Postings buffered in RAM before a segment is written.
+    static constexpr size_t pendingCapacity = 128;
+
+    // Words shorter than this aren't indexed, and longer ones are cut off.
+    static constexpr size_t minWordLength = 2;
+    static constexpr size_t maxWordLength = 24;
+
+    static constexpr size_t maxWordsPerMessage = Message::maxTextLength / (minWordLength + 1) + 1;
+
+    // Messages indexed per update() while catching up with the history.
+    static constexpr size_t catchUpPerUpdate = 16;
+
+    static constexpr size_t maxQueryWords = 4;
+    static constexpr size_t maxResults = 32;
+
+    // Time spent per continueSearch() call, and on a whole search.
+    static constexpr uint32_t sliceBudgetMS = 20;
+    static constexpr uint32_t searchBudgetMS = 1000;
+
+    struct FileHeader {
+        uint32_t magic;
+        uint8_t version;
+    } __attribute__((packed));
+
+    struct SegmentHeader {
+        // Body length, not including this header or the trailing segment length.
+        uint16_t length;
+
+        // CRC-32 of the rest of this header and the body.
+        uint32_t crc;
+
+        uint32_t firstMessage;
+        uint8_t messageCount;
+
+        // Hash of the first message, to tell whether the index still matches the history.
+        uint32_t anchor;
+    } __attribute__((packed));
+
+    // Worst case, every posting is for a different word: hash + count + one delta.
+    static constexpr size_t maxBodyLength = pendingCapacity * (sizeof(uint16_t) + 2);
+    static constexpr size_t maxSegmentLength = sizeof(SegmentHeader) + maxBodyLength + sizeof(uint16_t);
+
+public:
+    SearchIndex(Storage& s, const char* indexFilename) :
+        storage(s),
+        filename(indexFilename)
+    {}
+
+    // Open the index and check it against history. Starts over if it doesn't match.
+    bool load(const MessageHistory& history);
+
+    // Close the index, e.g. before switching to another conversation's files.
+    // Postings still in RAM are dropped; they're indexed again after the next load().
+    void close();
+
+    // Throw away the index and rebuild it from history, in the background.
+    bool rebuild();
+
+    // Call often, for example in loop(). Indexes new messages.
+    void update(const MessageHistory& history);
+
+    // False if the index file couldn't be opened or written; load() tries again.
+    inline bool isAvailable() const {
+        return file != nullptr;
+    }
+
+    // Messages in the history that are indexed, including those with postings still in RAM.
+    inline size_t indexedCount() const {
+        return segmentsEnd + pendingMessages;
+    }
+
+    // Start searching for messages that contain every word in text (up to maxQueryWords).
+    // Returns false if text has no searchable words.
+    bool beginSearch(const char* text);
+
+    // Continue the search for up to budgetMS. Returns true once the search is finished.
+    bool continueSearch(const MessageHistory& history, uint32_t budgetMS = sliceBudgetMS);
+
+    void cancelSearch();
+
+    inline bool isSearching() const {
+        return searchState != SearchState::idle && searchState != SearchState::finished;
+    }
+
+    // Matching message numbers, newest first.
+    inline size_t resultCount() const {
+        return searchResultCount;
+    }
+
+    inline size_t result(size_t i) const {
+        return searchResults[i];
+    }
+
+    // Oldest message the search has looked at. Nothing older was searched if the search
+    // ran out of time or results.
+    inline size_t searchedFrom() const {
+        return searchFrom;
+    }
+
+    inline uint32_t searchElapsedMS() const {
+        return searchElapsed;
+    }
+
+private:
+    enum class SearchState: uint8_t {
+        idle,
+        starting,
+        scanningTail,
+        scanningPending,
+        scanningSegments,
+        finished,
+    };
+
+    struct Posting {
+        uint16_t wordHash;
+        uint8_t position;
+    } __attribute__((packed));
+
+    // Copy the next word at or after p into word, lowercased, and advance p past it.
+    // Returns the word length, or 0 if there are no more words.
+    static size_t nextWord(const char*& p, char (&word)[maxWordLength + 1]);
+
+    static uint16_t hashWord(const char* word, size_t length);
+    static uint32_t hashMessage(const MessageView& msg);
+
+    bool writeFileHeader();
+
+    // Read and check the segment at offset into segmentBuffer. Returns its total length, or 0.
+    uint32_t readSegment(uint32_t offset, SegmentHeader& header);
+
+    // Offset just past the last good segment. Sets the header of that segment, if any.
+    uint32_t findEnd(SegmentHeader& last, bool& hasLast);
+
+    void indexMessage(const MessageView& msg);
+    bool flushPending();
+    void closeFile();
+
+    // Which positions in a segment (or the pending postings) have every query word.
+    uint64_t matchBody(const uint8_t* body, size_t length) const;
+    uint64_t matchPending() const;
+    uint64_t combineMasks(const uint64_t (&masks)[maxQueryWords]) const;
+
+    // Check the candidates against the message text and record the matches, newest first.
+    // Returns false once the result list is full.
+    bool collectResults(const MessageHistory& history, size_t first, uint64_t candidates);
+
+    // Returns false once the result list is full.
+    bool addResult(size_t index);
+
+    // Does the text contain every query word?
+    bool matchesText(const char* text) const;
+
+    void finishSearch();
+
+private:
+    Storage& storage;
+    const char* filename;
+    StorageFile* file = nullptr;
+
+    // Messages covered by the segments on storage.
+    size_t segmentsEnd = 0;
+
+    // History clears seen so far, to notice the history being cleared.
+    uint32_t lastCleared = 0;
+
+    // Postings for messages segmentsEnd onwards.
+    Posting pending[pendingCapacity];
+    size_t pendingCount = 0;
+    size_t pendingMessages = 0;
+    uint32_t pendingAnchor = 0;
+
+    // Shared by segment writes and reads.
+    uint8_t segmentBuffer[maxSegmentLength];
+
+    // Search state.
+    SearchState searchState = SearchState::idle;
+    char queryWords[maxQueryWords][maxWordLength + 1];
+    uint16_t queryHashes[maxQueryWords];
+    size_t queryWordCount = 0;
+    size_t searchResults[maxResults];
+    size_t searchResultCount = 0;
+    size_t searchFrom = 0;
+
+    // Unindexed messages still to check, newest first.
+    size_t searchTail = 0;
+    size_t searchTailStop = 0;
+
+    // Candidates among the postings that were in RAM when the search started.
+    size_t searchPendingFirst = 0;
+    uint64_t searchPendingCandidates = 0;
+
+    // End of the next segment to search.
+    uint32_t searchCursor = 0;
+    uint32_t searchStart = 0;
+    uint32_t searchElapsed = 0;
+};
@@ -1,8 +1,45 @@
 #include "Settings.h"
+#include "SchemaMigration.h"
 
 // #define LOGGER Serial
 #include "Logger.h"
 
+// Memory map upgrades, one per version change. See SchemaMigration.
+static const SchemaMigration::Step settingsMigrationSteps[] = {
+    {0, nullptr}
+};
+
+static const SchemaMigration settingsMigration(settingsMigrationSteps, Settings::currentVersion);
+
+bool Settings::migrate(uint8_t* data, uint16_t& length, uint16_t capacity) {
+    uint16_t version;
+
+    if (length < sizeof(version)) {
+        return false;
+    }
+
+    // The version is always the first field.
+    memcpy(&version, data, sizeof(version));
+
+    if (version == currentVersion) {
+        return true;
+    }
+
+    LOGFMT("Migrating settings from version %u to %u\n", version, currentVersion);
+
+    // The memory map is a single record; its type is unused.
+    uint8_t type = 0;
+
+    if (!settingsMigration.canMigrate(version) || !settingsMigration.migrateRecord(version, type, data, length, capacity)) {
+        return false;
+    }
+
+    version = currentVersion;
+    memcpy(data, &version, sizeof(version));
+
+    return true;
+}
+
 void Settings::setDefaults() {
     memoryMap.version = currentVersion;
     memoryMap.configuredRadio = configuredRadioType;    
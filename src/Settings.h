@@ -84,6 +84,10 @@ struct Settings {
     //
     void setDefaults();
 
+    // Upgrade a saved memory map from older firmware in place, up to capacity bytes.
+    // Returns false if it's from a version that can't be upgraded.
+    static bool migrate(uint8_t* data, uint16_t& length, uint16_t capacity);
+
     void logCurrent() const;
 
     uint16_t version() const {
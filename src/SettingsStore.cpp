@@ -0,0 +1,121 @@
+#include "SettingsStore.h"
+#include "Crc32.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+uint32_t SettingsStore::computeCrc(const SlotHeader& header, const void* payload) {
+    uint32_t crc = Crc32::update(Crc32::initial, &header.sequence, sizeof(header.sequence));
+    crc = Crc32::update(crc, &header.length, sizeof(header.length));
+    return Crc32::update(crc, payload, header.length);
+}
+
+bool SettingsStore::readSlot(uint8_t slot, SlotHeader& header, uint8_t (&payload)[maxPayloadLength]) {
+    StorageFile* file = storage.open(slotFilenames[slot], Storage::Mode::read);
+    if (file == nullptr) {
+        return false;
+    }
+
+    bool valid = file->read(&header, sizeof(header)) == (int)sizeof(header) &&
+                 header.magic == magic &&
+                 header.length <= maxPayloadLength &&
+                 file->read(payload, header.length) == (int)header.length;
+
+    storage.close(file);
+
+    if (valid && computeCrc(header, payload) != header.crc) {
+        LOGFMT("Settings slot %s failed CRC check\n", slotFilenames[slot]);
+        valid = false;
+    }
+
+    return valid;
+}
+
+void SettingsStore::remember(uint8_t slot, uint32_t sequence, const void* data, size_t length) {
+    hasCurrent = true;
+    currentSlot = slot;
+    currentSequence = sequence;
+    memcpy(current, data, length);
+    currentLength = length;
+}
+
+bool SettingsStore::load(void* data, size_t capacity, size_t& length) {
+    hasCurrent = false;
+
+    SlotHeader header;
+    uint8_t payload[maxPayloadLength];
+
+    for (uint8_t slot = 0; slot < slotCount; slot++) {
+        if (!readSlot(slot, header, payload)) {
+            continue;
+        }
+
+        if (hasCurrent && (int32_t)(header.sequence - currentSequence) <= 0) {
+            continue;
+        }
+
+        remember(slot, header.sequence, payload, header.length);
+    }
+
+    if (!hasCurrent) {
+        return false;
+    }
+
+    LOGFMT("Settings loaded from %s, sequence %u\n", slotFilenames[currentSlot], currentSequence);
+
+    length = currentLength;
+    memcpy(data, current, min(capacity, currentLength));
+
+    return true;
+}
+
+bool SettingsStore::save(const void* data, size_t length) {
+    if (length > maxPayloadLength) {
+        LOGLN("Settings too large to save");
+        return false;
+    }
+
+    if (hasCurrent && length == currentLength && memcmp(data, current, length) == 0) {
+        skipped++;
+        return true;
+    }
+
+    // Never overwrite the newest good copy.
+    const uint8_t slot = hasCurrent ? (currentSlot + 1) % slotCount : 0;
+
+    SlotHeader header;
+    header.magic = magic;
+    header.sequence = currentSequence + 1;
+    header.length = length;
+    header.crc = computeCrc(header, data);
+
+    StorageFile* file = storage.open(slotFilenames[slot], Storage::Mode::truncate);
+    if (file == nullptr) {
+        LOGFMT("Failed to open %s\n", slotFilenames[slot]);
+        return false;
+    }
+
+    const bool written = file->write(&header, sizeof(header)) == sizeof(header) &&
+                         file->write(data, length) == length &&
+                         file->sync();
+
+    storage.close(file);
+
+    if (!written) {
+        LOGFMT("Failed to write %s\n", slotFilenames[slot]);
+        return false;
+    }
+
+    remember(slot, header.sequence, data, length);
+    return true;
+}
+
+bool SettingsStore::exists() {
+    for (uint8_t slot = 0; slot < slotCount; slot++) {
+        if (storage.exists(slotFilenames[slot])) {
+            return true;
+        }
+    }
+
+    return false;
+}
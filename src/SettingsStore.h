@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Storage/Storage.h"
+
+// Crash-safe storage for a small block of settings.
+//
+// Two slot files are written alternately, each with a sequence number and a CRC. A save
+// always overwrites the older slot, so the newest good copy is never touched: if power is
+// lost mid-write, the torn slot fails its CRC and the other one is loaded instead.
+//
+// Saves of unchanged bytes are skipped, so repeated saves don't wear the card.
+//
+// Slot file format:
+// SlotHeader, then length bytes of payload.
+class SettingsStore {
+public:
+    static constexpr uint32_t magic = 0x53544553; // "SETS"
+
+    // Largest payload that can be stored.
+    static constexpr size_t maxPayloadLength = 128;
+
+    static constexpr uint8_t slotCount = 2;
+
+    struct SlotHeader {
+        uint32_t magic;
+
+        // Higher is newer; compared with wraparound.
+        uint32_t sequence;
+
+        uint16_t length;
+
+        // CRC-32 of sequence, length and the payload.
+        uint32_t crc;
+    } __attribute__((packed));
+
+public:
+    SettingsStore(Storage& s, const char* slotAFilename, const char* slotBFilename) :
+        storage(s),
+        slotFilenames{slotAFilename, slotBFilename}
+    {}
+
+    // Read the newest good slot into data. length is set to the stored payload length,
+    // which may differ from capacity if the payload was written by other firmware;
+    // at most capacity bytes are copied. Returns false if neither slot is readable.
+    bool load(void* data, size_t capacity, size_t& length);
+
+    // Write data to the older slot. Returns true without writing if it's unchanged.
+    // Call load() first, so the newest copy is known.
+    bool save(const void* data, size_t length);
+
+    // True if either slot file exists.
+    bool exists();
+
+    // Saves skipped because nothing changed, for diagnostics.
+    inline uint32_t skippedSaves() const {
+        return skipped;
+    }
+
+private:
+    static uint32_t computeCrc(const SlotHeader& header, const void* payload);
+
+    // Read and check a slot into payload. Returns false if it's missing or damaged.
+    bool readSlot(uint8_t slot, SlotHeader& header, uint8_t (&payload)[maxPayloadLength]);
+
+    // Remember what's on storage, to skip unchanged saves.
+    void remember(uint8_t slot, uint32_t sequence, const void* data, size_t length);
+
+private:
+    Storage& storage;
+    const char* slotFilenames[slotCount];
+
+    // Newest good slot on storage, its sequence number and contents.
+    bool hasCurrent = false;
+    uint8_t currentSlot = 0;
+    uint32_t currentSequence = 0;
+    uint8_t current[maxPayloadLength];
+    size_t currentLength = 0;
+
+    uint32_t skipped = 0;
+};
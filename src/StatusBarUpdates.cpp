@@ -0,0 +1,112 @@
+#include "StatusBarUpdates.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+Color::RGB StatusBarUpdates::fadedToBlack(const Color::RGB& color, uint32_t elapsed, uint32_t duration) {
+    if (duration == 0 || elapsed >= duration) {
+        return Color::RGB(0);
+    }
+
+    // Integer steps; there's no FPU.
+    const uint32_t remaining = fadeSteps - (uint64_t)elapsed * fadeSteps / duration;
+
+    return Color::RGB(color.r * remaining / fadeSteps,
+                      color.g * remaining / fadeSteps,
+                      color.b * remaining / fadeSteps);
+}
+
+StatusBarUpdates::Entry* StatusBarUpdates::entryFor(lv_obj_t* label) {
+    Entry* unused = nullptr;
+
+    for (size_t i = 0; i < maxLabels; i++) {
+        if (entries[i].label == label) {
+            return &entries[i];
+        }
+
+        if (unused == nullptr && entries[i].label == nullptr) {
+            unused = &entries[i];
+        }
+    }
+
+    if (unused != nullptr) {
+        unused->label = label;
+    }
+
+    return unused;
+}
+
+void StatusBarUpdates::setTextColor(lv_obj_t* label, const Color::RGB& color, bool now) {
+    if (label == nullptr) {
+        return;
+    }
+
+    requestCount++;
+
+    Entry* entry = entryFor(label);
+    const uint16_t packed = color.packed565();
+
+    if (entry == nullptr) {
+        LOGLN("StatusBarUpdates: too many labels, applying directly");
+        Color::RGB c(color);
+        lv_obj_set_style_text_color(label, c.toLV(), 0);
+        appliedCount++;
+        return;
+    }
+
+    if (now) {
+        entry->hasPending = false;
+
+        if (!entry->hasShown || entry->shown != packed) {
+            apply(*entry, packed);
+        }
+
+        return;
+    }
+
+    entry->pending = packed;
+    entry->hasPending = true;
+}
+
+void StatusBarUpdates::update() {
+    const uint32_t now = millis();
+
+    if (now - lastUpdate < intervalMS) {
+        return;
+    }
+
+    lastUpdate = now;
+
+    for (size_t i = 0; i < maxLabels; i++) {
+        Entry& entry = entries[i];
+
+        if (!entry.hasPending) {
+            continue;
+        }
+
+        entry.hasPending = false;
+
+        // Same pixels as on screen; nothing to redraw.
+        if (entry.hasShown && entry.shown == entry.pending) {
+            continue;
+        }
+
+        apply(entry, entry.pending);
+    }
+}
+
+void StatusBarUpdates::apply(Entry& entry, uint16_t color) {
+    Color::RGB c = Color::RGB::fromPacked565(color);
+    lv_obj_set_style_text_color(entry.label, c.toLV(), 0);
+
+    entry.shown = color;
+    entry.hasShown = true;
+    appliedCount++;
+}
+
+void StatusBarUpdates::logStats() const {
+#if defined(LOGGER)
+    LOGFMT("Status bar updates: requested: %u, applied: %u, invalidations saved: %u\n",
+        requestCount, appliedCount, invalidationsSaved());
+#endif
+}
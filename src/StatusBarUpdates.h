@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+#include <lvgl.h>
+#include "Color.h"
+
+// Coalesces style changes to status bar labels, so animating them doesn't redraw the status
+// bar every loop.
+//
+// Changing a label's text color invalidates it, and each invalidation costs a partial redraw
+// and an SPI flush. Colors requested with setTextColor() are held until update(), which applies
+// them at most once per LVGL refresh period, and only if they differ from what's on screen in
+// RGB565. Fades are quantized to fadeSteps steps (see fadedToBlack), so a slow fade changes
+// the color a few dozen times instead of on every loop.
+class StatusBarUpdates {
+public:
+    static constexpr size_t maxLabels = 4;
+
+    // Brightness levels a fade goes through.
+    static constexpr uint8_t fadeSteps = 32;
+
+    // No point applying changes more often than LVGL draws them.
+    static constexpr uint32_t intervalMS = LV_DEF_REFR_PERIOD;
+
+    // color faded towards black by elapsed out of duration, in fadeSteps steps.
+    static Color::RGB fadedToBlack(const Color::RGB& color, uint32_t elapsed, uint32_t duration);
+
+    // Set a label's text color. With now, it's applied right away, e.g. when the label is
+    // being shown anyway; otherwise it's applied in update().
+    void setTextColor(lv_obj_t* label, const Color::RGB& color, bool now = false);
+
+    // Call often, for example in loop(). Applies pending colors once per interval.
+    void update();
+
+    // Changes requested, and changes that invalidated a label. The difference was saved.
+    inline uint32_t requested() const {
+        return requestCount;
+    }
+
+    inline uint32_t applied() const {
+        return appliedCount;
+    }
+
+    inline uint32_t invalidationsSaved() const {
+        return requestCount - appliedCount;
+    }
+
+    void logStats() const;
+
+private:
+    struct Entry {
+        lv_obj_t* label = nullptr;
+        uint16_t shown = 0;
+        uint16_t pending = 0;
+        bool hasShown = false;
+        bool hasPending = false;
+    };
+
+    Entry* entryFor(lv_obj_t* label);
+    void apply(Entry& entry, uint16_t color);
+
+private:
+    Entry entries[maxLabels];
+    uint32_t lastUpdate = 0;
+
+    uint32_t requestCount = 0;
+    uint32_t appliedCount = 0;
+};
@@ -0,0 +1,193 @@
+#include "MemoryStorage.h"
+
+MemoryStorage::~MemoryStorage() {
+    for (size_t i = 0; i < maxFiles; i++) {
+        free(entries[i].data);
+    }
+}
+
+MemoryStorage::Entry* MemoryStorage::find(const char* path) {
+    for (size_t i = 0; i < maxFiles; i++) {
+        if (entries[i].used && strcmp(entries[i].name, path) == 0) {
+            return &entries[i];
+        }
+    }
+
+    return nullptr;
+}
+
+bool MemoryStorage::reserve(Entry& e, uint32_t capacity) {
+    if (capacity <= e.capacity) {
+        return true;
+    }
+
+    // Grow geometrically so appends stay cheap.
+    uint32_t newCapacity = (e.capacity == 0) ? 256 : e.capacity;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+
+    uint8_t* data = (uint8_t*)realloc(e.data, newCapacity);
+    if (data == nullptr) {
+        return false;
+    }
+
+    e.data = data;
+    e.capacity = newCapacity;
+    return true;
+}
+
+StorageFile* MemoryStorage::open(const char* path, Mode mode) {
+    if (strlen(path) >= maxNameLength) {
+        return nullptr;
+    }
+
+    File* f = nullptr;
+
+    for (size_t i = 0; i < maxOpenFiles; i++) {
+        if (files[i].entry == nullptr) {
+            f = &files[i];
+            break;
+        }
+    }
+
+    if (f == nullptr) {
+        return nullptr;
+    }
+
+    Entry* e = find(path);
+
+    if (e == nullptr) {
+        if (mode == Mode::read) {
+            return nullptr;
+        }
+
+        for (size_t i = 0; i < maxFiles && e == nullptr; i++) {
+            if (!entries[i].used) {
+                e = &entries[i];
+            }
+        }
+
+        if (e == nullptr) {
+            return nullptr;
+        }
+
+        strcpy(e->name, path);
+        e->size = 0;
+        e->used = true;
+    }
+
+    if (mode == Mode::truncate) {
+        e->size = 0;
+    }
+
+    f->entry = e;
+    f->offset = 0;
+    return f;
+}
+
+void MemoryStorage::close(StorageFile* file) {
+    if (file != nullptr) {
+        static_cast<File*>(file)->entry = nullptr;
+    }
+}
+
+bool MemoryStorage::remove(const char* path) {
+    Entry* e = find(path);
+
+    if (e == nullptr) {
+        return false;
+    }
+
+    // Open handles to it would dangle.
+    for (size_t i = 0; i < maxOpenFiles; i++) {
+        if (files[i].entry == e) {
+            return false;
+        }
+    }
+
+    free(e->data);
+    *e = Entry();
+    return true;
+}
+
+bool MemoryStorage::rename(const char* oldPath, const char* newPath) {
+    Entry* e = find(oldPath);
+
+    if (e == nullptr || find(newPath) != nullptr || strlen(newPath) >= maxNameLength) {
+        return false;
+    }
+
+    strcpy(e->name, newPath);
+    return true;
+}
+
+int MemoryStorage::File::read(void* buffer, size_t length) {
+    if (offset >= entry->size) {
+        return 0;
+    }
+
+    if (length > entry->size - offset) {
+        length = entry->size - offset;
+    }
+
+    memcpy(buffer, entry->data + offset, length);
+    offset += length;
+    return length;
+}
+
+size_t MemoryStorage::File::write(const void* buffer, size_t length) {
+    if (!reserve(*entry, offset + length)) {
+        return 0;
+    }
+
+    // Writing past the end leaves a gap; fill it with zeros like a real file system.
+    if (offset > entry->size) {
+        memset(entry->data + entry->size, 0, offset - entry->size);
+    }
+
+    memcpy(entry->data + offset, buffer, length);
+    offset += length;
+
+    if (offset > entry->size) {
+        entry->size = offset;
+    }
+
+    return length;
+}
+
+bool MemoryStorage::File::seek(uint32_t position) {
+    offset = position;
+    return true;
+}
+
+bool MemoryStorage::File::seekEnd() {
+    offset = entry->size;
+    return true;
+}
+
+uint32_t MemoryStorage::File::position() {
+    return offset;
+}
+
+uint32_t MemoryStorage::File::size() {
+    return entry->size;
+}
+
+bool MemoryStorage::File::truncate(uint32_t length) {
+    if (length > entry->size) {
+        if (!reserve(*entry, length)) {
+            return false;
+        }
+
+        memset(entry->data + entry->size, 0, length - entry->size);
+    }
+
+    entry->size = length;
+
+    if (offset > length) {
+        offset = length;
+    }
+
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Storage.h"
+
+// Storage in RAM. Contents are lost on reset; useful for testing and benchmarking the
+// persistence code without a file system, and for measuring how much of a save is spent
+// in the file system itself.
+class MemoryStorage: public Storage {
+public:
+    static constexpr size_t maxFiles = 16;
+    static constexpr size_t maxNameLength = 32;
+
+    virtual ~MemoryStorage();
+
+    virtual StorageFile* open(const char* path, Mode mode) override;
+    virtual void close(StorageFile* file) override;
+
+    virtual bool exists(const char* path) override {
+        return find(path) != nullptr;
+    }
+
+    virtual bool remove(const char* path) override;
+    virtual bool rename(const char* oldPath, const char* newPath) override;
+
+private:
+    struct Entry {
+        char name[maxNameLength] = {0};
+        uint8_t* data = nullptr;
+        uint32_t size = 0;
+        uint32_t capacity = 0;
+        bool used = false;
+    };
+
+    class File: public StorageFile {
+    public:
+        virtual int read(void* buffer, size_t length) override;
+        virtual size_t write(const void* buffer, size_t length) override;
+        virtual bool seek(uint32_t position) override;
+        virtual bool seekEnd() override;
+        virtual uint32_t position() override;
+        virtual uint32_t size() override;
+        virtual bool truncate(uint32_t length) override;
+
+        virtual bool sync() override {
+            return true;
+        }
+
+        Entry* entry = nullptr;
+        uint32_t offset = 0;
+    };
+
+    Entry* find(const char* path);
+    static bool reserve(Entry& e, uint32_t capacity);
+
+    Entry entries[maxFiles];
+    File files[maxOpenFiles];
+};
@@ -0,0 +1,133 @@
+#include "PosixStorage.h"
+#include <unistd.h>
+#include <sys/stat.h>
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+bool PosixStorage::fullPath(const char* path, char (&out)[maxPathLength]) const {
+    int length = snprintf(out, maxPathLength, "%s/%s", root, path);
+    return length > 0 && length < int(maxPathLength);
+}
+
+StorageFile* PosixStorage::open(const char* path, Mode mode) {
+    File* f = nullptr;
+
+    for (size_t i = 0; i < maxOpenFiles; i++) {
+        if (files[i].file == nullptr) {
+            f = &files[i];
+            break;
+        }
+    }
+
+    char full[maxPathLength];
+
+    if (f == nullptr || !fullPath(path, full)) {
+        LOGLN("Failed to open file");
+        return nullptr;
+    }
+
+    switch (mode) {
+        case Mode::read:
+            f->file = fopen(full, "rb");
+            break;
+
+        case Mode::readWrite:
+            // "r+" doesn't create the file, and "a+" can only write at the end.
+            f->file = fopen(full, "r+b");
+            if (f->file == nullptr) {
+                f->file = fopen(full, "w+b");
+            }
+            break;
+
+        case Mode::truncate:
+            f->file = fopen(full, "w+b");
+            break;
+    }
+
+    return (f->file == nullptr) ? nullptr : f;
+}
+
+void PosixStorage::close(StorageFile* file) {
+    if (file == nullptr) {
+        return;
+    }
+
+    File* f = static_cast<File*>(file);
+
+    if (f->file != nullptr) {
+        fclose(f->file);
+        f->file = nullptr;
+    }
+}
+
+bool PosixStorage::exists(const char* path) {
+    char full[maxPathLength];
+    struct stat st;
+    return fullPath(path, full) && stat(full, &st) == 0;
+}
+
+bool PosixStorage::remove(const char* path) {
+    char full[maxPathLength];
+    return fullPath(path, full) && ::remove(full) == 0;
+}
+
+bool PosixStorage::rename(const char* oldPath, const char* newPath) {
+    char fullOld[maxPathLength];
+    char fullNew[maxPathLength];
+
+    // POSIX rename replaces the destination; match the SD card, which doesn't.
+    if (!fullPath(oldPath, fullOld) || !fullPath(newPath, fullNew) || exists(newPath)) {
+        return false;
+    }
+
+    return ::rename(fullOld, fullNew) == 0;
+}
+
+int PosixStorage::File::read(void* buffer, size_t length) {
+    size_t count = fread(buffer, 1, length, file);
+    return ferror(file) ? -1 : int(count);
+}
+
+size_t PosixStorage::File::write(const void* buffer, size_t length) {
+    return fwrite(buffer, 1, length, file);
+}
+
+bool PosixStorage::File::seek(uint32_t position) {
+    return fseek(file, position, SEEK_SET) == 0;
+}
+
+bool PosixStorage::File::seekEnd() {
+    return fseek(file, 0, SEEK_END) == 0;
+}
+
+uint32_t PosixStorage::File::position() {
+    return ftell(file);
+}
+
+uint32_t PosixStorage::File::size() {
+    const long current = ftell(file);
+    fseek(file, 0, SEEK_END);
+    const long end = ftell(file);
+    fseek(file, current, SEEK_SET);
+
+    return end;
+}
+
+bool PosixStorage::File::truncate(uint32_t length) {
+    fflush(file);
+
+    if (ftruncate(fileno(file), length) != 0) {
+        return false;
+    }
+
+    if (position() > length) {
+        seek(length);
+    }
+
+    return true;
+}
+
+bool PosixStorage::File::sync() {
+    return fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
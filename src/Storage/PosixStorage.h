@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "Storage.h"
+
+// Storage on a POSIX file system, e.g. for running the persistence code on a host.
+// Paths are relative to the root directory given to the constructor.
+class PosixStorage: public Storage {
+public:
+    static constexpr size_t maxPathLength = 128;
+
+    PosixStorage(const char* rootDirectory) : root(rootDirectory) {}
+
+    virtual StorageFile* open(const char* path, Mode mode) override;
+    virtual void close(StorageFile* file) override;
+
+    virtual bool exists(const char* path) override;
+    virtual bool remove(const char* path) override;
+    virtual bool rename(const char* oldPath, const char* newPath) override;
+
+private:
+    class File: public StorageFile {
+    public:
+        virtual int read(void* buffer, size_t length) override;
+        virtual size_t write(const void* buffer, size_t length) override;
+        virtual bool seek(uint32_t position) override;
+        virtual bool seekEnd() override;
+        virtual uint32_t position() override;
+        virtual uint32_t size() override;
+        virtual bool truncate(uint32_t length) override;
+        virtual bool sync() override;
+
+        FILE* file = nullptr;
+    };
+
+    // Prefix path with the root directory. Returns false if it doesn't fit.
+    bool fullPath(const char* path, char (&out)[maxPathLength]) const;
+
+    const char* root;
+    File files[maxOpenFiles];
+};
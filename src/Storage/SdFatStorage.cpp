@@ -0,0 +1,53 @@
+#include "SdFatStorage.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+StorageFile* SdFatStorage::open(const char* path, Mode mode) {
+    File* f = nullptr;
+
+    for (size_t i = 0; i < maxOpenFiles; i++) {
+        if (!files[i].inUse) {
+            f = &files[i];
+            break;
+        }
+    }
+
+    if (f == nullptr) {
+        LOGLN("Too many open files");
+        return nullptr;
+    }
+
+    oflag_t flags = O_RDONLY;
+
+    switch (mode) {
+        case Mode::read:
+            flags = O_RDONLY;
+            break;
+
+        case Mode::readWrite:
+            flags = O_CREAT | O_RDWR;
+            break;
+
+        case Mode::truncate:
+            flags = O_CREAT | O_RDWR | O_TRUNC;
+            break;
+    }
+
+    if (!f->file.open(path, flags)) {
+        return nullptr;
+    }
+
+    f->inUse = true;
+    return f;
+}
+
+void SdFatStorage::close(StorageFile* file) {
+    if (file == nullptr) {
+        return;
+    }
+
+    File* f = static_cast<File*>(file);
+    f->file.close();
+    f->inUse = false;
+}
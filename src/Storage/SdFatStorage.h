@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include "Storage.h"
+
+// Storage on the SD card.
+class SdFatStorage: public Storage {
+public:
+    SdFatStorage(SdFat& sd) : sdCard(sd) {}
+
+    virtual StorageFile* open(const char* path, Mode mode) override;
+    virtual void close(StorageFile* file) override;
+
+    virtual bool exists(const char* path) override {
+        return sdCard.exists(path);
+    }
+
+    virtual bool remove(const char* path) override {
+        return sdCard.remove(path);
+    }
+
+    virtual bool rename(const char* oldPath, const char* newPath) override {
+        return sdCard.rename(oldPath, newPath);
+    }
+
+private:
+    class File: public StorageFile {
+    public:
+        virtual int read(void* buffer, size_t length) override {
+            return file.read(buffer, length);
+        }
+
+        virtual size_t write(const void* buffer, size_t length) override {
+            return file.write(buffer, length);
+        }
+
+        virtual bool seek(uint32_t position) override {
+            return file.seekSet(position);
+        }
+
+        virtual bool seekEnd() override {
+            return file.seekEnd();
+        }
+
+        virtual uint32_t position() override {
+            return file.curPosition();
+        }
+
+        virtual uint32_t size() override {
+            return file.fileSize();
+        }
+
+        virtual bool truncate(uint32_t length) override {
+            return file.truncate(length);
+        }
+
+        virtual bool sync() override {
+            return file.sync();
+        }
+
+        File32 file;
+        bool inUse = false;
+    };
+
+    SdFat& sdCard;
+    File files[maxOpenFiles];
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Arduino.h>
+
+// An open file on a Storage backend. Get one from Storage::open(), give it back with Storage::close().
+class StorageFile {
+public:
+    virtual ~StorageFile() = default;
+
+    // Returns the number of bytes read, or -1 on error.
+    virtual int read(void* buffer, size_t length) = 0;
+
+    // Returns the number of bytes written.
+    virtual size_t write(const void* buffer, size_t length) = 0;
+
+    // Write at the end of the file.
+    size_t append(const void* buffer, size_t length) {
+        return seekEnd() ? write(buffer, length) : 0;
+    }
+
+    // Read a single byte. Returns -1 at the end of the file or on error.
+    int read() {
+        uint8_t b;
+        return (read(&b, 1) == 1) ? b : -1;
+    }
+
+    size_t write(uint8_t b) {
+        return write(&b, 1);
+    }
+
+    virtual bool seek(uint32_t position) = 0;
+    virtual bool seekEnd() = 0;
+    virtual uint32_t position() = 0;
+    virtual uint32_t size() = 0;
+    virtual bool truncate(uint32_t length) = 0;
+
+    // Make sure everything written so far is on the medium.
+    virtual bool sync() = 0;
+};
+
+// Minimal file system interface, so persistence code doesn't depend on a particular
+// file system (SD card on the device, POSIX or RAM on a host).
+//
+// Backends keep a fixed pool of file objects, so opening a file doesn't allocate.
+class Storage {
+public:
+    enum class Mode: uint8_t {
+        // Read only. Fails if the file doesn't exist.
+        read,
+
+        // Read and write, starting at the beginning. Creates the file if needed.
+        readWrite,
+
+        // Read and write, emptying the file first. Creates the file if needed.
+        truncate,
+    };
+
+    // Files that can be open at once, per backend.
+    static constexpr size_t maxOpenFiles = 8;
+
+    virtual ~Storage() = default;
+
+    // Returns nullptr if the file can't be opened.
+    virtual StorageFile* open(const char* path, Mode mode) = 0;
+
+    // Closes the file and returns it to the pool. Safe to call with nullptr.
+    virtual void close(StorageFile* file) = 0;
+
+    virtual bool exists(const char* path) = 0;
+    virtual bool remove(const char* path) = 0;
+
+    // Fails if newPath exists.
+    virtual bool rename(const char* oldPath, const char* newPath) = 0;
+};
@@ -0,0 +1,124 @@
+#include "TrafficQueue.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+uint16_t TrafficQueue::enqueue(TrafficClass c, const uint8_t* frame, uint8_t length, const uint8_t* destination, uint8_t destinationLength) {
+    const uint8_t index = uint8_t(c);
+    ClassStats& s = classStats[index];
+
+    if (queues[index].isFull() || length > maxFrameSize || destinationLength > MacAddress::addressLength) {
+        LOGFMT("Dropping %s frame, queue full\n", className(c));
+        s.dropped++;
+        return 0;
+    }
+
+    // Ticket 0 means failure.
+    nextTicket++;
+    if (nextTicket == 0) {
+        nextTicket = 1;
+    }
+
+    Entry entry;
+    entry.trafficClass = c;
+    entry.ticket = nextTicket;
+    entry.enqueueTimestamp = millis();
+    entry.length = length;
+    memcpy(entry.frame, frame, length);
+
+    if (destination != nullptr) {
+        memcpy(entry.destination, destination, destinationLength);
+    }
+
+    queues[index].push(entry);
+    s.enqueued++;
+
+    return entry.ticket;
+}
+
+bool TrafficQueue::isEmpty() const {
+    for (uint8_t i = 0; i < classCount; i++) {
+        if (!queues[i].isEmpty()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TrafficQueue::dequeue(Entry& out, const TrafficClass* onlyClass) {
+    const uint32_t now = millis();
+
+    int best = -1;
+    int32_t bestPriority = 0;
+
+    for (uint8_t i = 0; i < classCount; i++) {
+        if (queues[i].isEmpty()) {
+            continue;
+        }
+
+        if (onlyClass != nullptr && uint8_t(*onlyClass) != i) {
+            continue;
+        }
+
+        // Aging: waiting frames climb one class per interval, but never above acks.
+        const uint32_t waited = now - queues[i].first().enqueueTimestamp;
+        int32_t priority = int32_t(i) - int32_t(waited / agingIntervalMS);
+
+        if (i != uint8_t(TrafficClass::ack) && priority <= int32_t(TrafficClass::ack)) {
+            priority = int32_t(TrafficClass::ack) + 1;
+        }
+
+        // Ties go to the higher class, which is scanned first.
+        if (best < 0 || priority < bestPriority) {
+            best = i;
+            bestPriority = priority;
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+
+    out = queues[best].shift();
+
+    ClassStats& s = classStats[best];
+    const uint32_t delay = now - out.enqueueTimestamp;
+    s.dequeued++;
+    s.totalDelayMS += delay;
+    s.maxDelayMS = max(s.maxDelayMS, delay);
+
+    return true;
+}
+
+const char* TrafficQueue::className(TrafficClass c) {
+    switch (c) {
+        case TrafficClass::ack:
+            return "ack";
+
+        case TrafficClass::message:
+            return "message";
+
+        case TrafficClass::presence:
+            return "presence";
+
+        case TrafficClass::sync:
+            return "sync";
+    }
+
+    return "";
+}
+
+void TrafficQueue::logStats() const {
+#if defined(LOGGER)
+    LOGLN("--------------------------\nTraffic queue:\n--------------------------");
+
+    for (uint8_t i = 0; i < classCount; i++) {
+        const ClassStats& s = classStats[i];
+        LOGFMT("%-8s sent: %u, dropped: %u, avg delay: %ums, max delay: %ums\n",
+            className(TrafficClass(i)), s.dequeued, s.dropped, s.averageDelayMS(), s.maxDelayMS);
+    }
+
+    LOGLN("--------------------------\n");
+#endif
+}
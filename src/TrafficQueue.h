@@ -0,0 +1,99 @@
+#pragma once
+
+#include <Arduino.h>
+#include <CircularBuffer.hpp>
+#include "MacAddress.h"
+
+// Traffic classes, highest priority first.
+enum class TrafficClass: uint8_t {
+    // Acknowledgements. Always go first so the peer's retry timers don't expire.
+    ack = 0,
+
+    // User messages.
+    message,
+
+    // Presence pings.
+    presence,
+
+    // Background history sync.
+    sync,
+};
+
+// Strict-priority transmit queue with one FIFO per traffic class.
+//
+// The highest priority non-empty class is served first. To prevent starvation, a frame's
+// effective priority improves by one class for every agingIntervalMS it has been waiting,
+// so a long-waiting ping eventually goes out ahead of a steady stream of sync traffic.
+// Acks are never overtaken.
+//
+// Queueing delay (enqueue to dequeue) is tracked per class.
+class TrafficQueue {
+public:
+    static constexpr uint8_t classCount = 4;
+
+    // Large enough for a full ESP-NOW packet.
+    static constexpr size_t maxFrameSize = 250;
+
+    // Frames queued per class before enqueue() starts failing.
+    static constexpr size_t depthPerClass = 4;
+
+    static constexpr uint32_t agingIntervalMS = 1000;
+
+    struct Entry {
+        TrafficClass trafficClass = TrafficClass::message;
+
+        // Identifies the frame so callers can wait for it to be transmitted.
+        uint16_t ticket = 0;
+
+        uint32_t enqueueTimestamp = 0;
+
+        // Destination, in whatever form the messenger uses (MAC or single byte address).
+        uint8_t destination[MacAddress::addressLength] = {0};
+
+        uint8_t length = 0;
+        uint8_t frame[maxFrameSize];
+    };
+
+    struct ClassStats {
+        uint32_t enqueued = 0;
+        uint32_t dropped = 0;
+        uint32_t dequeued = 0;
+        uint32_t totalDelayMS = 0;
+        uint32_t maxDelayMS = 0;
+
+        inline uint32_t averageDelayMS() const {
+            return (dequeued == 0) ? 0 : totalDelayMS / dequeued;
+        }
+    };
+
+public:
+    // Returns the frame's ticket, or 0 if the class's queue is full.
+    uint16_t enqueue(TrafficClass c, const uint8_t* frame, uint8_t length, const uint8_t* destination = nullptr, uint8_t destinationLength = 0);
+
+    // Remove the next frame to transmit. Returns false if nothing is queued.
+    // If onlyClass is given, only that class is considered.
+    bool dequeue(Entry& out, const TrafficClass* onlyClass = nullptr);
+
+    inline bool isEmpty(TrafficClass c) const {
+        return queues[uint8_t(c)].isEmpty();
+    }
+
+    bool isEmpty() const;
+
+    inline bool isFull(TrafficClass c) const {
+        return queues[uint8_t(c)].isFull();
+    }
+
+    const ClassStats& stats(TrafficClass c) const {
+        return classStats[uint8_t(c)];
+    }
+
+    void logStats() const;
+
+    static const char* className(TrafficClass c);
+
+private:
+    CircularBuffer<Entry, depthPerClass> queues[classCount];
+    ClassStats classStats[classCount];
+    uint16_t nextTicket = 0;
+};
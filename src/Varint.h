@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+// LEB128 style variable length integers: 7 bits per byte, low bits first,
+// high bit set on every byte but the last. Values under 128 take a single byte.
+namespace Varint {
+    // Longest encoding of a 32 bit value.
+    static constexpr size_t maxLength = 5;
+
+    // Returns the number of bytes written; out must hold maxLength bytes.
+    inline size_t write(uint8_t* out, uint32_t value) {
+        size_t length = 0;
+
+        while (value >= 0x80) {
+            out[length++] = uint8_t(value) | 0x80;
+            value >>= 7;
+        }
+
+        out[length++] = uint8_t(value);
+        return length;
+    }
+
+    // Read a value at p, advancing p past it. Returns false if it runs past end.
+    inline bool read(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+        value = 0;
+
+        for (uint8_t shift = 0; p < end && shift < 32; shift += 7) {
+            const uint8_t b = *p++;
+            value |= uint32_t(b & 0x7F) << shift;
+
+            if ((b & 0x80) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Map signed values to unsigned so small negative values stay short too.
+    inline uint32_t zigzag(int32_t value) {
+        return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+    }
+
+    inline int32_t unzigzag(uint32_t value) {
+        return int32_t(value >> 1) ^ -int32_t(value & 1);
+    }
+}
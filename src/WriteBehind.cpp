@@ -0,0 +1,128 @@
+#include "WriteBehind.h"
+
+// #define LOGGER Serial
+#include "Logger.h"
+
+void WriteBehind::markDirty(Target t) {
+    TargetState& target = targets[uint8_t(t)];
+    const uint32_t now = millis();
+
+    if (!target.dirty) {
+        target.dirty = true;
+        target.firstDirtyTimestamp = now;
+    }
+
+    target.lastDirtyTimestamp = now;
+    target.stats.marks++;
+}
+
+bool WriteBehind::flush(Target t) {
+    TargetState& target = targets[uint8_t(t)];
+
+    if (!target.dirty) {
+        return true;
+    }
+
+    if (target.flushCallback == nullptr) {
+        return false;
+    }
+
+    // Clear first, so a flush that marks the target dirty again isn't lost.
+    const uint32_t firstDirtyTimestamp = target.firstDirtyTimestamp;
+    target.dirty = false;
+
+    const uint32_t start = micros();
+    const bool success = target.flushCallback();
+    const uint32_t elapsed = micros() - start;
+
+    Stats& s = target.stats;
+    s.flushes++;
+    s.lastFlushMicros = elapsed;
+    s.totalFlushMicros += elapsed;
+    if (elapsed > s.maxFlushMicros) {
+        s.maxFlushMicros = elapsed;
+    }
+
+    s.lastPendingMS = millis() - target.firstDirtyTimestamp;
+    if (s.lastPendingMS > s.maxPendingMS) {
+        s.maxPendingMS = s.lastPendingMS;
+    }
+
+    target.failed = !success;
+
+    if (!success) {
+        // Still dirty, and still as overdue as before. update() waits a quiet period
+        // before trying again, so a missing card doesn't stall every loop.
+        target.dirty = true;
+        target.firstDirtyTimestamp = firstDirtyTimestamp;
+        target.lastFailureTimestamp = millis();
+
+        s.failures++;
+        LOGFMT("Failed to flush %s\n", targetName(t));
+    }
+
+    LOGFMT("Flushed %s: %u us, pending %u ms, %u saves coalesced so far\n", 
+        targetName(t), elapsed, s.lastPendingMS, s.marks - s.flushes);
+
+    return success;
+}
+
+bool WriteBehind::flushAll() {
+    bool success = true;
+
+    for (uint8_t i = 0; i < targetCount; i++) {
+        success = flush(Target(i)) && success;
+    }
+
+    return success;
+}
+
+void WriteBehind::update() {
+    const uint32_t now = millis();
+
+    for (uint8_t i = 0; i < targetCount; i++) {
+        const TargetState& target = targets[i];
+
+        if (!target.dirty) {
+            continue;
+        }
+
+        if (target.failed && (now - target.lastFailureTimestamp) < quietPeriodMS) {
+            continue;
+        }
+
+        if ((now - target.lastDirtyTimestamp) >= quietPeriodMS || (now - target.firstDirtyTimestamp) >= deadlineMS) {
+            (void)flush(Target(i));
+
+            // One flush per loop, so two targets coming due together don't stall twice as long.
+            return;
+        }
+    }
+}
+
+void WriteBehind::logStats() const {
+#if defined(LOGGER)
+    LOGLN("--------------------------\nWrite-behind:\n--------------------------");
+
+    for (uint8_t i = 0; i < targetCount; i++) {
+        const Stats& s = targets[i].stats;
+        LOGFMT("%-15s saves: %u, flushes: %u, failed: %u, avg flush: %uus, max flush: %uus, max pending: %ums\n",
+            targetName(Target(i)), s.marks, s.flushes, s.failures, 
+            (s.flushes == 0) ? 0 : s.totalFlushMicros / s.flushes, s.maxFlushMicros, s.maxPendingMS);
+    }
+
+    LOGLN("--------------------------\n");
+#endif
+}
+
+const char* WriteBehind::targetName(Target t) {
+    switch (t) {
+        case Target::settings:
+            return "settings";
+
+        case Target::messageHistory:
+            return "message history";
+    }
+
+    return "unknown";
+}
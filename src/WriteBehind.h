@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Write-behind scheduler for things persisted to the SD card.
+//
+// Saving marks a target dirty instead of writing right away. A dirty target is flushed once
+// it has been quiet for quietPeriodMS, or at the latest deadlineMS after it first became
+// dirty, so a burst of changes (e.g. a run of slider moves in settings, or a batch of
+// incoming messages) costs one write instead of many. flushAll() writes everything
+// immediately; call it when the battery is about to run out, or before shutting down.
+// A target whose flush fails stays dirty and is tried again after another quiet period.
+//
+// Each flush is timed, since it stalls the loop while it runs.
+class WriteBehind {
+public:
+    enum class Target: uint8_t {
+        settings = 0,
+        messageHistory,
+    };
+
+    static constexpr uint8_t targetCount = 2;
+
+    static constexpr uint32_t quietPeriodMS = 2 * 1000;
+    static constexpr uint32_t deadlineMS = 10 * 1000;
+
+    struct Stats {
+        // Saves requested, and flushes that actually wrote. The difference was coalesced.
+        uint32_t marks = 0;
+        uint32_t flushes = 0;
+        uint32_t failures = 0;
+
+        // Loop stall caused by flushing.
+        uint32_t lastFlushMicros = 0;
+        uint32_t maxFlushMicros = 0;
+        uint32_t totalFlushMicros = 0;
+
+        // How long changes waited before being written.
+        uint32_t lastPendingMS = 0;
+        uint32_t maxPendingMS = 0;
+    };
+
+public:
+    // The function that writes the target. Returns false on failure.
+    void setFlushCallback(Target t, bool (*cb)()) {
+        targets[uint8_t(t)].flushCallback = cb;
+    }
+
+    // Schedule the target to be written.
+    void markDirty(Target t);
+
+    // Write the target now, if it's dirty.
+    bool flush(Target t);
+
+    // Write every dirty target now.
+    bool flushAll();
+
+    // Call often, for example in loop(). Flushes targets that are due.
+    void update();
+
+    inline bool isDirty(Target t) const {
+        return targets[uint8_t(t)].dirty;
+    }
+
+    const Stats& stats(Target t) const {
+        return targets[uint8_t(t)].stats;
+    }
+
+    void logStats() const;
+
+    static const char* targetName(Target t);
+
+private:
+    struct TargetState {
+        bool (*flushCallback)() = nullptr;
+        bool dirty = false;
+        uint32_t firstDirtyTimestamp = 0;
+        uint32_t lastDirtyTimestamp = 0;
+        // The last flush failed; it's retried once it's been quietPeriodMS since.
+        bool failed = false;
+        uint32_t lastFailureTimestamp = 0;
+        Stats stats;
+    };
+
+    TargetState targets[targetCount];
+};
@@ -1,8 +1,17 @@
 #include <Arduino.h>
 #include <lvgl.h>
+#include "lvgl_allocator.h"
 
 // LVGL custom memory management for ESP32 family boards - use PSRAM instead of DRAM.
 
+namespace {
+    LvglAllocationStats stats;
+}
+
+const LvglAllocationStats& lvglAllocationStats() {
+    return stats;
+}
+
 void lv_mem_init(void) {
     return;
 }
@@ -20,14 +29,22 @@ void lv_mem_remove_pool(lv_mem_pool_t pool) {
 }
 
 void * lv_malloc_core(size_t size) {
+    stats.allocations++;
+    stats.bytesAllocated += size;
     return heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
 }
 
 void * lv_realloc_core(void * p, size_t new_size) {
+    stats.allocations++;
+    stats.bytesAllocated += new_size;
     return heap_caps_realloc(p, new_size, MALLOC_CAP_8BIT);
 }
 
 void lv_free_core(void * p){
+    if (p != NULL) {
+        stats.frees++;
+    }
+
     return heap_caps_free(p);
 }
 
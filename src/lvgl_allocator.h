@@ -0,0 +1,12 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Counts of LVGL's allocations, to see how much heap churn an operation causes.
+struct LvglAllocationStats {
+    uint32_t allocations = 0;
+    uint32_t frees = 0;
+    uint32_t bytesAllocated = 0;
+};
+
+const LvglAllocationStats& lvglAllocationStats();
@@ -11,6 +11,19 @@
 #include "Color.h"
 #include "SceneManager.h"
 #include "Device.h"
+#include "Presence.h"
+#include "HistorySync.h"
+#include "HistoryJournal.h"
+#include "ConversationDirectory.h"
+#include "SearchIndex.h"
+#include "WriteBehind.h"
+#include "SettingsStore.h"
+#include "BootTimeline.h"
+#include "Payload.h"
+#include "FrameProfiler.h"
+#include "SceneBenchmark.h"
+#include "StatusBarUpdates.h"
+#include "Storage/SdFatStorage.h"
 
 // Radio messengers
 #include "EspNowMessenger.h"
@@ -55,8 +68,25 @@ const int32_t batteryIndicatorCanvasWidth = 36;
 const int32_t batteryIndicatorCanvasHeight = 20;
 const uint32_t batteryIndicatorCanvasBufferSize = batteryIndicatorCanvasWidth * batteryIndicatorCanvasHeight * (LV_COLOR_DEPTH / 8);
 
-// We'll allocate the battery canvas buffer and assign 
-// references to the canvas and label in setup()
+// The indicator is drawn once per fill level and kept; changing level just points the canvas
+// at another sprite. Levels are batterySpriteStep percent apart. At or below batteryLowPercent
+// the fill is red, so those levels have a red sprite as well.
+const uint8_t batterySpriteStep = 5;
+const uint8_t batteryLowPercent = 20;
+const size_t batteryAmberSpriteCount = 100 / batterySpriteStep + 1;
+const size_t batteryRedSpriteCount = batteryLowPercent / batterySpriteStep + 1;
+
+// Amber levels, then red levels, then the empty battery shown until the first reading.
+const size_t batterySpriteCount = batteryAmberSpriteCount + batteryRedSpriteCount + 1;
+const size_t batteryEmptySprite = batterySpriteCount - 1;
+
+// We'll allocate the sprites and assign references to the canvas and label in setup().
+// If there isn't room for all the sprites, batteryIndicatorCanvasBuffer is redrawn every time.
+uint8_t* batterySprites = nullptr;
+bool batterySpriteDrawn[batterySpriteCount] = {false};
+size_t batterySpriteShown = SIZE_MAX;
+int32_t batteryLabelPercent = -1;
+
 uint8_t* batteryIndicatorCanvasBuffer = nullptr;
 lv_obj_t* batteryStatusLabel = nullptr;
 lv_obj_t* batteryIndicatorCanvas = nullptr;
@@ -77,17 +107,22 @@ uint32_t lvglKeyPressedTimestamp = 0;
 // Status bar labels
 ////////////////////////////////////
 lv_obj_t* radioModeStatusLabel = nullptr;
+lv_obj_t* presenceStatusLabel = nullptr;
 lv_obj_t* pingStatusLabel = nullptr;
 lv_obj_t* newMessageStatusLabel = nullptr;
 
+// Label color changes are applied once per refresh at most.
+StatusBarUpdates statusBarUpdates;
+
 // Ping
 const uint32_t pingIndicatorTimeout = 5 * 1000;
 bool pingIndicatorActive = false;
 uint32_t pingIndicatorTimer = 0;
 
-const int32_t minPingBroadcastTimeout = 60 * 1000;
-const int32_t maxPingBroadcastTimeout = 120 * 1000;
-int32_t pingBroadcastTimer = 0;
+////////////////////////////////////
+// Presence
+////////////////////////////////////
+Presence presence;
 
 ////////////////////////////////////
 // SD Card
@@ -96,18 +131,86 @@ SdFat sdCard;
 SdSpiConfig sdConfig(SD_CS, 0, SD_SCK_MHZ(50));
 bool sdCardInitialized = false;
 
+// Settings and history go through this, so they don't depend on SdFat directly.
+SdFatStorage sdStorage(sdCard);
+
+////////////////////////////////////
+// Write-behind for settings and history
+////////////////////////////////////
+WriteBehind writeBehind;
+
+// At or below this, save right away; we may lose power at any moment.
+const uint8_t lowBatteryFlushPercent = 5;
+bool batteryLow = false;
+
 ////////////////////////////////////
 // Settings
 ////////////////////////////////////
-const char* settingsFilename = "settings.cfg";
+// Written to two slots alternately, so a save never destroys the last good copy.
+const char* settingsSlotAFilename = "settings.a";
+const char* settingsSlotBFilename = "settings.b";
+SettingsStore settingsStore(sdStorage, settingsSlotAFilename, settingsSlotBFilename);
 Settings settings;
+
+// Single settings file written by older firmware; converted on first load.
+const char* legacySettingsFilename = "settings.cfg";
 bool settingsInitialized = false;
 
 ////////////////////////////////////
 // Message history
 ////////////////////////////////////
-const char* messageHistoryFilename = "messages.hst";
+// Each peer's history is kept in its own files; only the open conversation is loaded.
+const char* conversationDirectoryFilename = "convs.dir";
+const char* conversationDirectoryTempFilename = "convs.tmp";
+ConversationDirectory conversations(sdStorage, conversationDirectoryFilename, conversationDirectoryTempFilename);
+
+// Names of the open conversation's files. The journal and search index refer to these,
+// so they're filled in before either is loaded, and change when another conversation is opened.
+ConversationDirectory::Files conversationFiles = {};
+MacAddress conversationPeer;
+
 MessageHistory messageHistory;
+HistoryJournal messageHistoryJournal(sdStorage, 
+                                     conversationFiles.journal, 
+                                     conversationFiles.journalIndex,
+                                     conversationFiles.compaction,
+                                     conversationFiles.compactionIndex);
+
+// Word index for finding old messages; rebuilt from the journal if it's missing or out of date.
+SearchIndex searchIndex(sdStorage, conversationFiles.searchIndex);
+
+// Single history written by older firmware, before conversations were kept separately.
+// Adopted as the paired device's conversation.
+const char* unpartitionedJournalFilename = "messages.jnl";
+const char* unpartitionedJournalIndexFilename = "messages.idx";
+const char* unpartitionedCompactionFilename = "messages.tmp";
+const char* unpartitionedCompactionIndexFilename = "messages.itm";
+const char* unpartitionedSearchIndexFilename = "search.idx";
+
+// Snapshot written by older firmware; converted to the journal on first load.
+const char* legacyMessageHistoryFilename = "messages.hst";
+
+// Catches up with messages the paired device sent while we were away.
+HistorySync historySync;
+
+// The paired device came back while the history was still loading. The digest describes the
+// whole history, so it's sent once the load is done.
+bool digestPending = false;
+
+// Our messages that failed to send are resent when the paired device comes back,
+// and this often while it stays reachable. Only the newest resendScanLimit are looked at.
+const uint32_t resendIntervalMS = 30 * 1000;
+const size_t resendScanLimit = 64;
+bool resendPending = false;
+uint32_t lastResendTimestamp = 0;
+
+// In fast boot, the history is loaded a slice at a time after the first frame. Until it's
+// done, the newest messages are read straight from the journal to show, a few more each loop.
+const size_t historyPreviewStep = 8;
+const uint32_t historyLoadSliceMS = 10;
+bool historyLoading = false;
+MessageArenaStorage<MessageHistory::maxResidentMessages, MessageHistory::residentPoolSize>* historyPreview = nullptr;
+size_t historyPreviewCount = 0;
 
 //////////////////////////////////////////
 // Device
@@ -125,14 +228,38 @@ SceneManager sceneManager;
 //////////////////////////////////////////
 uint32_t lastMillis = 0;
 
+//////////////////////////////////////////
+// Boot timing
+//////////////////////////////////////////
+BootTimeline bootTimeline;
+
+//////////////////////////////////////////
+// Frame profiling
+//////////////////////////////////////////
+#if defined(PROFILE_FRAMES)
+FrameProfiler frameProfiler;
+#endif
+
+#if defined(BENCHMARK_SCENES)
+SceneBenchmark sceneBenchmark;
+#endif
+
 //////////////////////////////////////////
 // General implementation forward reference
 //////////////////////////////////////////
 void fatalError(const char* message);
 bool loadSettings();
 bool saveSettings();
+bool requestSaveSettings();
 bool loadMessageHistory();
+bool openPairedConversation(bool& converted);
+bool loadConversationHistory();
+void discardUnreadableJournal();
+bool loadLegacyMessageHistory();
+void adoptUnpartitionedHistory();
+bool openConversation(const MacAddress& peer);
 bool saveMessageHistory();
+bool requestSaveMessageHistory();
 bool deleteMessageHistory();
 
 //////////////////////////////////////////
@@ -143,13 +270,31 @@ void connectBarButton(lv_obj_t* btn, Device::BarButton bb);
 void disconnectBarButton(Device::BarButton bb);
 void showNewIndicator(bool visible);
 
+//////////////////////////////////////////
+// Boot forward reference
+//////////////////////////////////////////
+void showBootStatus(const char* text);
+void logBootTimeline();
+void beginLoadingHistory();
+void continueLoadingHistory(uint32_t budgetMS);
+void finishLoadingHistory();
+void historyLoaded();
+
+//////////////////////////////////////////
+// Profiling forward reference
+//////////////////////////////////////////
+void updateFrameProfiler();
+
 //////////////////////////////////////////
 // LVGL implementation forward reference
 //////////////////////////////////////////
 void initLVGL();
+void initStatusBar();
 uint32_t lvglTick();
 
 void drawBatteryIndicator();
+size_t batterySpriteFor(bool hasReading, uint8_t pct);
+void drawBatterySprite(bool hasReading, uint8_t pct);
 
 void lvglFlushDisplay(lv_display_t* disp, const lv_area_t* area, uint8_t* pixels);
 void lvglTouchpadRead(lv_indev_t* indev, lv_indev_data_t* data);
@@ -167,6 +312,17 @@ void batteryPercentageChanged(uint8_t p);
 void messengerPingCallback();
 void messengerPayloadReceived(const uint8_t* payload, uint32_t len);
 
+//////////////////////////////////////////
+// Presence events forward reference
+//////////////////////////////////////////
+void presenceStateChanged(Presence::State state);
+
+//////////////////////////////////////////
+// History sync events forward reference
+//////////////////////////////////////////
+void historySyncMessagesAdded(uint8_t count);
+void resendPendingMessages();
+
 //////////////////////////////////////////
 // Setup
 //////////////////////////////////////////
@@ -185,6 +341,13 @@ void setup() {
     LOGLN("Serial console started");
 #endif    
 
+    bootTimeline.mark("serial");
+
+#if defined(USE_LORA) && defined(FAST_BOOT)
+    // The radio's reset pulse runs while everything else starts up.
+    LoRaMessenger::startReset();
+#endif
+
     // Turn on I2C power
     pinMode(PIN_I2C_POWER, INPUT);
     delay(1);
@@ -192,11 +355,15 @@ void setup() {
     pinMode(PIN_I2C_POWER, OUTPUT);
     digitalWrite(PIN_I2C_POWER, !polarity);
 
+    bootTimeline.mark("i2c power");
+
     // Set up keyboard and turn off back lights to obscure the initial screen weirdness as much as possible.
     keyboard.begin();
     keyboard.setDisplayBrightness(0.0);
     keyboard.setKeyboardBrightness(0.0);
 
+    bootTimeline.mark("keyboard");
+
     // Turn off Feather Neopixel power. We aren't using it.
     pinMode(NEOPIXEL_POWER, OUTPUT);
     digitalWrite(NEOPIXEL_POWER, LOW);
@@ -204,6 +371,8 @@ void setup() {
     // Display; we goin' fast.
     display.begin(80000000);
     display.setRotation(1);
+
+#if !defined(FAST_BOOT)
     display.setTextWrap(false);
     display.fillScreen(0);
     display.setTextSize(2);    
@@ -213,59 +382,80 @@ void setup() {
     // Set brightness to defaults so we can see the intro sequence.
     keyboard.setDisplayBrightness(0.5);
     keyboard.setKeyboardBrightness(0.05);
-    display.println("display OK");
-    display.println("keyboard OK");
+#endif
+
+    showBootStatus("display OK");
+    showBootStatus("keyboard OK");
+
+    bootTimeline.mark("display");
 
     // Touchscreen
     touchpad.begin();
-    display.println("touchscreen OK");
+    showBootStatus("touchscreen OK");
+
+    bootTimeline.mark("touchscreen");
+
+    // Set up battery monitor. In fast boot, the first reading is taken once the monitor
+    // has settled, instead of waiting for it here.
+#if defined(FAST_BOOT)
+    const bool waitForBatteryReading = false;
+#else
+    const bool waitForBatteryReading = true;
+#endif
 
-    // Set up battery monitor    
-    if (batteryMonitor.begin()) {
+    if (batteryMonitor.begin(waitForBatteryReading)) {
         batteryMonitor.setPercentChangedCallback(batteryPercentageChanged);
-        display.println("battery monitor OK");
+        showBootStatus("battery monitor OK");
     }
     else {
         LOGLN("Failed to initialize battery monitor.");
-        display.println("battery monitor FAIL");
+        showBootStatus("battery monitor FAIL");
     }    
 
+    bootTimeline.mark("battery monitor");
+
     // Set default settings.
     settings.setDefaults();
 
     // SD card reader and settings
     if (sdCard.begin(sdConfig)) {
         sdCardInitialized = true;
-        display.println("storage OK");
+        showBootStatus("storage OK");
+
+        bootTimeline.mark("storage");
 
         if (loadSettings()) {
             settingsInitialized = true;
-            display.println("config OK");
+            showBootStatus("config OK");
         }
         else {
             LOGLN("Error initializing settings, using defaults.");
-            display.println("config FAIL");
+            showBootStatus("config FAIL");
         }
+
+        bootTimeline.mark("settings");
     }   
     else {
         LOGLN("Error initializing SD card reader, using default settings.");
-        display.println("storage FAIL");
+        showBootStatus("storage FAIL");
     }
 
-    // Set brightness from settings
+    // Set brightness from settings. In fast boot the backlight stays off until the first frame.
+#if !defined(FAST_BOOT)
     keyboard.setDisplayBrightness(settings.displayBrightness() / 100.0f);
     keyboard.setKeyboardBrightness(settings.keyboardBrightness() / 100.0f);    
+#endif
 
     settings.logCurrent();
 
     // Get mac address of this device
     MacAddress myMacAddress;
     if (!esp_read_mac(myMacAddress.rawAddress, ESP_MAC_WIFI_STA) == ESP_OK) {
-        display.println("mac address FAIL");
+        showBootStatus("mac address FAIL");
         fatalError("Error retrieving MAC address");
     }
 
-    display.println("mac address OK");
+    showBootStatus("mac address OK");
 
     // Get other mac address from settings.
     MacAddress otherMacAddress = settings.otherMacAddress();
@@ -287,11 +477,11 @@ void setup() {
             LoRaMessenger* lora = new LoRaMessenger(myLoraAddress, otherLoraAddress);
 
             if (!lora->begin(pmk)) {
-                display.println("LoRa FAIL");
+                showBootStatus("LoRa FAIL");
                 fatalError("Error initializing LoRa radio");
             }
 
-            display.println("LoRa OK");
+            showBootStatus("LoRa OK");
 
             lora->setPingCallback(messengerPingCallback);
             lora->setPayloadReceivedCallback(messengerPayloadReceived);
@@ -306,11 +496,11 @@ void setup() {
             settings.lmk(lmk);        
 
             if (!espNow->begin(otherMacAddress, pmk, lmk)) {
-                display.println("ESP-NOW FAIL");
+                showBootStatus("ESP-NOW FAIL");
                 fatalError("Error initializing ESP-NOW radio");
             }
 
-            display.println("ESP-NOW OK");
+            showBootStatus("ESP-NOW OK");
 
             espNow->setPayloadReceivedCallback(messengerPayloadReceived);    
             espNow->setPingCallback(messengerPingCallback);
@@ -320,12 +510,20 @@ void setup() {
 #endif
     }
 
+    bootTimeline.mark("radio");
+
     // Global device object.
-    device = new Device(myMacAddress, sceneManager, settings, messenger, messageHistory, 
+    device = new Device(myMacAddress, sceneManager, settings, messenger, messageHistory, searchIndex,
                         display, keyboard, touchpad, pixel, batteryMonitor);
 
-    device->setSaveSettingsCallback(saveSettings);
-    device->setSaveMessageHistoryCallback(saveMessageHistory);
+    // Saves are coalesced; see requestSaveSettings() and requestSaveMessageHistory().
+    writeBehind.setFlushCallback(WriteBehind::Target::settings, saveSettings);
+    writeBehind.setFlushCallback(WriteBehind::Target::messageHistory, saveMessageHistory);
+
+    device->setSaveSettingsCallback(requestSaveSettings);
+    device->setSaveMessageHistoryCallback(requestSaveMessageHistory);
+    device->setOpenConversationCallback(openConversation);
+    device->setFinishLoadingHistoryCallback(finishLoadingHistory);
     device->setFlushInputCallback(flushInputEvents);
     device->setConnectBarButtonCallback(connectBarButton);
     device->setDisconnectBarButtonCallback(disconnectBarButton);
@@ -334,6 +532,7 @@ void setup() {
     // Good place to delete this if you ever hose it.
     // deleteMessageHistory();
 
+#if !defined(FAST_BOOT)
     if (loadMessageHistory()) {
         display.println("message history OK");
     }
@@ -342,16 +541,63 @@ void setup() {
         LOGLN("Failed to load message history");
     }
 
+    bootTimeline.mark("message history");
+
+    // Anything the index is missing is indexed in the background.
+    if (sdCardInitialized && searchIndex.load(messageHistory)) {
+        display.println("search index OK");
+    }
+    else {
+        display.println("search index FAIL");
+        LOGLN("Failed to load search index");
+    }
+
+    bootTimeline.mark("search index");
+#endif
+
     // LVGL begin
     initLVGL();
 
+#if !defined(FAST_BOOT)
+    initStatusBar();
+#endif
+
+    bootTimeline.mark("lvgl");
+
     // Go to startup scene.
-    sceneManager.gotoScene(new ConversationScene(*device));
+    sceneManager.gotoCachedScene<ConversationScene>(*device);
 
-    // Set first ping broadcast timer to happen soon after launch.
-    // Randomize to reduce chances that two turned on at the same time
-    // will send their first ping at the exact same time.
-    pingBroadcastTimer = random(3000, 6000);
+    bootTimeline.mark("first scene");
+
+#if defined(FAST_BOOT)
+    // Draw the first frame now, then turn on the backlight to show it.
+    lv_refr_now(nullptr);
+    keyboard.setDisplayBrightness(settings.displayBrightness() / 100.0f);
+    keyboard.setKeyboardBrightness(settings.keyboardBrightness() / 100.0f);    
+
+    bootTimeline.mark("first frame");
+
+    initStatusBar();
+    bootTimeline.mark("status bar");
+
+    // Continued in loop().
+    beginLoadingHistory();
+#endif
+
+    // History sync starts when the paired device shows up.
+    historySync.setMessagesAddedCallback(historySyncMessagesAdded);
+    historySync.begin(device->messenger, &messageHistory);
+
+    // Start tracking the paired device's presence. This schedules the first ping.
+    presence.setStateChangedCallback(presenceStateChanged);
+    presence.begin(device->messenger);
+
+    bootTimeline.mark("setup");
+
+    // In fast boot, this waits until the history has loaded.
+#if !defined(FAST_BOOT)
+    logBootTimeline();
+#endif
 
     // Finally, get the current timestamp, and we're good to go.
     lastMillis = millis();
@@ -365,6 +611,8 @@ void loop() {
     uint32_t dt = now - lastMillis;
     lastMillis = now;
 
+    updateFrameProfiler();
+
     // Update radio and battery monitor
     device->messenger->updateRx();
     batteryMonitor.update();
@@ -384,19 +632,53 @@ void loop() {
             lv_obj_remove_flag(radioModeStatusLabel, LV_OBJ_FLAG_HIDDEN);
         } 
         else {
-            Color::RGB c(globalTheme.amber);
-            c.darkenTo((float)pingIndicatorTimer / pingIndicatorTimeout);
-            lv_obj_set_style_text_color(pingStatusLabel, c.toLV(), 0);
+            Color::RGB c = StatusBarUpdates::fadedToBlack(globalTheme.amber, pingIndicatorTimer, pingIndicatorTimeout);
+            statusBarUpdates.setTextColor(pingStatusLabel, c);
         }
     }
 
-    // Update auto-ping broadcast.
-    pingBroadcastTimer -= dt;
-    
-    if (pingBroadcastTimer <= 0) {
-        pingBroadcastTimer = random(minPingBroadcastTimeout, maxPingBroadcastTimeout);    
-        device->messenger->ping();
+    statusBarUpdates.update();
+
+    // Update presence; this pings the paired device only if the link has gone quiet.
+    presence.update();
+
+#if defined(FAST_BOOT)
+    // The rest works on the history, so it waits until it has loaded.
+    if (historyLoading) {
+        continueLoadingHistory(historyLoadSliceMS);
+        return;
+    }
+#endif
+
+    // Stream any history the paired device is missing.
+    historySync.update();
+
+    // Resend our messages that didn't go out.
+    if (presence.getState() == Presence::State::reachable && 
+        (resendPending || now - lastResendTimestamp >= resendIntervalMS)) 
+    {
+        resendPending = false;
+        lastResendTimestamp = now;
+        resendPendingMessages();
+    }
+
+    // Write out settings and history once they've settled.
+    writeBehind.update();
+
+    // Compact the message journal in the background.
+    messageHistoryJournal.update(messageHistory);
+
+    // Index new messages for search.
+    searchIndex.update(messageHistory);
+
+#if defined(BENCHMARK_SCENES)
+    // Runs once, after the history has loaded.
+    if (!sceneBenchmark.hasRun()) {
+        sceneBenchmark.start();
     }
+
+    sceneBenchmark.update();
+#endif
 }
 
 //////////////////////////////////////////
@@ -421,79 +703,238 @@ void fatalError(const char* message) {
     }
 }
 
-bool createSettingsFile() {
-    File32 file;
-    
-    if (!file.open(settingsFilename, O_CREAT | O_RDWR)) {
-        LOGLN("Failed to create settings.cfg");
-        return false;
+void showBootStatus(const char* text) {
+    // The first frame comes sooner without the progress text.
+#if !defined(FAST_BOOT)
+    display.println(text);
+#endif
+}
+
+void logBootTimeline() {
+#if defined(LOG_BOOT_TIMELINE)
+    bootTimeline.dump(Serial);
+    Serial.printf("%u messages in history\n", messageHistory.size());
+#endif
+}
+
+void updateFrameProfiler() {
+#if defined(PROFILE_FRAMES)
+    frameProfiler.loopTick();
+    frameProfiler.update();
+
+    // Single key commands on the serial console.
+    while (Serial.available() > 0) {
+        switch (Serial.read()) {
+            case 'p':
+                frameProfiler.printCsv(Serial);
+                Serial.printf("status bar invalidations saved: %u of %u\n",
+                    (unsigned)statusBarUpdates.invalidationsSaved(), (unsigned)statusBarUpdates.requested());
+                sceneManager.printStats(Serial);
+                break;
+            case 'r': frameProfiler.reset(); break;
+            case 'o': frameProfiler.showOverlay(!frameProfiler.isOverlayShown()); break;
+            default: break;
+        }
+    }
+#endif
+}
+
+void beginLoadingHistory() {
+    bool converted = false;
+
+    if (!openPairedConversation(converted)) {
+        LOGLN("Failed to load message history");
+        historyLoaded();
+        return;
     }
 
-    size_t bytesWritten = file.write((uint8_t*)&settings, sizeof(settings));
+    // Files from older firmware are converted all at once, which loads them too.
+    if (converted) {
+        historyLoaded();
+        return;
+    }
+
+    if (!messageHistoryJournal.beginLoad(messageHistory)) {
+        discardUnreadableJournal();
+        historyLoaded();
+        return;
+    }
 
-    file.close();
+    historyPreview = new MessageArenaStorage<MessageHistory::maxResidentMessages, MessageHistory::residentPoolSize>();
+    historyPreviewCount = 0;
+    device->historyPreview = historyPreview;
+    historyLoading = true;
+}
 
-    if (bytesWritten == 0) {
-        LOGLN("Failed to write to settings.cfg");
-        return false;
+void continueLoadingHistory(uint32_t budgetMS) {
+    if (!historyLoading) {
+        return;
     }
 
-    return true;
+    // Newest messages first, a few more each time, until the preview is full.
+    if (historyPreviewCount < MessageHistory::maxResidentMessages) {
+        historyPreviewCount += historyPreviewStep;
+
+        // Fewer means there's nothing older to show.
+        if (messageHistoryJournal.readNewest(historyPreviewCount, *historyPreview) < historyPreviewCount) {
+            historyPreviewCount = MessageHistory::maxResidentMessages;
+        }
+
+        if (historyPreview->size() > 0) {
+            sceneManager.historyChanged();
+        }
+
+        return;
+    }
+
+    if (messageHistoryJournal.continueLoad(messageHistory, budgetMS)) {
+        historyLoaded();
+    }
+}
+
+void finishLoadingHistory() {
+    if (!historyLoading) {
+        return;
+    }
+
+    while (!messageHistoryJournal.continueLoad(messageHistory, UINT32_MAX)) {
+    }
+
+    historyLoaded();
+}
+
+void historyLoaded() {
+    historyLoading = false;
+    device->historyPreview = nullptr;
+    delete historyPreview;
+    historyPreview = nullptr;
+
+    bootTimeline.mark("message history");
+
+    // Anything the index is missing is indexed in the background.
+    if (!sdCardInitialized || !searchIndex.load(messageHistory)) {
+        LOGLN("Failed to load search index");
+    }
+
+    bootTimeline.mark("search index");
+
+    // Replace the preview, or the empty list shown before it.
+    sceneManager.historyChanged();
+
+    if (digestPending) {
+        digestPending = false;
+
+        if (!device->legacyPeer) {
+            historySync.sendDigest();
+        }
+    }
+
+    logBootTimeline();
 }
 
 bool restoreSettingsDefaults() {
     settings.setDefaults();
-    
-    if (!sdCard.remove(settingsFilename)) {
-        LOGLN("Failed to delete corrupt settings.cfg");
+
+    if (!settingsStore.save(&settings.memoryMap, sizeof(settings.memoryMap))) {
+        LOGLN("Failed to save default settings");
+        return false;
+    }
+
+    return true;
+}
+
+// Returns false if the settings are from another firmware or hardware configuration.
+bool validateSettings() {
+    if (settings.version() != settings.currentVersion) {
+        LOGFMT("Settings version mismatch, loaded: %d, expected: %d.\n", settings.version(), settings.currentVersion);
         return false;
     }
 
-    if (!createSettingsFile()) {
-        LOGLN("Failed to create new settings.cfg");
+    if (settings.configuredRadio() != Settings::configuredRadioType) {
+        LOGFMT("Base radio type mismatch, loaded: %s, expected: %s.\n", 
+            (settings.configuredRadio() == Settings::RadioType::espNow) ? "ESP-NOW" : "LoRa", 
+            (settings.configuredRadioType == Settings::RadioType::espNow) ? "ESP-NOW" : "LoRa");
         return false;
     }
 
     return true;
 }
 
+// Read settings.cfg into data. Returns the number of bytes read, or 0.
+size_t loadLegacySettings(uint8_t* data, size_t capacity) {
+    StorageFile* file = sdStorage.open(legacySettingsFilename, Storage::Mode::read);
+    if (file == nullptr) {
+        LOGLN("Failed to open settings.cfg");
+        return 0;
+    }
+
+    int bytesRead = file->read(data, capacity);
+    sdStorage.close(file);
+
+    return (bytesRead > 0) ? bytesRead : 0;
+}
+
+// Upgrade data to the current memory map and apply it. Returns false if it can't be used.
+bool applySavedSettings(uint8_t* data, size_t length, size_t capacity) {
+    uint16_t migratedLength = length;
+
+    if (!Settings::migrate(data, migratedLength, capacity)) {
+        LOGLN("Settings can't be migrated.");
+        return false;
+    }
+
+    if (migratedLength != sizeof(settings.memoryMap)) {
+        LOGFMT("Corrupted settings detected, length: %u, expected: %u.\n", migratedLength, sizeof(settings.memoryMap));
+        return false;
+    }
+
+    memcpy(&settings.memoryMap, data, migratedLength);
+
+    return validateSettings();
+}
+
 bool loadSettings() {
-    if (sdCard.exists(settingsFilename)) {
-        LOGLN("settings.cfg found, reading...");
+    uint8_t data[SettingsStore::maxPayloadLength];
+    size_t length = 0;
 
-        File32 file;
-        if (!file.open(settingsFilename, O_RDONLY)) {
-            LOGLN("Failed to open settings.cfg");
-            return false;            
+    if (settingsStore.load(data, sizeof(data), length)) {
+        if (!applySavedSettings(data, length, sizeof(data))) {
+            LOGLN("Restoring settings to defaults.");
+            return restoreSettingsDefaults();
         }
 
-        size_t bytesRead = file.readBytes((uint8_t*)&settings, sizeof(settings));
-        file.close();
+        // Writes the upgraded settings if they were migrated; skipped otherwise.
+        return settingsStore.save(&settings.memoryMap, sizeof(settings.memoryMap));
+    }
+
+    if (sdStorage.exists(legacySettingsFilename)) {
+        LOGLN("settings.cfg found, converting...");
 
-        if (bytesRead != sizeof(settings)) {
-            LOGLN("Corrupted settings.cfg detected. Restoring settings to defaults.");
-            return restoreSettingsDefaults();
+        length = loadLegacySettings(data, sizeof(data));
+
+        if (!applySavedSettings(data, length, sizeof(data))) {
+            LOGLN("Restoring settings to defaults.");
+            settings.setDefaults();
         }
 
-        if (settings.version() != settings.currentVersion) {
-            LOGFMT("Settings version mismatch, loaded: %d, expected: %d. Restoring settings to defaults.\n", settings.version(), settings.currentVersion);
-            return restoreSettingsDefaults();
+        // Only drop the old file once the new copy is safely written.
+        if (!settingsStore.save(&settings.memoryMap, sizeof(settings.memoryMap))) {
+            LOGLN("Failed to convert settings.cfg");
+            return false;
         }
 
-        if (settings.configuredRadio() != Settings::configuredRadioType) {
-            LOGFMT("Base radio type mismatch, loaded: %s, expected: %s. Restoring settings to defaults.\n", 
-                (settings.configuredRadio() == Settings::RadioType::espNow) ? "ESP-NOW" : "LoRa", 
-                (settings.configuredRadioType == Settings::RadioType::espNow) ? "ESP-NOW" : "LoRa");
+        sdStorage.remove(legacySettingsFilename);
+        return true;
+    }
 
-            return restoreSettingsDefaults();
-        }        
-    } 
+    if (settingsStore.exists()) {
+        LOGLN("No readable settings slot. Restoring settings to defaults.");
+    }
     else {
-        LOGLN("settings.cfg not found, creating...");
-        return createSettingsFile();
+        LOGLN("No settings found, creating...");
     }
 
-    return true;
+    return restoreSettingsDefaults();
 }
 
 bool saveSettings() {
@@ -501,16 +942,31 @@ bool saveSettings() {
         return false;
     }
 
-    if (sdCard.exists(settingsFilename)) {
-        LOGLN("settings.cfg found, deleting...");
+    // Skipped if nothing changed since the last save.
+    return settingsStore.save(&settings.memoryMap, sizeof(settings.memoryMap));
+}
 
-        if (!sdCard.remove(settingsFilename)) {
-            LOGLN("Failed to delete settings.cfg, aborting save.");
-            return false;
-        }
+bool requestSaveSettings() {
+    writeBehind.markDirty(WriteBehind::Target::settings);
+
+    if (batteryLow) {
+        return writeBehind.flush(WriteBehind::Target::settings);
     }
 
-    return createSettingsFile();
+    return true;
+}
+
+bool requestSaveMessageHistory() {
+    writeBehind.markDirty(WriteBehind::Target::messageHistory);
+
+    // Only the newest messages are kept in RAM; don't let unsaved ones scroll out.
+    const bool atRisk = messageHistoryJournal.unsavedMessageCount(messageHistory) >= MessageHistory::minResidentMessages - 1;
+
+    if (batteryLow || atRisk) {
+        return writeBehind.flush(WriteBehind::Target::messageHistory);
+    }
+
+    return true;
 }
 
 bool saveMessageHistory() {
@@ -519,118 +975,178 @@ bool saveMessageHistory() {
         return false;
     }
 
-    if (sdCard.exists(messageHistoryFilename)) {
-        LOGLN("Deleting existing message history...");
+    // Appends only what changed since the last save.
+    return messageHistoryJournal.save(messageHistory);
+}
 
-        if (!deleteMessageHistory()) {
-            LOGLN("Failed to delete existing message history.");
-            return false;
-        }
+bool deleteMessageHistory() {
+    if (!sdCardInitialized) {
+        LOGLN("Failed to delete message history: SD card reader not initialized");
+        return false;
+    }
+
+    return messageHistoryJournal.remove();
+}
+
+void closeLegacyMessageHistoryFileAndDelete(StorageFile* f) {
+    sdStorage.close(f);
+
+    if (!sdStorage.remove(legacyMessageHistoryFilename)) {
+        LOGLN("Failed to delete old message history");
     }    
+}
 
-    if (messageHistory.isEmpty()) {
-        // Nothing else to do!
-        return true;
-    }
+bool loadMessageHistory() {
+    bool converted = false;
 
-    File32 file;
-    
-    if (!file.open(messageHistoryFilename, O_CREAT | O_RDWR)) {
-        LOGLN("Failed to create messages.hst");
+    if (!openPairedConversation(converted)) {
         return false;
     }
-    
-    const int messageCount = messageHistory.size();
-    bool wroteAllMessages = true;
-    Message msg;
-    size_t bytesWritten;
 
-    // Write version
-    bytesWritten = file.write(MessageHistory::currentVersion);
-
-    if (bytesWritten != 1) {
-        LOGLN("Failed to write message history version");
-    }
+    return converted || loadConversationHistory();
+}
 
-    // Write message count
-    bytesWritten = file.write(messageCount);
+bool openPairedConversation(bool& converted) {
+    converted = false;
 
-    if (bytesWritten != 1) {
-        LOGLN("Failed to write message count");
-        file.close();
+    if (!sdCardInitialized) {
+        LOGLN("Failed to load message history: SD card reader not initialized");
         return false;
     }
 
-    for (int i = 0; i < messageCount; i++) {
-        msg = messageHistory.getMessage(i);
+    // The journal holds every message; only the newest are kept in RAM.
+    messageHistory.setArchive(&messageHistoryJournal);
 
-        // Write the message sender
-        bytesWritten = file.write(uint8_t(msg.sender));
+    // Only the paired device's conversation is loaded.
+    conversationPeer = settings.otherMacAddress();
 
-        if (bytesWritten != 1) {
-            LOGFMT("Failed to write sender for message %d\n", i);
-            file.close();
-            return false;
-        }
+    if (!conversations.load() || !conversations.open(conversationPeer, conversationFiles)) {
+        LOGLN("Failed to open conversation directory");
+        return false;
+    }
 
-        // Write the message length
-        uint8_t messageLength = strlen(msg.text);
-        bytesWritten = file.write(messageLength);
+    // First start after an update; the single history belongs to the paired device.
+    if (conversations.isNew()) {
+        adoptUnpartitionedHistory();
+    }
 
-        if (bytesWritten != 1) {
-            LOGFMT("Failed to write message length for message %d\n", i);
-            file.close();
+    // Convert a snapshot from older firmware once, then carry on with the journal.
+    if (!messageHistoryJournal.exists() && sdStorage.exists(legacyMessageHistoryFilename)) {
+        if (!loadLegacyMessageHistory()) {
             return false;
         }
 
-        // Write the message
-        bytesWritten = file.write(&msg.text, messageLength);
-
-        if (bytesWritten != messageLength) {
-            LOGFMT("Failed to write string for message %d\n", i);
-            file.close();
+        if (!messageHistoryJournal.rewrite(messageHistory)) {
+            LOGLN("Failed to convert message history to journal");
             return false;
         }
-    }
 
-    file.close();
+        sdStorage.remove(legacyMessageHistoryFilename);
+        LOGLN("Message history converted to journal");
+        converted = true;
+    }
 
-    LOGLN("Message history saved!");
     return true;
 }
 
-bool deleteMessageHistory() {
-    if (!sdCardInitialized) {
-        LOGLN("Failed to delete message history: SD card reader not initialized");
+bool loadConversationHistory() {
+    if (!messageHistoryJournal.load(messageHistory)) {
+        discardUnreadableJournal();
         return false;
     }
 
-    return sdCard.remove(messageHistoryFilename);
+    return true;
 }
 
-void closeMessageHistoryFileAndDelete(File32& f) {
-    f.close();
+void discardUnreadableJournal() {
+    LOGLN("Unreadable message journal. Deleting.");
+    messageHistoryJournal.remove();
+    messageHistory.clear();
+    (void)messageHistoryJournal.load(messageHistory);
+}
 
-    if (!sdCard.remove(messageHistoryFilename)) {
-        LOGLN("Failed to delete old message history");
-    }    
+void adoptUnpartitionedHistory() {
+    const char* from[] = {
+        unpartitionedJournalFilename,
+        unpartitionedJournalIndexFilename,
+        unpartitionedCompactionFilename,
+        unpartitionedCompactionIndexFilename,
+        unpartitionedSearchIndexFilename
+    };
+
+    const char* to[] = {
+        conversationFiles.journal,
+        conversationFiles.journalIndex,
+        conversationFiles.compaction,
+        conversationFiles.compactionIndex,
+        conversationFiles.searchIndex
+    };
+
+    for (size_t i = 0; i < sizeof(from) / sizeof(from[0]); i++) {
+        if (sdStorage.exists(from[i]) && !sdStorage.rename(from[i], to[i])) {
+            LOGFMT("Failed to move %s to %s\n", from[i], to[i]);
+        }
+    }
 }
 
-bool loadMessageHistory() {
+bool openConversation(const MacAddress& peer) {
+    finishLoadingHistory();
+
     if (!sdCardInitialized) {
-        LOGLN("Failed to load message history: SD card reader not initialized");
+        LOGLN("Failed to open conversation: SD card reader not initialized");
         return false;
     }
 
-    if (!sdCard.exists(messageHistoryFilename)) {
-        LOGLN("Message history does not yet exist.");
-        return true;        
+    if (peer == conversationPeer) {
+        return true;
     }
 
+    // Appends whatever the current conversation hasn't saved yet; cheap.
+    (void)writeBehind.flush(WriteBehind::Target::messageHistory);
+
+    conversations.setMessageCount(conversationPeer, messageHistory.size());
+
+    // Into a copy: the journal and search index are still using conversationFiles, and if the
+    // directory can't be updated the current conversation stays open.
+    ConversationDirectory::Files files;
+
+    if (!conversations.open(peer, files)) {
+        LOGLN("Failed to open conversation");
+        return false;
+    }
+
+    messageHistoryJournal.close();
+    searchIndex.close();
+    historySync.reset();
+    messageHistory.reset();
+
+    conversationFiles = files;
+    conversationPeer = peer;
+    device->legacyPeer = false;
+
+    const bool loaded = loadConversationHistory();
+    (void)searchIndex.load(messageHistory);
+
+    // Cached scenes still show the previous conversation.
+    sceneManager.historyChanged();
+
+    LOGFMT("Opened conversation with %02X:%02X:%02X:%02X:%02X:%02X, %u messages\n",
+        peer.rawAddress[0],
+        peer.rawAddress[1],
+        peer.rawAddress[2],
+        peer.rawAddress[3],
+        peer.rawAddress[4],
+        peer.rawAddress[5],
+        messageHistory.size());
+
+    return loaded;
+}
+
+bool loadLegacyMessageHistory() {
     LOGLN("messages.hst found, reading...");
     
-    File32 file;
-    if (!file.open(messageHistoryFilename, O_RDONLY)) {
+    StorageFile* file = sdStorage.open(legacyMessageHistoryFilename, Storage::Mode::read);
+    if (file == nullptr) {
         LOGLN("Failed to open messages.hst");
         return false;            
     }
@@ -639,46 +1155,63 @@ bool loadMessageHistory() {
     uint8_t messageCount = 0;
 
     // First byte is version.
-    int readByte = file.read();
+    int readByte = file->read();
 
     if (readByte == -1) {
         LOGLN("Failed to read message history version. Deleting corrupt message history.");
-        closeMessageHistoryFileAndDelete(file);
+        closeLegacyMessageHistoryFileAndDelete(file);
         return false;
     }
 
     version = readByte;
 
-    // If the version doesn't match the current version, delete the file and return.
-    if (version != MessageHistory::currentVersion) {
-        LOGFMT("Message history file version mismatch. Loaded %d, expected %d. Deleting old version.\n", version, MessageHistory::currentVersion);
-        closeMessageHistoryFileAndDelete(file);
+    // Version 1 has no sequence numbers, so it can still be read.
+    // If the version doesn't match either, delete the file and return.
+    const bool hasSequenceNumbers = (version == MessageHistory::snapshotVersion);
+
+    if (version != MessageHistory::snapshotVersion && version != 1) {
+        LOGFMT("Message history file version mismatch. Loaded %d, expected %d. Deleting old version.\n", version, MessageHistory::snapshotVersion);
+        closeLegacyMessageHistoryFileAndDelete(file);
         return false;
     }
 
     // Next byte is the message count
-    readByte = file.read();
+    readByte = file->read();
 
     if (readByte == -1) {
         LOGLN("Failed to read message count. Deleting corrupt message history.");        
-        closeMessageHistoryFileAndDelete(file);
+        closeLegacyMessageHistoryFileAndDelete(file);
         return false;
     }
 
     messageCount = readByte;
 
+    // Then the sequence state
+    if (hasSequenceNumbers) {
+        uint16_t sequenceState[2] = {0};
+
+        if (file->read(sequenceState, sizeof(sequenceState)) != sizeof(sequenceState)) {
+            LOGLN("Failed to read sequence state. Deleting corrupt message history.");
+            closeLegacyMessageHistoryFileAndDelete(file);
+            return false;
+        }
+
+        messageHistory.setIdState(sequenceState[0], sequenceState[1], 0);
+    }
+
     // Now it's time for the messages
     Message::Sender sender = Message::Sender::me;
+    uint16_t sequence = 0;
     uint8_t messageLength = 0;
     char messageBuffer[Message::bufferSize];
 
     for (int i = 0; i < messageCount; i++) {
         // Message sender is the first byte
-        readByte = file.read();
+        readByte = file->read();
 
         if (readByte == -1) {
             LOGFMT("Failed to read message sender for message %d. Deleting corrupt message history.\n", i);
-            closeMessageHistoryFileAndDelete(file);
+            closeLegacyMessageHistoryFileAndDelete(file);
             return false;
         }
 
@@ -687,38 +1220,46 @@ bool loadMessageHistory() {
         // Somehow we got an invalid sender value, the file is corrupt.
         if (sender != Message::Sender::me && sender != Message::Sender::them) {
             LOGFMT("Read invalid sender for message %d. Deleting corrupt message history.\n", i);
-            closeMessageHistoryFileAndDelete(file);
+            closeLegacyMessageHistoryFileAndDelete(file);
             return false;            
         }
 
+        // Next two bytes are the sequence number
+        if (hasSequenceNumbers && file->read(&sequence, sizeof(sequence)) != sizeof(sequence)) {
+            LOGFMT("Failed to read sequence number for message %d. Deleting corrupt message history.\n", i);
+            closeLegacyMessageHistoryFileAndDelete(file);
+            return false;
+        }
+
         // Next byte is the message string length
-        readByte = file.read();
+        readByte = file->read();
 
         if (readByte == -1) {
             LOGFMT("Failed to read message length for message %d. Deleting corrupt message history.\n", i);
-            closeMessageHistoryFileAndDelete(file);
+            closeLegacyMessageHistoryFileAndDelete(file);
             return false;
         }
 
         messageLength = readByte;
 
         // Now read in 'messageLength' bytes. That's our message!
-        size_t bytesRead = file.read(messageBuffer, messageLength);
+        size_t bytesRead = file->read(messageBuffer, messageLength);
 
         if (bytesRead != messageLength) {
             LOGFMT("Failed to read message text for message %d. Deleting corrupt message history.\n", i);
-            closeMessageHistoryFileAndDelete(file);
+            closeLegacyMessageHistoryFileAndDelete(file);
             return false;            
         }
 
         // Null terminate it
         messageBuffer[messageLength] = 0;
 
-        // And add it to the message history
-        messageHistory.addMessage(sender, messageBuffer);
+        // And add it to the message history. Messages were only stored once sent, and have no timestamp.
+        const Message::Status status = (sender == Message::Sender::me) ? Message::Status::sent : Message::Status::acked;
+        messageHistory.restoreMessage(sender, messageBuffer, messageLength, sequence, Message::withStatus(0, status), 0);
     }
 
-    file.close();
+    sdStorage.close(file);
 
     LOGLN("Message history loaded!");
 
@@ -737,6 +1278,17 @@ void initLVGL() {
         lv_display_t* disp = lv_display_create(device->displayWidth, device->displayHeight);
         lv_display_set_flush_cb(disp, lvglFlushDisplay);
         lv_display_set_buffers(disp, lvglDrawBuffer, NULL, drawBufferSize, LV_DISPLAY_RENDER_MODE_PARTIAL);    
+
+#if defined(PROFILE_FRAMES)
+        frameProfiler.begin(disp);
+#if defined(PROFILE_FRAMES_OVERLAY)
+        frameProfiler.showOverlay(true);
+#endif
+#endif
+
+#if defined(BENCHMARK_SCENES)
+        sceneBenchmark.begin(*device, disp);
+#endif
     }    
 
     // lvgl input device and keyboard group for keyboard input.
@@ -768,7 +1320,9 @@ void initLVGL() {
             barButtonIndevs[i] = indev;
         }
     }
+}
 
+void initStatusBar() {
     // Radio mode label
     {
         lv_obj_t* label = lv_label_create(lv_layer_top());
@@ -785,6 +1339,15 @@ void initLVGL() {
          radioModeStatusLabel = label;
     }    
 
+    // Presence label
+    {
+        lv_obj_t* label = lv_label_create(lv_layer_top());
+        lv_obj_add_style(label, &globalTheme.statusBarText, 0);
+        lv_obj_align_to(label, radioModeStatusLabel, LV_ALIGN_OUT_RIGHT_MID, 6, 0);
+        presenceStatusLabel = label;
+        presenceStateChanged(presence.getState());
+    }
+
     // Ping label
     {
         lv_obj_t* label = lv_label_create(lv_layer_top());
@@ -807,7 +1370,15 @@ void initLVGL() {
 
     // Battery indicator
     {
-        batteryIndicatorCanvasBuffer = (uint8_t*)malloc(batteryIndicatorCanvasBufferSize);
+        batterySprites = (uint8_t*)heap_caps_malloc(batterySpriteCount * batteryIndicatorCanvasBufferSize, MALLOC_CAP_SPIRAM);
+
+        if (batterySprites == nullptr) {
+            LOGLN("Not enough memory for battery sprites, drawing every time");
+            batteryIndicatorCanvasBuffer = (uint8_t*)malloc(batteryIndicatorCanvasBufferSize);
+        }
+        else {
+            batteryIndicatorCanvasBuffer = batterySprites + batteryEmptySprite * batteryIndicatorCanvasBufferSize;
+        }
 
         lv_obj_t* canvas = lv_canvas_create(lv_layer_top());
         lv_canvas_set_buffer(canvas, batteryIndicatorCanvasBuffer, batteryIndicatorCanvasWidth, batteryIndicatorCanvasHeight, LV_COLOR_FORMAT_RGB565);
@@ -823,15 +1394,81 @@ void initLVGL() {
 }
 
 void drawBatteryIndicator() {
-    uint8_t pct = batteryMonitor.getPercentage();
+    const uint32_t start = micros();
+    const bool hasReading = batteryMonitor.hasReading();
+    const uint8_t pct = batteryMonitor.getPercentage();
 
-    // Update text
-    char batteryBuffer[16] = {0};
-    const int32_t batteryBufferSize = sizeof(batteryBuffer);
-    snprintf(batteryBuffer, batteryBufferSize, "%d%%", pct);
-    // snprintf(batteryBuffer, batteryBufferSize, "%d", batteryMonitor.getVoltage());
-    batteryBuffer[batteryBufferSize - 1] = 0;
-    lv_label_set_text(batteryStatusLabel, batteryBuffer);
+    // Update text; blank until the first reading.
+    const int32_t labelPercent = hasReading ? pct : -1;
+
+    if (labelPercent != batteryLabelPercent) {
+        char batteryBuffer[16] = {0};
+        const int32_t batteryBufferSize = sizeof(batteryBuffer);
+
+        if (hasReading) {
+            snprintf(batteryBuffer, batteryBufferSize, "%d%%", pct);
+        }
+
+        // snprintf(batteryBuffer, batteryBufferSize, "%d", batteryMonitor.getVoltage());
+        batteryBuffer[batteryBufferSize - 1] = 0;
+        lv_label_set_text(batteryStatusLabel, batteryBuffer);
+        batteryLabelPercent = labelPercent;
+    }
+
+    // Without sprites, draw into the one buffer every time.
+    if (batterySprites == nullptr) {
+        lv_canvas_set_buffer(batteryIndicatorCanvas, batteryIndicatorCanvasBuffer, batteryIndicatorCanvasWidth, batteryIndicatorCanvasHeight, LV_COLOR_FORMAT_RGB565);
+        drawBatterySprite(hasReading, pct);
+        lv_obj_invalidate(batteryIndicatorCanvas);
+        return;
+    }
+
+    const size_t sprite = batterySpriteFor(hasReading, pct);
+
+    if (sprite == batterySpriteShown) {
+        return;
+    }
+
+    uint8_t* buffer = batterySprites + sprite * batteryIndicatorCanvasBufferSize;
+    const bool drawn = batterySpriteDrawn[sprite];
+
+    lv_canvas_set_buffer(batteryIndicatorCanvas, buffer, batteryIndicatorCanvasWidth, batteryIndicatorCanvasHeight, LV_COLOR_FORMAT_RGB565);
+
+    if (!drawn) {
+        drawBatterySprite(hasReading, pct);
+        batterySpriteDrawn[sprite] = true;
+    }
+
+    lv_obj_invalidate(batteryIndicatorCanvas);
+    batterySpriteShown = sprite;
+
+    LOGFMT("Battery indicator: %uus, %s\n", (unsigned)(micros() - start), drawn ? "cached" : "drawn");
+}
+
+size_t batterySpriteFor(bool hasReading, uint8_t pct) {
+    if (!hasReading) {
+        return batteryEmptySprite;
+    }
+
+    // Nearest level; a low battery never rounds up past the last red one.
+    const size_t level = (pct + batterySpriteStep / 2) / batterySpriteStep;
+
+    if (pct <= batteryLowPercent) {
+        return batteryAmberSpriteCount + ((level < batteryRedSpriteCount) ? level : batteryRedSpriteCount - 1);
+    }
+
+    return (level < batteryAmberSpriteCount) ? level : batteryAmberSpriteCount - 1;
+}
+
+// Draws into the canvas's current buffer.
+void drawBatterySprite(bool hasReading, uint8_t pct) {
+    const bool low = (pct <= batteryLowPercent);
+
+    // Sprites are drawn at the level they stand for.
+    if (batterySprites != nullptr) {
+        const size_t sprite = batterySpriteFor(hasReading, pct);
+        pct = ((sprite >= batteryAmberSpriteCount) ? sprite - batteryAmberSpriteCount : sprite) * batterySpriteStep;
+    }
 
     // Draw battery image to canvas
     lv_canvas_fill_bg(batteryIndicatorCanvas, lv_color_black(), LV_OPA_COVER);
@@ -852,13 +1489,15 @@ void drawBatteryIndicator() {
     lv_draw_rect(&layer, &dsc, &coords);
 
     // Draw fill
-    int32_t xFill = map(pct, 0, 100, 5, 27);
-    lv_draw_rect_dsc_init(&dsc);
-    dsc.border_width = 0;
-    dsc.radius = 2;    
-    dsc.bg_color = (pct > 20) ? globalTheme.amber : lv_color_make(255, 0, 0);
-    coords = {5, 7, xFill, 13};
-    lv_draw_rect(&layer, &dsc, &coords);
+    if (hasReading) {
+        int32_t xFill = map(pct, 0, 100, 5, 27);
+        lv_draw_rect_dsc_init(&dsc);
+        dsc.border_width = 0;
+        dsc.radius = 2;    
+        dsc.bg_color = low ? lv_color_make(255, 0, 0) : globalTheme.amber;
+        coords = {5, 7, xFill, 13};
+        lv_draw_rect(&layer, &dsc, &coords);
+    }
 
     // Draw terminal
     lv_draw_rect_dsc_init(&dsc);
@@ -913,10 +1552,22 @@ void lvglFlushDisplay(lv_display_t* disp, const lv_area_t* area, uint8_t* pixels
     // we're using RHReliableDatagram, and as soon as the redraw is 
     // complete the radio can service it's interrupts again and
     // dispatch the payload to our callback.
+#if defined(PROFILE_FRAMES)
+    frameProfiler.flushStarted();
+#endif
+
     cli();
     display.drawRGBBitmap(area->x1, area->y1, (uint16_t*)pixels, w, h);
     sei();
 
+#if defined(PROFILE_FRAMES)
+    frameProfiler.flushFinished(area);
+#endif
+
+#if defined(BENCHMARK_SCENES)
+    sceneBenchmark.flushed(area, pixels);
+#endif
+
     lv_display_flush_ready(disp);
 }
 
@@ -990,6 +1641,11 @@ void disconnectBarButton(Device::BarButton bb) {
 }
 
 void showNewIndicator(bool visible) {
+    // Scenes can load before the status bar is set up.
+    if (newMessageStatusLabel == nullptr) {
+        return;
+    }
+
     if (visible) {
         lv_obj_remove_flag(newMessageStatusLabel, LV_OBJ_FLAG_HIDDEN);
     }
@@ -1001,6 +1657,13 @@ void showNewIndicator(bool visible) {
 void lvglBarButtonRead(lv_indev_t* indev, lv_indev_data_t* data) {
     for (int barButtonIndex = 0; barButtonIndex < Device::barButtonCount; barButtonIndex++) {
         if (getBarButtonIndev(barButtonIndex) == indev) {
+#if defined(BENCHMARK_SCENES)
+            if (sceneBenchmark.isRunning()) {
+                sceneBenchmark.readBarButton(barButtonIndex, data);
+                break;
+            }
+#endif
+
             if (lvglBarButtonDown[barButtonIndex]) {
                 data->state = LV_INDEV_STATE_PRESSED;
             }
@@ -1033,6 +1696,13 @@ void lvglSetBarButtonState(uint8_t barButtonIndex, const BBQ10Keyboard::KeyEvent
 }
 
 void lvglKeyboardRead(lv_indev_t* indev, lv_indev_data_t* data) {
+#if defined(BENCHMARK_SCENES)
+    if (sceneBenchmark.isRunning()) {
+        sceneBenchmark.readKeyboard(data);
+        return;
+    }
+#endif
+
     if (keyboard.keyCount() == 0) {
         if (lvglKeyHeld) {
             uint32_t now = millis();
@@ -1106,23 +1776,191 @@ void lvglKeyboardRead(lv_indev_t* indev, lv_indev_data_t* data) {
 void batteryPercentageChanged(uint8_t pct) {
     LOGFMT("battery pct: %d\n", pct);    
     drawBatteryIndicator();
+
+    // Running out of power; don't sit on unsaved changes.
+    const bool low = (pct <= lowBatteryFlushPercent);
+
+    if (low && !batteryLow) {
+        LOGLN("Battery low, flushing pending saves");
+        writeBehind.flushAll();
+        writeBehind.logStats();
+    }
+
+    batteryLow = low;
 }
 
 void messengerPayloadReceived(const uint8_t* payload, uint32_t len) {
-    char message[len+1];
-    memcpy(message, payload, len);
-    message[len] = 0;
+#if defined(PROFILE_FRAMES)
+    const uint32_t receivedMicros = micros();
+#endif
 
-    device->messageHistory.addMessage(Message::Sender::them, message);
-    (void)saveMessageHistory();
+    // Messages and sync traffic both go into the history.
+    finishLoadingHistory();
+
+    const uint8_t type = Payload::typeOf(payload, len);
+    uint32_t id = 0;
+    uint32_t headerLength = 0;
+
+    if (type == uint8_t(Payload::Type::message) && len >= sizeof(Payload::MessageHeader)) {
+        Payload::MessageHeader header;
+        memcpy(&header, payload, sizeof(header));
+        id = header.id;
+        headerLength = sizeof(header);
+    }
+    else if (type == uint8_t(Payload::Type::text) && len >= sizeof(Payload::TextHeader)) {
+        // From older firmware.
+        Payload::TextHeader header;
+        memcpy(&header, payload, sizeof(header));
+        id = device->messageHistory.receivedIdForSequence(header.sequence);
+        headerLength = sizeof(header);
+    }
+    else if (Payload::isLegacyText(payload, len)) {
+        // Bare text, from firmware that predates payload types. It has no ids, so duplicates
+        // can't be told apart, and it would show our typed payloads as text.
+        if (!device->legacyPeer) {
+            LOGLN("Paired device runs older firmware, sending it bare text");
+            device->legacyPeer = true;
+        }
+    }
+    else if (type == uint8_t(Payload::Type::syncDigest) || type == uint8_t(Payload::Type::syncBatch)) {
+        device->legacyPeer = false;
+        historySync.payloadReceived(payload, len);
+        return;
+    }
+    else {
+        LOGFMT("Dropping payload of unknown type %u\n", type);
+        return;
+    }
+
+    if (headerLength > 0) {
+        device->legacyPeer = false;
+    }
+
+    // A resend of a message whose ack was lost.
+    if (id != 0 && device->messageHistory.contains(Message::Sender::them, id)) {
+        LOGFMT("Dropping duplicate message %u\n", id);
+        return;
+    }
+
+    const uint32_t textLength = len - headerLength;
+    char message[textLength+1];
+    memcpy(message, payload + headerLength, textLength);
+    message[textLength] = 0;
+
+    device->messageHistory.addMessage(Message::Sender::them, message, id);
+    (void)requestSaveMessageHistory();
+
+    sceneManager.historyAppended(1);
     sceneManager.receivedMessage(message);
+
+#if defined(PROFILE_FRAMES)
+    frameProfiler.messageAdded(receivedMicros);
+#endif
 }
 
 void messengerPingCallback() {
+    presence.pingReceived();
+
     pingIndicatorActive = true;
     pingIndicatorTimer = 0;
 
-    lv_obj_set_style_text_color(pingStatusLabel, globalTheme.amber, 0);
+    // Shown right away; the label is redrawn for showing it anyway.
+    statusBarUpdates.setTextColor(pingStatusLabel, globalTheme.amber, true);
     lv_obj_remove_flag(pingStatusLabel, LV_OBJ_FLAG_HIDDEN);
     lv_obj_add_flag(radioModeStatusLabel, LV_OBJ_FLAG_HIDDEN);
-}
\ No newline at end of file
+}
+
+void presenceStateChanged(Presence::State state) {
+    // The paired device is back; catch up on anything either side missed.
+    // Pings don't finish the load, so a digest from a half-loaded history has to wait.
+    if (state == Presence::State::reachable) {
+        resendPending = true;
+    }
+
+    if (state == Presence::State::reachable && !device->legacyPeer) {
+        if (historyLoading) {
+            digestPending = true;
+        }
+        else {
+            historySync.sendDigest();
+        }
+    }
+
+    if (presenceStatusLabel == nullptr) {
+        return;
+    }
+
+    switch (state) {
+        case Presence::State::unknown:
+            lv_label_set_text(presenceStatusLabel, "Searching");
+            break;
+
+        case Presence::State::reachable:
+            lv_label_set_text(presenceStatusLabel, "Online");
+            break;
+
+        case Presence::State::stale:
+            lv_label_set_text(presenceStatusLabel, "Idle");
+            break;
+
+        case Presence::State::unreachable:
+            lv_label_set_text(presenceStatusLabel, "Offline");
+            break;
+    }
+}
+
+void resendPendingMessages() {
+    const size_t count = messageHistory.size();
+    const size_t resident = min(messageHistory.residentCount(), resendScanLimit);
+    size_t i = count - resident;
+
+    // Find the oldest one, then send them in order.
+    for (; i < count; i++) {
+        const MessageView msg = messageHistory.getMessage(i);
+
+        if (msg.sender == Message::Sender::me && Message::statusOf(msg.flags) == Message::Status::pending) {
+            break;
+        }
+    }
+
+    if (i == count) {
+        return;
+    }
+
+    char text[Message::bufferSize];
+    uint8_t resent = 0;
+
+    for (; i < count; i++) {
+        const MessageView msg = messageHistory.getMessage(i);
+
+        if (msg.sender != Message::Sender::me || msg.id == 0 || Message::statusOf(msg.flags) != Message::Status::pending) {
+            continue;
+        }
+
+        // The view doesn't outlive the status change.
+        memcpy(text, msg.text, msg.length + 1);
+
+        // Still not getting through; try again later.
+        if (!device->sendMessage(msg.id, text)) {
+            break;
+        }
+
+        resent++;
+    }
+
+    LOGFMT("Resent %u pending message(s)\n", resent);
+
+    if (resent > 0) {
+        (void)requestSaveMessageHistory();
+    }
+}
+
+void historySyncMessagesAdded(uint8_t count) {
+    (void)requestSaveMessageHistory();
+
+    sceneManager.historyAppended(count);
+
+    // Let the scene know a message arrived, using the newest one.
+    MessageView msg = messageHistory.getMessage(messageHistory.size() - 1);
+    sceneManager.receivedMessage(msg.text);
+}
@@ -0,0 +1,171 @@
+// Memory per message and bytes copied, before and after the MessageArena.
+//
+// Before: MessageHistory was a CircularBuffer<Message, 10>. Every slot is a whole message buffer,
+// adding one builds a Message and copies it in, and getMessage() returns a copy.
+// After: MessageHistory's resident arena. Adding copies the text once; reads are views.
+//
+// The workload is the one the UI and persistence put on the history: add a message, then
+// read every message in RAM (building the message list, and the old snapshot save).
+//
+// Usage: ArenaBenchmark [messages]
+
+#include <Arduino.h>
+#include <CircularBuffer.hpp>
+#include "MessageArena.h"
+#include "MessageHistory.h"
+#include "HostBench.h"
+
+namespace {
+    // A message as it was: the sender and a whole text buffer, whatever the text's length.
+    struct BufferMessage {
+        BufferMessage() {
+            text[0] = 0;
+        }
+
+        BufferMessage(Message::Sender s) : sender(s) {
+            text[0] = 0;
+        }
+
+        void setText(const char* str) {
+            const size_t strBufferSize = min(Message::bufferSize, strlen(str) + 1);
+            strncpy(text, str, Message::bufferSize);
+            text[strBufferSize - 1] = 0;
+        }
+
+        Message::Sender sender = Message::Sender::me;
+        char text[Message::bufferSize];
+    } __attribute__((packed));
+
+    // The history as it was.
+    class BufferHistory {
+    public:
+        static constexpr size_t maxMessages = 10;
+
+        void addMessage(Message::Sender sender, const char* text) {
+            BufferMessage msg(sender);
+            msg.setText(text);
+            messages.push(msg);
+
+            // setText() copies the whole buffer, then push() copies the Message.
+            bytesCopied += Message::bufferSize + sizeof(BufferMessage);
+        }
+
+        BufferMessage getMessage(size_t index) {
+            bytesCopied += sizeof(BufferMessage);
+            return messages[index];
+        }
+
+        size_t size() const {
+            return messages.size();
+        }
+
+        uint64_t bytesCopied = 0;
+
+    private:
+        CircularBuffer<BufferMessage, maxMessages> messages;
+    };
+
+    class ArenaHistory {
+    public:
+        void addMessage(Message::Sender sender, const char* text, size_t length) {
+            messages.push(sender, 0, 0, 0, text, length, true);
+            bytesCopied += length + 1;
+        }
+
+        MessageView getMessage(size_t index) const {
+            return messages[index];
+        }
+
+        size_t size() const {
+            return messages.size();
+        }
+
+        size_t bytesUsed() const {
+            return messages.bytesUsed();
+        }
+
+        uint64_t bytesCopied = 0;
+
+    private:
+        MessageArenaStorage<MessageHistory::maxResidentMessages, MessageHistory::residentPoolSize> messages;
+    };
+
+    constexpr size_t bufferHistoryBytes = BufferHistory::maxMessages * sizeof(BufferMessage);
+    constexpr size_t arenaHistoryBytes = MessageHistory::maxResidentMessages * sizeof(MessageArena::Record) + MessageHistory::residentPoolSize;
+}
+
+int main(int argc, char** argv) {
+    const size_t messageCount = (argc > 1) ? atoi(argv[1]) : 10000;
+
+    BufferHistory before;
+    ArenaHistory after;
+    Random random(6);
+    char text[Message::bufferSize];
+
+    Samples beforeNanos;
+    Samples afterNanos;
+    Samples arenaResident;
+    uint64_t textBytes = 0;
+    uint64_t arenaBytes = 0;
+    uint32_t checksum = 0;
+
+    for (size_t i = 0; i < messageCount; i++) {
+        const size_t length = sampleText(random, text);
+        const Message::Sender sender = (i % 2) ? Message::Sender::them : Message::Sender::me;
+        textBytes += length;
+
+        before.addMessage(sender, text);
+        after.addMessage(sender, text, length);
+
+        double start = preciseMicros();
+
+        for (size_t j = 0; j < before.size(); j++) {
+            const BufferMessage msg = before.getMessage(j);
+            checksum += strlen(msg.text);
+        }
+
+        beforeNanos.add((preciseMicros() - start) * 1000 / before.size());
+
+        start = preciseMicros();
+
+        for (size_t j = 0; j < after.size(); j++) {
+            const MessageView msg = after.getMessage(j);
+            checksum += strlen(msg.text);
+        }
+
+        afterNanos.add((preciseMicros() - start) * 1000 / after.size());
+
+        // Once the arena is full, how many messages it holds.
+        if (i >= MessageHistory::maxResidentMessages) {
+            arenaResident.add(after.size());
+            arenaBytes += after.bytesUsed() + after.size() * sizeof(MessageArena::Record);
+        }
+    }
+
+    const double meanText = double(textBytes) / messageCount;
+    const double arenaPerMessage = double(arenaBytes) / arenaResident.sum();
+
+    printf("%u messages, %.1f bytes of text on average (checksum %u)\n\n",
+        (unsigned)messageCount, meanText, (unsigned)checksum);
+
+    printf("memory per message      before %5.1f bytes (sizeof(BufferMessage))   after %5.1f bytes (%u byte record + text + null)\n",
+        double(sizeof(BufferMessage)), arenaPerMessage, (unsigned)sizeof(MessageArena::Record));
+
+    printf("messages in RAM         before %5u in %u bytes             after %5.1f on average (min %.0f) in %u bytes\n",
+        (unsigned)BufferHistory::maxMessages, (unsigned)bufferHistoryBytes,
+        arenaResident.mean(), arenaResident.percentile(0), (unsigned)arenaHistoryBytes);
+
+    printf("bytes copied per add    before %5.0f                          after %5.1f\n",
+        double(Message::bufferSize + sizeof(BufferMessage)), meanText + 1);
+
+    printf("bytes copied per read   before %5u                          after %5u\n\n",
+        (unsigned)sizeof(BufferMessage), 0u);
+
+    printf("bytes copied in total   before %llu, after %llu\n\n",
+        (unsigned long long)before.bytesCopied, (unsigned long long)after.bytesCopied);
+
+    printLatency("before: per message read", beforeNanos, "ns");
+    printLatency("after: per message read", afterNanos, "ns");
+
+    return 0;
+}
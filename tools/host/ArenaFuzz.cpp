@@ -0,0 +1,188 @@
+// Random operations on MessageArenas of a few shapes, checked against a std::deque.
+//
+// The arena may drop any number of its oldest messages to make room when pushing with
+// eviction, so after each push the reference drops its oldest until the sizes agree, and
+// everything that's left has to match. Evicting pushes must keep at least as many messages
+// as MessageHistory counts on (minResidentMessages for its arena).
+//
+// Usage: ArenaFuzz [operations per shape]
+
+#include <Arduino.h>
+#include <deque>
+#include <string>
+#include "MessageArena.h"
+#include "HostBench.h"
+
+namespace {
+    struct Entry {
+        Message::Sender sender;
+        uint32_t id;
+        uint8_t flags;
+        uint32_t timestamp;
+        std::string text;
+    };
+
+    size_t failures = 0;
+
+    void fail(const char* shape, size_t op, const char* what) {
+        printf("%s, operation %u: %s\n", shape, (unsigned)op, what);
+
+        if (++failures > 10) {
+            exit(1);
+        }
+    }
+
+    bool matches(const MessageView& v, const Entry& e) {
+        return v.sender == e.sender && v.id == e.id && v.sequence == Message::sequenceOf(e.id) &&
+            v.flags == e.flags && v.timestamp == e.timestamp && v.length == e.text.size() &&
+            memcmp(v.text, e.text.data(), e.text.size()) == 0 && v.text[v.length] == 0;
+    }
+
+    // Mostly short texts, with the edge cases mixed in.
+    size_t randomLength(Random& random) {
+        switch (random.below(10)) {
+            case 0: return 0;
+            case 1: return Message::maxLength;
+            case 2: return Message::maxLength + 1 + random.below(16);
+            case 3: return 100 + random.below(Message::maxLength - 100);
+            default: return 1 + random.below(60);
+        }
+    }
+
+    template<size_t recordCapacity, size_t poolSize>
+    void fuzz(const char* shape, uint32_t seed, size_t operations) {
+        MessageArenaStorage<recordCapacity, poolSize> arena;
+        std::deque<Entry> reference;
+        Random random(seed);
+        char text[Message::maxLength + 32];
+
+        // Every message stays until at least this many newer ones are added.
+        const size_t guaranteed = max(size_t(1), (poolSize - Message::bufferSize) / Message::bufferSize);
+
+        for (size_t op = 0; op < operations; op++) {
+            const uint32_t choice = random.below(100);
+
+            if (choice < 65) {
+                const bool evict = choice < 50;
+                const size_t length = randomLength(random);
+                sampleText(random, text, length);
+
+                Entry e = {
+                    random.below(2) ? Message::Sender::me : Message::Sender::them,
+                    random.next(),
+                    uint8_t(random.next()),
+                    random.next(),
+                    std::string(text, min(length, Message::maxLength)),
+                };
+
+                const size_t before = arena.size();
+
+                if (!arena.push(e.sender, e.id, e.flags, e.timestamp, text, length, evict)) {
+                    if (evict) {
+                        fail(shape, op, "evicting push failed");
+                    }
+
+                    if (arena.size() != before) {
+                        fail(shape, op, "failed push changed the arena");
+                    }
+
+                    continue;
+                }
+
+                reference.push_back(e);
+
+                if (arena.size() > before + 1) {
+                    fail(shape, op, "arena grew by more than one");
+                }
+
+                if (!evict && arena.size() != before + 1) {
+                    fail(shape, op, "push without eviction dropped messages");
+                }
+
+                if (arena.size() < min(before + 1, min(recordCapacity, guaranteed))) {
+                    fail(shape, op, "evicting push dropped more than it had to");
+                }
+
+                while (reference.size() > arena.size()) {
+                    reference.pop_front();
+                }
+
+                if (!matches(arena[arena.size() - 1], reference.back())) {
+                    fail(shape, op, "pushed message doesn't read back");
+                }
+            }
+            else if (choice < 80) {
+                arena.shift();
+
+                if (!reference.empty()) {
+                    reference.pop_front();
+                }
+            }
+            else if (choice < 95) {
+                if (!reference.empty()) {
+                    const size_t index = random.below(reference.size());
+                    const uint8_t flags = random.next();
+                    arena.setFlags(index, flags);
+                    reference[index].flags = flags;
+                }
+            }
+            else if (choice < 97) {
+                arena.clear();
+                reference.clear();
+            }
+            else {
+                // Out of range reads give an empty view.
+                const MessageView v = arena[arena.size() + random.below(4)];
+
+                if (v.length != 0 || v.text == nullptr || v.text[0] != 0) {
+                    fail(shape, op, "out of range read isn't empty");
+                }
+            }
+
+            if (arena.size() != reference.size()) {
+                fail(shape, op, "size differs from the reference");
+                reference.resize(arena.size());
+                continue;
+            }
+
+            if (arena.isEmpty() != reference.empty() || arena.size() > recordCapacity) {
+                fail(shape, op, "bad size");
+            }
+
+            size_t bytes = 0;
+
+            for (size_t i = 0; i < reference.size(); i++) {
+                if (!matches(arena[i], reference[i])) {
+                    fail(shape, op, "message differs from the reference");
+                    break;
+                }
+
+                bytes += reference[i].text.size() + 1;
+            }
+
+            if (arena.bytesUsed() != bytes || bytes > arena.bytesCapacity()) {
+                fail(shape, op, "pool accounting is off");
+            }
+        }
+
+        printf("%-28s %u operations\n", shape, (unsigned)operations);
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t operations = (argc > 1) ? atoi(argv[1]) : 200000;
+
+    fuzz<1, Message::bufferSize>("1 record, minimal pool", 1, operations);
+    fuzz<4, 256>("4 records, 256 byte pool", 2, operations);
+    fuzz<64, 512>("64 records, 512 byte pool", 3, operations);
+    fuzz<MessageHistory::maxResidentMessages, MessageHistory::residentPoolSize>("resident history", 4, operations);
+    fuzz<MessageHistory::pageSize, MessageHistory::pagePoolSize>("history page", 5, operations);
+
+    if (failures > 0) {
+        printf("%u failures\n", (unsigned)failures);
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}
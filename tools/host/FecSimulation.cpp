@@ -0,0 +1,296 @@
+// Goodput and latency of LoRa message delivery over a lossy link, plain ARQ against FEC,
+// across a sweep of packet error rates.
+//
+// - ARQ: RHReliableDatagram as LoRaMessenger sets it up. Each attempt is the frame and its
+//   ack; a lost one costs the timeout (500 ms plus up to as much again) before the retry.
+// - FEC: LoRaMessenger::txWaitFec(). Data and parity fragments go out back to back, sized
+//   from the measured delivery ratio. The radio is half duplex, so once the receiver has
+//   decoded the block it holds its ack until the round's last fragment slot, when the
+//   sender listens. It acks any round it hears a fragment of from then on.
+// - Adaptive: what USE_LORA_FEC does, FEC only while the delivery ratio is below the threshold.
+//
+// The link ratio is the firmware's LinkStats, fed the way each path feeds it. Fragments are
+// encoded and decoded with ErasureCode, and every delivered message is checked.
+//
+// Frames are lost independently, with a bit error rate set so that a frame carrying a
+// referenceLength byte payload is lost at the given PER; shorter frames survive more often.
+// Airtime is LoRa's at SF7, 125 kHz, CR 4/5, 8 symbol preamble, explicit header and CRC.
+//
+// Usage: FecSimulation [messages per point]
+
+#include <Arduino.h>
+#include <cmath>
+#include "ErasureCode.h"
+#include "LinkStats.h"
+#include "Message.h"
+#include "Payload.h"
+#include "HostBench.h"
+
+namespace {
+    // LoRaMessenger's FEC parameters (LoRaMessenger.h needs RadioHead, so it isn't built here).
+    constexpr uint8_t fecFragmentTargetSize = 32;
+    constexpr uint8_t fecDeliveryThreshold = 80;
+    constexpr uint8_t fecMinParity = 1;
+    constexpr uint8_t fecMaxParity = 8;
+    constexpr uint8_t fecMaxRounds = 3;
+    constexpr double fecAckTimeoutUS = 600 * 1000;
+    constexpr size_t fecHeaderSize = 6;
+
+    // RHReliableDatagram as LoRaMessenger::begin() sets it up; its ack carries one byte.
+    constexpr uint8_t arqRetries = 6;
+    constexpr double arqTimeoutUS = 500 * 1000;
+    constexpr size_t arqAckLength = 1;
+
+    // The PER of the sweep is the loss rate of a frame with this much payload.
+    constexpr size_t referenceLength = 64;
+
+    const double errorRates[] = {0, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8};
+
+    enum class Strategy {
+        arq,
+        fec,
+        adaptive,
+    };
+
+    const char* strategyName(Strategy s) {
+        switch (s) {
+            case Strategy::arq: return "ARQ";
+            case Strategy::fec: return "FEC";
+            case Strategy::adaptive: return "adaptive";
+        }
+
+        return "";
+    }
+
+    // Bytes on air for a payload: RadioHead's 4 byte header, and the encrypted part padded
+    // to Speck's 8 byte block with a length byte.
+    size_t frameLength(size_t payloadLength) {
+        return 4 + (payloadLength + 1 + 7) / 8 * 8;
+    }
+
+    double airtimeUS(size_t payloadLength) {
+        const double symbolUS = 1024;
+        const double bits = 8.0 * frameLength(payloadLength) - 4 * 7 + 28 + 16;
+        const double symbols = 8 + std::max(std::ceil(bits / (4 * 7)) * 5, 0.0);
+        return (8 + 4.25) * symbolUS + symbols * symbolUS;
+    }
+
+    class Channel {
+    public:
+        Channel(double per, uint32_t seed) : random(seed) {
+            bitSurvival = std::pow(1 - per, 1.0 / (8 * frameLength(referenceLength)));
+        }
+
+        bool deliver(size_t payloadLength) {
+            return uniform() < std::pow(bitSurvival, 8.0 * frameLength(payloadLength));
+        }
+
+        double uniform() {
+            return random.next() / 4294967296.0;
+        }
+
+    private:
+        Random random;
+        double bitSurvival;
+    };
+
+    struct Outcome {
+        bool delivered = false;
+        // The sender saw the ack; otherwise the message is reported as failed.
+        bool acked = false;
+        double deliveredUS = 0;
+        double busyUS = 0;
+    };
+
+    Outcome sendArq(Channel& channel, LinkStats& link, size_t length) {
+        Outcome o;
+        uint32_t attempts = 0;
+
+        for (uint8_t attempt = 0; attempt <= arqRetries && !o.acked; attempt++) {
+            attempts++;
+            o.busyUS += airtimeUS(length);
+
+            if (channel.deliver(length)) {
+                if (!o.delivered) {
+                    o.delivered = true;
+                    o.deliveredUS = o.busyUS;
+                }
+
+                if (channel.deliver(arqAckLength)) {
+                    o.busyUS += airtimeUS(arqAckLength);
+                    o.acked = true;
+                    break;
+                }
+            }
+
+            o.busyUS += arqTimeoutUS * (1 + channel.uniform());
+        }
+
+        // As LoRaMessenger::sendMessage() counts them: every retransmission failed, then the result.
+        for (uint32_t i = 1; i < attempts; i++) {
+            link.recordDelivery(0, false);
+        }
+
+        link.recordDelivery(0, o.acked);
+        return o;
+    }
+
+    size_t decodeFailures = 0;
+
+    Outcome sendFec(Channel& channel, LinkStats& link, const uint8_t* payload, size_t length) {
+        Outcome o;
+
+        uint8_t dataCount = (length + fecFragmentTargetSize - 1) / fecFragmentTargetSize;
+        dataCount = min(dataCount, ErasureCode::maxDataFragments);
+
+        const uint8_t fragmentSize = (length + dataCount - 1) / dataCount;
+        const size_t fragmentLength = fecHeaderSize + fragmentSize;
+
+        uint8_t block[Message::maxLength + ErasureCode::maxDataFragments] = {0};
+        memcpy(block, payload, length);
+
+        const uint8_t deliveryPercent = max(link.deliveryPercent(), uint8_t(10));
+        const uint8_t parityCount = constrain(dataCount * (100 - deliveryPercent) / deliveryPercent + 1, fecMinParity, fecMaxParity);
+
+        // The receiver's side.
+        uint8_t fragments[sizeof(block)];
+        uint8_t indices[ErasureCode::maxDataFragments];
+        uint8_t receivedCount = 0;
+
+        uint8_t nextIndex = 0;
+
+        for (uint8_t round = 0; round < fecMaxRounds; round++) {
+            const uint8_t fragmentCount = (round == 0) ? (dataCount + parityCount) : parityCount;
+            bool ackHeld = false;
+
+            for (uint8_t i = 0; i < fragmentCount; i++) {
+                const uint8_t index = nextIndex++;
+                o.busyUS += airtimeUS(fragmentLength);
+
+                if (!channel.deliver(fragmentLength)) {
+                    continue;
+                }
+
+                if (!o.delivered) {
+                    ErasureCode::encode(block, dataCount, fragmentSize, index, &fragments[receivedCount * fragmentSize]);
+                    indices[receivedCount++] = index;
+
+                    if (receivedCount < dataCount) {
+                        continue;
+                    }
+
+                    uint8_t decoded[sizeof(block)];
+
+                    if (!ErasureCode::decode(fragments, indices, dataCount, fragmentSize, decoded) || memcmp(decoded, payload, length) != 0) {
+                        decodeFailures++;
+                    }
+
+                    o.delivered = true;
+                    o.deliveredUS = o.busyUS;
+                }
+
+                ackHeld = true;
+            }
+
+            // The held ack goes out once the round is over.
+            const bool ackHeard = ackHeld && channel.deliver(fecHeaderSize);
+
+            link.recordDelivery(0, ackHeard);
+
+            if (ackHeard) {
+                o.busyUS += airtimeUS(fecHeaderSize);
+                o.acked = true;
+                break;
+            }
+
+            o.busyUS += fecAckTimeoutUS;
+        }
+
+        return o;
+    }
+
+    struct Result {
+        Samples latencyMS;
+        uint32_t delivered = 0;
+        uint32_t acked = 0;
+        // Delivered, but the sender never saw the ack, so it reports a failure.
+        uint32_t unacked = 0;
+        uint32_t fecMessages = 0;
+        uint64_t textBytes = 0;
+        double busyUS = 0;
+    };
+
+    Result run(Strategy strategy, double per, size_t messageCount) {
+        Channel channel(per, 11);
+        LinkStats link;
+        Random random(12);
+        Result r;
+
+        for (size_t i = 0; i < messageCount; i++) {
+            uint8_t payload[Message::maxLength + 1];
+            char text[Message::bufferSize];
+            const size_t textLength = min(sampleText(random, text), Message::maxLength - sizeof(Payload::MessageHeader));
+            const size_t length = sizeof(Payload::MessageHeader) + textLength;
+
+            Payload::MessageHeader header = {Payload::Type::message, uint32_t(i + 1)};
+            memcpy(payload, &header, sizeof(header));
+            memcpy(payload + sizeof(header), text, textLength);
+
+            const bool useFec = strategy == Strategy::fec ||
+                (strategy == Strategy::adaptive && link.deliveryPercent() < fecDeliveryThreshold);
+
+            const Outcome o = useFec ? sendFec(channel, link, payload, length) : sendArq(channel, link, length);
+
+            r.fecMessages += useFec;
+            r.busyUS += o.busyUS;
+
+            if (o.delivered) {
+                r.delivered++;
+                r.textBytes += textLength;
+                r.latencyMS.add(o.deliveredUS / 1000);
+            }
+
+            r.acked += o.acked;
+            r.unacked += o.delivered && !o.acked;
+        }
+
+        return r;
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t messageCount = (argc > 1) ? atoi(argv[1]) : 2000;
+
+    printf("%u messages per point; PER of a %u byte frame, %.1f ms on air\n\n",
+        (unsigned)messageCount, (unsigned)referenceLength, airtimeUS(referenceLength) / 1000);
+
+    printf("%-5s %-9s %9s %7s %9s %5s %10s %10s %10s %12s\n",
+        "PER", "strategy", "delivered", "acked", "unacked", "FEC", "p50 ms", "p90 ms", "p99 ms", "goodput B/s");
+
+    for (double per : errorRates) {
+        for (Strategy s : {Strategy::arq, Strategy::fec, Strategy::adaptive}) {
+            const Result r = run(s, per, messageCount);
+
+            printf("%3.0f%%  %-9s %8.1f%% %6.1f%% %8.1f%% %4.0f%% %10.0f %10.0f %10.0f %12.1f\n",
+                per * 100,
+                strategyName(s),
+                100.0 * r.delivered / messageCount,
+                100.0 * r.acked / messageCount,
+                r.delivered ? 100.0 * r.unacked / r.delivered : 0.0,
+                100.0 * r.fecMessages / messageCount,
+                r.latencyMS.percentile(50),
+                r.latencyMS.percentile(90),
+                r.latencyMS.percentile(99),
+                r.textBytes / (r.busyUS / 1e6));
+        }
+
+        printf("\n");
+    }
+
+    if (decodeFailures > 0) {
+        printf("%u blocks didn't decode to the message sent\n", (unsigned)decodeFailures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include "HostBench.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <stdlib.h>
+
+namespace {
+    const char* words[] = {
+        "the", "a", "to", "and", "you", "i", "is", "it", "we", "on", "at", "in", "ok", "yes", "no",
+        "meet", "north", "ridge", "camp", "water", "radio", "battery", "charge", "tonight", "tomorrow",
+        "morning", "signal", "bridge", "road", "closed", "open", "trail", "supplies", "food", "fuel",
+        "map", "check", "copy", "roger", "heading", "back", "waiting", "here", "there", "soon",
+        "later", "storm", "wind", "rain", "cold", "fire", "shelter", "river", "crossing", "east",
+        "west", "south", "mile", "hour", "minutes", "safe", "clear", "repeat", "received", "lost",
+        "found", "team", "group", "two", "three", "four", "five", "left", "right", "gate", "tower",
+    };
+
+    constexpr size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+    size_t appendWords(Random& random, char* text, size_t length, size_t target) {
+        while (length < target) {
+            const char* word = words[random.below(wordCount)];
+            const size_t wordLength = strlen(word);
+            const size_t separator = (length > 0) ? 1 : 0;
+
+            if (length + separator + wordLength > target) {
+                break;
+            }
+
+            if (separator) {
+                text[length++] = ' ';
+            }
+
+            memcpy(text + length, word, wordLength);
+            length += wordLength;
+        }
+
+        text[length] = 0;
+        return length;
+    }
+}
+
+size_t sampleText(Random& random, char* text) {
+    const bool isLong = random.below(20) == 0;
+    const size_t target = isLong ? 100 + random.below(Message::maxTextLength - 100) : 4 + random.below(56);
+
+    size_t length = appendWords(random, text, 0, target);
+
+    if (length == 0) {
+        strcpy(text, "ok");
+        length = 2;
+    }
+
+    return length;
+}
+
+size_t sampleText(Random& random, char* text, size_t length) {
+    size_t written = appendWords(random, text, 0, length);
+
+    while (written < length) {
+        text[written++] = 'x';
+    }
+
+    text[length] = 0;
+    return length;
+}
+
+size_t addConversationMessage(MessageHistory& history, Random& random) {
+    char text[Message::bufferSize];
+    const size_t length = sampleText(random, text);
+
+    // Keep the previous sender two times out of three.
+    const bool fromMe = (history.isEmpty() || random.below(3) == 0) ?
+        (history.totalAdded() % 2 == 0) :
+        history.getMessage(history.size() - 1).sender == Message::Sender::me;
+
+    if (fromMe) {
+        history.addMessage(Message::Sender::me, text, history.takeId(), Message::Status::sent);
+
+        if (random.below(4) == 0) {
+            history.setAckedThrough(history.sentHighWater());
+        }
+    }
+    else {
+        history.addMessage(Message::Sender::them, text, history.receivedHighWaterId() + 1);
+    }
+
+    return length;
+}
+
+StorageFile* CountingStorage::open(const char* path, Mode mode) {
+    File* wrapper = nullptr;
+
+    for (size_t i = 0; i < maxOpenFiles; i++) {
+        if (files[i].inner == nullptr) {
+            wrapper = &files[i];
+            break;
+        }
+    }
+
+    if (wrapper == nullptr) {
+        return nullptr;
+    }
+
+    wrapper->inner = backend.open(path, mode);
+
+    if (wrapper->inner == nullptr) {
+        return nullptr;
+    }
+
+    totals.opens++;
+    return wrapper;
+}
+
+void CountingStorage::close(StorageFile* file) {
+    if (file == nullptr) {
+        return;
+    }
+
+    File* wrapper = static_cast<File*>(file);
+    backend.close(wrapper->inner);
+    wrapper->inner = nullptr;
+}
+
+bool CountingStorage::exists(const char* path) {
+    return backend.exists(path);
+}
+
+bool CountingStorage::remove(const char* path) {
+    totals.removes++;
+    return backend.remove(path);
+}
+
+bool CountingStorage::rename(const char* oldPath, const char* newPath) {
+    totals.renames++;
+    return backend.rename(oldPath, newPath);
+}
+
+int CountingStorage::File::read(void* buffer, size_t length) {
+    const int result = inner->read(buffer, length);
+    owner->totals.reads++;
+
+    if (result > 0) {
+        owner->totals.bytesRead += result;
+    }
+
+    return result;
+}
+
+size_t CountingStorage::File::write(const void* buffer, size_t length) {
+    const size_t result = inner->write(buffer, length);
+    owner->totals.writes++;
+    owner->totals.bytesWritten += result;
+    return result;
+}
+
+bool CountingStorage::File::seek(uint32_t position) {
+    return inner->seek(position);
+}
+
+bool CountingStorage::File::seekEnd() {
+    return inner->seekEnd();
+}
+
+uint32_t CountingStorage::File::position() {
+    return inner->position();
+}
+
+uint32_t CountingStorage::File::size() {
+    return inner->size();
+}
+
+bool CountingStorage::File::truncate(uint32_t length) {
+    return inner->truncate(length);
+}
+
+bool CountingStorage::File::sync() {
+    owner->totals.syncs++;
+    return inner->sync();
+}
+
+const char* makeScratchDirectory(const char* name) {
+    static char path[256];
+    snprintf(path, sizeof(path), "/tmp/%s-XXXXXX", name);
+    return mkdtemp(path);
+}
+
+void removeScratchDirectory(const char* path) {
+    std::error_code error;
+    std::filesystem::remove_all(path, error);
+}
+
+double preciseMicros() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+double Samples::sum() const {
+    double total = 0;
+
+    for (double v : values) {
+        total += v;
+    }
+
+    return total;
+}
+
+double Samples::mean() const {
+    return values.empty() ? 0 : sum() / values.size();
+}
+
+double Samples::percentile(double percent) const {
+    if (values.empty()) {
+        return 0;
+    }
+
+    if (!sorted) {
+        std::sort(values.begin(), values.end());
+        sorted = true;
+    }
+
+    // Nearest rank.
+    size_t rank = size_t(percent / 100 * values.size() + 0.999999);
+    rank = min(max(rank, size_t(1)), values.size());
+    return values[rank - 1];
+}
+
+void printLatency(const char* label, const Samples& s, const char* unit) {
+    printf("%-32s n=%-6u p50 %9.1f  p90 %9.1f  p99 %9.1f  max %9.1f  mean %9.1f %s\n",
+        label,
+        (unsigned)s.count(),
+        s.percentile(50),
+        s.percentile(90),
+        s.percentile(99),
+        s.maximum(),
+        s.mean(),
+        unit);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+#include "Message.h"
+#include "MessageHistory.h"
+#include "Storage/Storage.h"
+
+// Pieces shared by the host benchmarks and tests.
+
+// Small deterministic random number generator (xorshift32), so every run sees the same data.
+struct Random {
+    explicit Random(uint32_t seed) : state(seed ? seed : 1) {}
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // Uniform in [0, bound).
+    uint32_t below(uint32_t bound) {
+        return next() % bound;
+    }
+
+    uint32_t state;
+};
+
+// Write a chat-like message of random words into text (at least Message::bufferSize bytes).
+// Most messages are a few words; about one in twenty is long. Returns the length.
+size_t sampleText(Random& random, char* text);
+
+// Write exactly length bytes of random words into text, padding the last one. Returns length.
+size_t sampleText(Random& random, char* text, size_t length);
+
+// Add the next message of a simulated conversation to history: senders alternate in short
+// bursts, our messages are sent and then acked a few at a time, as a sync digest would.
+// Returns the text length.
+size_t addConversationMessage(MessageHistory& history, Random& random);
+
+// Wraps a Storage backend and counts the traffic through it, to measure write amplification.
+class CountingStorage: public Storage {
+public:
+    struct Counts {
+        uint64_t bytesWritten = 0;
+        uint64_t bytesRead = 0;
+        uint32_t writes = 0;
+        uint32_t reads = 0;
+        uint32_t syncs = 0;
+        uint32_t opens = 0;
+        uint32_t removes = 0;
+        uint32_t renames = 0;
+    };
+
+    explicit CountingStorage(Storage& s) : backend(s) {
+        for (size_t i = 0; i < maxOpenFiles; i++) {
+            files[i].owner = this;
+        }
+    }
+
+    virtual StorageFile* open(const char* path, Mode mode) override;
+    virtual void close(StorageFile* file) override;
+    virtual bool exists(const char* path) override;
+    virtual bool remove(const char* path) override;
+    virtual bool rename(const char* oldPath, const char* newPath) override;
+
+    const Counts& counts() const {
+        return totals;
+    }
+
+    void resetCounts() {
+        totals = Counts();
+    }
+
+private:
+    class File: public StorageFile {
+    public:
+        virtual int read(void* buffer, size_t length) override;
+        virtual size_t write(const void* buffer, size_t length) override;
+        virtual bool seek(uint32_t position) override;
+        virtual bool seekEnd() override;
+        virtual uint32_t position() override;
+        virtual uint32_t size() override;
+        virtual bool truncate(uint32_t length) override;
+        virtual bool sync() override;
+
+        CountingStorage* owner = nullptr;
+        StorageFile* inner = nullptr;
+    };
+
+    Storage& backend;
+    File files[maxOpenFiles];
+    Counts totals;
+};
+
+// A fresh directory under /tmp for PosixStorage, and a way to get rid of it afterwards.
+// Returns nullptr on failure; the path is valid until the next call.
+const char* makeScratchDirectory(const char* name);
+void removeScratchDirectory(const char* path);
+
+// Microseconds of real time, with sub-microsecond resolution.
+double preciseMicros();
+
+// Measurements with exact percentiles; the firmware's Histogram buckets are too coarse to
+// compare benchmark runs.
+class Samples {
+public:
+    void add(double value) {
+        values.push_back(value);
+        sorted = false;
+    }
+
+    size_t count() const {
+        return values.size();
+    }
+
+    double sum() const;
+    double mean() const;
+    double percentile(double percent) const;
+
+    double maximum() const {
+        return percentile(100);
+    }
+
+private:
+    mutable std::vector<double> values;
+    mutable bool sorted = true;
+};
+
+// One line of statistics: count, p50, p90, p99, max and mean.
+void printLatency(const char* label, const Samples& s, const char* unit = "us");
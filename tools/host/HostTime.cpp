@@ -0,0 +1,29 @@
+#include <Arduino.h>
+#include <chrono>
+#include <thread>
+
+namespace {
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t simulated = 0;
+
+    uint64_t elapsedMicros() {
+        const auto now = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now - start).count() + simulated;
+    }
+}
+
+uint32_t millis() {
+    return elapsedMicros() / 1000;
+}
+
+uint32_t micros() {
+    return elapsedMicros();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void advanceTime(uint32_t us) {
+    simulated += us;
+}
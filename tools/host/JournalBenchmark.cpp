@@ -0,0 +1,292 @@
+// HistoryJournal against the messages.hst snapshot it replaced, on PosixStorage.
+//
+// - Save latency by history length: the snapshot rewrites every message it keeps, the
+//   journal appends one record.
+// - Load latency, time to the first page (read from the index), and recovery from a torn write.
+// - A long conversation with compaction running: bytes written per byte of text.
+//
+// Usage: JournalBenchmark [conversation length]
+
+#include <Arduino.h>
+#include <vector>
+#include <string>
+#include "HistoryJournal.h"
+#include "MessageHistory.h"
+#include "Storage/PosixStorage.h"
+#include "HostBench.h"
+#include "LegacyHistoryFile.h"
+
+namespace {
+    const char* journalFilename = "messages.jnl";
+    const char* indexFilename = "messages.idx";
+    const char* snapshotFilename = "messages.hst";
+
+    constexpr size_t savesPerLength = 200;
+
+    // Every message in RAM, standing in for the old firmware keeping its history in memory.
+    class RamArchive: public MessageArchive {
+    public:
+        void add(const char* text, size_t length, Message::Sender sender, uint32_t id, uint8_t flags, uint32_t timestamp) {
+            messages.push_back({std::string(text, length), sender, id, flags, timestamp});
+        }
+
+        virtual size_t readMessages(size_t first, size_t maxCount, MessageArena& out) override {
+            size_t count = 0;
+
+            for (size_t i = first; i < messages.size() && count < maxCount; i++, count++) {
+                const Entry& e = messages[i];
+
+                if (!out.push(e.sender, e.id, e.flags, e.timestamp, e.text.c_str(), e.text.size(), false)) {
+                    break;
+                }
+            }
+
+            return count;
+        }
+
+    private:
+        struct Entry {
+            std::string text;
+            Message::Sender sender;
+            uint32_t id;
+            uint8_t flags;
+            uint32_t timestamp;
+        };
+
+        std::vector<Entry> messages;
+    };
+
+    HistoryJournal makeJournal(Storage& storage) {
+        return HistoryJournal(storage, journalFilename, indexFilename, "messages.tmp", "messages.itm");
+    }
+
+    void addMessage(MessageHistory& history, RamArchive& archive, Random& random) {
+        addConversationMessage(history, random);
+
+        const MessageView msg = history.getMessage(history.size() - 1);
+        archive.add(msg.text, msg.length, msg.sender, msg.id, msg.flags, msg.timestamp);
+    }
+
+    // Save latency once the history holds length messages.
+    void benchmarkSaves(Storage& storage, size_t length) {
+        char label[64];
+
+        // Journal: fill it, compact it, then time appends.
+        {
+            HistoryJournal journal = makeJournal(storage);
+            MessageHistory history;
+            RamArchive unused;
+            Random random(2);
+
+            history.setArchive(&journal);
+            (void)journal.load(history);
+
+            // Saved in batches smaller than the RAM tail, so nothing is missed.
+            for (size_t i = 0; i < length; i++) {
+                addMessage(history, unused, random);
+
+                if (i % MessageHistory::pageSize == 0) {
+                    (void)journal.save(history);
+                }
+            }
+
+            (void)journal.rewrite(history);
+
+            Samples saves;
+
+            for (size_t i = 0; i < savesPerLength; i++) {
+                addMessage(history, unused, random);
+
+                const double start = preciseMicros();
+                (void)journal.save(history);
+                saves.add(preciseMicros() - start);
+            }
+
+            snprintf(label, sizeof(label), "journal save, %u messages", (unsigned)length);
+            printLatency(label, saves);
+
+            journal.remove();
+        }
+
+        // Snapshot: every save rewrites the whole history, up to the format's limit.
+        if (length <= LegacyHistoryFile::formatMessageLimit) {
+            MessageHistory history;
+            RamArchive archive;
+            Random random(2);
+
+            history.setArchive(&archive);
+
+            for (size_t i = 0; i < length; i++) {
+                addMessage(history, archive, random);
+            }
+
+            Samples saves;
+
+            for (size_t i = 0; i < savesPerLength; i++) {
+                addMessage(history, archive, random);
+
+                const double start = preciseMicros();
+                (void)LegacyHistoryFile::save(storage, snapshotFilename, history, length);
+                saves.add(preciseMicros() - start);
+            }
+
+            snprintf(label, sizeof(label), "snapshot save, %u messages", (unsigned)length);
+            printLatency(label, saves);
+
+            storage.remove(snapshotFilename);
+        }
+    }
+
+    // Load latency of a journal holding length messages, with and without a torn last record.
+    void benchmarkLoads(Storage& storage, size_t length) {
+        char label[64];
+
+        {
+            HistoryJournal journal = makeJournal(storage);
+            MessageHistory history;
+            Random random(3);
+
+            history.setArchive(&journal);
+            (void)journal.load(history);
+
+            for (size_t i = 0; i < length; i++) {
+                addConversationMessage(history, random);
+                (void)journal.save(history);
+            }
+
+            journal.close();
+        }
+
+        Samples loads;
+        Samples newest;
+
+        for (int i = 0; i < 10; i++) {
+            HistoryJournal journal = makeJournal(storage);
+            MessageHistory history;
+            history.setArchive(&journal);
+
+            MessageArenaStorage<MessageHistory::pageSize, MessageHistory::pagePoolSize> page;
+
+            // Boot shows the newest page straight from the index, then replays the rest.
+            const double start = preciseMicros();
+            bool loaded = journal.beginLoad(history);
+            const size_t read = journal.readNewest(MessageHistory::pageSize, page);
+            newest.add(preciseMicros() - start);
+
+            while (loaded && !journal.continueLoad(history, 100)) {
+            }
+
+            loads.add(preciseMicros() - start);
+
+            if (read != MessageHistory::pageSize || !loaded || history.size() != length) {
+                printf("load failed: %u of %u messages\n", (unsigned)history.size(), (unsigned)length);
+                exit(1);
+            }
+
+            journal.close();
+        }
+
+        snprintf(label, sizeof(label), "journal load, %u messages", (unsigned)length);
+        printLatency(label, loads);
+
+        snprintf(label, sizeof(label), "first page, %u messages", (unsigned)length);
+        printLatency(label, newest);
+
+        // Cut the last record short, as a reset in the middle of a write would.
+        StorageFile* f = storage.open(journalFilename, Storage::Mode::readWrite);
+        if (f == nullptr || !f->truncate(f->size() - 3)) {
+            printf("can't truncate %s\n", journalFilename);
+            exit(1);
+        }
+
+        storage.close(f);
+
+        HistoryJournal journal = makeJournal(storage);
+        MessageHistory history;
+        history.setArchive(&journal);
+
+        const double start = preciseMicros();
+        (void)journal.load(history);
+        Samples recovery;
+        recovery.add(preciseMicros() - start);
+
+        snprintf(label, sizeof(label), "torn load, %u messages", (unsigned)length);
+        printLatency(label, recovery);
+
+        if (history.size() + 1 != length && history.size() != length) {
+            printf("recovered %u of %u messages\n", (unsigned)history.size(), (unsigned)length);
+            exit(1);
+        }
+
+        journal.remove();
+    }
+
+    // A long conversation, saved after every message, with loop() running in between.
+    void benchmarkConversation(Storage& backend, size_t length) {
+        CountingStorage storage(backend);
+        HistoryJournal journal = makeJournal(storage);
+        MessageHistory history;
+        Random random(4);
+        uint64_t textBytes = 0;
+        Samples saves;
+
+        history.setArchive(&journal);
+        (void)journal.load(history);
+        storage.resetCounts();
+
+        for (size_t i = 0; i < length; i++) {
+            textBytes += addConversationMessage(history, random);
+
+            const double start = preciseMicros();
+            (void)journal.save(history);
+            saves.add(preciseMicros() - start);
+
+            advanceTime(4 * 1000 * 1000);
+
+            for (int step = 0; step < 1000; step++) {
+                journal.update(history);
+            }
+        }
+
+        char label[64];
+        snprintf(label, sizeof(label), "conversation save, %u messages", (unsigned)length);
+        printLatency(label, saves);
+
+        printf("%-32s %.2f bytes written per text byte, %u compactions\n",
+            "",
+            double(storage.counts().bytesWritten) / double(textBytes),
+            (unsigned)journal.stats().compactions);
+
+        journal.remove();
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t conversationLength = (argc > 1) ? atoi(argv[1]) : 5000;
+
+    const char* directory = makeScratchDirectory("journal-benchmark");
+    if (directory == nullptr) {
+        printf("can't create a scratch directory\n");
+        return 1;
+    }
+
+    PosixStorage storage(directory);
+
+    const size_t lengths[] = {10, 100, 255, 1000, 10000};
+
+    for (size_t length : lengths) {
+        benchmarkSaves(storage, length);
+    }
+
+    printf("\n");
+
+    for (size_t length : {1000, 10000}) {
+        benchmarkLoads(storage, length);
+    }
+
+    printf("\n");
+    benchmarkConversation(storage, conversationLength);
+
+    removeScratchDirectory(directory);
+    return 0;
+}
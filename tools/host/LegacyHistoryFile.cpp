@@ -0,0 +1,86 @@
+#include "LegacyHistoryFile.h"
+
+bool LegacyHistoryFile::save(Storage& storage, const char* path, const MessageHistory& history, size_t maxMessages) {
+    if (storage.exists(path) && !storage.remove(path)) {
+        return false;
+    }
+
+    if (history.isEmpty()) {
+        return true;
+    }
+
+    StorageFile* file = storage.open(path, Storage::Mode::truncate);
+    if (file == nullptr) {
+        return false;
+    }
+
+    const size_t count = min(history.size(), min(maxMessages, formatMessageLimit));
+    const size_t first = history.size() - count;
+    const uint16_t nextSequence = Message::sequenceOf(history.nextSentId());
+    const uint16_t receivedHighWater = history.receivedHighWaterMark();
+
+    bool success = file->write(MessageHistory::snapshotVersion) == 1 &&
+                   file->write(uint8_t(count)) == 1 &&
+                   file->write(&nextSequence, sizeof(nextSequence)) == sizeof(nextSequence) &&
+                   file->write(&receivedHighWater, sizeof(receivedHighWater)) == sizeof(receivedHighWater);
+
+    for (size_t i = first; success && i < history.size(); i++) {
+        const MessageView msg = history.getMessage(i);
+
+        success = file->write(uint8_t(msg.sender)) == 1 &&
+                  file->write(&msg.sequence, sizeof(msg.sequence)) == sizeof(msg.sequence) &&
+                  file->write(msg.length) == 1 &&
+                  file->write(msg.text, msg.length) == msg.length;
+    }
+
+    success = file->sync() && success;
+    storage.close(file);
+    return success;
+}
+
+bool LegacyHistoryFile::load(Storage& storage, const char* path, MessageHistory& history) {
+    StorageFile* file = storage.open(path, Storage::Mode::read);
+    if (file == nullptr) {
+        return false;
+    }
+
+    const int version = file->read();
+    const int count = file->read();
+    uint16_t sequenceState[2] = {0};
+
+    if (version != MessageHistory::snapshotVersion || count == -1 ||
+        file->read(sequenceState, sizeof(sequenceState)) != sizeof(sequenceState))
+    {
+        storage.close(file);
+        return false;
+    }
+
+    history.setIdState(sequenceState[0], sequenceState[1], 0);
+
+    char text[Message::bufferSize];
+
+    for (int i = 0; i < count; i++) {
+        const int sender = file->read();
+        uint16_t sequence = 0;
+
+        if (sender == -1 || file->read(&sequence, sizeof(sequence)) != sizeof(sequence)) {
+            storage.close(file);
+            return false;
+        }
+
+        const int length = file->read();
+
+        if (length == -1 || file->read(text, length) != length) {
+            storage.close(file);
+            return false;
+        }
+
+        text[length] = 0;
+
+        const Message::Status status = (Message::Sender(sender) == Message::Sender::me) ? Message::Status::sent : Message::Status::acked;
+        history.restoreMessage(Message::Sender(sender), text, length, sequence, Message::withStatus(0, status), 0);
+    }
+
+    storage.close(file);
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+#include "MessageHistory.h"
+#include "Storage/Storage.h"
+
+// The messages.hst snapshot format the journal replaced (see MessageHistory::snapshotVersion),
+// written the way older firmware wrote it, so the benchmarks can compare the two.
+//
+// Every save deletes the file and writes the newest messages again, one small write per field.
+// The firmware that used it kept 10 messages; the format allows up to 255.
+namespace LegacyHistoryFile {
+    static constexpr size_t firmwareMessageLimit = 10;
+    static constexpr size_t formatMessageLimit = 255;
+
+    // Write the newest maxMessages messages of history to path, replacing it.
+    bool save(Storage& storage, const char* path, const MessageHistory& history, size_t maxMessages = firmwareMessageLimit);
+
+    // Read path into history, like the firmware's converter does.
+    bool load(Storage& storage, const char* path, MessageHistory& history);
+}
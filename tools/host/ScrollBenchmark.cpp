@@ -0,0 +1,163 @@
+// Scroll latency through a long history: MessageHistory's page cache in front of a
+// HistoryJournal on PosixStorage.
+//
+// - Sequential: every message, newest to oldest (scrolling back) and oldest to newest.
+// - Random: single messages anywhere in the history, e.g. search results.
+// - Jump: a screenful of messages starting anywhere, e.g. opening a search result.
+//
+// Page misses are counted by the history; each one is a read of up to a page of messages.
+//
+// Usage: ScrollBenchmark [messages]
+
+#include <Arduino.h>
+#include "HistoryJournal.h"
+#include "MessageHistory.h"
+#include "Storage/PosixStorage.h"
+#include "HostBench.h"
+
+namespace {
+    // Bubbles ConversationScene keeps built at once (bubblePoolSize).
+    constexpr size_t screenMessages = 16;
+
+    constexpr size_t randomReads = 2000;
+    constexpr size_t jumps = 500;
+
+    struct Counter {
+        Counter(const MessageHistory& h) : history(h), hits(h.pageHits()), misses(h.pageMisses()) {}
+
+        void print(size_t reads) const {
+            const uint32_t m = history.pageMisses() - misses;
+            const uint32_t total = (history.pageHits() - hits) + m;
+
+            printf("%-32s %u page misses in %u archive reads (%.1f%%), %u message reads\n",
+                "",
+                (unsigned)m,
+                (unsigned)total,
+                total ? 100.0 * m / total : 0.0,
+                (unsigned)reads);
+        }
+
+        const MessageHistory& history;
+        uint32_t hits;
+        uint32_t misses;
+    };
+
+    // Read message index, checking it came back.
+    inline double timedRead(const MessageHistory& history, size_t index) {
+        const double start = preciseMicros();
+        const MessageView msg = history.getMessage(index);
+        const double elapsed = preciseMicros() - start;
+
+        if (msg.length == 0) {
+            printf("message %u didn't read back\n", (unsigned)index);
+            exit(1);
+        }
+
+        return elapsed;
+    }
+
+    void benchmark(Storage& storage, size_t messageCount) {
+        HistoryJournal journal(storage, "messages.jnl", "messages.idx", "messages.tmp", "messages.itm");
+        MessageHistory history;
+        Random random(5);
+        char label[64];
+
+        history.setArchive(&journal);
+        (void)journal.load(history);
+
+        // Saved in batches smaller than the RAM tail, so nothing is missed.
+        for (size_t i = 0; i < messageCount; i++) {
+            addConversationMessage(history, random);
+
+            if (i % MessageHistory::pageSize == 0) {
+                (void)journal.save(history);
+            }
+        }
+
+        (void)journal.save(history);
+
+        printf("%u messages, %u resident, MessageHistory is %u bytes\n",
+            (unsigned)history.size(), (unsigned)history.residentCount(), (unsigned)sizeof(MessageHistory));
+
+        {
+            Samples reads;
+            Counter counter(history);
+
+            for (size_t i = history.size(); i > 0; i--) {
+                reads.add(timedRead(history, i - 1));
+            }
+
+            printLatency("scroll back, per message", reads);
+            counter.print(reads.count());
+        }
+
+        {
+            Samples reads;
+            Counter counter(history);
+
+            for (size_t i = 0; i < history.size(); i++) {
+                reads.add(timedRead(history, i));
+            }
+
+            printLatency("scroll forward, per message", reads);
+            counter.print(reads.count());
+        }
+
+        {
+            Samples reads;
+            Counter counter(history);
+
+            for (size_t i = 0; i < randomReads; i++) {
+                reads.add(timedRead(history, random.below(history.size())));
+            }
+
+            printLatency("random, per message", reads);
+            counter.print(reads.count());
+        }
+
+        {
+            Samples screens;
+            Counter counter(history);
+
+            for (size_t i = 0; i < jumps; i++) {
+                const size_t first = random.below(history.size() - screenMessages);
+                double elapsed = 0;
+
+                for (size_t j = 0; j < screenMessages; j++) {
+                    elapsed += timedRead(history, first + j);
+                }
+
+                screens.add(elapsed);
+            }
+
+            snprintf(label, sizeof(label), "jump, per %u message screen", (unsigned)screenMessages);
+            printLatency(label, screens);
+            counter.print(jumps * screenMessages);
+        }
+
+        printf("\n");
+        journal.remove();
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* directory = makeScratchDirectory("scroll-benchmark");
+    if (directory == nullptr) {
+        printf("can't create a scratch directory\n");
+        return 1;
+    }
+
+    PosixStorage storage(directory);
+
+    if (argc > 1) {
+        benchmark(storage, atoi(argv[1]));
+    }
+    else {
+        for (size_t count : {1000, 10000}) {
+            benchmark(storage, count);
+        }
+    }
+
+    removeScratchDirectory(directory);
+    return 0;
+}
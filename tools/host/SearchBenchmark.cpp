@@ -0,0 +1,145 @@
+// SearchIndex size and query latency, on PosixStorage.
+//
+// Messages are indexed as they arrive, as loop() does it. Queries run the way SearchScene
+// runs them, a slice at a time until the search finishes; latency is the whole search.
+//
+// Usage: SearchBenchmark [messages]
+
+#include <Arduino.h>
+#include "HistoryJournal.h"
+#include "MessageHistory.h"
+#include "SearchIndex.h"
+#include "Storage/PosixStorage.h"
+#include "HostBench.h"
+
+namespace {
+    struct QueryKind {
+        const char* name;
+        const char* queries[4];
+    };
+
+    const QueryKind kinds[] = {
+        // Fills the results from the newest segments.
+        {"common word", {"river", "camp", "signal", "water"}},
+        // Few matches, so every segment is read.
+        {"two words", {"north ridge", "storm tower", "fuel map", "bridge closed"}},
+        {"rare word", {"beacon", "beacon", "beacon", "beacon"}},
+        {"missing word", {"zebra", "quartz", "avalanche", "helicopter"}},
+    };
+
+    constexpr size_t repeats = 25;
+
+    uint32_t fileSize(Storage& storage, const char* path) {
+        StorageFile* f = storage.open(path, Storage::Mode::read);
+        const uint32_t size = (f != nullptr) ? f->size() : 0;
+        storage.close(f);
+        return size;
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t messageCount = (argc > 1) ? atoi(argv[1]) : 10000;
+
+    const char* directory = makeScratchDirectory("search-benchmark");
+    if (directory == nullptr) {
+        printf("can't create a scratch directory\n");
+        return 1;
+    }
+
+    PosixStorage storage(directory);
+    HistoryJournal journal(storage, "messages.jnl", "messages.idx", "messages.tmp", "messages.itm");
+    SearchIndex index(storage, "search.idx");
+    MessageHistory history;
+    Random random(8);
+    char text[Message::bufferSize];
+    uint64_t textBytes = 0;
+    Samples indexing;
+
+    history.setArchive(&journal);
+    (void)journal.load(history);
+    (void)index.load(history);
+
+    for (size_t i = 0; i < messageCount; i++) {
+        size_t length = sampleText(random, text);
+
+        if (i % 1000 == 0) {
+            length = min(length, Message::maxTextLength - 7);
+            strcpy(text + length, " beacon");
+            length += 7;
+        }
+
+        textBytes += length;
+        history.addMessage((i % 2) ? Message::Sender::them : Message::Sender::me, text);
+
+        if (i % MessageHistory::pageSize == 0) {
+            (void)journal.save(history);
+        }
+
+        const double start = preciseMicros();
+        index.update(history);
+        indexing.add(preciseMicros() - start);
+    }
+
+    (void)journal.save(history);
+
+    const uint32_t indexBytes = fileSize(storage, "search.idx");
+    const uint32_t journalBytes = fileSize(storage, "messages.jnl");
+
+    printf("%u messages, %.1f bytes of text on average\n", (unsigned)messageCount, double(textBytes) / messageCount);
+    printf("index %u bytes, %.1f bytes per message, %.0f%% of the text, %.0f%% of the journal\n\n",
+        (unsigned)indexBytes,
+        double(indexBytes) / messageCount,
+        100.0 * indexBytes / textBytes,
+        100.0 * indexBytes / journalBytes);
+
+    printLatency("index, per message", indexing);
+
+    // Reload, as after a restart: the segments are all on storage, the history cache is cold.
+    index.close();
+    (void)index.load(history);
+
+    while (index.indexedCount() < history.size()) {
+        index.update(history);
+    }
+
+    for (const QueryKind& kind : kinds) {
+        Samples latency;
+        Samples results;
+        Samples searched;
+
+        for (size_t r = 0; r < repeats; r++) {
+            for (const char* query : kind.queries) {
+                const double start = preciseMicros();
+                (void)index.beginSearch(query);
+
+                while (!index.continueSearch(history)) {
+                }
+
+                latency.add(preciseMicros() - start);
+                results.add(index.resultCount());
+                searched.add(history.size() - index.searchedFrom());
+            }
+        }
+
+        char label[64];
+        snprintf(label, sizeof(label), "query, %s", kind.name);
+        printLatency(label, latency);
+
+        printf("%-32s %.0f results, %.0f messages searched on average\n", "", results.mean(), searched.mean());
+    }
+
+    // Rebuild from the history, all at once.
+    const double start = preciseMicros();
+    (void)index.rebuild();
+
+    while (index.indexedCount() < history.size()) {
+        index.update(history);
+    }
+
+    printf("\nrebuild %u messages: %.1f ms\n", (unsigned)messageCount, (preciseMicros() - start) / 1000);
+
+    index.close();
+    journal.close();
+    removeScratchDirectory(directory);
+    return 0;
+}
@@ -0,0 +1,192 @@
+// SearchIndex results against a brute-force scan of the history.
+//
+// 700 messages, with a few rare words mixed in, are indexed as they arrive, the way loop()
+// does it. Every query must return exactly what reading every message would: the newest
+// matches first, up to SearchIndex::maxResults. That's checked with the newest postings
+// still in RAM, after a reload, and in the middle of a rebuild.
+//
+// Usage: SearchTest
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "HistoryJournal.h"
+#include "MessageHistory.h"
+#include "SearchIndex.h"
+#include "Storage/MemoryStorage.h"
+#include "HostBench.h"
+
+namespace {
+    constexpr size_t messageCount = 700;
+
+    const char* queries[] = {
+        // Common words, more matches than fit in the results.
+        "river", "camp", "the", "signal",
+        // Case and punctuation don't matter.
+        "RIVER", "Camp!", "...water,",
+        // Every word has to match.
+        "north ridge", "meet at the gate", "storm tower cold",
+        // Rare words.
+        "beacon", "beacon seven", "Ærø", "checkpoint2",
+        // Words that don't occur, or only inside others.
+        "zebra", "ate", "ow",
+        // More words than a query uses; only the first maxQueryWords count.
+        "the a to and you is it we",
+    };
+
+    // Rare words, every few messages.
+    const char* rareWords[] = {"beacon", "beacon seven", "Ærø", "checkpoint2 ok"};
+
+    size_t failures = 0;
+
+    // The brute-force side: its own tokenizer, written from the documented rules.
+    std::vector<std::string> words(const char* text) {
+        std::vector<std::string> out;
+        std::string word;
+
+        for (const char* p = text;; p++) {
+            const uint8_t c = *p;
+
+            if (isalnum(c) || c >= 0x80) {
+                word += char(tolower(c));
+                continue;
+            }
+
+            if (word.size() >= SearchIndex::minWordLength) {
+                out.push_back(word.substr(0, SearchIndex::maxWordLength));
+            }
+
+            word.clear();
+
+            if (c == 0) {
+                return out;
+            }
+        }
+    }
+
+    std::vector<size_t> bruteForce(const MessageHistory& history, const char* query) {
+        std::vector<std::string> wanted = words(query);
+        std::vector<size_t> results;
+
+        if (wanted.size() > SearchIndex::maxQueryWords) {
+            wanted.resize(SearchIndex::maxQueryWords);
+        }
+
+        for (size_t i = history.size(); i > 0 && results.size() < SearchIndex::maxResults; i--) {
+            const std::vector<std::string> have = words(history.getMessage(i - 1).text);
+            bool all = !wanted.empty();
+
+            for (const std::string& w : wanted) {
+                bool found = false;
+
+                for (const std::string& h : have) {
+                    found = found || (h == w);
+                }
+
+                all = all && found;
+            }
+
+            if (all) {
+                results.push_back(i - 1);
+            }
+        }
+
+        return results;
+    }
+
+    void check(const char* stage, SearchIndex& index, const MessageHistory& history) {
+        for (const char* query : queries) {
+            const std::vector<size_t> expected = bruteForce(history, query);
+
+            if (!index.beginSearch(query)) {
+                if (!words(query).empty()) {
+                    printf("%s: \"%s\" wasn't searched\n", stage, query);
+                    failures++;
+                }
+
+                continue;
+            }
+
+            while (!index.continueSearch(history)) {
+            }
+
+            std::vector<size_t> found;
+
+            for (size_t i = 0; i < index.resultCount(); i++) {
+                found.push_back(index.result(i));
+            }
+
+            if (found != expected) {
+                printf("%s: \"%s\" found %u, expected %u\n", stage, query, (unsigned)found.size(), (unsigned)expected.size());
+                failures++;
+            }
+            else if (found.size() < SearchIndex::maxResults && index.searchedFrom() != 0) {
+                printf("%s: \"%s\" stopped at message %u\n", stage, query, (unsigned)index.searchedFrom());
+                failures++;
+            }
+        }
+
+        printf("%-40s %u queries\n", stage, (unsigned)(sizeof(queries) / sizeof(queries[0])));
+    }
+}
+
+int main() {
+    MemoryStorage storage;
+    HistoryJournal journal(storage, "messages.jnl", "messages.idx", "messages.tmp", "messages.itm");
+    SearchIndex index(storage, "search.idx");
+    MessageHistory history;
+    Random random(7);
+    char text[Message::bufferSize];
+
+    history.setArchive(&journal);
+    (void)journal.load(history);
+    (void)index.load(history);
+
+    for (size_t i = 0; i < messageCount; i++) {
+        size_t length = sampleText(random, text);
+
+        if (i % 37 == 0) {
+            const char* rare = rareWords[(i / 37) % 4];
+            length = min(length, Message::maxTextLength - strlen(rare) - 1);
+            snprintf(text + length, sizeof(text) - length, " %s", rare);
+        }
+
+        history.addMessage((i % 2) ? Message::Sender::them : Message::Sender::me, text);
+        (void)journal.save(history);
+        index.update(history);
+    }
+
+    if (index.indexedCount() != history.size()) {
+        printf("indexed %u of %u messages\n", (unsigned)index.indexedCount(), (unsigned)history.size());
+        return 1;
+    }
+
+    check("indexed as they arrived", index, history);
+
+    // Postings still in RAM are lost; update() catches up.
+    index.close();
+    (void)index.load(history);
+    check("reloaded, before catching up", index, history);
+
+    while (index.indexedCount() < history.size()) {
+        index.update(history);
+    }
+
+    check("reloaded", index, history);
+
+    (void)index.rebuild();
+
+    for (int i = 0; i < 10; i++) {
+        index.update(history);
+    }
+
+    check("halfway through a rebuild", index, history);
+
+    if (failures > 0) {
+        printf("%u failures\n", (unsigned)failures);
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}
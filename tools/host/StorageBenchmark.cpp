@@ -0,0 +1,151 @@
+// Load/save latency and write amplification of each message history format, on each
+// host storage backend.
+//
+// A conversation is saved after every message, as the firmware does. Write amplification
+// is bytes written to storage (including compaction) per byte of message text.
+//
+// Usage: StorageBenchmark [messages]
+
+#include <Arduino.h>
+#include "HistoryJournal.h"
+#include "MessageHistory.h"
+#include "Storage/MemoryStorage.h"
+#include "Storage/PosixStorage.h"
+#include "HostBench.h"
+#include "LegacyHistoryFile.h"
+
+namespace {
+    const char* snapshotFilename = "messages.hst";
+
+    enum class Format {
+        snapshot,
+        journal,
+    };
+
+    struct Result {
+        Samples save;
+        Samples load;
+        uint64_t textBytes = 0;
+        CountingStorage::Counts counts;
+        uint32_t compactions = 0;
+    };
+
+    HistoryJournal makeJournal(Storage& storage) {
+        return HistoryJournal(storage, "messages.jnl", "messages.idx", "messages.tmp", "messages.itm");
+    }
+
+    void runConversation(Storage& backend, Format format, size_t messageCount, Result& result) {
+        CountingStorage storage(backend);
+        HistoryJournal journal = makeJournal(storage);
+        MessageHistory history;
+        Random random(1);
+
+        if (format == Format::journal) {
+            history.setArchive(&journal);
+            (void)journal.load(history);
+        }
+
+        storage.resetCounts();
+
+        for (size_t i = 0; i < messageCount; i++) {
+            result.textBytes += addConversationMessage(history, random);
+
+            const double start = preciseMicros();
+            const bool saved = (format == Format::journal) ?
+                journal.save(history) :
+                LegacyHistoryFile::save(storage, snapshotFilename, history);
+            result.save.add(preciseMicros() - start);
+
+            if (!saved) {
+                printf("save failed at message %u\n", (unsigned)i);
+                exit(1);
+            }
+
+            // A few seconds between messages, with loop() running every few milliseconds,
+            // so compaction gets its turn.
+            if (format == Format::journal) {
+                advanceTime(4 * 1000 * 1000);
+
+                for (int step = 0; step < 1000; step++) {
+                    journal.update(history);
+                }
+            }
+        }
+
+        result.counts = storage.counts();
+        result.compactions = journal.stats().compactions;
+        journal.close();
+    }
+
+    void measureLoads(Storage& storage, Format format, size_t repeats, Result& result) {
+        for (size_t i = 0; i < repeats; i++) {
+            HistoryJournal journal = makeJournal(storage);
+            MessageHistory history;
+
+            const double start = preciseMicros();
+            const bool loaded = (format == Format::journal) ?
+                journal.load(history) :
+                LegacyHistoryFile::load(storage, snapshotFilename, history);
+            result.load.add(preciseMicros() - start);
+
+            if (!loaded) {
+                printf("load failed\n");
+                exit(1);
+            }
+
+            journal.close();
+        }
+    }
+
+    void printResult(const char* backend, const char* format, size_t messageCount, const Result& r) {
+        char label[64];
+
+        snprintf(label, sizeof(label), "%s %s save", backend, format);
+        printLatency(label, r.save);
+
+        snprintf(label, sizeof(label), "%s %s load", backend, format);
+        printLatency(label, r.load);
+
+        printf("%-32s %.2f bytes written per text byte, %.1f writes, %.2f syncs per save, %u compactions\n\n",
+            "",
+            double(r.counts.bytesWritten) / double(r.textBytes),
+            double(r.counts.writes) / double(messageCount),
+            double(r.counts.syncs) / double(messageCount),
+            (unsigned)r.compactions);
+    }
+
+    void runBackend(const char* name, Storage& storage, size_t messageCount) {
+        const Format formats[] = {Format::snapshot, Format::journal};
+        const char* formatNames[] = {"snapshot", "journal"};
+
+        for (size_t i = 0; i < 2; i++) {
+            Result result;
+            runConversation(storage, formats[i], messageCount, result);
+            measureLoads(storage, formats[i], 20, result);
+            printResult(name, formatNames[i], messageCount, result);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t messageCount = (argc > 1) ? atoi(argv[1]) : 1000;
+
+    printf("%u messages, saved after each one\n", (unsigned)messageCount);
+    printf("The snapshot keeps the newest %u messages, as the firmware that wrote it did; the journal keeps all of them.\n\n",
+        (unsigned)LegacyHistoryFile::firmwareMessageLimit);
+
+    MemoryStorage memory;
+    runBackend("memory", memory, messageCount);
+
+    const char* directory = makeScratchDirectory("storage-benchmark");
+    if (directory == nullptr) {
+        printf("can't create a scratch directory\n");
+        return 1;
+    }
+
+    PosixStorage posix(directory);
+    runBackend("posix", posix, messageCount);
+    removeScratchDirectory(directory);
+
+    return 0;
+}
@@ -0,0 +1,308 @@
+// History sync between two devices over a simulated link.
+//
+// Two MessageHistory/HistorySync pairs, each with a HistoryJournal on MemoryStorage, are
+// wired together the way main.cpp wires them to a messenger. They share a conversation,
+// then B goes away while A sends a gap of messages. When B comes back both send their
+// digest, as presenceStateChanged() does, and the loop runs until both are in step again.
+//
+// Then they sync again, right away and after B has sent a run of messages longer than the
+// hash scan reaches. Nothing is missing either time, so only the two digests should go out;
+// resending a window here would repeat on every sync.
+//
+// Frames take airtime on a shared half duplex channel: a fixed per-frame cost (preamble,
+// headers, the link layer ack) plus the payload at the link's bit rate. Retries, losses
+// and the time spent in loop() are left out, so the times are lower bounds.
+//
+// Usage: SyncSimulation [gap]
+
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "HistoryJournal.h"
+#include "HistorySync.h"
+#include "MessageHistory.h"
+#include "Messenger.h"
+#include "Payload.h"
+#include "Storage/MemoryStorage.h"
+#include "HostBench.h"
+
+namespace {
+    struct Link {
+        const char* name;
+        uint32_t bitsPerSecond;
+        uint32_t frameOverheadUS;
+    };
+
+    const Link links[] = {
+        // 1 Mbps with the long preamble, the action frame headers and the MAC ack.
+        {"ESP-NOW 1 Mbps", 1000000, 600},
+        // SF7, 125 kHz, CR 4/5: preamble and header, and the messenger's ack frame.
+        {"LoRa SF7/125 kHz", 5470, 60000},
+    };
+
+    constexpr size_t sharedMessages = 50;
+
+    // B's messages after the sync, enough to push A's out of the hash scan.
+    constexpr size_t burstMessages = HistorySync::maxHashScan + HistorySync::hashWindow;
+
+    // Gives up after this much simulated time; a sync that takes longer is broken.
+    constexpr uint64_t timeoutUS = 3600ull * 1000 * 1000;
+
+    struct Traffic {
+        uint32_t frames = 0;
+        uint64_t bytes = 0;
+    };
+
+    class SimulatedMessenger: public Messenger {
+    public:
+        virtual void updateRx() override {
+            // Handled like messengerPayloadReceived(): everything that isn't a message is sync.
+            while (!inbox.empty()) {
+                const std::vector<uint8_t> payload = inbox.front();
+                inbox.pop_front();
+                sync->payloadReceived(payload.data(), payload.size());
+            }
+        }
+
+        virtual void ping() override {
+        }
+
+        virtual bool settingsChanged(const Settings&, uint8_t) override {
+            return true;
+        }
+
+        virtual const LinkStats& linkStats() const override {
+            return stats;
+        }
+
+        bool isIdle() const {
+            return inbox.empty() && trafficQueue().isEmpty() && !sync->isStreaming();
+        }
+
+        const Link* link = nullptr;
+        SimulatedMessenger* peer = nullptr;
+        HistorySync* sync = nullptr;
+        uint64_t* airtimeUS = nullptr;
+        Traffic sent;
+
+    protected:
+        virtual bool transmit(const TrafficQueue::Entry& entry) override {
+            const uint32_t us = link->frameOverheadUS + uint64_t(entry.length) * 8 * 1000000 / link->bitsPerSecond;
+            *airtimeUS += us;
+            advanceTime(us);
+
+            sent.frames++;
+            sent.bytes += entry.length;
+
+            peer->inbox.emplace_back(entry.frame, entry.frame + entry.length);
+            return true;
+        }
+
+    private:
+        std::deque<std::vector<uint8_t>> inbox;
+        LinkStats stats;
+    };
+
+    struct Device {
+        Device() : journal(storage, "messages.jnl", "messages.idx", "messages.tmp", "messages.itm") {
+            history.setArchive(&journal);
+            (void)journal.load(history);
+            sync.begin(&messenger, &history);
+            messenger.sync = &sync;
+        }
+
+        MemoryStorage storage;
+        HistoryJournal journal;
+        MessageHistory history;
+        HistorySync sync;
+        SimulatedMessenger messenger;
+    };
+
+    // Plain function pointers, like the firmware's callbacks.
+    Device* devices[2];
+
+    void saveA(uint8_t) {
+        (void)devices[0]->journal.save(devices[0]->history);
+    }
+
+    void saveB(uint8_t) {
+        (void)devices[1]->journal.save(devices[1]->history);
+    }
+
+    // Our messages as the peer should have them: id to text.
+    std::map<uint32_t, std::string> messagesFrom(const MessageHistory& history, Message::Sender sender) {
+        std::map<uint32_t, std::string> out;
+
+        for (size_t i = 0; i < history.size(); i++) {
+            const MessageView msg = history.getMessage(i);
+
+            if (msg.sender == sender) {
+                out[msg.id] = std::string(msg.text, msg.length);
+            }
+        }
+
+        return out;
+    }
+
+    // Runs both devices until neither has anything left to send.
+    bool runUntilIdle(const Link& link, size_t gap, const uint64_t& airtimeUS) {
+        while (!devices[0]->messenger.isIdle() || !devices[1]->messenger.isIdle()) {
+            for (Device* d : devices) {
+                d->sync.update();
+                (void)d->messenger.serviceTxQueue();
+                d->messenger.updateRx();
+            }
+
+            if (airtimeUS > timeoutUS) {
+                printf("%s, gap %u: sync didn't finish\n", link.name, (unsigned)gap);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Syncs two devices that already have each other's messages, and checks that only the digests went out.
+    bool resyncIsQuiet(const Link& link, size_t gap, const char* when, const uint64_t& airtimeUS) {
+        const uint32_t before[] = {devices[0]->messenger.sent.frames, devices[1]->messenger.sent.frames};
+
+        for (Device* d : devices) {
+            d->sync.sendDigest();
+        }
+
+        if (!runUntilIdle(link, gap, airtimeUS)) {
+            return false;
+        }
+
+        const uint32_t toB = devices[0]->messenger.sent.frames - before[0];
+        const uint32_t toA = devices[1]->messenger.sent.frames - before[1];
+
+        if (toB != 1 || toA != 1) {
+            printf("%s, gap %u: resync %s sent %u and %u frames\n", link.name, (unsigned)gap, when, (unsigned)toB, (unsigned)toA);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool simulate(const Link& link, size_t gap) {
+        Device a;
+        Device b;
+        Random random(10);
+        char text[Message::bufferSize];
+        uint64_t airtimeUS = 0;
+        uint64_t gapTextBytes = 0;
+
+        devices[0] = &a;
+        devices[1] = &b;
+        a.sync.setMessagesAddedCallback(saveA);
+        b.sync.setMessagesAddedCallback(saveB);
+
+        for (Device* d : devices) {
+            d->messenger.link = &link;
+            d->messenger.airtimeUS = &airtimeUS;
+        }
+
+        a.messenger.peer = &b.messenger;
+        b.messenger.peer = &a.messenger;
+
+        // The shared part of the conversation, delivered live.
+        for (size_t i = 0; i < sharedMessages; i++) {
+            Device& from = random.below(2) ? a : b;
+            Device& to = (&from == &a) ? b : a;
+            sampleText(random, text);
+
+            const uint32_t id = from.history.takeId();
+            from.history.addMessage(Message::Sender::me, text, id);
+            to.history.addMessage(Message::Sender::them, text, id);
+            (void)a.journal.save(a.history);
+            (void)b.journal.save(b.history);
+        }
+
+        // B is gone; A keeps sending.
+        for (size_t i = 0; i < gap; i++) {
+            gapTextBytes += sampleText(random, text);
+            a.history.addMessage(Message::Sender::me, text, a.history.takeId());
+
+            if (i % MessageHistory::pageSize == 0) {
+                (void)a.journal.save(a.history);
+            }
+        }
+
+        (void)a.journal.save(a.history);
+        (void)b.journal.save(b.history);
+
+        // B is back.
+        const double start = preciseMicros();
+        a.sync.sendDigest();
+        b.sync.sendDigest();
+
+        if (!runUntilIdle(link, gap, airtimeUS)) {
+            return false;
+        }
+
+        const double cpuMS = (preciseMicros() - start) / 1000;
+
+        if (messagesFrom(a.history, Message::Sender::me) != messagesFrom(b.history, Message::Sender::them)) {
+            printf("%s, gap %u: B's history doesn't match A's\n", link.name, (unsigned)gap);
+            return false;
+        }
+
+        const Traffic& toB = a.messenger.sent;
+        const Traffic& toA = b.messenger.sent;
+
+        printf("%-18s gap %5u  %9.1f ms  A->B %4u frames %7llu bytes (%.2f per text byte)  B->A %u frames %llu bytes  cpu %.1f ms\n",
+            link.name,
+            (unsigned)gap,
+            airtimeUS / 1000.0,
+            (unsigned)toB.frames,
+            (unsigned long long)toB.bytes,
+            gapTextBytes ? double(toB.bytes) / gapTextBytes : 0.0,
+            (unsigned)toA.frames,
+            (unsigned long long)toA.bytes,
+            cpuMS);
+
+        if (!resyncIsQuiet(link, gap, "after the sync", airtimeUS)) {
+            return false;
+        }
+
+        // B talks for a while, live, then they sync again.
+        for (size_t i = 0; i < burstMessages; i++) {
+            sampleText(random, text);
+
+            const uint32_t id = b.history.takeId();
+            b.history.addMessage(Message::Sender::me, text, id);
+            a.history.addMessage(Message::Sender::them, text, id);
+        }
+
+        (void)a.journal.save(a.history);
+        (void)b.journal.save(b.history);
+
+        if (!resyncIsQuiet(link, gap, "after a long run of B's messages", airtimeUS)) {
+            return false;
+        }
+
+        a.journal.close();
+        b.journal.close();
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    bool ok = true;
+
+    for (const Link& link : links) {
+        if (argc > 1) {
+            ok = simulate(link, atoi(argv[1])) && ok;
+            continue;
+        }
+
+        for (size_t gap : {10, 100, 1000}) {
+            ok = simulate(link, gap) && ok;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
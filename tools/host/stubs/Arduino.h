@@ -0,0 +1,29 @@
+#pragma once
+
+// Just enough of the Arduino core to build the firmware's portable modules on a host.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+// size_t and uint32_t are the same type on the ESP32 but not on a 64-bit host.
+template<typename A, typename B>
+inline typename std::common_type<A, B>::type min(A a, B b) { return (a < b) ? a : b; }
+
+template<typename A, typename B>
+inline typename std::common_type<A, B>::type max(A a, B b) { return (a > b) ? a : b; }
+
+template<typename T, typename L, typename H>
+inline T constrain(T x, L low, H high) { return (x < low) ? low : (x > high) ? high : x; }
+
+// Host time: real time since start, plus whatever a simulation added with advanceTime().
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void advanceTime(uint32_t us);
+
+inline void yield() {}
+inline long random(long low, long high) { return low + rand() % (high - low); }
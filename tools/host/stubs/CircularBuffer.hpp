@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+
+// The parts of rlogiacco/CircularBuffer the portable modules use.
+template<typename T, size_t S>
+class CircularBuffer {
+public:
+    bool push(T value) {
+        if (count == S) {
+            buffer[head] = value;
+            head = (head + 1) % S;
+            return false;
+        }
+
+        buffer[(head + count++) % S] = value;
+        return true;
+    }
+
+    T shift() {
+        T value = buffer[head];
+        head = (head + 1) % S;
+        count--;
+        return value;
+    }
+
+    T operator[](size_t index) const { return buffer[(head + index) % S]; }
+    T first() const { return buffer[head]; }
+    size_t size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    bool isFull() const { return count == S; }
+    void clear() { head = 0; count = 0; }
+
+private:
+    T buffer[S];
+    size_t head = 0;
+    size_t count = 0;
+};